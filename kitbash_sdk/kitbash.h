@@ -1,6 +1,11 @@
 #ifndef KITBASH_H
 #define KITBASH_H
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -36,6 +41,47 @@ struct ObjInfo {
     std::vector<ObjLine> lines;
 };
 
+namespace kitbash {
+    // Vertex sanity checks. VT coordinates are read as 32-bit floats, as the sim
+    // uses them, and checked in blocks with AVX2 where the CPU has it. Merges run
+    // the checks by default on the output vertices and report in MergeStats.
+    enum class GeometryIssue {
+        BadPosition,            // NaN or infinite coordinate, or beyond float range
+        BadNormal,              // NaN, infinite or zero-length normal
+        UnnormalizedNormal,     // Length off 1 by more than normal_tolerance
+        BadUv,                  // NaN, infinite or far outside 0..1
+        Malformed               // Fewer than 8 numbers
+    };
+    constexpr int geometry_issue_count = 5;
+    const char* geometry_issue_name(GeometryIssue issue);   // "bad_position", ..., "malformed"
+    
+    struct GeometryOptions {
+        bool check = false;                 // Scan vertices during merges; parsing them runs at
+                                            // a few hundred MB/s per core, so it is opt-in
+        bool repair_normals = false;        // With check: normalize normals; zero or NaN ones get face normals
+        double normal_tolerance = 0.01;
+        double uv_margin = 1.0;             // UVs outside -margin .. 1 + margin are far outside
+        size_t max_lines = 5;               // First offending lines kept per issue
+    };
+    
+    struct GeometryReport {
+        bool checked = false;
+        bool vectorized = false;            // The AVX2 kernel ran
+        uint64_t vertices = 0;
+        uint64_t counts[geometry_issue_count] = {};             // Vertices per GeometryIssue
+        std::vector<uint64_t> first_lines[geometry_issue_count];   // 1-based, in the file checked or written
+        uint64_t repaired_normals = 0;
+        
+        uint64_t count(GeometryIssue issue) const { return counts[static_cast<int>(issue)]; }
+        bool clean() const {
+            for (uint64_t count : counts) {
+                if (count > 0) return false;
+            }
+            return true;
+        }
+    };
+}
+
 struct MergeStats {
     int original_vt_count = 0;
     int original_tris_count = 0;
@@ -51,6 +97,7 @@ struct MergeStats {
     std::string addition_filename;
     std::string output_filename;
     std::string backup_filename;
+    kitbash::GeometryReport geometry;   // Output vertices; line numbers in the output
     
     // Calculated percentages for display
     double vt_increase_percent() const {
@@ -78,10 +125,12 @@ namespace kitbash {
     };
     Stats get_stats(const std::string& obj_file);
     
-    // Advanced merge with detailed statistics
-    bool merge_with_stats(const std::string& base, const std::string& addition, MergeStats* stats = nullptr);
+    // Advanced merge with detailed statistics; stats->geometry reports the vertex checks
+    bool merge_with_stats(const std::string& base, const std::string& addition, MergeStats* stats = nullptr,
+                          const GeometryOptions& geometry = GeometryOptions());
     bool merge_to_file_with_stats(const std::string& base, const std::string& addition,
-                                  const std::string& output, MergeStats* stats = nullptr);
+                                  const std::string& output, MergeStats* stats = nullptr,
+                                  const GeometryOptions& geometry = GeometryOptions());
     
     // Core file operations
     std::vector<std::string> read_file(const std::string& filename);
@@ -90,6 +139,809 @@ namespace kitbash {
     std::string generate_backup_filename(const std::string& filename);
     bool is_obj_file(const std::string& filename);
     bool validate_obj_format(const std::vector<std::string>& lines);
+    
+    // Parsing and merging primitives - public wrappers around internal functions
+    std::vector<std::string> tokenize(const std::string& line);
+    ObjInfo parse_obj(const std::vector<std::string>& lines);
+    std::vector<std::string> merge_objects(const ObjInfo& base, const ObjInfo& addition);
+    std::string adjust_indices_line(const std::string& line, int vt_offset);
+    std::string adjust_tris_line(const std::string& line, int tris_offset);
+    
+    // Parsed OBJ8 document with copy-on-write storage.
+    // Geometry (VT, IDX/IDX10) and footer lines live in reference-counted immutable
+    // chunks, so snapshot() is O(1) and a mutation copies only the chunks it touches.
+    // Serializing a base after merge() gives the same lines as merge_objects().
+    class Document {
+    public:
+        enum class Section { Header, Vertices, Indices, Footer };
+        
+        static constexpr size_t chunk_lines = 4096;    // Lines per chunk when parsing
+        
+        Document();
+        static Document parse(const ObjInfo& info);
+        static Document load(const std::string& filename);  // Throws like read_file()
+        
+        // O(1) copy sharing all chunks - use for undo stacks and what-if merges
+        Document snapshot() const { return *this; }
+        
+        int vt_count() const;
+        int tris_count() const;
+        size_t line_count(Section section) const;
+        size_t total_line_count() const;
+        
+        const std::string& line(Section section, size_t index) const;
+        void set_line(Section section, size_t index, const std::string& content);
+        void append_line(Section section, const std::string& content);
+        
+        // Merge addition into this document (same rules as merge_objects).
+        // Addition VT chunks are shared, not copied.
+        void merge(const Document& addition);
+        
+        // Number of chunks this document shares with another (memory accounting)
+        size_t shared_chunk_count(const Document& other) const;
+        
+        std::vector<std::string> to_lines() const;
+        void write(const std::string& filename) const;
+        
+    private:
+        struct Chunks;
+        struct Body;
+        std::shared_ptr<Body> body_;    // Shared between snapshots until mutated
+        
+        Body& mutable_body();
+    };
+    
+    // Piece-table text store for small edits to large files.
+    // The original file is memory-mapped and never copied; inserted text goes to an
+    // append-only buffer. Pieces live in a balanced tree indexed by bytes and newlines,
+    // so edits and line lookups are O(log n) and write() streams the pieces out.
+    class PieceTable {
+    public:
+        explicit PieceTable(const std::string& filename);  // Throws like read_file()
+        ~PieceTable();
+        PieceTable(PieceTable&& other) noexcept;
+        PieceTable& operator=(PieceTable&& other) noexcept;
+        
+        size_t size() const;                        // Total bytes
+        size_t line_count() const;                  // Lines as read_file() would see them
+        size_t piece_count() const;
+        
+        size_t line_offset(size_t line) const;      // Byte offset where a line starts
+        std::string line(size_t line) const;        // Line content without the newline
+        std::string text(size_t offset, size_t length) const;
+        
+        void insert(size_t offset, const std::string& text);
+        void erase(size_t offset, size_t length);
+        void replace_line(size_t line, const std::string& content);
+        
+        // Write the edited text. Writing over the original file is allowed: the
+        // result goes to a temporary file first and the table then reopens it.
+        void write(const std::string& filename);
+        
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl_;
+    };
+    
+    // Asynchronous merge API
+    enum class MergePhase { Read, Parse, Merge, Write, Done };
+    
+    struct MergeProgress {
+        MergePhase phase = MergePhase::Read;
+        uint64_t bytes_done = 0;        // Bytes processed in the current phase
+        uint64_t bytes_total = 0;       // Bytes the current phase will process
+        double percent = 0.0;           // Overall completion (0-100)
+    };
+    using ProgressCallback = std::function<void(const MergeProgress&)>;
+    
+    // Cooperative cancellation flag shared between the caller and a running merge.
+    // Copies refer to the same flag; the merge checks it between chunks.
+    class CancellationToken {
+    public:
+        CancellationToken() : flag_(std::make_shared<std::atomic<bool>>(false)) {}
+        void cancel() { flag_->store(true); }
+        bool is_cancelled() const { return flag_->load(); }
+    private:
+        std::shared_ptr<std::atomic<bool>> flag_;
+    };
+    
+    struct AsyncMergeOptions {
+        std::string output;             // Empty: overwrite base (backup created first)
+        ProgressCallback on_progress;   // Called on the worker thread
+        CancellationToken cancel;
+    };
+    
+    // Merge output held in an anonymous in-memory file (a memfd on Linux), sealed
+    // or reopened read-only. Map it with mmap() or copy it with sendfile(); the
+    // descriptor is closed with the last reference.
+    struct MemoryOutput {
+        int descriptor = -1;
+        uint64_t size = 0;
+        
+        MemoryOutput() = default;
+        ~MemoryOutput();
+        MemoryOutput(const MemoryOutput&) = delete;
+        MemoryOutput& operator=(const MemoryOutput&) = delete;
+    };
+    
+    struct MergeResult {
+        bool success = false;
+        bool cancelled = false;
+        std::string error;
+        MergeStats stats;
+        std::shared_ptr<const MemoryOutput> memory;     // Results delivered in memory only
+    };
+    using CompletionCallback = std::function<void(const MergeResult&)>;
+    
+    // Run a merge on the internal thread pool. Output is written to a temporary file
+    // and renamed into place, so a cancelled or failed merge leaves no partial file.
+    std::future<MergeResult> merge_async(const std::string& base, const std::string& addition,
+                                         const AsyncMergeOptions& options = AsyncMergeOptions());
+    void merge_async(const std::string& base, const std::string& addition,
+                     const AsyncMergeOptions& options, CompletionCallback on_complete);
+    
+    // Resumable merge for time-sliced callers such as a simulator plugin's frame loop.
+    // Each step() does a bounded amount of parse, merge and write work and keeps its
+    // position between calls; the finished output matches merge_to_file().
+    class IncrementalMerge {
+    public:
+        // Empty output merges in place; the original base is kept as the backup
+        IncrementalMerge(const std::string& base, const std::string& addition,
+                         const std::string& output = "");
+        ~IncrementalMerge();    // Discards partial output if the merge did not finish
+        IncrementalMerge(IncrementalMerge&& other) noexcept;
+        IncrementalMerge& operator=(IncrementalMerge&& other) noexcept;
+        
+        // Work for about budget_us microseconds. Returns true once there is nothing
+        // left to do, either because the merge finished or because it failed.
+        bool step(int64_t budget_us);
+        
+        bool done() const;
+        bool failed() const;
+        const std::string& error() const;
+        double percent() const;                 // Overall completion (0-100)
+        MergeProgress progress() const;
+        const MergeStats& stats() const;        // Complete once done() and !failed()
+        
+        void cancel();                          // Stop and discard partial output
+        
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl_;
+    };
+
+    namespace detail { struct CompiledAccess; }
+
+    // Selective merge filter over the addition's TRIS batches. Every kind of filter
+    // that is given must match, through any one of its values; an empty filter keeps
+    // every batch.
+    struct SelectionFilter {
+        std::vector<std::string> datarefs;      // Inside an ANIM block driven by one; "prefix*" matches a prefix
+        std::vector<std::string> manipulators;  // ATTR_manip_ type in effect, e.g. "command", "drag_axis" or "none"
+        std::vector<int> lods;                  // 1-based ATTR_LOD of the addition; 0: before the first one
+        std::vector<std::pair<uint64_t, uint64_t>> lines;  // Addition line ranges, 1-based and inclusive
+        
+        bool empty() const { return datarefs.empty() && manipulators.empty() && lods.empty() && lines.empty(); }
+    };
+    
+    struct SelectionStats {
+        uint64_t batches = 0;               // TRIS lines in the addition
+        uint64_t kept_batches = 0;
+        uint64_t anim_blocks = 0;
+        uint64_t kept_anim_blocks = 0;
+        uint64_t vertices = 0;
+        uint64_t kept_vertices = 0;         // Used by a kept batch
+        uint64_t indices = 0;
+        uint64_t kept_indices = 0;
+        uint64_t dropped_draws = 0;         // LINES and LIGHTS, which are never kept
+    };
+    
+    // Addition precompiled for repeated merges, like a linker object: VT bytes ready
+    // to copy, plus IDX and footer text with relocation entries marking where the
+    // base vertex and triangle offsets are added. Applying it to a base is a copy
+    // and a patch of the relocation sites; the source is never tokenized again.
+    // Copies share the same immutable data.
+    class CompiledAddition {
+    public:
+        struct Data;
+
+        CompiledAddition();
+        static CompiledAddition compile(const std::string& addition_file);  // Throws like read_file()
+        static CompiledAddition load(const std::string& kbo_file);          // Throws on a bad .kbo file
+        void save(const std::string& kbo_file) const;
+        
+        // Like compile(), shared by every process of this user on the machine: the first
+        // to compile a file publishes the image in shared memory and the others map it
+        // read-only. Entries are matched by device, inode, size and mtime. Sets *shared
+        // when the result came from shared memory. Plain compile() where unsupported.
+        static CompiledAddition compile_shared(const std::string& addition_file, bool* shared = nullptr);
+        static void clear_shared();     // Drop every shared entry
+        // Cap on the bytes in shared memory, enforced when this process publishes (0: a
+        // quarter of /dev/shm, at most 1 GiB). The least recently used images go first.
+        static void set_shared_limit(uint64_t bytes);
+
+        // Like compile(), keeping only the TRIS batches that pass filter, the ANIM blocks
+        // around them and the vertices and indices they use, renumbered in file order.
+        // Attributes carry forward: the latest of each state is written before the next
+        // kept batch or ANIM line, so none is written in front of a dropped batch.
+        // Throws like compile(), and on an index or TRIS range past the addition's data.
+        static CompiledAddition compile_selected(const std::string& addition_file, const SelectionFilter& filter,
+                                                 SelectionStats* stats = nullptr);
+        
+        // True if the file starts with the .kbo signature
+        static bool is_compiled_file(const std::string& filename);
+
+        bool empty() const;
+        const std::string& source() const;      // Addition filename it was compiled from
+        int vt_count() const;
+        int tris_count() const;
+        size_t line_count() const;
+        size_t relocation_count() const;
+
+    private:
+        friend struct detail::CompiledAccess;
+        std::shared_ptr<const Data> data_;
+    };
+
+    // Merge a compiled addition into base; same output as merge_to_file()
+    bool merge_compiled_to_file(const std::string& base, const CompiledAddition& addition,
+                                const std::string& output, MergeStats* stats = nullptr,
+                                const GeometryOptions& geometry = GeometryOptions());
+
+    // Merge under a fixed memory budget, for inputs larger than RAM. Both files are
+    // read front to back once in blocks instead of being mapped. The header and the
+    // vertices go straight to the output. Indices and footers come later in the
+    // output, so they wait in memory and spill to temporary files once the budget
+    // runs out. The output is still written in one sequential pass and matches
+    // merge_to_file(). Not available: normal repair (it needs every triangle at once),
+    // .kbo additions, and files whose POINT_COUNTS line changes part way through.
+    struct BoundedMergeOptions {
+        uint64_t max_memory = 256ull << 20;     // Bytes for all buffers; at least 16 MiB
+        std::string temp_dir;                   // Spill files; empty: next to the output
+        GeometryOptions geometry;
+    };
+    
+    struct BoundedMergeResult {
+        uint64_t spilled_bytes = 0;             // Written to spill files and read back
+        size_t spill_files = 0;
+        uint64_t peak_buffered_bytes = 0;       // Most section bytes held in memory at once
+    };
+    
+    // Empty output merges in place (the base becomes the backup). Throws std::runtime_error.
+    BoundedMergeResult merge_to_file_bounded(const std::string& base, const std::string& addition,
+                                             const std::string& output,
+                                             const BoundedMergeOptions& options = BoundedMergeOptions(),
+                                             MergeStats* stats = nullptr);
+    
+    // Fan-out merge: one addition into many bases. The addition is compiled once and
+    // shared read-only by every merge; bases are merged concurrently.
+    struct FanoutOptions {
+        std::string output_dir;         // Empty: merge each base in place (backup kept)
+        size_t threads = 0;             // 0: the shared pool (one worker per hardware thread)
+    };
+    
+    struct FanoutResult {
+        std::string base;
+        std::string output;
+        bool success = false;
+        std::string error;
+        MergeStats stats;
+    };
+    
+    // One result per base, in the order given
+    std::vector<FanoutResult> merge_fanout(const std::string& addition, const std::vector<std::string>& bases,
+                                           const FanoutOptions& options = FanoutOptions());
+    std::vector<FanoutResult> merge_fanout(const CompiledAddition& addition, const std::vector<std::string>& bases,
+                                           const FanoutOptions& options = FanoutOptions());
+    
+    // Build manifest: merge steps forming a dependency graph, one step per line:
+    //
+    //     # comment
+    //     panel    = panel_base.obj + switch_a.obj + switch_b.obj
+    //     cockpit  = cockpit_shell.obj + @panel + seats.obj -> cockpit.obj
+    //     fuselage = frame.obj + @cockpit -> fuselage.obj
+    //
+    // The first operand is the base and the rest are merged into it in order.
+    // `@name` uses another step's result, held in memory as a Document; `-> file`
+    // writes the result. Relative paths are resolved against the manifest's folder.
+    // Independent steps run in parallel. Input hashes are recorded in
+    // <manifest>.state, and a step whose inputs are unchanged is not rebuilt.
+    struct ManifestOptions {
+        bool force = false;             // Rebuild every step regardless of the recorded state
+        size_t threads = 0;             // 0: the shared pool
+    };
+    
+    enum class StepStatus { Built, UpToDate, Failed, Unused };
+    
+    struct ManifestStepResult {
+        std::string name;
+        std::string output;             // Empty for in-memory intermediates
+        StepStatus status = StepStatus::Unused;
+        std::string error;
+        double processing_time = 0.0;   // Seconds
+    };
+    
+    struct ManifestResult {
+        bool success = false;
+        std::string error;              // Manifest-level problem (syntax, cycle, state file)
+        std::vector<ManifestStepResult> steps;  // In manifest order
+        size_t built = 0;
+        size_t up_to_date = 0;
+    };
+    
+    ManifestResult run_manifest(const std::string& manifest_file,
+                                const ManifestOptions& options = ManifestOptions());
+    
+    // Persistent merge-result cache, in the spirit of ccache. Entries are keyed by a
+    // hash of the base bytes, addition bytes, tool version and merge options; a hit
+    // materializes the stored output (reflink, then hard link if allowed, then copy)
+    // without parsing anything. Safe to share between processes.
+    struct CacheOptions {
+        std::string directory;          // Empty: default_directory()
+        uint64_t max_bytes = 5ULL << 30;    // Least recently used entries beyond this are evicted
+        bool hard_links = false;        // Outputs then share the cache's read-only inode
+        GeometryOptions geometry;       // Part of the key when checked; the report is stored
+                                        // with the entry and replayed on a hit
+    };
+    
+    struct CacheStats {
+        uint64_t hits = 0;              // Counted by this MergeCache object
+        uint64_t misses = 0;
+        uint64_t entries = 0;           // On disk, as of the last store or trim()
+        uint64_t bytes = 0;
+    };
+    
+    class MergeCache {
+    public:
+        explicit MergeCache(const CacheOptions& options = CacheOptions());
+        
+        // Same result as merge_to_file_with_stats(). `options` names anything else that
+        // changes the output so it becomes part of the key. Sets *hit when given.
+        bool merge_to_file(const std::string& base, const std::string& addition, const std::string& output,
+                           MergeStats* stats = nullptr, bool* hit = nullptr, const std::string& options = "");
+        
+        // True if merge_to_file() would be a hit now: both inputs are hashed, not parsed
+        bool contains(const std::string& base, const std::string& addition, const std::string& options = "") const;
+        
+        void trim();                    // Evict down to max_bytes
+        void clear();                   // Remove every entry
+        CacheStats stats() const { return stats_; }
+        const std::string& directory() const { return options_.directory; }
+        
+        // $KITBASH_CACHE_DIR, else a kitbash folder in the user's cache directory
+        static std::string default_directory();
+        
+    private:
+        CacheOptions options_;
+        CacheStats stats_;
+    };
+    
+    // Batch of independent merges, one job per line:
+    //
+    //     # comment
+    //     c172.obj + avionics_box.obj -> out/c172.obj
+    //     pa28.obj + avionics_box.obj
+    //
+    // A job without `-> output` merges in place and creates a backup. Relative paths are resolved against the batch file's folder.
+    struct BatchJob {
+        std::string base;
+        std::string addition;           // An OBJ8 or .kbo file
+        std::string output;             // Empty: merge in place and create a backup
+    };
+    
+    struct BatchOptions {
+        size_t workers = 0;             // 0: one per hardware thread
+        bool isolate = false;           // Run jobs in forked worker processes (POSIX only)
+        uint64_t memory_limit = 0;      // Per worker process address-space cap in bytes; 0: none
+    };
+    
+    struct BatchResult {
+        BatchJob job;
+        bool success = false;
+        std::string error;              // Includes crashes of an isolated worker
+        MergeStats stats;
+    };
+    
+    // Throws std::runtime_error ("file:line: message") on syntax errors
+    std::vector<BatchJob> read_batch_file(const std::string& batch_file);
+    
+    // One result per job, in the order given. With `isolate`, a job that crashes
+    // its worker is marked failed and the worker is replaced; the others carry on.
+    std::vector<BatchResult> run_batch(const std::vector<BatchJob>& jobs,
+                                       const BatchOptions& options = BatchOptions());
+    
+    // Shared-directory job queue for spreading a batch over processes and machines.
+    // submit_batch() drops one file per job into <queue>/pending. Workers claim a job
+    // by renaming it into <queue>/leased (rename is atomic, so exactly one wins),
+    // renew the lease by touching it while the merge runs, and write the outcome and
+    // stats to <queue>/done/<id>.result. A lease not renewed within lease_seconds is
+    // returned to pending by any other worker. Machines sharing the folder should keep
+    // their clocks roughly in sync.
+    struct QueueOptions {
+        size_t workers = 0;             // Jobs run concurrently by this process; 0: one per hardware thread
+        double lease_seconds = 60.0;    // Renewed at least every quarter of this
+    };
+    
+    struct QueueJobResult {
+        std::string id;
+        BatchResult result;
+    };
+    
+    struct QueueRunResult {
+        std::vector<QueueJobResult> jobs;   // Run by this process, in completion order
+        size_t reclaimed = 0;           // Expired leases this process returned to pending
+        std::string error;              // Queue folder unusable
+    };
+    
+    // Returns the job ids. Paths are stored absolute. Throws std::runtime_error.
+    std::vector<std::string> submit_batch(const std::string& queue_dir, const std::vector<BatchJob>& jobs);
+    
+    // Claims and runs jobs until no job is pending or leased
+    QueueRunResult run_queue_worker(const std::string& queue_dir, const QueueOptions& options = QueueOptions());
+    
+    // Merge service for long-running hosts such as an editor plugin or a build server.
+    // A request with an output joins an identical one already in flight (same base,
+    // addition and output) and receives its result instead of running again. In-place
+    // requests for a base that is still queued are combined into one N-way merge:
+    // the additions are applied in submission order and the base is written, and
+    // backed up, once. Interactive requests are served before bulk ones, and one
+    // worker is never given bulk work, so a bulk backlog cannot delay an interactive
+    // request. With `workers` = 1 that worker is an extra thread beside the bulk one.
+    enum class Priority { Interactive, Bulk };
+    
+    struct ServiceOptions {
+        size_t workers = 0;             // 0: one per hardware thread
+    };
+    
+    struct ServiceStats {
+        uint64_t requests = 0;
+        uint64_t executions = 0;        // Merges actually run
+        uint64_t coalesced = 0;         // Requests that shared an identical merge's result
+        uint64_t combined = 0;          // In-place requests folded into another request's write
+    };
+    
+    class MergeService {
+    public:
+        explicit MergeService(const ServiceOptions& options = ServiceOptions());
+        ~MergeService();                // Finishes every submitted merge
+        
+        MergeService(const MergeService&) = delete;
+        MergeService& operator=(const MergeService&) = delete;
+        
+        // Same result as merge_to_file_with_stats(); `output` empty merges in place.
+        // Accepts OBJ8 and .kbo additions (the latter are never combined).
+        std::shared_future<MergeResult> submit(const std::string& base, const std::string& addition,
+                                               const std::string& output = "",
+                                               Priority priority = Priority::Bulk);
+        
+        // Merge into a MemoryOutput (MergeResult::memory) instead of a file. Identical
+        // requests in flight share one; POSIX only.
+        std::shared_future<MergeResult> submit_to_memory(const std::string& base, const std::string& addition,
+                                                         Priority priority = Priority::Bulk);
+        ServiceStats stats() const;
+        
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl_;
+    };
+    
+    // Local server mode (POSIX only): a MergeService behind a Unix domain socket,
+    // one request per connection. Serves until should_stop returns true, which is
+    // checked several times a second, then finishes the accepted requests.
+    bool serve_merge_service(const std::string& socket_path, const ServiceOptions& options,
+                             const std::function<bool()>& should_stop, std::string* error = nullptr,
+                             ServiceStats* stats = nullptr);
+    
+    // Send one merge to a server; relative paths are resolved here, not by the server
+    MergeResult merge_remote(const std::string& socket_path, const std::string& base, const std::string& addition,
+                             const std::string& output = "", Priority priority = Priority::Bulk);
+    
+    // Have the server merge into memory and hand the output back instead of writing a
+    // file itself. Transfer::Descriptor passes the server's memory file over the
+    // socket (SCM_RIGHTS), so no output bytes cross it; Transfer::Stream sends the
+    // bytes through the socket. The output is written to `output` here, or returned
+    // in MergeResult::memory when `output` is empty.
+    enum class Transfer { Descriptor, Stream };
+    
+    MergeResult fetch_remote(const std::string& socket_path, const std::string& base, const std::string& addition,
+                             const std::string& output = "", Transfer transfer = Transfer::Descriptor,
+                             Priority priority = Priority::Bulk);
+    
+    // Render-cost report for one OBJ8 file, gathered in a single pass over the mapped
+    // file without building a Document, so it also works on files of several GB.
+    // State changes are counted per render state (ATTR_blend and ATTR_no_blend are
+    // both "blend"); setting a state to the value it already has is counted as
+    // redundant. ATTR_LOD resets every state to its default.
+    struct AttributeChanges {
+        std::string attribute;
+        uint64_t changes = 0;
+        uint64_t redundant = 0;
+    };
+    
+    struct LodCost {
+        double near_distance = 0.0;     // Both 0 for geometry drawn before any ATTR_LOD
+        double far_distance = 0.0;
+        uint64_t draw_calls = 0;
+        uint64_t triangles = 0;
+    };
+    
+    // Cost of one ANIM_begin block including the blocks nested in it
+    struct AnimCost {
+        uint64_t line = 0;              // Of its ANIM_begin, 1-based
+        int depth = 0;                  // 1 for a top-level block
+        std::string datarefs;           // Driving this block itself, space separated
+        uint64_t triangles = 0;
+        uint64_t vertices = 0;          // Used by its draws; counted once per block
+        uint64_t draw_calls = 0;
+        uint64_t keyframes = 0;         // *_key lines; ANIM_trans and ANIM_rotate count as two
+    };
+    
+    // Cost of everything a dataref animates. A block is counted once even when the
+    // dataref also drives blocks nested in it.
+    struct DatarefCost {
+        std::string dataref;
+        uint64_t nodes = 0;             // ANIM blocks it drives directly
+        uint64_t triangles = 0;
+        uint64_t vertices = 0;
+        uint64_t draw_calls = 0;
+        uint64_t keyframes = 0;         // In the subtrees it drives
+        uint64_t own_keyframes = 0;     // Keyed to this dataref itself
+    };
+    
+    struct AnalysisOptions {
+        bool breakdown = false;         // Fill anim_subtrees and datarefs; keeps 4 bytes per index
+        GeometryOptions geometry{true}; // Vertex checks into ObjAnalysis::geometry (on); no repair
+    };
+    
+    struct ObjAnalysis {
+        static constexpr uint64_t bytes_per_vertex = 32;    // Position, normal and UV as floats
+        static constexpr uint64_t bytes_per_index = 4;
+        
+        std::string filename;
+        uint64_t file_bytes = 0;
+        uint64_t line_count = 0;
+        uint64_t vertices = 0;          // VT lines
+        uint64_t indices = 0;           // Entries on IDX and IDX10 lines
+        uint64_t vertex_bytes = 0;
+        uint64_t index_bytes = 0;
+        uint64_t draw_calls = 0;        // TRIS commands
+        uint64_t triangles = 0;         // Drawn by them
+        std::vector<AttributeChanges> state_changes;    // Most changes first
+        uint64_t anim_nodes = 0;        // ANIM_begin blocks
+        int max_anim_depth = 0;
+        uint64_t manipulators = 0;      // ATTR_manip_* other than none and wheel
+        std::vector<LodCost> lods;      // In file order
+        uint64_t unreferenced_vertices = 0;     // Not used by any index
+        uint64_t undrawn_indices = 0;   // Not covered by any TRIS range
+        uint64_t invalid_references = 0;        // Indices past the last vertex, TRIS past the last index
+        std::vector<AnimCost> anim_subtrees;    // Breakdown: every ANIM block, most triangles first
+        std::vector<DatarefCost> datarefs;      // Breakdown: most triangles first
+        GeometryReport geometry;        // Line numbers in this file
+    };
+    
+    // Throws std::runtime_error if the file cannot be read or is not OBJ8
+    ObjAnalysis analyze_obj(const std::string& filename, const AnalysisOptions& options = AnalysisOptions());
+    
+    // Deep structural check of one OBJ8 file, cheap enough to run before every merge:
+    // POINT_COUNTS against the VT, VLINE, VLIGHT and index records actually present,
+    // every index against the vertex table it points into (VLINE inside LINES ranges,
+    // VT elsewhere), every TRIS, LINES and LIGHTS range against its table, and the
+    // record order the merge relies on. validate_obj_format() only checks the header.
+    // The mapped file is split at line boundaries and the chunks are scanned in
+    // parallel in one pass. Indices are summarized per block of 256, and only blocks
+    // or chunks with a problem are read again to name the lines.
+    enum class StructureIssue { MissingPointCounts, CountMismatch, IndexOutOfRange, RangeOutOfBounds,
+                                Misplaced, Malformed };
+    constexpr int structure_issue_count = 6;
+    const char* structure_issue_name(StructureIssue issue);     // "missing_point_counts", ..., "malformed"
+    
+    struct StructureDiagnostic {
+        StructureIssue issue = StructureIssue::Malformed;
+        uint64_t line = 0;              // 1-based; 0 for the file as a whole
+        std::string message;
+    };
+    
+    struct StructureOptions {
+        size_t threads = 0;             // 0: the shared pool
+        size_t max_diagnostics = 20;    // Kept in line order; counts cover all of them
+    };
+    
+    struct StructureReport {
+        std::string filename;
+        bool has_point_counts = false;
+        uint64_t declared_vertices = 0;         // POINT_COUNTS fields, from its last line
+        uint64_t declared_line_vertices = 0;
+        uint64_t declared_lights = 0;
+        uint64_t declared_indices = 0;
+        uint64_t vertices = 0;                  // VT records
+        uint64_t line_vertices = 0;             // VLINE records
+        uint64_t lights = 0;                    // VLIGHT records
+        uint64_t indices = 0;                   // Entries on IDX and IDX10 lines
+        uint64_t draw_commands = 0;             // TRIS, LINES and LIGHTS
+        uint64_t line_count = 0;
+        size_t chunks = 0;                      // Scanned in parallel
+        uint64_t counts[structure_issue_count] = {};    // Per StructureIssue
+        std::vector<StructureDiagnostic> diagnostics;   // First max_diagnostics, in line order
+    
+        uint64_t count(StructureIssue issue) const { return counts[static_cast<int>(issue)]; }
+        uint64_t issue_count() const {
+            uint64_t total = 0;
+            for (uint64_t count : counts) total += count;
+            return total;
+        }
+        bool valid() const { return issue_count() == 0; }
+    };
+    
+    // Throws std::runtime_error if the file cannot be read or is not OBJ8
+    StructureReport validate_structure(const std::string& filename,
+                                       const StructureOptions& options = StructureOptions());
+    
+    // Merge with hardware counters read around every chunk of work, per phase. The
+    // inputs are memory-mapped, so most reading shows up as page faults in Parse.
+    // Counters come from Linux perf_event_open on the calling thread, user space
+    // only. A counter the kernel does not permit or the CPU lacks is marked
+    // unavailable and left at 0; timings are always measured.
+    enum class Counter { Cycles, Instructions, BranchMisses, CacheMisses, PageFaults };
+    constexpr int counter_count = 5;
+    const char* counter_name(Counter counter);      // "cycles", ..., "llc_misses", "page_faults"
+    
+    struct PhaseProfile {
+        MergePhase phase = MergePhase::Read;
+        double seconds = 0.0;
+        uint64_t bytes = 0;             // Bytes the phase processed
+        uint64_t counters[counter_count] = {};     // Indexed by Counter
+        
+        uint64_t count(Counter counter) const { return counters[static_cast<int>(counter)]; }
+    };
+    
+    struct MergeProfile {
+        MergeStats stats;
+        std::vector<PhaseProfile> phases;           // Read, Parse, Merge, Write
+        bool available[counter_count] = {};         // Indexed by Counter
+        std::string counter_error;      // Why a counter is unavailable
+    };
+    
+    // Same output as merge_to_file_with_stats(); `output` empty merges in place.
+    // Throws std::runtime_error.
+    MergeProfile profile_merge(const std::string& base, const std::string& addition, const std::string& output);
+    
+    // Macro benchmark for sizing build machines: the full merge engine (mapped inputs,
+    // chunked merge, output written) on synthetic bases and additions generated for
+    // each size. For every thread count, `merges` independent merges are shared out
+    // among that many threads; speedup is relative to the first thread count. Inputs
+    // and outputs are memory files on Linux and temporary files elsewhere. Peak
+    // memory is the process's peak resident set during the point (since start where
+    // the OS cannot reset it).
+    struct BenchmarkPoint {
+        uint64_t vertices = 0;          // In each base
+        size_t threads = 0;
+        size_t merges = 0;              // Per run
+        uint64_t input_bytes = 0;       // Base and addition bytes read per run
+        uint64_t output_bytes = 0;      // Written per run
+        std::vector<double> samples;    // Seconds per run
+        double seconds = 0.0;           // Median of samples
+        double mb_per_second = 0.0;     // Input throughput
+        double speedup = 0.0;
+        double efficiency = 0.0;        // Speedup per thread
+        uint64_t peak_memory = 0;       // Bytes
+    };
+    
+    struct BenchmarkOptions {
+        std::vector<uint64_t> sizes = {10000, 100000, 1000000};    // Base vertices
+        std::vector<size_t> thread_counts;  // Empty: default_thread_counts(0)
+        size_t merges = 0;              // Per run; 0: the largest thread count
+        uint64_t addition_ratio = 4;    // Addition is 1/ratio of the base
+        int runs = 5;                   // Timed runs per point, after one warm-up run
+        std::function<void(const BenchmarkPoint&)> on_point;   // Called as each point finishes
+    };
+    
+    // 1, 2, 4, ... up to max_threads, which is included; 0 uses the hardware threads
+    std::vector<size_t> default_thread_counts(size_t max_threads);
+    
+    // Points in size order, then thread order. Throws std::runtime_error.
+    std::vector<BenchmarkPoint> run_benchmark(const BenchmarkOptions& options = BenchmarkOptions());
+    
+    // Dry-run planning: output size, counts, peak memory and wall time of merges,
+    // predicted from file sizes and POINT_COUNTS lines alone. Only each input's header
+    // up to POINT_COUNTS is read (a .kbo addition's header and section sizes), so a
+    // batch of any size is planned in milliseconds. Indices are assumed to spread
+    // evenly over their vertices when estimating how much longer the rebased numbers
+    // print. Time and memory are linear in the input bytes, fitted to a --bench run.
+    struct PlanCalibration {
+        std::string source;                 // Benchmark file; empty for the built-in figures
+        size_t points = 0;                  // Single-thread points fitted
+        double seconds_fixed = 0.003;       // Per merge
+        double seconds_per_byte = 5e-9;     // Per input byte, one merge on one thread
+        double memory_fixed = 6e6;          // Peak resident bytes of a merge ...
+        double memory_per_byte = 1.05;      // ... plus this much per input byte
+        std::vector<std::pair<size_t, double>> efficiency = {{1, 1.0}};    // Threads, speedup per thread
+    
+        double efficiency_at(size_t threads) const;     // Largest measured count <= threads
+    };
+    
+    // Fit to benchmark points: time and memory against bytes per merge on one thread,
+    // and the median efficiency of each thread count. Throws std::runtime_error if no
+    // point ran on one thread.
+    PlanCalibration calibrate_plan(const std::vector<BenchmarkPoint>& points);
+    
+    // Reads the output of `kitbash --bench --json`. Throws std::runtime_error.
+    PlanCalibration load_plan_calibration(const std::string& bench_json);
+    
+    struct PlanOptions {
+        size_t workers = 0;                 // Concurrent merges; 0: one per hardware thread
+        uint64_t memory_limit = 0;          // Bytes per merge; 0: none. Merges predicted above it are flagged
+        PlanCalibration calibration;
+    };
+    
+    struct MergePlan {
+        BatchJob job;
+        std::string error;                  // Inputs could not be planned; the rest is unset
+        uint64_t base_bytes = 0;
+        uint64_t addition_bytes = 0;
+        uint64_t base_vertices = 0;         // POINT_COUNTS fields
+        uint64_t base_indices = 0;
+        uint64_t addition_vertices = 0;
+        uint64_t addition_indices = 0;
+        uint64_t vertices = 0;              // The output's POINT_COUNTS
+        uint64_t indices = 0;
+        uint64_t output_bytes = 0;
+        uint64_t peak_memory = 0;
+        double seconds = 0.0;               // On one otherwise idle thread
+        bool over_memory_limit = false;
+    };
+    
+    struct BatchPlan {
+        std::vector<MergePlan> merges;      // In job order
+        size_t workers = 0;
+        uint64_t input_bytes = 0;
+        uint64_t output_bytes = 0;
+        uint64_t peak_memory = 0;           // The `workers` largest merges at once
+        double cpu_seconds = 0.0;           // All merges one after another
+        double wall_seconds = 0.0;          // Longest first onto `workers`, slowed by the efficiency
+        double efficiency = 1.0;            // Used for the wall time
+        size_t failed = 0;                  // Merges with an error
+        size_t over_memory_limit = 0;
+    };
+    
+    // Never throws for a bad input; its MergePlan carries the error
+    BatchPlan plan_merges(const std::vector<BatchJob>& jobs, const PlanOptions& options = PlanOptions());
+    
+    // Differential verification: the optimized engines (streaming MergeJob, compiled
+    // addition, bounded, Document, fan-out) against the original merge_objects() path, which
+    // is kept as the reference. Outputs are compared line by line as tokens, so
+    // spacing, tabs, line endings and blank lines do not matter; the first line
+    // that differs is reported.
+    struct VerifyResult {
+        bool match = false;
+        std::string case_name;          // verify_corpus(): size and engine run
+        std::string engine;             // Engine that diverged or failed
+        std::string section;            // Header, Vertices, Indices, Footer or "End of output"
+        uint64_t expected_line = 0;     // 1-based line in the reference output; 0 past its end
+        uint64_t actual_line = 0;       // 1-based line in the engine's output; 0 past its end
+        std::string expected;
+        std::string actual;
+        uint64_t lines_compared = 0;    // Non-blank lines that matched
+        std::string error;              // An engine threw instead of producing output
+    };
+    
+    struct VerifyOptions {
+        std::vector<uint64_t> sizes = {1, 2, 3, 10, 11, 64, 193, 1000, 4099, 100000};  // Base vertices
+        std::vector<size_t> thread_counts;  // Fan-out threads; empty: default_thread_counts(0)
+        std::function<void(const VerifyResult&)> on_case;  // Called as each case finishes
+    };
+    
+    struct VerifySweepResult {
+        size_t cases = 0;
+        std::vector<VerifyResult> divergences;  // Cases that did not match
+    };
+    
+    // Never throws; an unreadable or invalid input is reported in VerifyResult::error
+    VerifyResult verify_merge(const std::string& base, const std::string& addition);
+    
+    // Generated base and addition pairs at each size, through every engine and every
+    // fan-out thread count. Files live in a temporary folder that is removed after.
+    // Throws std::runtime_error if that folder cannot be written.
+    VerifySweepResult verify_corpus(const VerifyOptions& options = VerifyOptions());
 }
 
 #endif // KITBASH_H
\ No newline at end of file
@@ -0,0 +1,433 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+// Internal helper functions
+namespace {
+    using kitbash::detail::next_token;
+
+    // Render state an ATTR_ command belongs to, and the value that state starts with
+    struct StateGroup {
+        const char* name;
+        const char* initial;
+    };
+
+    const std::map<std::string_view, StateGroup>& state_groups() {
+        static const std::map<std::string_view, StateGroup> groups = {
+            {"ATTR_cockpit", {"cockpit", "ATTR_no_cockpit"}},
+            {"ATTR_cockpit_device", {"cockpit", "ATTR_no_cockpit"}},
+            {"ATTR_cockpit_region", {"cockpit", "ATTR_no_cockpit"}},
+            {"ATTR_no_cockpit", {"cockpit", "ATTR_no_cockpit"}},
+            {"ATTR_draw_enable", {"draw", "ATTR_draw_enable"}},
+            {"ATTR_draw_disable", {"draw", "ATTR_draw_enable"}},
+            {"ATTR_blend", {"blend", "ATTR_blend"}},
+            {"ATTR_no_blend", {"blend", "ATTR_blend"}},
+            {"ATTR_shadow_blend", {"blend", "ATTR_blend"}},
+            {"ATTR_shade_flat", {"shade", "ATTR_shade_smooth"}},
+            {"ATTR_shade_smooth", {"shade", "ATTR_shade_smooth"}},
+            {"ATTR_hard", {"hard", "ATTR_no_hard"}},
+            {"ATTR_hard_deck", {"hard", "ATTR_no_hard"}},
+            {"ATTR_no_hard", {"hard", "ATTR_no_hard"}},
+            {"ATTR_cull", {"cull", "ATTR_cull"}},
+            {"ATTR_no_cull", {"cull", "ATTR_cull"}},
+            {"ATTR_depth", {"depth", "ATTR_depth"}},
+            {"ATTR_no_depth", {"depth", "ATTR_depth"}},
+            {"ATTR_light_level", {"light_level", "ATTR_light_level_reset"}},
+            {"ATTR_light_level_reset", {"light_level", "ATTR_light_level_reset"}},
+            {"ATTR_draped", {"draped", "ATTR_no_draped"}},
+            {"ATTR_no_draped", {"draped", "ATTR_no_draped"}},
+            {"ATTR_solid_camera", {"solid_camera", "ATTR_no_solid_camera"}},
+            {"ATTR_no_solid_camera", {"solid_camera", "ATTR_no_solid_camera"}},
+            {"ATTR_shiny_rat", {"shiny", "ATTR_shiny_rat 0"}},
+            {"ATTR_poly_os", {"poly_os", "ATTR_poly_os 0"}},
+            {"ATTR_manip_none", {"manipulator", "ATTR_manip_none"}},
+        };
+        return groups;
+    }
+
+    bool starts_with(std::string_view text, std::string_view prefix) {
+        return text.size() >= prefix.size() && text.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    // Command and arguments with single spaces, so spacing differences compare equal
+    std::string normalized(std::string_view line) {
+        std::string value;
+        size_t pos = 0;
+        for (std::string_view token = next_token(line, pos); !token.empty(); token = next_token(line, pos)) {
+            if (!value.empty()) {
+                value += ' ';
+            }
+            value.append(token.data(), token.size());
+        }
+        return value;
+    }
+
+    // Keyframes an animation command contributes; ANIM_trans and ANIM_rotate carry two
+    uint64_t keyframes_of(std::string_view command) {
+        if (command == "ANIM_trans_key" || command == "ANIM_rotate_key") {
+            return 1;
+        }
+        return command == "ANIM_trans" || command == "ANIM_rotate" ? 2 : 0;
+    }
+
+    // Commands whose last argument is the dataref driving the animation
+    bool names_dataref(std::string_view command) {
+        return command == "ANIM_trans_begin" || command == "ANIM_rotate_begin" || command == "ANIM_trans" ||
+               command == "ANIM_rotate" || command == "ANIM_hide" || command == "ANIM_show";
+    }
+
+    std::string_view last_token(std::string_view text, size_t pos) {
+        std::string_view last;
+        for (std::string_view token = next_token(text, pos); !token.empty(); token = next_token(text, pos)) {
+            last = token;
+        }
+        return last;
+    }
+
+    bool parse_count(std::string_view token, uint64_t& value) {
+        int parsed = 0;
+        if (!kitbash::detail::parse_int_prefix(token, parsed) || parsed < 0) {
+            return false;
+        }
+        value = static_cast<uint64_t>(parsed);
+        return true;
+    }
+
+    class Analyzer {
+    public:
+        Analyzer(kitbash::ObjAnalysis& report, const kitbash::AnalysisOptions& options)
+            : report_(report), breakdown_(options.breakdown) {
+            reset_state();
+            if (options.geometry.check) {
+                kitbash::GeometryOptions geometry = options.geometry;
+                geometry.repair_normals = false;
+                scanner_ = std::make_unique<kitbash::detail::GeometryScanner>(geometry);
+            }
+        }
+
+        void line(std::string_view text) {
+            size_t pos = 0;
+            std::string_view command = next_token(text, pos);
+            if (command.empty() || command[0] == '#') {
+                return;
+            }
+            if (command == "VT") {
+                ++report_.vertices;
+                if (scanner_) {
+                    scanner_->add(text, report_.line_count);
+                }
+            } else if (command == "IDX" || command == "IDX10") {
+                for (std::string_view token = next_token(text, pos); !token.empty(); token = next_token(text, pos)) {
+                    reference(token);
+                }
+            } else if (command == "TRIS") {
+                draw(text, pos);
+            } else if (command == "ANIM_begin") {
+                ++report_.anim_nodes;
+                ++depth_;
+                report_.max_anim_depth = std::max(report_.max_anim_depth, depth_);
+                if (breakdown_) {
+                    open_node();
+                }
+            } else if (command == "ANIM_end") {
+                depth_ = std::max(0, depth_ - 1);
+                if (breakdown_ && !open_.empty()) {
+                    close_node();
+                }
+            } else if (breakdown_ && starts_with(command, "ANIM_")) {
+                animation(command, text, pos);
+            } else if (command == "ATTR_LOD") {
+                kitbash::LodCost lod;
+                lod.near_distance = std::atof(std::string(next_token(text, pos)).c_str());
+                lod.far_distance = std::atof(std::string(next_token(text, pos)).c_str());
+                report_.lods.push_back(lod);
+                reset_state();      // Each LOD starts from the default state
+            } else if (starts_with(command, "ATTR_")) {
+                attribute(command, text);
+            }
+        }
+
+        void finish() {
+            while (breakdown_ && !open_.empty()) {
+                close_node();       // Unbalanced ANIM_begin
+            }
+            if (scanner_) {
+                report_.geometry = scanner_->finish();
+            }
+            report_.vertex_bytes = report_.vertices * kitbash::ObjAnalysis::bytes_per_vertex;
+            report_.index_bytes = report_.indices * kitbash::ObjAnalysis::bytes_per_index;
+
+            uint64_t used = 0;
+            for (uint64_t i = 0; i < report_.vertices && i / 64 < referenced_.size(); ++i) {
+                used += (referenced_[i / 64] >> (i % 64)) & 1;
+            }
+            report_.unreferenced_vertices = report_.vertices - used;
+
+            // Union of the TRIS ranges against the index count
+            std::sort(ranges_.begin(), ranges_.end());
+            uint64_t covered = 0;
+            uint64_t end = 0;
+            for (const auto& range : ranges_) {
+                uint64_t first = std::max(range.first, end);
+                uint64_t last = std::min(range.second, report_.indices);
+                if (last > first) {
+                    covered += last - first;
+                }
+                end = std::max(end, range.second);
+                if (range.second > report_.indices) {
+                    ++report_.invalid_references;
+                }
+            }
+            report_.undrawn_indices = report_.indices - covered;
+
+            std::sort(report_.state_changes.begin(), report_.state_changes.end(),
+                      [](const kitbash::AttributeChanges& a, const kitbash::AttributeChanges& b) {
+                          return a.changes != b.changes ? a.changes > b.changes : a.attribute < b.attribute;
+                      });
+            if (breakdown_) {
+                sort_by_cost(report_.anim_subtrees);
+                for (auto& entry : datarefs_) {
+                    report_.datarefs.push_back(std::move(entry.second));
+                }
+                sort_by_cost(report_.datarefs);
+            }
+        }
+
+    private:
+        void reference(std::string_view token) {
+            ++report_.indices;
+            uint64_t index = 0;
+            bool valid = parse_count(token, index) && index < report_.vertices;
+            if (breakdown_) {
+                index_values_.push_back(valid ? static_cast<uint32_t>(index) : no_vertex);
+            }
+            if (!valid) {
+                ++report_.invalid_references;     // Vertices always come before indices
+                return;
+            }
+            if (index / 64 >= referenced_.size()) {
+                referenced_.resize(report_.vertices / 64 + 1, 0);
+            }
+            referenced_[index / 64] |= uint64_t(1) << (index % 64);
+        }
+
+        void draw(std::string_view text, size_t pos) {
+            uint64_t offset = 0;
+            uint64_t count = 0;
+            if (!parse_count(next_token(text, pos), offset) || !parse_count(next_token(text, pos), count)) {
+                ++report_.invalid_references;
+                return;
+            }
+            ++report_.draw_calls;
+            report_.triangles += count / 3;
+            if (report_.lods.empty()) {
+                report_.lods.push_back(kitbash::LodCost());    // Geometry outside any ATTR_LOD
+            }
+            ++report_.lods.back().draw_calls;
+            report_.lods.back().triangles += count / 3;
+            ranges_.emplace_back(offset, offset + count);
+            if (breakdown_ && !open_.empty()) {
+                attribute_draw(offset, count);
+            }
+        }
+
+        void open_node() {
+            kitbash::AnimCost node;
+            node.line = report_.line_count;
+            node.depth = depth_;
+            open_.push_back(report_.anim_subtrees.size());
+            report_.anim_subtrees.push_back(node);
+            node_datarefs_.emplace_back();
+        }
+
+        // Fold a finished subtree into its parent and into the datarefs that drive it
+        void close_node() {
+            size_t index = open_.back();
+            open_.pop_back();
+            const kitbash::AnimCost& node = report_.anim_subtrees[index];
+            if (!open_.empty()) {
+                add_cost(report_.anim_subtrees[open_.back()], node);
+            }
+            for (const std::string& dataref : node_datarefs_.back()) {
+                // Counted once, at the outermost subtree the dataref drives
+                if (--active_[dataref] == 0) {
+                    add_cost(datarefs_[dataref], node);
+                }
+            }
+            node_datarefs_.pop_back();
+        }
+
+        void animation(std::string_view command, std::string_view text, size_t pos) {
+            if (open_.empty()) {
+                return;
+            }
+            kitbash::AnimCost& node = report_.anim_subtrees[open_.back()];
+            uint64_t keyframes = keyframes_of(command);
+            node.keyframes += keyframes;
+            if (command == "ANIM_trans_key" || command == "ANIM_rotate_key") {
+                if (!key_dataref_.empty()) {
+                    ++datarefs_[key_dataref_].own_keyframes;
+                }
+                return;
+            }
+            if (!names_dataref(command)) {
+                if (command == "ANIM_trans_end" || command == "ANIM_rotate_end") {
+                    key_dataref_.clear();
+                }
+                return;
+            }
+            std::string dataref(last_token(text, pos));
+            // Keys that follow a *_begin line belong to its dataref
+            key_dataref_ = command == "ANIM_trans_begin" || command == "ANIM_rotate_begin" ? dataref : "";
+            kitbash::DatarefCost& cost = datarefs_[dataref];
+            if (cost.dataref.empty()) {
+                cost.dataref = dataref;
+            }
+            cost.own_keyframes += keyframes;
+            auto& driving = node_datarefs_.back();
+            if (std::find(driving.begin(), driving.end(), dataref) == driving.end()) {
+                driving.push_back(dataref);
+                ++cost.nodes;
+                ++active_[dataref];
+                if (!node.datarefs.empty()) {
+                    node.datarefs += ' ';
+                }
+                node.datarefs += dataref;
+            }
+        }
+
+        // Vertices are counted once per node, however many of its draws use them
+        void attribute_draw(uint64_t offset, uint64_t count) {
+            kitbash::AnimCost& node = report_.anim_subtrees[open_.back()];
+            ++node.draw_calls;
+            node.triangles += count / 3;
+            if (stamps_.size() < report_.vertices) {
+                stamps_.resize(report_.vertices, 0);
+            }
+            uint32_t stamp = static_cast<uint32_t>(open_.back() + 1);
+            uint64_t end = std::min<uint64_t>(offset + count, index_values_.size());
+            for (uint64_t i = offset; i < end; ++i) {
+                uint32_t vertex = index_values_[i];
+                if (vertex != no_vertex && stamps_[vertex] != stamp) {
+                    stamps_[vertex] = stamp;
+                    ++node.vertices;
+                }
+            }
+        }
+
+        template <typename Cost>
+        static void add_cost(Cost& total, const kitbash::AnimCost& subtree) {
+            total.triangles += subtree.triangles;
+            total.vertices += subtree.vertices;
+            total.draw_calls += subtree.draw_calls;
+            total.keyframes += subtree.keyframes;
+        }
+
+        template <typename Cost>
+        static void sort_by_cost(std::vector<Cost>& costs) {
+            std::stable_sort(costs.begin(), costs.end(), [](const Cost& a, const Cost& b) {
+                if (a.triangles != b.triangles) {
+                    return a.triangles > b.triangles;
+                }
+                if (a.draw_calls != b.draw_calls) {
+                    return a.draw_calls > b.draw_calls;
+                }
+                return a.keyframes > b.keyframes;
+            });
+        }
+
+        void attribute(std::string_view command, std::string_view text) {
+            std::string group;
+            auto known = state_groups().find(command);
+            if (known != state_groups().end()) {
+                group = known->second.name;
+            } else if (starts_with(command, "ATTR_manip_")) {
+                group = "manipulator";
+            } else {
+                group = std::string(command.substr(5));     // Its own state
+            }
+            if (starts_with(command, "ATTR_manip_") && command != "ATTR_manip_none" &&
+                command != "ATTR_manip_wheel") {
+                ++report_.manipulators;
+            }
+
+            auto& counts = changes_for(group);
+            std::string value = normalized(text);
+            std::string& current = state_[group];
+            if (value == current) {
+                ++counts.redundant;
+            } else {
+                ++counts.changes;
+                current = value;
+            }
+        }
+
+        kitbash::AttributeChanges& changes_for(const std::string& group) {
+            auto found = change_index_.find(group);
+            if (found == change_index_.end()) {
+                found = change_index_.emplace(group, report_.state_changes.size()).first;
+                report_.state_changes.push_back(kitbash::AttributeChanges());
+                report_.state_changes.back().attribute = group;
+            }
+            return report_.state_changes[found->second];
+        }
+
+        void reset_state() {
+            state_.clear();
+            for (const auto& entry : state_groups()) {
+                state_[entry.second.name] = entry.second.initial;
+            }
+        }
+
+        static constexpr uint32_t no_vertex = UINT32_MAX;
+
+        kitbash::ObjAnalysis& report_;
+        bool breakdown_ = false;
+        int depth_ = 0;
+        std::vector<uint64_t> referenced_;      // One bit per vertex
+        std::vector<std::pair<uint64_t, uint64_t>> ranges_;     // TRIS [first, end) in indices
+        std::map<std::string, std::string> state_;
+        std::map<std::string, size_t> change_index_;
+
+        // Breakdown only
+        std::vector<uint32_t> index_values_;    // Vertex of each index, or no_vertex
+        std::vector<uint32_t> stamps_;          // Last node (+1) that counted each vertex
+        std::vector<size_t> open_;              // anim_subtrees entries of the enclosing ANIM blocks
+        std::vector<std::vector<std::string>> node_datarefs_;  // Datarefs driving each open block
+        std::map<std::string, int> active_;     // Open blocks driven by each dataref
+        std::map<std::string, kitbash::DatarefCost> datarefs_;
+        std::string key_dataref_;
+
+        std::unique_ptr<kitbash::detail::GeometryScanner> scanner_;
+    };
+}
+
+namespace kitbash {
+    ObjAnalysis analyze_obj(const std::string& filename, const AnalysisOptions& options) {
+        detail::MappedFile file(filename);
+        if (!detail::validate_obj_header(file.view())) {
+            throw std::runtime_error("Invalid OBJ8 format: " + filename);
+        }
+
+        ObjAnalysis report;
+        report.filename = filename;
+        report.file_bytes = file.size();
+        Analyzer analyzer(report, options);
+        std::string_view data = file.view();
+        size_t pos = 0;
+        while (pos < data.size()) {
+            const void* found = std::memchr(data.data() + pos, '\n', data.size() - pos);
+            size_t line_end = found ? static_cast<const char*>(found) - data.data() : data.size();
+            ++report.line_count;
+            analyzer.line(data.substr(pos, line_end - pos));
+            pos = line_end + 1;
+        }
+        analyzer.finish();
+        return report;
+    }
+}
@@ -0,0 +1,56 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include "kitbash_thread_pool.h"
+#include <stdexcept>
+
+// Internal helper functions
+namespace {
+    // Drive a MergeJob chunk by chunk, reporting progress and honouring cancellation
+    kitbash::MergeResult run_merge(const std::string& base, const std::string& addition,
+                                   const kitbash::AsyncMergeOptions& options) {
+        kitbash::MergeResult result;
+        try {
+            kitbash::detail::MergeJob job(base, addition, options.output);
+            bool finished = false;
+            while (!finished) {
+                if (options.cancel.is_cancelled()) {
+                    job.abort();
+                    result.cancelled = true;
+                    result.error = "Merge cancelled";
+                    return result;
+                }
+                finished = job.run_chunk();
+                if (options.on_progress) {
+                    options.on_progress(job.progress());
+                }
+            }
+            result.stats = job.stats();
+            result.success = true;
+        } catch (const std::exception& e) {
+            result.error = e.what();
+        }
+        return result;
+    }
+}
+
+namespace kitbash {
+    std::future<MergeResult> merge_async(const std::string& base, const std::string& addition,
+                                         const AsyncMergeOptions& options) {
+        auto promise = std::make_shared<std::promise<MergeResult>>();
+        std::future<MergeResult> future = promise->get_future();
+        detail::ThreadPool::shared().submit([promise, base, addition, options] {
+            promise->set_value(run_merge(base, addition, options));
+        });
+        return future;
+    }
+
+    void merge_async(const std::string& base, const std::string& addition,
+                     const AsyncMergeOptions& options, CompletionCallback on_complete) {
+        detail::ThreadPool::shared().submit([base, addition, options, on_complete] {
+            MergeResult result = run_merge(base, addition, options);
+            if (on_complete) {
+                on_complete(result);
+            }
+        });
+    }
+}
@@ -0,0 +1,415 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include "kitbash_thread_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <new>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Internal helper functions
+namespace {
+    std::string resolve(const std::filesystem::path& folder, const std::string& path) {
+        std::filesystem::path p(path);
+        return p.is_absolute() ? p.string() : (folder / p).lexically_normal().string();
+    }
+
+    void run_in_process(const std::vector<kitbash::BatchJob>& jobs, const std::vector<size_t>& pending,
+                        std::vector<kitbash::BatchResult>& results, size_t workers) {
+        std::unique_ptr<kitbash::detail::ThreadPool> own_pool;
+        if (workers > 0) {
+            own_pool = std::make_unique<kitbash::detail::ThreadPool>(workers);
+        }
+        kitbash::detail::ThreadPool& pool = own_pool ? *own_pool : kitbash::detail::ThreadPool::shared();
+
+        std::vector<std::future<void>> done;
+        done.reserve(pending.size());
+        for (size_t i : pending) {
+            auto promise = std::make_shared<std::promise<void>>();
+            done.push_back(promise->get_future());
+            const kitbash::BatchJob* job = &jobs[i];
+            kitbash::BatchResult* result = &results[i];
+            pool.submit([promise, job, result] {
+                kitbash::detail::run_batch_job(*job, *result);
+                promise->set_value();
+            });
+        }
+        for (auto& future : done) {
+            pool.wait(future);
+        }
+    }
+
+#ifndef _WIN32
+    // Workers talk to the parent over a socket pair: the parent sends a job index
+    // (8 bytes), the worker answers with [8-byte size][payload]. Sockets rather than
+    // pipes so a write to a dead worker fails with EPIPE instead of raising SIGPIPE.
+    bool send_all(int fd, const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t sent = ::send(fd, bytes, size, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                return false;
+            }
+            bytes += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    bool receive_all(int fd, void* data, size_t size) {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0) {
+            ssize_t received = ::recv(fd, bytes, size, 0);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                return false;
+            }
+            bytes += received;
+            size -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    // Filenames are known to the parent; only the outcome and the counts travel
+    struct ResultMessage {
+        int32_t success;
+        int32_t counts[9];
+        double processing_time;
+        uint64_t backup_size;
+        uint64_t error_size;
+    };
+
+    std::string encode(const kitbash::BatchResult& result) {
+        const MergeStats& stats = result.stats;
+        ResultMessage message{};
+        message.success = result.success ? 1 : 0;
+        int32_t counts[9] = {
+            stats.original_vt_count, stats.original_tris_count, stats.original_line_count,
+            stats.added_vt_count, stats.added_tris_count, stats.added_line_count,
+            stats.final_vt_count, stats.final_tris_count, stats.final_line_count,
+        };
+        std::memcpy(message.counts, counts, sizeof(counts));
+        message.processing_time = stats.processing_time;
+        message.backup_size = stats.backup_filename.size();
+        message.error_size = result.error.size();
+
+        std::string payload(reinterpret_cast<const char*>(&message), sizeof(message));
+        payload += stats.backup_filename;
+        payload += result.error;
+        return payload;
+    }
+
+    bool decode(const std::string& payload, kitbash::BatchResult& result) {
+        ResultMessage message;
+        if (payload.size() < sizeof(message)) {
+            return false;
+        }
+        std::memcpy(&message, payload.data(), sizeof(message));
+        if (payload.size() - sizeof(message) != message.backup_size + message.error_size) {
+            return false;
+        }
+        MergeStats& stats = result.stats;
+        int* counts[9] = {
+            &stats.original_vt_count, &stats.original_tris_count, &stats.original_line_count,
+            &stats.added_vt_count, &stats.added_tris_count, &stats.added_line_count,
+            &stats.final_vt_count, &stats.final_tris_count, &stats.final_line_count,
+        };
+        for (size_t i = 0; i < 9; ++i) {
+            *counts[i] = message.counts[i];
+        }
+        stats.processing_time = message.processing_time;
+        stats.base_filename = result.job.base;
+        stats.addition_filename = result.job.addition;
+        stats.output_filename = result.job.output.empty() ? result.job.base : result.job.output;
+        stats.backup_filename = payload.substr(sizeof(message), message.backup_size);
+        result.error = payload.substr(sizeof(message) + message.backup_size);
+        result.success = message.success != 0;
+        return true;
+    }
+
+    [[noreturn]] void worker_main(int fd, const std::vector<kitbash::BatchJob>& jobs, uint64_t memory_limit) {
+        if (memory_limit > 0) {
+            rlimit limit{static_cast<rlim_t>(memory_limit), static_cast<rlim_t>(memory_limit)};
+            ::setrlimit(RLIMIT_AS, &limit);
+        }
+        uint64_t index;
+        while (receive_all(fd, &index, sizeof(index)) && index < jobs.size()) {
+            kitbash::BatchResult result;
+            kitbash::detail::run_batch_job(jobs[index], result);
+            std::string payload = encode(result);
+            uint64_t size = payload.size();
+            if (!send_all(fd, &size, sizeof(size)) || !send_all(fd, payload.data(), payload.size())) {
+                break;
+            }
+        }
+        // Skip static destructors: they belong to the parent (e.g. the shared pool's threads)
+        ::_exit(0);
+    }
+
+    struct Worker {
+        pid_t pid = -1;
+        int fd = -1;
+        size_t job = SIZE_MAX;      // SIZE_MAX while idle
+    };
+
+    Worker spawn_worker(const std::vector<kitbash::BatchJob>& jobs, uint64_t memory_limit,
+                        const std::vector<Worker>& others) {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            throw std::runtime_error(std::string("Cannot start worker process: ") + std::strerror(errno));
+        }
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            ::close(fds[0]);
+            for (const auto& other : others) {
+                if (other.fd >= 0) {
+                    ::close(other.fd);
+                }
+            }
+            worker_main(fds[1], jobs, memory_limit);
+        }
+        int error = errno;
+        ::close(fds[1]);
+        if (pid < 0) {
+            ::close(fds[0]);
+            throw std::runtime_error(std::string("Cannot start worker process: ") + std::strerror(error));
+        }
+        Worker worker;
+        worker.pid = pid;
+        worker.fd = fds[0];
+        return worker;
+    }
+
+    // Reap a worker that stopped answering and describe why
+    std::string reap_worker(Worker& worker) {
+        ::close(worker.fd);
+        worker.fd = -1;
+        int status = 0;
+        while (::waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) {
+        }
+        if (WIFSIGNALED(status)) {
+            return "Worker process crashed (signal " + std::to_string(WTERMSIG(status)) + ": " +
+                   strsignal(WTERMSIG(status)) + ")";
+        }
+        return "Worker process exited with status " + std::to_string(WEXITSTATUS(status));
+    }
+
+    // Remove the partial output a worker left behind; its temporary names carry its pid
+    void remove_worker_temps(const kitbash::BatchJob& job, pid_t pid) {
+        std::filesystem::path output = job.output.empty() ? job.base : job.output;
+        std::string prefix = std::filesystem::path(
+            kitbash::detail::temp_prefix_for(output.string(), static_cast<int>(pid))).filename().string();
+        std::error_code ec;
+        std::filesystem::path folder = output.has_parent_path() ? output.parent_path() : std::filesystem::path(".");
+        for (std::filesystem::directory_iterator it(folder, ec), end; !ec && it != end; it.increment(ec)) {
+            std::string name = it->path().filename().string();
+            if (name.compare(0, prefix.size(), prefix) == 0 && name.size() > 4 &&
+                name.compare(name.size() - 4, 4, ".tmp") == 0) {
+                std::error_code ignored;
+                std::filesystem::remove(it->path(), ignored);
+            }
+        }
+    }
+
+    void run_isolated(const std::vector<kitbash::BatchJob>& jobs, const std::vector<size_t>& pending,
+                      std::vector<kitbash::BatchResult>& results, size_t workers, uint64_t memory_limit) {
+        std::vector<Worker> pool;
+        auto shut_down = [&pool] {
+            // Closing the socket ends each worker's loop
+            for (auto& worker : pool) {
+                if (worker.fd >= 0) {
+                    ::close(worker.fd);
+                    while (::waitpid(worker.pid, nullptr, 0) < 0 && errno == EINTR) {
+                    }
+                }
+            }
+        };
+
+        try {
+            while (pool.size() < std::min(workers, pending.size())) {
+                pool.push_back(spawn_worker(jobs, memory_limit, pool));
+            }
+
+            size_t next = 0;
+            size_t running = 0;
+            std::vector<pollfd> ready;
+            std::vector<size_t> polled;
+            while (next < pending.size() || running > 0) {
+                for (size_t w = 0; w < pool.size() && next < pending.size(); ++w) {
+                    if (pool[w].job != SIZE_MAX) {
+                        continue;
+                    }
+                    uint64_t index = pending[next];
+                    if (send_all(pool[w].fd, &index, sizeof(index))) {
+                        pool[w].job = pending[next++];
+                        ++running;
+                    } else {
+                        // Died while idle (e.g. killed from outside): replace it and retry
+                        reap_worker(pool[w]);
+                        pool[w] = spawn_worker(jobs, memory_limit, pool);
+                        --w;
+                    }
+                }
+
+                ready.clear();
+                polled.clear();
+                for (size_t w = 0; w < pool.size(); ++w) {
+                    if (pool[w].job != SIZE_MAX) {
+                        ready.push_back(pollfd{pool[w].fd, POLLIN, 0});
+                        polled.push_back(w);
+                    }
+                }
+                if (::poll(ready.data(), ready.size(), -1) < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error(std::string("Cannot wait for worker processes: ") +
+                                             std::strerror(errno));
+                }
+
+                for (size_t i = 0; i < ready.size(); ++i) {
+                    if (ready[i].revents == 0) {
+                        continue;
+                    }
+                    Worker& worker = pool[polled[i]];
+                    kitbash::BatchResult& result = results[worker.job];
+                    uint64_t size = 0;
+                    std::string payload;
+                    bool answered = receive_all(worker.fd, &size, sizeof(size)) && size < (1ULL << 32);
+                    if (answered) {
+                        payload.resize(static_cast<size_t>(size));
+                        answered = receive_all(worker.fd, &payload[0], payload.size()) && decode(payload, result);
+                    }
+                    if (!answered) {
+                        // The job took its worker down; only this job fails
+                        result.success = false;
+                        result.error = reap_worker(worker);
+                        remove_worker_temps(jobs[worker.job], worker.pid);
+                        worker = spawn_worker(jobs, memory_limit, pool);
+                    }
+                    worker.job = SIZE_MAX;
+                    --running;
+                }
+            }
+        } catch (...) {
+            shut_down();
+            throw;
+        }
+        shut_down();
+    }
+#endif
+}
+
+namespace kitbash {
+    // Never throws so a failing job does not affect the others
+    void detail::run_batch_job(const BatchJob& job, BatchResult& result, std::function<void()> commit_guard) {
+        try {
+            std::unique_ptr<detail::MergeJob> merge;
+            if (CompiledAddition::is_compiled_file(job.addition)) {
+                merge = std::make_unique<detail::MergeJob>(
+                    job.base, CompiledAddition::load(job.addition), job.output);
+            } else {
+                merge = std::make_unique<detail::MergeJob>(job.base, job.addition, job.output);
+            }
+            merge->set_commit_guard(std::move(commit_guard));
+            while (!merge->run_chunk()) {
+            }
+            result.stats = merge->stats();
+            result.stats.addition_filename = job.addition;
+            result.success = true;
+        } catch (const std::bad_alloc&) {
+            result.error = "Out of memory";
+        } catch (const std::exception& e) {
+            result.error = e.what();
+        }
+    }
+
+    std::vector<BatchJob> read_batch_file(const std::string& batch_file) {
+        std::ifstream file(batch_file);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open file: " + batch_file);
+        }
+        std::filesystem::path folder = std::filesystem::path(batch_file).parent_path();
+
+        std::vector<BatchJob> jobs;
+        std::string text;
+        int line_number = 0;
+        while (std::getline(file, text)) {
+            ++line_number;
+            auto tokens = tokenize(text);
+            if (tokens.empty() || tokens[0][0] == '#') {
+                continue;
+            }
+
+            // base + addition [-> output]
+            bool has_output = tokens.size() == 5 && tokens[3] == "->";
+            if ((tokens.size() != 3 && !has_output) || tokens[1] != "+") {
+                throw std::runtime_error(batch_file + ":" + std::to_string(line_number) +
+                                         ": expected 'base.obj + addition.obj [-> output.obj]'");
+            }
+            BatchJob job;
+            job.base = resolve(folder, tokens[0]);
+            job.addition = resolve(folder, tokens[2]);
+            if (has_output) {
+                job.output = resolve(folder, tokens[4]);
+            }
+            jobs.push_back(std::move(job));
+        }
+        return jobs;
+    }
+
+    std::vector<BatchResult> run_batch(const std::vector<BatchJob>& jobs, const BatchOptions& options) {
+        std::vector<BatchResult> results(jobs.size());
+        std::vector<size_t> pending;
+        std::set<std::string> outputs;
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            results[i].job = jobs[i];
+            const std::string& output = jobs[i].output.empty() ? jobs[i].base : jobs[i].output;
+            if (!outputs.insert(std::filesystem::absolute(output).lexically_normal().string()).second) {
+                // Two merges writing one file would race; the first one wins
+                results[i].error = "Duplicate output file: " + output;
+            } else {
+                pending.push_back(i);
+            }
+        }
+        size_t workers = options.workers > 0 ? options.workers
+                                             : std::max<size_t>(1, std::thread::hardware_concurrency());
+
+        try {
+#ifndef _WIN32
+            if (options.isolate) {
+                run_isolated(jobs, pending, results, workers, options.memory_limit);
+                return results;
+            }
+#endif
+            // No fork() on Windows: isolation falls back to worker threads
+            run_in_process(jobs, pending, results, options.workers);
+        } catch (const std::exception& e) {
+            for (auto& result : results) {
+                if (!result.success && result.error.empty()) {
+                    result.error = e.what();
+                }
+            }
+        }
+        return results;
+    }
+}
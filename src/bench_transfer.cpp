@@ -0,0 +1,148 @@
+// Result delivery benchmark for the merge server: passing the result's memory
+// file over the socket (SCM_RIGHTS) against streaming its bytes through it.
+//
+//     kitbash_transfer_bench base.obj addition.obj [--runs N]
+//
+// Starts a server on a private socket, then fetches the same merge repeatedly
+// with each transfer mode, once into memory (every page of the result is read)
+// and once into a file. Delivery time is the client's wall time minus the merge
+// time reported by the server.
+
+#include "kitbash.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2.0;
+}
+
+// Read one byte per page so the whole result is actually brought in
+uint64_t touch(const kitbash::MemoryOutput& memory) {
+    uint64_t sum = 0;
+#ifndef _WIN32
+    if (memory.size == 0) {
+        return 0;
+    }
+    void* data = ::mmap(nullptr, memory.size, PROT_READ, MAP_SHARED, memory.descriptor, 0);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (uint64_t i = 0; i < memory.size; i += 4096) {
+        sum += bytes[i];
+    }
+    ::munmap(data, memory.size);
+#else
+    (void)memory;
+#endif
+    return sum;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> files;
+    int runs = 5;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc) {
+            runs = std::max(1, std::atoi(argv[++i]));
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.size() != 2) {
+        std::cout << "Usage: kitbash_transfer_bench base.obj addition.obj [--runs N]\n";
+        return 1;
+    }
+
+    namespace fs = std::filesystem;
+    fs::path folder = fs::temp_directory_path() / ("kitbash-bench-" + std::to_string(
+        std::chrono::steady_clock::now().time_since_epoch().count()));
+    fs::create_directories(folder);
+    std::string socket_path = (folder / "server.sock").string();
+    std::string output = (folder / "result.obj").string();
+
+    std::atomic<bool> stop(false);
+    std::atomic<bool> failed(false);
+    std::string error;
+    std::thread server([&] {
+        if (!kitbash::serve_merge_service(socket_path, kitbash::ServiceOptions(), [&] { return stop.load(); },
+                                          &error)) {
+            failed = true;
+        }
+    });
+    while (!fs::exists(socket_path) && !failed) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    struct Mode {
+        const char* name;
+        kitbash::Transfer transfer;
+        bool to_file;
+    };
+    const Mode modes[] = {
+        {"descriptor -> memory", kitbash::Transfer::Descriptor, false},
+        {"stream     -> memory", kitbash::Transfer::Stream, false},
+        {"descriptor -> file", kitbash::Transfer::Descriptor, true},
+        {"stream     -> file", kitbash::Transfer::Stream, true},
+    };
+
+    int status = 0;
+    uint64_t output_bytes = 0;
+    volatile uint64_t checksum = 0;     // Keeps the page reads from being optimized away
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Mode                    Total (ms)   Delivery (ms)   Delivery (MB/s)\n";
+    for (const Mode& mode : modes) {
+        std::vector<double> totals;
+        std::vector<double> deliveries;
+        for (int run = 0; run <= runs && status == 0; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            auto result = kitbash::fetch_remote(socket_path, files[0], files[1], mode.to_file ? output : "",
+                                                mode.transfer);
+            if (result.success && result.memory) {
+                checksum = checksum + touch(*result.memory);
+                output_bytes = result.memory->size;
+            }
+            double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (!result.success) {
+                std::cout << "Merge failed: " << result.error << "\n";
+                status = 1;
+            } else if (run > 0) {   // The first run warms the page cache
+                totals.push_back(total);
+                deliveries.push_back(std::max(0.0, total - result.stats.processing_time));
+            }
+        }
+        if (status != 0) {
+            break;
+        }
+        double delivery = median(deliveries);
+        std::cout << std::left << std::setw(22) << mode.name << std::right
+                  << std::setw(12) << median(totals) * 1000.0
+                  << std::setw(16) << delivery * 1000.0
+                  << std::setw(18) << (delivery > 0 ? output_bytes / delivery / 1e6 : 0.0) << "\n";
+    }
+    std::cout << "Output: " << output_bytes << " bytes, median of " << runs << " runs\n";
+
+    stop = true;
+    server.join();
+    std::error_code ec;
+    fs::remove_all(folder, ec);
+    if (!error.empty()) {
+        std::cout << "Server error: " << error << "\n";
+        return 1;
+    }
+    return status;
+}
@@ -0,0 +1,366 @@
+// Benchmark comparator for `kitbash --bench --json` results: flags speedups and
+// regressions that stand out from run-to-run noise.
+//
+//     kitbash_benchcmp old.json new.json [--threshold PCT] [--alpha P]
+//
+// Benchmarks are matched by name. For each pair the median and the median
+// absolute deviation (MAD) of the run times are shown, and a two-sided
+// Mann-Whitney U test decides whether the two sets of runs differ: exact for
+// small sample counts, normal approximation with tie correction otherwise.
+// A change is significant when p < alpha (default 0.05). Exit code 1 when a
+// significant regression is slower by more than the threshold (default 5%),
+// 2 when an input cannot be read.
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct Benchmark {
+    std::string name;
+    std::vector<double> samples;
+};
+
+// Just enough JSON for the benchmark files: objects, arrays, strings, numbers
+class JsonReader {
+public:
+    explicit JsonReader(const std::string& text) : text_(text) {}
+
+    std::vector<Benchmark> benchmarks() {
+        std::vector<Benchmark> result;
+        expect('{');
+        while (!take('}')) {
+            std::string key = string();
+            expect(':');
+            if (key == "benchmarks") {
+                expect('[');
+                while (!take(']')) {
+                    result.push_back(benchmark());
+                    take(',');
+                }
+            } else {
+                skip();
+            }
+            take(',');
+        }
+        return result;
+    }
+
+private:
+    Benchmark benchmark() {
+        Benchmark entry;
+        expect('{');
+        while (!take('}')) {
+            std::string key = string();
+            expect(':');
+            if (key == "name") {
+                entry.name = string();
+            } else if (key == "samples_seconds") {
+                expect('[');
+                while (!take(']')) {
+                    entry.samples.push_back(number());
+                    take(',');
+                }
+            } else {
+                skip();
+            }
+            take(',');
+        }
+        return entry;
+    }
+
+    void space() {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+            ++pos_;
+        }
+    }
+
+    bool take(char c) {
+        space();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!take(c)) {
+            throw std::runtime_error(std::string("expected '") + c + "' at offset " + std::to_string(pos_));
+        }
+    }
+
+    std::string string() {
+        expect('"');
+        std::string value;
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            if (text_[pos_] == '\\' && pos_ + 1 < text_.size()) {
+                ++pos_;
+            }
+            value += text_[pos_++];
+        }
+        expect('"');
+        return value;
+    }
+
+    double number() {
+        space();
+        const char* start = text_.c_str() + pos_;
+        char* end = nullptr;
+        double value = std::strtod(start, &end);
+        if (end == start) {
+            throw std::runtime_error("expected a number at offset " + std::to_string(pos_));
+        }
+        pos_ += end - start;
+        return value;
+    }
+
+    void skip() {
+        space();
+        if (take('{')) {
+            while (!take('}')) {
+                string();
+                expect(':');
+                skip();
+                take(',');
+            }
+        } else if (take('[')) {
+            while (!take(']')) {
+                skip();
+                take(',');
+            }
+        } else if (pos_ < text_.size() && text_[pos_] == '"') {
+            string();
+        } else {
+            while (pos_ < text_.size() && text_[pos_] != ',' && text_[pos_] != '}' && text_[pos_] != ']') {
+                ++pos_;
+            }
+        }
+    }
+
+    const std::string& text_;
+    size_t pos_ = 0;
+};
+
+std::vector<Benchmark> load(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file: " + filename);
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text = buffer.str();
+    try {
+        return JsonReader(text).benchmarks();
+    } catch (const std::exception& e) {
+        throw std::runtime_error(filename + ": " + e.what());
+    }
+}
+
+double median(std::vector<double> values) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2.0;
+}
+
+double mad(const std::vector<double>& values) {
+    double center = median(values);
+    std::vector<double> deviations;
+    for (double value : values) {
+        deviations.push_back(std::fabs(value - center));
+    }
+    return median(deviations);
+}
+
+// Two-sided p-value of the Mann-Whitney U test
+double mann_whitney(const std::vector<double>& a, const std::vector<double>& b) {
+    size_t n1 = a.size();
+    size_t n2 = b.size();
+    if (n1 == 0 || n2 == 0) {
+        return 1.0;
+    }
+
+    // Midranks over the pooled samples; ties share the average rank
+    std::vector<std::pair<double, int>> pooled;
+    for (double value : a) {
+        pooled.emplace_back(value, 0);
+    }
+    for (double value : b) {
+        pooled.emplace_back(value, 1);
+    }
+    std::sort(pooled.begin(), pooled.end());
+    double rank_sum = 0.0;
+    double tie_term = 0.0;
+    bool ties = false;
+    for (size_t i = 0; i < pooled.size();) {
+        size_t j = i;
+        while (j < pooled.size() && pooled[j].first == pooled[i].first) {
+            ++j;
+        }
+        double rank = (i + 1 + j) / 2.0;
+        for (size_t k = i; k < j; ++k) {
+            if (pooled[k].second == 0) {
+                rank_sum += rank;
+            }
+        }
+        double t = static_cast<double>(j - i);
+        tie_term += t * t * t - t;
+        ties = ties || j - i > 1;
+        i = j;
+    }
+    double u = rank_sum - n1 * (n1 + 1) / 2.0;
+    double mean = n1 * n2 / 2.0;
+
+    if (n1 + n2 <= 40 && !ties) {
+        // Exact: table[i][j][k] = orderings of i and j samples with U = k
+        std::vector<std::vector<std::vector<double>>> table(n1 + 1, std::vector<std::vector<double>>(n2 + 1));
+        for (size_t i = 0; i <= n1; ++i) {
+            for (size_t j = 0; j <= n2; ++j) {
+                std::vector<double>& counts = table[i][j];
+                counts.assign(i * j + 1, 0.0);
+                if (i == 0 || j == 0) {
+                    counts[0] = 1.0;
+                    continue;
+                }
+                // The largest value is from the first sample (adds j to U) or the second
+                const std::vector<double>& first = table[i - 1][j];
+                const std::vector<double>& second = table[i][j - 1];
+                for (size_t k = 0; k < first.size(); ++k) {
+                    counts[k + j] += first[k];
+                }
+                for (size_t k = 0; k < second.size(); ++k) {
+                    counts[k] += second[k];
+                }
+            }
+        }
+        const std::vector<double>& counts = table[n1][n2];
+        double total = 0.0;
+        for (double count : counts) {
+            total += count;
+        }
+        double extreme = std::min(u, n1 * n2 - u);
+        double tail = 0.0;
+        for (size_t k = 0; k <= static_cast<size_t>(extreme + 0.5) && k < counts.size(); ++k) {
+            tail += counts[k];
+        }
+        return std::min(1.0, 2.0 * tail / total);
+    }
+
+    double n = static_cast<double>(n1 + n2);
+    double variance = n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1)));
+    if (variance <= 0.0) {
+        return 1.0;
+    }
+    double z = (std::fabs(u - mean) - 0.5) / std::sqrt(variance);     // Continuity correction
+    return std::min(1.0, std::erfc(std::max(0.0, z) / std::sqrt(2.0)));
+}
+
+// Smallest two-sided p-value the exact test can reach with these sample counts
+double smallest_p(size_t n1, size_t n2) {
+    double orderings = 1.0;     // (n1 + n2) choose n1
+    for (size_t i = 1; i <= n1; ++i) {
+        orderings = orderings * (n2 + i) / i;
+    }
+    return 2.0 / orderings;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> files;
+    double threshold = 5.0;
+    double alpha = 0.05;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threshold" && i + 1 < argc) {
+            threshold = std::atof(argv[++i]);
+        } else if (arg == "--alpha" && i + 1 < argc) {
+            alpha = std::atof(argv[++i]);
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.size() != 2) {
+        std::cout << "Usage: kitbash_benchcmp old.json new.json [--threshold PCT] [--alpha P]\n";
+        return 2;
+    }
+
+    std::vector<Benchmark> before;
+    std::vector<Benchmark> after;
+    try {
+        before = load(files[0]);
+        after = load(files[1]);
+    } catch (const std::exception& e) {
+        std::cout << "Error: " << e.what() << "\n";
+        return 2;
+    }
+    std::map<std::string, const Benchmark*> old_by_name;
+    for (const auto& benchmark : before) {
+        old_by_name[benchmark.name] = &benchmark;
+    }
+
+    int regressions = 0;
+    int improvements = 0;
+    std::cout << std::left << std::setw(26) << "Benchmark" << std::right << std::setw(16) << "Old (ms)"
+              << std::setw(16) << "New (ms)" << std::setw(10) << "Change" << std::setw(10) << "p"
+              << "   Verdict\n";
+    for (const auto& benchmark : after) {
+        auto found = old_by_name.find(benchmark.name);
+        if (found == old_by_name.end()) {
+            std::cout << std::left << std::setw(26) << benchmark.name << std::right << "   (new)\n";
+            continue;
+        }
+        const Benchmark& old = *found->second;
+        old_by_name.erase(found);
+        double old_median = median(old.samples);
+        double new_median = median(benchmark.samples);
+        double change = old_median > 0 ? (new_median / old_median - 1.0) * 100.0 : 0.0;
+        double p = mann_whitney(old.samples, benchmark.samples);
+
+        std::string verdict = "same";
+        if (p < alpha) {
+            if (change > threshold) {
+                verdict = "REGRESSION";
+                ++regressions;
+            } else if (change < -threshold) {
+                verdict = "faster";
+                ++improvements;
+            } else {
+                verdict = "within threshold";
+            }
+        } else if (smallest_p(old.samples.size(), benchmark.samples.size()) >= alpha) {
+            verdict = "unknown (too few runs)";
+        }
+
+        std::ostringstream old_text;
+        std::ostringstream new_text;
+        old_text << std::fixed << std::setprecision(2) << old_median * 1000.0 << " +-" << mad(old.samples) * 1000.0;
+        new_text << std::fixed << std::setprecision(2) << new_median * 1000.0 << " +-"
+                 << mad(benchmark.samples) * 1000.0;
+        std::cout << std::left << std::setw(26) << benchmark.name << std::right << std::setw(16) << old_text.str()
+                  << std::setw(16) << new_text.str() << std::fixed << std::setprecision(1) << std::setw(9) << change
+                  << "%" << std::setprecision(3) << std::setw(10) << p << "   " << verdict;
+        if (p < alpha && verdict != "within threshold") {
+            std::cout << " (" << std::setprecision(1) << (1.0 - p) * 100.0 << "% confidence)";
+        }
+        std::cout << "\n";
+    }
+    for (const auto& entry : old_by_name) {
+        std::cout << std::left << std::setw(26) << entry.first << std::right << "   (removed)\n";
+    }
+
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+    std::cout << "\n" << regressions << " regressions, " << improvements << " improvements beyond " << threshold
+              << "% (Mann-Whitney, alpha " << alpha << "); medians shown +- MAD\n";
+    return regressions > 0 ? 1 : 0;
+}
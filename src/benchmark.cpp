@@ -0,0 +1,297 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Internal helper functions
+namespace {
+    namespace fs = std::filesystem;
+
+    // Input file the merge engine can map: a memory file reached through /proc on
+    // Linux, so nothing touches the disk; a temporary file elsewhere
+    struct BenchFile {
+        std::string path;
+        int descriptor = -1;
+        uint64_t bytes = 0;
+
+        BenchFile(const fs::path& folder, const std::string& name, uint64_t vertices, uint64_t seed) {
+#ifdef __linux__
+            (void)folder;
+            descriptor = kitbash::detail::create_memory_file(name);
+            path = "/proc/self/fd/" + std::to_string(descriptor);
+            kitbash::detail::FileWriter out(descriptor, name);
+#else
+            path = (folder / (name + ".obj")).string();
+            kitbash::detail::FileWriter out(path);
+#endif
+            kitbash::detail::write_synthetic_obj(out, vertices, seed);
+            out.close();
+            bytes = out.bytes_written();
+        }
+
+        ~BenchFile() {
+            if (descriptor >= 0) {
+                kitbash::detail::close_descriptor(descriptor);
+            } else if (!path.empty()) {
+                std::error_code ec;
+                fs::remove(path, ec);
+            }
+        }
+
+        BenchFile(const BenchFile&) = delete;
+        BenchFile& operator=(const BenchFile&) = delete;
+    };
+
+    // One full merge; the output goes to a memory file (Linux) or a temporary file
+    uint64_t run_merge(const BenchFile& base, const BenchFile& addition, const fs::path& folder, size_t job) {
+#ifdef __linux__
+        (void)folder;
+        (void)job;
+        int descriptor = kitbash::detail::create_memory_file("kitbash-bench-output");
+        try {
+            kitbash::detail::MergeJob merge(base.path, addition.path, "<memory>");
+            merge.write_to_descriptor(descriptor);
+            while (!merge.run_chunk()) {
+            }
+            kitbash::detail::close_descriptor(descriptor);
+            return merge.output_bytes();
+        } catch (...) {
+            kitbash::detail::close_descriptor(descriptor);
+            throw;
+        }
+#else
+        std::string output = (folder / ("output-" + std::to_string(job) + ".obj")).string();
+        kitbash::detail::MergeJob merge(base.path, addition.path, output);
+        while (!merge.run_chunk()) {
+        }
+        uint64_t bytes = merge.output_bytes();
+        std::error_code ec;
+        fs::remove(output, ec);
+        return bytes;
+#endif
+    }
+
+    // Start a new peak-memory window where the OS allows it (Linux)
+    void reset_peak_memory() {
+#ifdef __linux__
+        std::ofstream clear_refs("/proc/self/clear_refs");
+        clear_refs << "5";
+#endif
+    }
+
+    // Peak resident set since reset_peak_memory(), or since start where it cannot be reset
+    uint64_t peak_memory() {
+#ifdef __linux__
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0) {
+                return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+            }
+        }
+        return 0;
+#elif defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return counters.PeakWorkingSetSize;
+        }
+        return 0;
+#else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return static_cast<uint64_t>(usage.ru_maxrss);          // Bytes
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024;   // Kilobytes
+#endif
+#endif
+    }
+}
+
+namespace kitbash {
+namespace detail {
+    // Footer blocks look like a panel of switches: an animated transform, a
+    // manipulator and the block's triangles
+    void write_synthetic_obj(FileWriter& out, uint64_t vertices, uint64_t seed) {
+        uint64_t indices = vertices - vertices % 3;
+        char line[160];
+        out.write_line("I");
+        out.write_line("800");
+        out.write_line("OBJ");
+        out.write_line("");
+        out.write_line("TEXTURE\tbench.png");
+        std::snprintf(line, sizeof(line), "POINT_COUNTS\t%llu\t0\t0\t%llu", static_cast<unsigned long long>(vertices),
+                      static_cast<unsigned long long>(indices));
+        out.write_line(line);
+        out.write_line("");
+
+        uint64_t state = seed * 2654435761u + 1;
+        auto next = [&state]() {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            return static_cast<double>(state >> 11) / static_cast<double>(1ull << 53);
+        };
+        for (uint64_t i = 0; i < vertices; ++i) {
+            std::snprintf(line, sizeof(line), "VT\t%.8f\t%.8f\t%.8f\t0\t1\t0\t%.8f\t%.8f", next() * 4.0 - 2.0,
+                          next() * 2.0, next() * 8.0 - 4.0, next(), next());
+            out.write_line(line);
+        }
+        out.write_line("");
+
+        std::string idx;
+        uint64_t i = 0;
+        for (; i + 10 <= indices; i += 10) {
+            idx = "IDX10";
+            for (uint64_t j = i; j < i + 10; ++j) {
+                idx += '\t';
+                idx += std::to_string(j);
+            }
+            out.write_line(idx);
+        }
+        for (; i < indices; ++i) {
+            out.write_line("IDX\t" + std::to_string(i));
+        }
+        out.write_line("");
+
+        const uint64_t block = 64 * 3;
+        for (uint64_t offset = 0; offset < indices; offset += block) {
+            uint64_t count = std::min(block, indices - offset);
+            out.write_line("ANIM_begin");
+            std::snprintf(line, sizeof(line), "\tANIM_trans_begin\tsim/bench/switch[%llu]",
+                          static_cast<unsigned long long>(offset / block % 512));
+            out.write_line(line);
+            out.write_line("\t\tANIM_trans_key\t0\t0\t0\t0");
+            out.write_line("\t\tANIM_trans_key\t1\t0\t0.01\t0");
+            out.write_line("\tANIM_trans_end");
+            out.write_line("\tATTR_manip_command\thand\tsim/bench/press\tPress");
+            std::snprintf(line, sizeof(line), "\tTRIS\t%llu\t%llu", static_cast<unsigned long long>(offset),
+                          static_cast<unsigned long long>(count));
+            out.write_line(line);
+            out.write_line("ANIM_end");
+        }
+    }
+}
+
+    std::vector<size_t> default_thread_counts(size_t max_threads) {
+        if (max_threads == 0) {
+            max_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+        std::vector<size_t> counts;
+        for (size_t threads = 1; threads < max_threads; threads *= 2) {
+            counts.push_back(threads);
+        }
+        counts.push_back(max_threads);
+        return counts;
+    }
+
+    std::vector<BenchmarkPoint> run_benchmark(const BenchmarkOptions& options) {
+        std::vector<size_t> thread_counts = options.thread_counts.empty() ? default_thread_counts(0)
+                                                                          : options.thread_counts;
+        size_t max_threads = *std::max_element(thread_counts.begin(), thread_counts.end());
+        size_t jobs = options.merges > 0 ? options.merges : max_threads;
+        int runs = std::max(1, options.runs);
+
+        fs::path folder;
+#ifndef __linux__
+        folder = fs::temp_directory_path() / ("kitbash-bench-" + std::to_string(
+            std::chrono::steady_clock::now().time_since_epoch().count()));
+        fs::create_directories(folder);
+#endif
+
+        std::vector<BenchmarkPoint> points;
+        for (uint64_t vertices : options.sizes) {
+            BenchFile base(folder, "kitbash-bench-base", vertices, 1);
+            BenchFile addition(folder, "kitbash-bench-addition",
+                               std::max<uint64_t>(3, vertices / options.addition_ratio), 2);
+            double single_thread = 0.0;
+            for (size_t threads : thread_counts) {
+                if (threads == 0) {
+                    continue;
+                }
+                BenchmarkPoint point;
+                point.vertices = vertices;
+                point.threads = threads;
+                point.merges = jobs;
+                point.input_bytes = (base.bytes + addition.bytes) * jobs;
+                reset_peak_memory();
+                // One extra run first to warm the page cache and the allocator
+                for (int run = 0; run <= runs; ++run) {
+                    std::atomic<size_t> next(0);
+                    std::atomic<uint64_t> output_bytes(0);
+                    std::exception_ptr failure;
+                    std::atomic<bool> failed(false);
+                    auto worker = [&] {
+                        for (size_t job = next++; job < jobs && !failed; job = next++) {
+                            try {
+                                output_bytes += run_merge(base, addition, folder, job);
+                            } catch (...) {
+                                if (!failed.exchange(true)) {
+                                    failure = std::current_exception();
+                                }
+                            }
+                        }
+                    };
+                    auto start = std::chrono::steady_clock::now();
+                    std::vector<std::thread> workers;
+                    for (size_t i = 1; i < threads; ++i) {
+                        workers.emplace_back(worker);
+                    }
+                    worker();
+                    for (auto& thread : workers) {
+                        thread.join();
+                    }
+                    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    if (failure) {
+                        std::rethrow_exception(failure);
+                    }
+                    if (run > 0) {
+                        point.samples.push_back(seconds);
+                    }
+                    point.output_bytes = output_bytes;
+                }
+                point.peak_memory = peak_memory();
+
+                std::vector<double> sorted = point.samples;
+                std::sort(sorted.begin(), sorted.end());
+                size_t mid = sorted.size() / 2;
+                point.seconds = sorted.size() % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2.0;
+                point.mb_per_second = point.seconds > 0 ? point.input_bytes / point.seconds / (1024.0 * 1024.0) : 0.0;
+                if (single_thread == 0.0) {
+                    single_thread = point.seconds * threads;   // Relative to the first thread count
+                }
+                point.speedup = point.seconds > 0 ? single_thread / point.seconds : 0.0;
+                point.efficiency = point.speedup / threads;
+                points.push_back(point);
+                if (options.on_point) {
+                    options.on_point(point);
+                }
+            }
+        }
+
+        if (!folder.empty()) {
+            std::error_code ec;
+            fs::remove_all(folder, ec);
+        }
+        return points;
+    }
+}
@@ -0,0 +1,480 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+
+// Merges under a memory budget. Both inputs are read once, front to back, in blocks
+// of whole lines, and each block is classified with scan_layout() on its own. The
+// header and the vertices are final as soon as they are read. The base indices,
+// the rebased addition indices and both footers come later in the output, so they
+// wait in spill sections until the inputs have been read.
+
+// Internal helper functions
+namespace {
+    namespace fs = std::filesystem;
+    using namespace kitbash::detail;
+
+    constexpr uint64_t min_memory = 16ull << 20;
+    constexpr size_t section_block = 256 << 10;     // Spill section allocation unit
+    constexpr size_t writer_buffer = 1 << 20;       // FileWriter's gather buffer
+
+    // Whole lines of a file, a block at a time. A last line without a newline gets
+    // one, as in merge_objects(). The buffer grows for lines longer than a block.
+    class LineReader {
+    public:
+        LineReader(const std::string& filename, size_t block, size_t max_line)
+            : name_(filename), file_(filename), buffer_(block), max_line_(max_line) {}
+
+        // Next block of complete lines; false at end of file
+        bool next(std::string_view& lines) {
+            size_t rest = end_ - begin_;
+            std::memmove(buffer_.data(), buffer_.data() + begin_, rest);
+            begin_ = 0;
+            end_ = rest;
+            for (;;) {
+                if (!eof_) {
+                    end_ += file_.read(buffer_.data() + end_, buffer_.size() - end_);
+                    eof_ = end_ < buffer_.size();
+                }
+                if (end_ == 0) {
+                    return false;
+                }
+                if (eof_) {
+                    if (buffer_[end_ - 1] != '\n') {
+                        if (end_ == buffer_.size()) {
+                            buffer_.resize(end_ + 1);
+                        }
+                        buffer_[end_++] = '\n';
+                    }
+                    begin_ = end_;
+                    lines = std::string_view(buffer_.data(), end_);
+                    return true;
+                }
+                size_t last = std::string_view(buffer_.data(), end_).rfind('\n');
+                if (last != std::string_view::npos) {
+                    begin_ = last + 1;
+                    lines = std::string_view(buffer_.data(), begin_);
+                    return true;
+                }
+                if (buffer_.size() >= max_line_) {
+                    throw std::runtime_error("Line too long for the memory budget: " + name_);
+                }
+                buffer_.resize(std::min(buffer_.size() * 2, max_line_));
+            }
+        }
+
+    private:
+        std::string name_;
+        FileReader file_;
+        std::vector<char> buffer_;
+        size_t max_line_;
+        size_t begin_ = 0;      // Unreturned bytes are [begin_, end_)
+        size_t end_ = 0;
+        bool eof_ = false;
+    };
+
+    class SpillSection;
+
+    // Memory the spill sections share. When a section needs a block the pool cannot
+    // give, the section holding the most goes to disk first.
+    struct SpillPool {
+        uint64_t limit = 0;
+        uint64_t used = 0;
+        uint64_t peak = 0;
+        std::vector<SpillSection*> sections;
+
+        bool acquire(SpillSection& requester);
+    };
+
+    // Output text that is written after everything has been read. Held in memory in
+    // fixed-size blocks until the pool runs out, then in a temporary file.
+    class SpillSection {
+    public:
+        SpillSection(SpillPool& pool, std::string path) : pool_(pool), path_(std::move(path)) {
+            pool_.sections.push_back(this);
+        }
+        ~SpillSection() {
+            discard();
+        }
+
+        SpillSection(const SpillSection&) = delete;
+        SpillSection& operator=(const SpillSection&) = delete;
+
+        void append(std::string_view bytes) {
+            while (!bytes.empty()) {
+                if (!file_ && (blocks_.empty() || blocks_.back().size() == section_block)) {
+                    if (pool_.acquire(*this)) {
+                        blocks_.emplace_back();
+                        blocks_.back().reserve(section_block);
+                    } else {
+                        spill();
+                    }
+                }
+                if (file_) {
+                    file_->write(bytes);
+                    spilled_bytes_ += bytes.size();
+                    return;
+                }
+                size_t length = std::min(bytes.size(), section_block - blocks_.back().size());
+                blocks_.back().append(bytes.data(), length);
+                bytes.remove_prefix(length);
+            }
+        }
+
+        void spill() {
+            if (file_) {
+                return;
+            }
+            file_ = std::make_unique<FileWriter>(path_);
+            spilled_ = true;
+            for (const auto& block : blocks_) {
+                file_->write(block);
+                spilled_bytes_ += block.size();
+            }
+            release();
+        }
+
+        // Write everything to out, then free the memory and the file
+        void replay(FileWriter& out, std::vector<char>& scratch) {
+            if (file_) {
+                file_->close();
+                file_.reset();
+                FileReader in(path_);
+                while (size_t count = in.read(scratch.data(), scratch.size())) {
+                    out.write(std::string_view(scratch.data(), count));
+                }
+            } else {
+                for (const auto& block : blocks_) {
+                    out.write(block);
+                }
+            }
+            discard();
+        }
+
+        uint64_t held() const { return blocks_.size() * section_block; }
+        bool spilled() const { return spilled_; }
+        uint64_t spilled_bytes() const { return spilled_bytes_; }
+
+    private:
+        void release() {
+            pool_.used -= held();
+            blocks_.clear();
+            blocks_.shrink_to_fit();
+        }
+
+        void discard() {
+            release();
+            if (spilled_) {
+                file_.reset();  // Closes the file without reporting errors
+                std::error_code ec;
+                fs::remove(path_, ec);
+            }
+        }
+
+        SpillPool& pool_;
+        std::string path_;
+        std::vector<std::string> blocks_;
+        std::unique_ptr<FileWriter> file_;
+        bool spilled_ = false;
+        uint64_t spilled_bytes_ = 0;
+    };
+
+    bool SpillPool::acquire(SpillSection& requester) {
+        while (used + section_block > limit) {
+            SpillSection* largest = nullptr;
+            for (SpillSection* section : sections) {
+                if (section->held() > 0 && (!largest || section->held() > largest->held())) {
+                    largest = section;
+                }
+            }
+            if (!largest || largest == &requester) {
+                return false;   // The requester goes to disk itself
+            }
+            largest->spill();
+        }
+        used += section_block;
+        peak = std::max(peak, used);
+        return true;
+    }
+
+    // A file's header up to its first POINT_COUNTS line
+    struct Head {
+        bool has_point_counts = false;
+        std::string point_counts;
+        int vt_count = 0;
+        int tris_count = 0;
+        uint64_t header_lines = 0;
+    };
+
+    // Forget the spans of the previous block; counters and scan state carry on
+    void start_block(ObjLayout& layout) {
+        layout.header.clear();
+        layout.vertices.clear();
+        layout.indices.clear();
+        layout.footer.clear();
+        layout.scan_pos = 0;
+    }
+
+    // Read a file up to its first POINT_COUNTS line, normally within the first block.
+    // The output's POINT_COUNTS line needs both counts before any vertex is written.
+    Head read_head(const std::string& filename, size_t block, size_t max_line) {
+        LineReader reader(filename, block, max_line);
+        ObjLayout layout;
+        Head head;
+        std::string_view lines;
+        bool first = true;
+        while (reader.next(lines)) {
+            if (first && !validate_obj_header(lines)) {
+                break;
+            }
+            first = false;
+            start_block(layout);
+            scan_layout(lines, layout, SIZE_MAX);
+            if (layout.has_point_counts) {
+                head.point_counts = std::string(layout.point_counts);
+                break;
+            }
+        }
+        if (first) {
+            throw std::runtime_error("Invalid OBJ8 format");
+        }
+        head.has_point_counts = layout.has_point_counts;
+        head.vt_count = layout.vt_count;
+        head.tris_count = layout.tris_count;
+        head.header_lines = layout.header_lines;
+        return head;
+    }
+
+    // Only the first POINT_COUNTS line is written; later ones must agree with it
+    void check_counts(const ObjLayout& layout, const Head& head, const std::string& filename) {
+        if (layout.vt_count != head.vt_count || layout.tris_count != head.tris_count) {
+            throw std::runtime_error("POINT_COUNTS changes part way through " + filename +
+                                     "; merge it without a memory budget");
+        }
+    }
+
+    void write_spans(FileWriter& out, std::string_view lines, const std::vector<Span>& spans) {
+        for (const auto& span : spans) {
+            out.write(lines.substr(span.begin, span.end - span.begin));
+        }
+    }
+
+    void append_spans(SpillSection& section, std::string_view lines, const std::vector<Span>& spans) {
+        for (const auto& span : spans) {
+            section.append(lines.substr(span.begin, span.end - span.begin));
+        }
+    }
+
+    void check_vertices(kitbash::detail::GeometryScanner* scanner, std::string_view lines,
+                        const std::vector<Span>& spans, uint64_t& line) {
+        if (!scanner) {
+            return;
+        }
+        for (const auto& span : spans) {
+            size_t pos = 0;
+            scan_vertex_lines(*scanner, lines.substr(span.begin, span.end - span.begin), pos, line, SIZE_MAX);
+        }
+    }
+
+    // Addition IDX lines (footer == false) or footer lines, rebased by offset: the
+    // block is compiled and rendered at once, so nothing is kept between blocks
+    void append_rebased(SpillSection& section, std::string_view lines, const std::vector<Span>& spans,
+                        bool footer, long long offset, CompiledBuilder& builder, std::string& rendered) {
+        if (spans.empty()) {
+            return;
+        }
+        std::string& literals = footer ? builder.footer_literals : builder.index_literals;
+        std::vector<Relocation>& relocs = footer ? builder.footer_relocs : builder.index_relocs;
+        literals.clear();
+        relocs.clear();
+        Cursor cursor;
+        compile_spans(lines, spans, footer, builder, cursor, SIZE_MAX);
+        CompiledSection compiled{literals, relocs.data(), relocs.size()};
+        rendered.clear();
+        cursor = Cursor();
+        render_section(rendered, compiled, offset, cursor, SIZE_MAX);
+        section.append(rendered);
+    }
+
+    // Removes the temporary output unless the merge committed it
+    struct TempOutput {
+        std::string path;
+        bool committed = false;
+        ~TempOutput() {
+            if (!committed) {
+                std::error_code ec;
+                fs::remove(path, ec);
+            }
+        }
+    };
+}
+
+namespace kitbash {
+    BoundedMergeResult merge_to_file_bounded(const std::string& base, const std::string& addition,
+                                             const std::string& output, const BoundedMergeOptions& options,
+                                             MergeStats* stats) {
+        auto start_time = std::chrono::steady_clock::now();
+        if (options.max_memory < min_memory) {
+            throw std::runtime_error("Memory budget must be at least 16 MB");
+        }
+        if (options.geometry.repair_normals) {
+            throw std::runtime_error("Normal repair is not available under a memory budget");
+        }
+        if (CompiledAddition::is_compiled_file(addition)) {
+            throw std::runtime_error("Compiled additions are not available under a memory budget");
+        }
+
+        // Outside the spill pool: the input block, the compiled and rendered addition
+        // block, the replay buffer, and the output and spill writers' buffers
+        size_t block = static_cast<size_t>(std::clamp<uint64_t>(options.max_memory / 32, 64 << 10, 4 << 20));
+        uint64_t fixed = 6 * static_cast<uint64_t>(block) + 6 * writer_buffer;
+        size_t max_line = static_cast<size_t>(std::min<uint64_t>(options.max_memory / 8, SIZE_MAX));
+        SpillPool pool;
+        pool.limit = options.max_memory - fixed;
+
+        std::string output_name = output.empty() ? base : output;
+        TempOutput temp{temp_path_for(output_name)};
+        // Spill files share the temporary output's unique name
+        fs::path spill_prefix = options.temp_dir.empty()
+            ? fs::path(temp.path)
+            : fs::path(options.temp_dir) / fs::path(temp.path).filename();
+        auto spill_path = [&](const char* suffix) { return spill_prefix.string() + suffix; };
+
+        Head base_head = read_head(base, block, max_line);
+        Head addition_head = read_head(addition, block, max_line);
+
+        MergeStats result_stats;
+        result_stats.base_filename = base;
+        result_stats.addition_filename = addition;
+        result_stats.output_filename = output_name;
+        result_stats.original_vt_count = base_head.vt_count;
+        result_stats.original_tris_count = base_head.tris_count;
+        result_stats.added_vt_count = addition_head.vt_count;
+        result_stats.added_tris_count = addition_head.tris_count;
+        result_stats.final_vt_count = base_head.vt_count + addition_head.vt_count;
+        result_stats.final_tris_count = base_head.tris_count + addition_head.tris_count;
+
+        // POINT_COUNTS with combined totals (dropped if malformed)
+        std::string point_counts;
+        std::string_view tokens[5];
+        if (base_head.has_point_counts && split_tokens(base_head.point_counts, tokens, 5) == 5) {
+            point_counts = "POINT_COUNTS ";
+            append_int(point_counts, result_stats.final_vt_count);
+            point_counts.append(" ").append(tokens[2]).append(" ").append(tokens[3]).append(" ");
+            append_int(point_counts, result_stats.final_tris_count);
+            point_counts.push_back('\n');
+        }
+
+        FileWriter out(temp.path);
+        std::vector<char> scratch(block);
+        // Vertices before POINT_COUNTS are written again after it, as merge_objects() does
+        SpillSection early(pool, spill_path(".spill-vt"));
+        SpillSection base_indices(pool, spill_path(".spill-idx"));
+        SpillSection addition_indices(pool, spill_path(".spill-add-idx"));
+        SpillSection base_footer(pool, spill_path(".spill-footer"));
+        SpillSection addition_footer(pool, spill_path(".spill-add-footer"));
+
+        std::unique_ptr<detail::GeometryScanner> scanner;
+        if (options.geometry.check) {
+            scanner = std::make_unique<detail::GeometryScanner>(options.geometry);
+        }
+        // Output line of the first vertex: the header, then POINT_COUNTS unless it is dropped
+        uint64_t vertex_line = base_head.header_lines + (point_counts.empty() ? 0 : 1) + 1;
+
+        // 1-3. Base header, POINT_COUNTS and base vertices; base indices and footer wait
+        ObjLayout base_layout;
+        {
+            LineReader reader(base, block, max_line);
+            std::string_view lines;
+            while (reader.next(lines)) {
+                bool had_point_counts = base_layout.has_point_counts;
+                start_block(base_layout);
+                scan_layout(lines, base_layout, SIZE_MAX);
+                write_spans(out, lines, base_layout.header);
+                if (!had_point_counts && base_layout.has_point_counts) {
+                    out.write(point_counts);
+                    early.replay(out, scratch);
+                }
+                if (base_layout.has_point_counts) {
+                    write_spans(out, lines, base_layout.vertices);
+                } else {
+                    append_spans(early, lines, base_layout.vertices);
+                }
+                check_vertices(scanner.get(), lines, base_layout.vertices, vertex_line);
+                append_spans(base_indices, lines, base_layout.indices);
+                append_spans(base_footer, lines, base_layout.footer);
+            }
+            if (!base_layout.has_point_counts) {
+                early.replay(out, scratch);
+            }
+            check_counts(base_layout, base_head, base);
+        }
+
+        // 3. Addition vertices; indices and footer rebased as they are read
+        ObjLayout addition_layout;
+        {
+            LineReader reader(addition, block, max_line);
+            CompiledBuilder builder;
+            std::string rendered;
+            std::string_view lines;
+            while (reader.next(lines)) {
+                start_block(addition_layout);
+                scan_layout(lines, addition_layout, SIZE_MAX);
+                write_spans(out, lines, addition_layout.vertices);
+                check_vertices(scanner.get(), lines, addition_layout.vertices, vertex_line);
+                append_rebased(addition_indices, lines, addition_layout.indices, false,
+                               base_head.vt_count, builder, rendered);
+                append_rebased(addition_footer, lines, addition_layout.footer, true,
+                               base_head.tris_count, builder, rendered);
+            }
+            check_counts(addition_layout, addition_head, addition);
+        }
+
+        BoundedMergeResult result;
+        for (const SpillSection* section : {&early, &base_indices, &addition_indices, &base_footer, &addition_footer}) {
+            result.spilled_bytes += section->spilled_bytes();
+            result.spill_files += section->spilled() ? 1 : 0;
+        }
+        result.peak_buffered_bytes = pool.peak;
+
+        // 4-7. Base indices, addition indices, base footer, attributes, addition footer
+        base_indices.replay(out, scratch);
+        addition_indices.replay(out, scratch);
+        base_footer.replay(out, scratch);
+        out.write("\tATTR_draw_enable\n\tATTR_cockpit\n");
+        addition_footer.replay(out, scratch);
+        out.close();
+
+        if (scanner) {
+            result_stats.geometry = scanner->finish();
+        }
+        if (output.empty()) {
+            // The untouched base becomes the backup
+            result_stats.backup_filename = generate_backup_filename(base);
+            replace_keeping_backup(base, temp.path, result_stats.backup_filename);
+        } else {
+            replace_file(temp.path, output_name);
+        }
+        temp.committed = true;
+
+        result_stats.original_line_count = static_cast<int>(base_layout.line_count);
+        result_stats.added_line_count = static_cast<int>(addition_layout.line_count);
+        result_stats.final_line_count = static_cast<int>(
+            base_layout.header_lines + (point_counts.empty() ? 0 : 1) +
+            base_layout.vertex_lines + addition_layout.vertex_lines +
+            base_layout.index_lines + addition_layout.index_lines +
+            base_layout.footer_lines + 2 + addition_layout.footer_lines);
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_time);
+        result_stats.processing_time = duration.count() / 1000000.0; // Convert to seconds
+        if (stats) {
+            *stats = std::move(result_stats);
+        }
+        return result;
+    }
+}
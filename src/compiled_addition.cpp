@@ -0,0 +1,266 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+// Internal helper functions
+namespace {
+    using kitbash::detail::CompiledSection;
+    using kitbash::detail::Relocation;
+
+    // .kbo layout: KboHeader, then each section 8-byte aligned at the offset the
+    // header records. Integers are stored in the writer's byte order; byte_order
+    // rejects files from a machine with the other one.
+    constexpr char kbo_magic[8] = {'K', 'I', 'T', 'B', 'A', 'S', 'H', 'O'};
+    constexpr uint32_t kbo_version = 1;
+    constexpr uint32_t kbo_byte_order = 0x01020304;
+
+    struct KboSection {
+        uint64_t offset;
+        uint64_t size;      // In bytes
+    };
+
+    struct KboHeader {
+        char magic[8];
+        uint32_t byte_order;
+        uint32_t version;
+        int32_t vt_count;
+        int32_t tris_count;
+        uint64_t line_count;
+        uint64_t vertex_lines;
+        uint64_t index_lines;
+        uint64_t footer_lines;
+        KboSection source;
+        KboSection vertices;
+        KboSection index_literals;
+        KboSection index_relocs;
+        KboSection footer_literals;
+        KboSection footer_relocs;
+    };
+
+    static_assert(sizeof(Relocation) == 8, "Relocation entries are stored as 8 bytes");
+
+    uint64_t span_bytes(const std::vector<kitbash::detail::Span>& spans) {
+        uint64_t total = 0;
+        for (const auto& span : spans) {
+            total += span.end - span.begin;
+        }
+        return total;
+    }
+
+    size_t aligned(size_t size) {
+        return (size + 7) & ~static_cast<size_t>(7);
+    }
+
+    std::string_view section_bytes(std::string_view image, const KboSection& section,
+                                   const std::string& filename) {
+        if (section.offset > image.size() || section.size > image.size() - section.offset) {
+            throw std::runtime_error("Invalid compiled addition: " + filename);
+        }
+        return image.substr(static_cast<size_t>(section.offset), static_cast<size_t>(section.size));
+    }
+
+    CompiledSection section_of(std::string_view image, const KboSection& literals,
+                               const KboSection& relocs, const std::string& filename) {
+        CompiledSection section;
+        section.literals = section_bytes(image, literals, filename);
+        std::string_view bytes = section_bytes(image, relocs, filename);
+        if (bytes.size() % sizeof(Relocation) != 0 ||
+            reinterpret_cast<uintptr_t>(bytes.data()) % alignof(Relocation) != 0) {
+            throw std::runtime_error("Invalid compiled addition: " + filename);
+        }
+        section.relocs = reinterpret_cast<const Relocation*>(bytes.data());
+        section.reloc_count = bytes.size() / sizeof(Relocation);
+
+        // Relocation sites must stay inside the literals or rendering would overrun
+        uint64_t literal_bytes = 0;
+        for (size_t i = 0; i < section.reloc_count; ++i) {
+            literal_bytes += section.relocs[i].literal;
+        }
+        if (literal_bytes > section.literals.size()) {
+            throw std::runtime_error("Invalid compiled addition: " + filename);
+        }
+        return section;
+    }
+}
+
+namespace kitbash {
+namespace detail {
+    std::shared_ptr<const CompiledAddition::Data> read_compiled_image(std::string_view image,
+                                                                      std::shared_ptr<const void> storage,
+                                                                      const std::string& name) {
+        KboHeader header;
+        if (image.size() < sizeof(header)) {
+            throw std::runtime_error("Invalid compiled addition: " + name);
+        }
+        std::memcpy(&header, image.data(), sizeof(header));
+        if (std::memcmp(header.magic, kbo_magic, sizeof(kbo_magic)) != 0) {
+            throw std::runtime_error("Invalid compiled addition: " + name);
+        }
+        if (header.byte_order != kbo_byte_order || header.version != kbo_version) {
+            throw std::runtime_error("Incompatible compiled addition: " + name);
+        }
+
+        // Zero-copy: the sections are views into the image, which the data keeps alive
+        auto data = std::make_shared<CompiledAddition::Data>();
+        data->source = std::string(section_bytes(image, header.source, name));
+        data->vt_count = header.vt_count;
+        data->tris_count = header.tris_count;
+        data->line_count = header.line_count;
+        data->vertex_lines = header.vertex_lines;
+        data->index_lines = header.index_lines;
+        data->footer_lines = header.footer_lines;
+        data->vertices = section_bytes(image, header.vertices, name);
+        data->indices = section_of(image, header.index_literals, header.index_relocs, name);
+        data->footer = section_of(image, header.footer_literals, header.footer_relocs, name);
+        data->storage = std::move(storage);
+        return data;
+    }
+
+    uint64_t write_compiled_image(const CompiledAddition::Data& data,
+                                  const std::function<void(std::string_view)>& write) {
+        std::string_view sections[] = {
+            data.source,
+            data.vertices,
+            data.indices.literals,
+            std::string_view(reinterpret_cast<const char*>(data.indices.relocs),
+                             data.indices.reloc_count * sizeof(Relocation)),
+            data.footer.literals,
+            std::string_view(reinterpret_cast<const char*>(data.footer.relocs),
+                             data.footer.reloc_count * sizeof(Relocation)),
+        };
+
+        KboHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, kbo_magic, sizeof(kbo_magic));
+        header.byte_order = kbo_byte_order;
+        header.version = kbo_version;
+        header.vt_count = data.vt_count;
+        header.tris_count = data.tris_count;
+        header.line_count = data.line_count;
+        header.vertex_lines = data.vertex_lines;
+        header.index_lines = data.index_lines;
+        header.footer_lines = data.footer_lines;
+        KboSection* entries[] = {
+            &header.source, &header.vertices, &header.index_literals,
+            &header.index_relocs, &header.footer_literals, &header.footer_relocs,
+        };
+        uint64_t offset = aligned(sizeof(header));
+        for (size_t i = 0; i < 6; ++i) {
+            *entries[i] = KboSection{offset, sections[i].size()};
+            offset += aligned(sections[i].size());
+        }
+
+        static const char padding[8] = {};
+        write(std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)));
+        write(std::string_view(padding, aligned(sizeof(header)) - sizeof(header)));
+        for (const auto& section : sections) {
+            write(section);
+            write(std::string_view(padding, aligned(section.size()) - section.size()));
+        }
+        return offset;
+    }
+}
+
+    CompiledAddition::CompiledAddition() = default;
+
+    CompiledAddition CompiledAddition::compile(const std::string& addition_file) {
+        detail::MappedFile file(addition_file);
+        std::string_view data = file.view();
+        if (!detail::validate_obj_header(data)) {
+            throw std::runtime_error("Invalid OBJ8 format");
+        }
+        detail::ObjLayout layout;
+        detail::scan_layout(data, layout, data.size());
+
+        auto builder = std::make_shared<detail::CompiledBuilder>();
+        builder->reserve(span_bytes(layout.indices), span_bytes(layout.footer));
+        for (const auto& span : layout.vertices) {
+            builder->vertices.append(data.data() + span.begin, span.end - span.begin);
+        }
+        if (!builder->vertices.empty() && builder->vertices.back() != '\n') {
+            builder->vertices.push_back('\n');
+        }
+        detail::Cursor cursor;
+        detail::compile_spans(data, layout.indices, false, *builder, cursor, data.size());
+        cursor = detail::Cursor();
+        detail::compile_spans(data, layout.footer, true, *builder, cursor, data.size());
+
+        return detail::CompiledAccess::wrap(detail::finish_compiled(std::move(builder), layout, addition_file));
+    }
+
+    CompiledAddition CompiledAddition::load(const std::string& kbo_file) {
+        auto file = std::make_shared<detail::MappedFile>(kbo_file);
+        std::string_view image = file->view();
+        return detail::CompiledAccess::wrap(detail::read_compiled_image(image, std::move(file), kbo_file));
+    }
+
+    void CompiledAddition::save(const std::string& kbo_file) const {
+        if (!data_) {
+            throw std::runtime_error("Compiled addition is empty");
+        }
+
+        // Write beside the target and rename, so a mapped .kbo is never truncated
+        std::string temp_name = detail::temp_path_for(kbo_file);
+        try {
+            detail::FileWriter writer(temp_name);
+            detail::write_compiled_image(*data_, [&writer](std::string_view bytes) { writer.write(bytes); });
+            writer.close();
+            std::filesystem::rename(temp_name, kbo_file);
+        } catch (...) {
+            std::error_code ec;
+            std::filesystem::remove(temp_name, ec);
+            throw;
+        }
+    }
+
+    bool CompiledAddition::is_compiled_file(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        char magic[sizeof(kbo_magic)];
+        return file.read(magic, sizeof(magic)) && std::memcmp(magic, kbo_magic, sizeof(magic)) == 0;
+    }
+
+    bool CompiledAddition::empty() const {
+        return !data_;
+    }
+
+    const std::string& CompiledAddition::source() const {
+        static const std::string none;
+        return data_ ? data_->source : none;
+    }
+
+    int CompiledAddition::vt_count() const {
+        return data_ ? data_->vt_count : 0;
+    }
+
+    int CompiledAddition::tris_count() const {
+        return data_ ? data_->tris_count : 0;
+    }
+
+    size_t CompiledAddition::line_count() const {
+        return data_ ? static_cast<size_t>(data_->line_count) : 0;
+    }
+
+    size_t CompiledAddition::relocation_count() const {
+        return data_ ? data_->indices.reloc_count + data_->footer.reloc_count : 0;
+    }
+
+    bool merge_compiled_to_file(const std::string& base, const CompiledAddition& addition,
+                                const std::string& output, MergeStats* stats,
+                                const GeometryOptions& geometry) {
+        try {
+            detail::MergeJob job(base, addition, output);
+            job.set_geometry_options(geometry);
+            while (!job.run_chunk()) {
+            }
+            if (stats) {
+                *stats = job.stats();
+            }
+            return true;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+}
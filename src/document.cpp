@@ -0,0 +1,348 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <fstream>
+#include <algorithm>
+#include <unordered_set>
+#include <stdexcept>
+#include <cctype>
+
+// Internal helper functions
+namespace {
+    using LineVector = std::vector<std::string>;
+    using LineChunk = std::shared_ptr<LineVector>;  // Never modified while shared
+
+    bool is_index_type(const std::string& type) {
+        return type == "IDX" || type == "IDX10";
+    }
+
+    // Cheap first-token check (same whitespace set as tokenize) used to skip
+    // untouched lines without building a token vector
+    bool first_token_is(const std::string& line, const char* word) {
+        size_t pos = line.find_first_not_of(" \t\n\v\f\r");
+        if (pos == std::string::npos) {
+            return false;
+        }
+        size_t len = std::char_traits<char>::length(word);
+        if (line.compare(pos, len, word) != 0) {
+            return false;
+        }
+        return pos + len == line.size() || std::isspace(static_cast<unsigned char>(line[pos + len]));
+    }
+
+    bool mentions_point_counts(const kitbash::Document& doc, kitbash::Document::Section section) {
+        for (size_t i = 0; i < doc.line_count(section); ++i) {
+            if (doc.line(section, i).find("POINT_COUNTS") != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+namespace kitbash {
+    // Ordered list of chunks with running line offsets for O(log n) lookup
+    struct Document::Chunks {
+        std::vector<LineChunk> chunks;
+        std::vector<size_t> starts;     // First line index of each chunk
+        size_t size = 0;
+
+        void append_chunk(const LineChunk& chunk) {
+            if (chunk->empty()) {
+                return;
+            }
+            starts.push_back(size);
+            size += chunk->size();
+            chunks.push_back(chunk);
+        }
+
+        void push_back(const std::string& content) {
+            // Start a new chunk if the last one is full or shared with another document
+            if (chunks.empty() || chunks.back().use_count() > 1 || chunks.back()->size() >= chunk_lines) {
+                starts.push_back(size);
+                chunks.push_back(std::make_shared<LineVector>());
+            }
+            chunks.back()->push_back(content);
+            ++size;
+        }
+
+        size_t find(size_t index) const {
+            if (index >= size) {
+                throw std::out_of_range("Document line index out of range");
+            }
+            auto it = std::upper_bound(starts.begin(), starts.end(), index);
+            return static_cast<size_t>(it - starts.begin()) - 1;
+        }
+
+        const std::string& at(size_t index) const {
+            size_t chunk = find(index);
+            return (*chunks[chunk])[index - starts[chunk]];
+        }
+
+        std::string& mutable_at(size_t index) {
+            size_t chunk = find(index);
+            // Copy-on-write: only the touched chunk is duplicated
+            if (chunks[chunk].use_count() > 1) {
+                chunks[chunk] = std::make_shared<LineVector>(*chunks[chunk]);
+            }
+            return (*chunks[chunk])[index - starts[chunk]];
+        }
+    };
+
+    struct Document::Body {
+        std::vector<std::string> header;    // Lines up to and including POINT_COUNTS
+        bool has_point_counts = false;      // Last header line is POINT_COUNTS
+        int vt_count = 0;
+        int tris_count = 0;
+        Chunks vertices;
+        Chunks indices;
+        Chunks footer;
+
+        Chunks& section(Section s) {
+            return s == Section::Vertices ? vertices : s == Section::Indices ? indices : footer;
+        }
+        const Chunks& section(Section s) const {
+            return s == Section::Vertices ? vertices : s == Section::Indices ? indices : footer;
+        }
+    };
+
+    Document::Document() : body_(std::make_shared<Body>()) {}
+
+    Document Document::parse(const ObjInfo& info) {
+        // Split lines into the same sections merge_objects() reads from
+        Document doc;
+        Body& body = *doc.body_;
+        body.vt_count = info.vt_count;
+        body.tris_count = info.tris_count;
+
+        bool in_header = true;
+        bool past_idx = false;
+        for (const auto& line : info.lines) {
+            if (in_header) {
+                body.header.push_back(line.content);
+                if (line.content.find("POINT_COUNTS") != std::string::npos) {
+                    body.has_point_counts = true;
+                    in_header = false;
+                }
+            }
+
+            if (line.type == "VT") {
+                body.vertices.push_back(line.content);
+            } else if (is_index_type(line.type)) {
+                body.indices.push_back(line.content);
+                past_idx = true;
+            }
+
+            if (past_idx && !is_index_type(line.type)) {
+                body.footer.push_back(line.content);
+            }
+        }
+
+        return doc;
+    }
+
+    Document Document::load(const std::string& filename) {
+        return parse(kitbash::parse_obj(kitbash::read_file(filename)));
+    }
+
+    int Document::vt_count() const {
+        return body_->vt_count;
+    }
+
+    int Document::tris_count() const {
+        return body_->tris_count;
+    }
+
+    size_t Document::line_count(Section section) const {
+        if (section == Section::Header) {
+            return body_->header.size();
+        }
+        return body_->section(section).size;
+    }
+
+    size_t Document::total_line_count() const {
+        return body_->header.size() + body_->vertices.size + body_->indices.size + body_->footer.size;
+    }
+
+    const std::string& Document::line(Section section, size_t index) const {
+        if (section == Section::Header) {
+            return body_->header.at(index);
+        }
+        return body_->section(section).at(index);
+    }
+
+    void Document::set_line(Section section, size_t index, const std::string& content) {
+        Body& body = mutable_body();
+        if (section == Section::Header) {
+            body.header.at(index) = content;
+        } else {
+            body.section(section).mutable_at(index) = content;
+        }
+    }
+
+    void Document::append_line(Section section, const std::string& content) {
+        Body& body = mutable_body();
+        if (section == Section::Header) {
+            body.header.push_back(content);
+        } else {
+            body.section(section).push_back(content);
+        }
+    }
+
+    void Document::merge(const Document& addition) {
+        // Hold the addition body so merging a document into itself stays valid
+        std::shared_ptr<const Body> add = addition.body_;
+        Body& body = mutable_body();
+        int vt_offset = body.vt_count;
+        int tris_offset = body.tris_count;
+
+        // Update POINT_COUNTS with combined totals (dropped if malformed, as in merge_objects)
+        body.vt_count += add->vt_count;
+        body.tris_count += add->tris_count;
+        if (body.has_point_counts) {
+            auto tokens = kitbash::tokenize(body.header.back());
+            if (tokens.size() >= 5) {
+                body.header.back() = "POINT_COUNTS " + std::to_string(body.vt_count) +
+                                     " " + tokens[2] + " " + tokens[3] + " " + std::to_string(body.tris_count);
+            } else {
+                body.header.pop_back();
+                body.has_point_counts = false;
+            }
+        }
+
+        // Addition vertices are copied verbatim, so their chunks are shared as-is
+        for (const auto& chunk : add->vertices.chunks) {
+            body.vertices.append_chunk(chunk);
+        }
+
+        // Addition indices are rebased (and re-tabbed), so each chunk is rebuilt
+        for (const auto& chunk : add->indices.chunks) {
+            auto adjusted = std::make_shared<LineVector>();
+            adjusted->reserve(chunk->size());
+            for (const auto& line : *chunk) {
+                adjusted->push_back(kitbash::adjust_indices_line(line, vt_offset));
+            }
+            body.indices.append_chunk(adjusted);
+        }
+
+        // Attributes, then addition footer with adjusted TRIS offsets
+        body.footer.push_back("\tATTR_draw_enable");
+        body.footer.push_back("\tATTR_cockpit");
+        for (const auto& chunk : add->footer.chunks) {
+            LineChunk adjusted;
+            for (size_t i = 0; i < chunk->size(); ++i) {
+                const std::string& line = (*chunk)[i];
+                if (!first_token_is(line, "TRIS")) {
+                    continue;
+                }
+                std::string rebased = kitbash::adjust_tris_line(line, tris_offset);
+                if (rebased == line) {
+                    continue;
+                }
+                if (!adjusted) {
+                    adjusted = std::make_shared<LineVector>(*chunk);
+                }
+                (*adjusted)[i] = rebased;
+            }
+            body.footer.append_chunk(adjusted ? adjusted : chunk);
+        }
+    }
+
+    size_t Document::shared_chunk_count(const Document& other) const {
+        std::unordered_set<const LineVector*> theirs;
+        for (const Chunks* chunks : {&other.body_->vertices, &other.body_->indices, &other.body_->footer}) {
+            for (const auto& chunk : chunks->chunks) {
+                theirs.insert(chunk.get());
+            }
+        }
+
+        size_t shared = 0;
+        for (const Chunks* chunks : {&body_->vertices, &body_->indices, &body_->footer}) {
+            for (const auto& chunk : chunks->chunks) {
+                shared += theirs.count(chunk.get());
+            }
+        }
+        return shared;
+    }
+
+    std::vector<std::string> Document::to_lines() const {
+        std::vector<std::string> lines;
+        lines.reserve(total_line_count());
+        lines.insert(lines.end(), body_->header.begin(), body_->header.end());
+        for (const Chunks* chunks : {&body_->vertices, &body_->indices, &body_->footer}) {
+            for (const auto& chunk : chunks->chunks) {
+                lines.insert(lines.end(), chunk->begin(), chunk->end());
+            }
+        }
+        return lines;
+    }
+
+    void Document::write(const std::string& filename) const {
+        // Same output format as write_file(), streamed straight from the chunks
+        std::ofstream file(filename);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot create file: " + filename);
+        }
+
+        for (const auto& line : body_->header) {
+            file << line << "\n";
+        }
+        for (const Chunks* chunks : {&body_->vertices, &body_->indices, &body_->footer}) {
+            for (const auto& chunk : chunks->chunks) {
+                for (const auto& line : *chunk) {
+                    file << line << "\n";
+                }
+            }
+        }
+
+        file.close();
+    }
+
+    Document::Body& Document::mutable_body() {
+        // Detach from snapshots: copies chunk pointers only, never line data
+        if (body_.use_count() > 1) {
+            body_ = std::make_shared<Body>(*body_);
+        }
+        return *body_;
+    }
+}
+
+namespace kitbash {
+namespace detail {
+    Document load_document(const std::string& filename) {
+        auto lines = read_file(filename);
+        if (!validate_obj_format(lines)) {
+            throw std::runtime_error("Invalid OBJ8 format: " + filename);
+        }
+        return Document::parse(parse_obj(lines));
+    }
+
+    // A merged document is handed on as-is only if reading its serialized lines back
+    // would give the same sections, e.g. no VT lines after the indices and a kept
+    // POINT_COUNTS line. Otherwise it is re-parsed from its lines, so a chain of
+    // in-memory merges matches a chain of kitbash runs byte for byte.
+    Document as_reloaded(const Document& doc) {
+        using Section = Document::Section;
+        size_t header_lines = doc.line_count(Section::Header);
+        // Without indices there is no footer on re-reading
+        bool same = header_lines > 0 &&
+                    (doc.line_count(Section::Indices) > 0 || doc.line_count(Section::Footer) == 0);
+        if (same) {
+            const std::string& point_counts = doc.line(Section::Header, header_lines - 1);
+            ObjInfo counts = parse_obj({point_counts});
+            same = point_counts.find("POINT_COUNTS") != std::string::npos &&
+                   counts.vt_count == doc.vt_count() && counts.tris_count == doc.tris_count();
+        }
+        for (size_t i = 0; same && i < header_lines; ++i) {
+            const std::string& line = doc.line(Section::Header, i);
+            same = !first_token_is(line, "VT") && !first_token_is(line, "IDX") && !first_token_is(line, "IDX10");
+        }
+        for (size_t i = 0; same && i < doc.line_count(Section::Footer); ++i) {
+            same = !first_token_is(doc.line(Section::Footer, i), "VT");
+        }
+        same = same && !mentions_point_counts(doc, Section::Vertices) &&
+               !mentions_point_counts(doc, Section::Indices) && !mentions_point_counts(doc, Section::Footer);
+        return same ? doc.snapshot() : Document::parse(parse_obj(doc.to_lines()));
+    }
+}
+}
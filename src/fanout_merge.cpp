@@ -0,0 +1,87 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include "kitbash_thread_pool.h"
+#include <filesystem>
+#include <set>
+#include <stdexcept>
+
+// Internal helper functions
+namespace {
+    // Merge one base; never throws so a failing base does not affect the others
+    void merge_one(const kitbash::CompiledAddition& addition, kitbash::FanoutResult& result,
+                   bool in_place) {
+        try {
+            kitbash::detail::MergeJob job(result.base, addition, in_place ? "" : result.output);
+            while (!job.run_chunk()) {
+            }
+            result.stats = job.stats();
+            result.success = true;
+        } catch (const std::exception& e) {
+            result.error = e.what();
+        }
+    }
+}
+
+namespace kitbash {
+    std::vector<FanoutResult> merge_fanout(const std::string& addition, const std::vector<std::string>& bases,
+                                           const FanoutOptions& options) {
+        CompiledAddition compiled;
+        try {
+            compiled = CompiledAddition::is_compiled_file(addition) ? CompiledAddition::load(addition)
+                                                                     : CompiledAddition::compile(addition);
+        } catch (const std::exception& e) {
+            // Nothing can be merged without the addition
+            std::vector<FanoutResult> results(bases.size());
+            for (size_t i = 0; i < bases.size(); ++i) {
+                results[i].base = bases[i];
+                results[i].error = e.what();
+            }
+            return results;
+        }
+        return merge_fanout(compiled, bases, options);
+    }
+
+    std::vector<FanoutResult> merge_fanout(const CompiledAddition& addition, const std::vector<std::string>& bases,
+                                           const FanoutOptions& options) {
+        bool in_place = options.output_dir.empty();
+        std::vector<FanoutResult> results(bases.size());
+        std::vector<size_t> pending;
+        std::set<std::string> outputs;
+        for (size_t i = 0; i < bases.size(); ++i) {
+            FanoutResult& result = results[i];
+            result.base = bases[i];
+            result.output = in_place ? bases[i]
+                : (std::filesystem::path(options.output_dir) / std::filesystem::path(bases[i]).filename()).string();
+            if (addition.empty()) {
+                result.error = "Compiled addition is empty";
+            } else if (!outputs.insert(std::filesystem::absolute(result.output).lexically_normal().string()).second) {
+                // Two merges writing one file would race; the first one wins
+                result.error = "Duplicate output file: " + result.output;
+            } else {
+                pending.push_back(i);
+            }
+        }
+
+        std::unique_ptr<detail::ThreadPool> own_pool;
+        if (options.threads > 0) {
+            own_pool = std::make_unique<detail::ThreadPool>(options.threads);
+        }
+        detail::ThreadPool& pool = own_pool ? *own_pool : detail::ThreadPool::shared();
+
+        std::vector<std::future<void>> done;
+        done.reserve(pending.size());
+        for (size_t index : pending) {
+            auto promise = std::make_shared<std::promise<void>>();
+            done.push_back(promise->get_future());
+            FanoutResult* result = &results[index];
+            pool.submit([promise, result, &addition, in_place] {
+                merge_one(addition, *result, in_place);
+                promise->set_value();
+            });
+        }
+        for (auto& future : done) {
+            pool.wait(future);
+        }
+        return results;
+    }
+}
@@ -0,0 +1,171 @@
+// Fuzz target for performance pathologies in the OBJ8 parsing and rebasing code:
+// tokenize(), parse_obj(), merge_objects() with adjust_indices_line() and
+// adjust_tris_line(), and the streaming MergeJob (scan, compile, render) on Linux.
+//
+// Every input must finish within a time budget that grows linearly with its size
+// (fixed_budget_ms + ns_per_byte per input byte). An input over budget aborts, so
+// libFuzzer saves it as a crash: quadratic behaviour on long lines, huge token
+// counts, deep ANIM nesting or long numbers shows up as a failure, not as a slow
+// build later. Memory is capped by libFuzzer's RSS and malloc limits, which are set
+// by default below unless given on the command line.
+//
+// Built with -DKITBASH_BUILD_FUZZER=ON. With Clang this is a libFuzzer binary:
+//
+//     kitbash_fuzz_parser fuzz_corpus -dict=fuzz_obj8.dict
+//
+// Other compilers build a replay driver that runs the target once on each file
+// given, for reproducing a saved crash or checking a corpus without Clang.
+//
+// KITBASH_FUZZ_BUDGET_MS and KITBASH_FUZZ_NS_PER_BYTE override the budget, e.g.
+// for sanitizer builds that run several times slower.
+
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef KITBASH_FUZZ_REPLAY
+#include <fstream>
+#include <iterator>
+#endif
+
+// Internal helper functions
+namespace {
+    double fixed_budget_ms = 250.0;     // Startup noise, page faults, allocator growth
+    double ns_per_byte = 2000.0;        // Several times the slowest path on a clean input
+
+    double env_number(const char* name, double fallback) {
+        const char* value = std::getenv(name);
+        return value && *value ? std::atof(value) : fallback;
+    }
+
+    // Lines as read_file() gives them: split on '\n', no empty line after a final newline
+    std::vector<std::string> split_lines(std::string_view data) {
+        std::vector<std::string> lines;
+        size_t pos = 0;
+        while (pos < data.size()) {
+            size_t end = data.find('\n', pos);
+            if (end == std::string_view::npos) {
+                end = data.size();
+            }
+            lines.emplace_back(data.substr(pos, end - pos));
+            pos = end + 1;
+        }
+        return lines;
+    }
+
+    void run_reference(const std::vector<std::string>& lines) {
+        for (const auto& line : lines) {
+            kitbash::tokenize(line);
+        }
+        ObjInfo info = kitbash::parse_obj(lines);
+        // The input is both base and addition, so every IDX and TRIS line is rebased
+        kitbash::merge_objects(info, info);
+    }
+
+#ifdef __linux__
+    // The streaming engine maps files; give it the input as a memory file
+    void run_streaming(std::string_view data) {
+        int input = kitbash::detail::create_memory_file("kitbash-fuzz-input");
+        int output = -1;
+        try {
+            {
+                kitbash::detail::FileWriter out(input, "kitbash-fuzz-input");
+                out.write(data);
+                out.close();
+            }
+            std::string path = "/proc/self/fd/" + std::to_string(input);
+            output = kitbash::detail::create_memory_file("kitbash-fuzz-output");
+            kitbash::detail::MergeJob job(path, path, "<memory>");
+            job.write_to_descriptor(output);
+            while (!job.run_chunk()) {
+            }
+        } catch (const std::exception&) {
+            // Rejected input; only the time it took matters
+        }
+        if (output >= 0) {
+            kitbash::detail::close_descriptor(output);
+        }
+        kitbash::detail::close_descriptor(input);
+    }
+#endif
+}
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    fixed_budget_ms = env_number("KITBASH_FUZZ_BUDGET_MS", fixed_budget_ms);
+    ns_per_byte = env_number("KITBASH_FUZZ_NS_PER_BYTE", ns_per_byte);
+
+#ifndef KITBASH_FUZZ_REPLAY
+    // Strict limits unless given: inputs up to 4 MB (room for a multi-megabyte
+    // line), 2 GB resident, 1 GB in a single allocation, 30 s as a last resort
+    static const char* defaults[] = {"-max_len=4194304", "-rss_limit_mb=2048", "-malloc_limit_mb=1024",
+                                     "-timeout=30"};
+    static std::vector<char*> args;
+    args.assign(*argv, *argv + *argc);
+    for (const char* flag : defaults) {
+        size_t name = std::strchr(flag, '=') - flag + 1;
+        bool given = false;
+        for (int i = 1; i < *argc; ++i) {
+            given = given || std::strncmp((*argv)[i], flag, name) == 0;
+        }
+        if (!given) {
+            args.push_back(const_cast<char*>(flag));
+        }
+    }
+    args.push_back(nullptr);
+    *argc = static_cast<int>(args.size()) - 1;
+    *argv = args.data();
+#else
+    (void)argc;
+    (void)argv;
+#endif
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    std::string_view input(reinterpret_cast<const char*>(data), size);
+    auto start = std::chrono::steady_clock::now();
+
+    run_reference(split_lines(input));
+#ifdef __linux__
+    run_streaming(input);
+#endif
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    double budget_ms = fixed_budget_ms + ns_per_byte * static_cast<double>(size) / 1e6;
+    if (elapsed_ms > budget_ms) {
+        std::fprintf(stderr, "kitbash_fuzz_parser: %zu byte input took %.1f ms, over the linear budget of %.1f ms\n",
+                     size, elapsed_ms, budget_ms);
+        std::abort();
+    }
+    return 0;
+}
+
+#ifdef KITBASH_FUZZ_REPLAY
+int main(int argc, char* argv[]) {
+    LLVMFuzzerInitialize(&argc, &argv);
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: kitbash_fuzz_parser input...\n");
+        return 2;
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::ifstream file(argv[i], std::ios::binary);
+        if (!file) {
+            std::fprintf(stderr, "Cannot open file: %s\n", argv[i]);
+            return 2;
+        }
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        auto start = std::chrono::steady_clock::now();
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%s: %zu bytes, %.1f ms\n", argv[i], data.size(), ms);
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,698 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// AVX2 kernel, chosen at run time; -DKITBASH_GEOMETRY_NO_AVX2 leaves only the scalar one
+#ifndef KITBASH_GEOMETRY_NO_AVX2
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define KITBASH_GEOMETRY_AVX2 1
+#define KITBASH_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define KITBASH_GEOMETRY_AVX2 1
+#define KITBASH_TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+#endif
+
+// Internal helper functions
+namespace {
+    using kitbash::GeometryIssue;
+    using kitbash::detail::next_token;
+
+    constexpr size_t block_size = 256;      // Vertices checked together; a multiple of 8
+
+    constexpr uint8_t flag_of(GeometryIssue issue) {
+        return static_cast<uint8_t>(1u << static_cast<int>(issue));
+    }
+
+    bool cpu_has_avx2() {
+#if defined(KITBASH_GEOMETRY_AVX2) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        __cpuid(info, 1);
+        bool os_saves_ymm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        return os_saves_ymm && (info[1] & (1 << 5));
+#elif defined(KITBASH_GEOMETRY_AVX2)
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+
+    // Decimal text to float. Plain and exponent forms are read directly; anything
+    // else (nan, inf, hex, MSVC's 1.#INF) goes through strtod. False if not a number.
+    bool parse_float(std::string_view token, float& value) {
+        static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        const char* p = token.data();
+        const char* end = p + token.size();
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            ++p;
+        }
+        uint64_t mantissa = 0;
+        int significant = 0;
+        int exponent = 0;
+        bool digits = false;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            digits = true;
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                significant += mantissa > 0;
+            } else {
+                ++exponent;
+            }
+        }
+        if (p < end && *p == '.') {
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+                digits = true;
+                if (significant < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    significant += mantissa > 0;
+                    --exponent;
+                }
+            }
+        }
+        if (digits && p < end && (*p == 'e' || *p == 'E')) {
+            const char* mark = p++;
+            bool negative_exponent = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negative_exponent = *p == '-';
+                ++p;
+            }
+            int written = 0;
+            bool exponent_digits = false;
+            for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+                exponent_digits = true;
+                written = std::min(written * 10 + (*p - '0'), 100000);
+            }
+            exponent += negative_exponent ? -written : written;
+            if (!exponent_digits) {
+                p = mark;   // "1e" is not a number; let strtod decide
+            }
+        }
+
+        if (digits && p == end) {
+            double result = static_cast<double>(mantissa);
+            if (mantissa == 0) {
+                result = 0.0;
+            } else if (exponent >= 0 && exponent <= 22 && mantissa <= (1ull << 53)) {
+                result *= powers[exponent];
+            } else if (exponent < 0 && exponent >= -22 && mantissa <= (1ull << 53)) {
+                result /= powers[-exponent];
+            } else {
+                result *= std::pow(10.0, exponent);
+            }
+            if (result > FLT_MAX) {
+                value = negative ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::infinity();
+            } else {
+                value = static_cast<float>(negative ? -result : result);
+            }
+            return true;
+        }
+
+        // Rare forms
+        if (token.find('#') != std::string_view::npos) {
+            bool infinite = token.find("INF") != std::string_view::npos;
+            value = infinite ? (negative ? -std::numeric_limits<float>::infinity()
+                                         : std::numeric_limits<float>::infinity())
+                             : std::numeric_limits<float>::quiet_NaN();
+            return true;
+        }
+        std::string text(token);
+        char* stop = nullptr;
+        double result = std::strtod(text.c_str(), &stop);
+        if (stop != text.c_str() + text.size() || text.empty()) {
+            return false;
+        }
+        if (std::isfinite(result) && std::fabs(result) > FLT_MAX) {
+            result = std::copysign(std::numeric_limits<double>::infinity(), result);
+        }
+        value = static_cast<float>(result);
+        return true;
+    }
+
+    inline bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    }
+
+    inline size_t read_digits(const char*& p, const char* end, uint64_t& mantissa) {
+        const char* start = p;
+        for (; p < end && static_cast<unsigned>(*p - '0') < 10; ++p) {
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+        return static_cast<size_t>(p - start);
+    }
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KITBASH_GEOMETRY_SSE2 1
+    inline size_t lowest_bit(uint32_t bits) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return index;
+#else
+        return static_cast<size_t>(__builtin_ctz(bits));
+#endif
+    }
+
+    // Value of count (1..8) digit characters at p; eight bytes at p must be readable
+    inline uint64_t digits_value(const char* p, size_t count) {
+        uint64_t chunk;
+        std::memcpy(&chunk, p, 8);
+        chunk -= 0x3030303030303030ull;
+        chunk <<= 8 * (8 - count);      // Drop what follows; zeros become leading digits
+        chunk = chunk * 10 + (chunk >> 8);
+        return ((chunk & 0x000000FF000000FFull) * (100 + (1000000ull << 32)) +
+                ((chunk >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32))) >> 32;
+    }
+
+    // One plain decimal at p of up to 8 integer and 8 fraction digits, classified 16
+    // bytes at a time so token length does not cost a branch per character. p is
+    // moved past it. False when the token is anything else; 24 bytes must be readable.
+    inline bool parse_plain_sse2(const char*& p, uint64_t& mantissa, size_t& fraction, bool& negative) {
+        __m128i text = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(text, _mm_set1_epi8(' ')),
+                                                  _mm_cmpeq_epi8(text, _mm_set1_epi8('\t'))),
+                                     _mm_or_si128(_mm_cmpeq_epi8(text, _mm_set1_epi8('\r')),
+                                                  _mm_cmpeq_epi8(text, _mm_set1_epi8('\n'))));
+        __m128i offset = _mm_sub_epi8(text, _mm_set1_epi8('0'));
+        __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(9)), offset);
+        __m128i dot = _mm_cmpeq_epi8(text, _mm_set1_epi8('.'));
+        uint32_t spaces = static_cast<uint32_t>(_mm_movemask_epi8(space));
+        if (spaces == 0) {
+            return false;
+        }
+        size_t length = lowest_bit(spaces);
+        uint32_t token = (1u << length) - 1;
+        negative = *p == '-';
+        uint32_t sign = (*p == '-' || *p == '+') ? 1u : 0u;
+        uint32_t dots = static_cast<uint32_t>(_mm_movemask_epi8(dot)) & token;
+        uint32_t others = token & ~static_cast<uint32_t>(_mm_movemask_epi8(digit)) & ~sign & ~dots;
+        if (others != 0 || (dots & (dots - 1)) != 0) {
+            return false;
+        }
+        size_t begin = sign;
+        size_t point = dots ? lowest_bit(dots) : length;
+        size_t whole = point - begin;
+        fraction = dots ? length - point - 1 : 0;
+        if (whole + fraction == 0 || whole > 8 || fraction > 8) {
+            return false;
+        }
+        uint64_t value = whole ? digits_value(p + begin, whole) : 0;
+        if (fraction) {
+            static const uint64_t scale[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+            value = value * scale[fraction] + digits_value(p + point + 1, fraction);
+        }
+        mantissa = value;
+        p += length;
+        return true;
+    }
+#endif
+
+    // The usual VT line in one pass: eight plain decimals ("-0.125", "3") with at most
+    // 19 digits each. Same arithmetic as parse_float(); false sends the line to it.
+    // readable (at least line.size()) bytes at line.data() may be read.
+    bool parse_plain_vertex(std::string_view line, size_t readable, float values[8]) {
+        static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+                                        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19};
+        const char* p = line.data();
+        const char* end = p + line.size();
+#ifdef KITBASH_GEOMETRY_SSE2
+        const char* fast_end = readable >= 24 ? line.data() + readable - 24 : line.data();
+#else
+        (void)readable;
+#endif
+        while (p < end && is_space(*p)) {
+            ++p;
+        }
+        if (end - p < 2 || p[0] != 'V' || p[1] != 'T') {
+            return false;
+        }
+        p += 2;
+        for (int k = 0; k < 8; ++k) {
+            if (p == end || !is_space(*p)) {
+                return false;
+            }
+            do {
+                ++p;
+            } while (p < end && is_space(*p));
+            uint64_t mantissa = 0;
+            size_t fraction = 0;
+            bool negative = false;
+#ifdef KITBASH_GEOMETRY_SSE2
+            if (p >= fast_end || !parse_plain_sse2(p, mantissa, fraction, negative))
+#endif
+            {
+                negative = p < end && *p == '-';
+                p += p < end && (*p == '-' || *p == '+');
+                size_t count = read_digits(p, end, mantissa);
+                if (p < end && *p == '.') {
+                    ++p;
+                    fraction = read_digits(p, end, mantissa);
+                }
+                count += fraction;
+                if (count == 0 || count > 19 || mantissa > (1ull << 53)) {
+                    return false;
+                }
+            }
+            if (p > end || (p < end && !is_space(*p))) {
+                return false;
+            }
+            double result = mantissa == 0 ? 0.0 : static_cast<double>(mantissa) / powers[fraction];
+            values[k] = static_cast<float>(negative ? -result : result);
+        }
+        return true;
+    }
+
+    // Structure-of-arrays vertex block, padded with harmless values to a multiple of 8
+    struct Block {
+        alignas(32) float x[block_size];
+        alignas(32) float y[block_size];
+        alignas(32) float z[block_size];
+        alignas(32) float nx[block_size];
+        alignas(32) float ny[block_size];
+        alignas(32) float nz[block_size];
+        alignas(32) float u[block_size];
+        alignas(32) float v[block_size];
+        uint8_t flags[block_size];
+        uint64_t lines[block_size];
+        std::string_view texts[block_size];     // Valid until the block is checked
+        size_t count = 0;
+
+        void set_harmless(size_t i) {
+            x[i] = y[i] = z[i] = 0.0f;
+            nx[i] = nz[i] = 0.0f;
+            ny[i] = 1.0f;
+            u[i] = v[i] = 0.0f;
+        }
+    };
+
+    struct Limits {
+        float min_length2;      // Below: zero-length normal
+        float low_length2;      // Outside low .. high: unnormalized
+        float high_length2;
+        float uv_low;
+        float uv_high;
+    };
+
+    void check_scalar(Block& block, size_t count, const Limits& limits) {
+        for (size_t i = 0; i < count; ++i) {
+            uint8_t flags = 0;
+            const float infinity = std::numeric_limits<float>::infinity();
+            if (!(std::fabs(block.x[i]) < infinity) || !(std::fabs(block.y[i]) < infinity) ||
+                !(std::fabs(block.z[i]) < infinity)) {
+                flags |= flag_of(GeometryIssue::BadPosition);
+            }
+            float length2 = block.nx[i] * block.nx[i] + block.ny[i] * block.ny[i];
+            length2 = length2 + block.nz[i] * block.nz[i];
+            bool normal_ok = length2 > limits.min_length2 && length2 < infinity;
+            if (!normal_ok) {
+                flags |= flag_of(GeometryIssue::BadNormal);
+            } else if (!(length2 >= limits.low_length2 && length2 <= limits.high_length2)) {
+                flags |= flag_of(GeometryIssue::UnnormalizedNormal);
+            }
+            if (!(block.u[i] >= limits.uv_low && block.u[i] <= limits.uv_high && block.v[i] >= limits.uv_low &&
+                  block.v[i] <= limits.uv_high)) {
+                flags |= flag_of(GeometryIssue::BadUv);
+            }
+            block.flags[i] |= flags;
+        }
+    }
+
+#ifdef KITBASH_GEOMETRY_AVX2
+    // Same tests as check_scalar(), 8 vertices at a time; NaN fails every ordered compare
+    KITBASH_TARGET_AVX2 void check_avx2(Block& block, size_t count, const Limits& limits) {
+        const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        const __m256 infinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+        const __m256 min_length2 = _mm256_set1_ps(limits.min_length2);
+        const __m256 low_length2 = _mm256_set1_ps(limits.low_length2);
+        const __m256 high_length2 = _mm256_set1_ps(limits.high_length2);
+        const __m256 uv_low = _mm256_set1_ps(limits.uv_low);
+        const __m256 uv_high = _mm256_set1_ps(limits.uv_high);
+        for (size_t i = 0; i < count; i += 8) {
+            __m256 x = _mm256_and_ps(_mm256_load_ps(block.x + i), abs_mask);
+            __m256 y = _mm256_and_ps(_mm256_load_ps(block.y + i), abs_mask);
+            __m256 z = _mm256_and_ps(_mm256_load_ps(block.z + i), abs_mask);
+            __m256 position_ok = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(x, infinity, _CMP_LT_OQ),
+                                                             _mm256_cmp_ps(y, infinity, _CMP_LT_OQ)),
+                                               _mm256_cmp_ps(z, infinity, _CMP_LT_OQ));
+
+            __m256 nx = _mm256_load_ps(block.nx + i);
+            __m256 ny = _mm256_load_ps(block.ny + i);
+            __m256 nz = _mm256_load_ps(block.nz + i);
+            __m256 length2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)),
+                                           _mm256_mul_ps(nz, nz));
+            __m256 normal_ok = _mm256_and_ps(_mm256_cmp_ps(length2, min_length2, _CMP_GT_OQ),
+                                             _mm256_cmp_ps(length2, infinity, _CMP_LT_OQ));
+            __m256 unit = _mm256_and_ps(_mm256_cmp_ps(length2, low_length2, _CMP_GE_OQ),
+                                        _mm256_cmp_ps(length2, high_length2, _CMP_LE_OQ));
+
+            __m256 u = _mm256_load_ps(block.u + i);
+            __m256 v = _mm256_load_ps(block.v + i);
+            __m256 uv_ok = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(u, uv_low, _CMP_GE_OQ),
+                                                       _mm256_cmp_ps(u, uv_high, _CMP_LE_OQ)),
+                                         _mm256_and_ps(_mm256_cmp_ps(v, uv_low, _CMP_GE_OQ),
+                                                       _mm256_cmp_ps(v, uv_high, _CMP_LE_OQ)));
+
+            int bad_position = ~_mm256_movemask_ps(position_ok) & 0xff;
+            int bad_normal = ~_mm256_movemask_ps(normal_ok) & 0xff;
+            int unnormalized = _mm256_movemask_ps(_mm256_andnot_ps(unit, normal_ok));
+            int bad_uv = ~_mm256_movemask_ps(uv_ok) & 0xff;
+            if ((bad_position | bad_normal | unnormalized | bad_uv) == 0) {
+                continue;
+            }
+            for (int lane = 0; lane < 8; ++lane) {
+                uint8_t flags = 0;
+                flags |= (bad_position >> lane & 1) ? flag_of(GeometryIssue::BadPosition) : 0;
+                flags |= (bad_normal >> lane & 1) ? flag_of(GeometryIssue::BadNormal) : 0;
+                flags |= (unnormalized >> lane & 1) ? flag_of(GeometryIssue::UnnormalizedNormal) : 0;
+                flags |= (bad_uv >> lane & 1) ? flag_of(GeometryIssue::BadUv) : 0;
+                block.flags[i + lane] |= flags;
+            }
+        }
+    }
+#endif
+
+    // Byte range of the normal (tokens 4 to 6 after VT) in a VT line
+    bool normal_range(std::string_view line, size_t& begin, size_t& end) {
+        size_t pos = 0;
+        next_token(line, pos);  // VT
+        for (int i = 0; i < 6; ++i) {
+            std::string_view token = next_token(line, pos);
+            if (token.empty()) {
+                return false;
+            }
+            if (i == 3) {
+                begin = token.data() - line.data();
+            }
+        }
+        end = pos;
+        return true;
+    }
+
+    std::string with_normal(std::string_view line, double nx, double ny, double nz) {
+        size_t begin = 0;
+        size_t end = 0;
+        if (!normal_range(line, begin, end)) {
+            return std::string(line);
+        }
+        char normal[96];
+        std::snprintf(normal, sizeof(normal), "%.6f\t%.6f\t%.6f", nx + 0.0, ny + 0.0, nz + 0.0);  // No -0
+        std::string text(line.substr(0, begin));
+        text += normal;
+        text += line.substr(end);
+        return text;
+    }
+}
+
+namespace kitbash {
+    const char* geometry_issue_name(GeometryIssue issue) {
+        switch (issue) {
+        case GeometryIssue::BadPosition:
+            return "bad_position";
+        case GeometryIssue::BadNormal:
+            return "bad_normal";
+        case GeometryIssue::UnnormalizedNormal:
+            return "unnormalized_normal";
+        case GeometryIssue::BadUv:
+            return "bad_uv";
+        case GeometryIssue::Malformed:
+            return "malformed";
+        }
+        return "";
+    }
+
+namespace detail {
+    // Vertex waiting for a face normal, accumulated from the triangles that use it
+    struct PendingNormal {
+        uint64_t vertex;
+        uint64_t line;
+        std::string text;
+        double nx = 0.0;
+        double ny = 0.0;
+        double nz = 0.0;
+    };
+
+    struct GeometryScanner::Impl {
+        GeometryOptions options;
+        Limits limits;
+        bool avx2 = false;
+        Block block;
+        GeometryReport report;
+        uint64_t vertex = 0;                // Ordinal of the next vertex
+
+        // Repair state
+        std::vector<Repair> repairs;
+        std::vector<PendingNormal> pending;
+        std::vector<uint8_t> is_pending;    // Per vertex
+        std::vector<float> px, py, pz;      // Every position, for face normals
+        long long triangle[3] = {0, 0, 0};
+        int corners = 0;
+
+        void check() {
+            size_t count = block.count;
+            size_t padded = (count + 7) / 8 * 8;
+            for (size_t i = count; i < padded; ++i) {
+                block.set_harmless(i);
+                block.flags[i] = 0;
+            }
+#ifdef KITBASH_GEOMETRY_AVX2
+            if (avx2) {
+                check_avx2(block, padded, limits);
+            } else {
+                check_scalar(block, count, limits);
+            }
+#else
+            check_scalar(block, count, limits);
+#endif
+            for (size_t i = 0; i < count; ++i) {
+                uint8_t flags = block.flags[i];
+                if (flags == 0) {
+                    continue;
+                }
+                for (int issue = 0; issue < geometry_issue_count; ++issue) {
+                    if (flags & (1u << issue)) {
+                        ++report.counts[issue];
+                        if (report.first_lines[issue].size() < options.max_lines) {
+                            report.first_lines[issue].push_back(block.lines[i]);
+                        }
+                    }
+                }
+                if (!options.repair_normals || (flags & flag_of(GeometryIssue::Malformed))) {
+                    continue;
+                }
+                uint64_t index = vertex - count + i;
+                if (flags & flag_of(GeometryIssue::UnnormalizedNormal)) {
+                    double nx = block.nx[i];
+                    double ny = block.ny[i];
+                    double nz = block.nz[i];
+                    double length = std::sqrt(nx * nx + ny * ny + nz * nz);
+                    repairs.push_back(Repair{block.lines[i],
+                                             with_normal(block.texts[i], nx / length, ny / length, nz / length)});
+                } else if (flags & flag_of(GeometryIssue::BadNormal)) {
+                    if (is_pending.size() <= index) {
+                        is_pending.resize(index + 1, 0);
+                    }
+                    is_pending[index] = 1;
+                    pending.push_back(PendingNormal{index, block.lines[i], std::string(block.texts[i])});
+                }
+            }
+            block.count = 0;
+        }
+
+        PendingNormal* find_pending(long long index) {
+            if (index < 0 || static_cast<uint64_t>(index) >= is_pending.size() || !is_pending[index]) {
+                return nullptr;
+            }
+            auto found = std::lower_bound(pending.begin(), pending.end(), static_cast<uint64_t>(index),
+                                          [](const PendingNormal& entry, uint64_t key) { return entry.vertex < key; });
+            return &*found;
+        }
+
+        void add_triangle() {
+            PendingNormal* touched[3];
+            bool any = false;
+            for (int i = 0; i < 3; ++i) {
+                touched[i] = find_pending(triangle[i]);
+                any = any || touched[i];
+            }
+            if (!any) {
+                return;
+            }
+            for (int i = 0; i < 3; ++i) {
+                if (triangle[i] < 0 || static_cast<uint64_t>(triangle[i]) >= px.size()) {
+                    return;
+                }
+            }
+            // Area-weighted face normal: (b - a) x (c - a)
+            size_t a = static_cast<size_t>(triangle[0]);
+            size_t b = static_cast<size_t>(triangle[1]);
+            size_t c = static_cast<size_t>(triangle[2]);
+            double ux = px[b] - px[a], uy = py[b] - py[a], uz = pz[b] - pz[a];
+            double vx = px[c] - px[a], vy = py[c] - py[a], vz = pz[c] - pz[a];
+            double nx = uy * vz - uz * vy;
+            double ny = uz * vx - ux * vz;
+            double nz = ux * vy - uy * vx;
+            if (!std::isfinite(nx) || !std::isfinite(ny) || !std::isfinite(nz)) {
+                return;
+            }
+            for (int i = 0; i < 3; ++i) {
+                if (touched[i]) {
+                    touched[i]->nx += nx;
+                    touched[i]->ny += ny;
+                    touched[i]->nz += nz;
+                }
+            }
+        }
+    };
+
+    GeometryScanner::GeometryScanner(const GeometryOptions& options) : impl_(std::make_unique<Impl>()) {
+        impl_->options = options;
+        double low = std::max(0.0, 1.0 - options.normal_tolerance);
+        double high = 1.0 + options.normal_tolerance;
+        impl_->limits.min_length2 = 1e-12f;
+        impl_->limits.low_length2 = static_cast<float>(low * low);
+        impl_->limits.high_length2 = static_cast<float>(high * high);
+        impl_->limits.uv_low = static_cast<float>(-options.uv_margin);
+        impl_->limits.uv_high = static_cast<float>(1.0 + options.uv_margin);
+        static const bool has_avx2 = cpu_has_avx2();
+        impl_->avx2 = has_avx2;
+        impl_->report.checked = true;
+        impl_->report.vectorized = has_avx2;
+    }
+
+    GeometryScanner::~GeometryScanner() = default;
+
+    void GeometryScanner::add(std::string_view line, uint64_t line_number) {
+        add(line, line_number, line.size());
+    }
+
+    void GeometryScanner::add(std::string_view line, uint64_t line_number, size_t readable) {
+        Impl& s = *impl_;
+        Block& block = s.block;
+        size_t i = block.count;
+        float values[8];
+        size_t pos = 0;
+        next_token(line, pos);  // VT
+        bool ok = true;
+        for (int k = parse_plain_vertex(line, readable, values) ? 8 : 0; k < 8 && ok; ++k) {
+            std::string_view token = next_token(line, pos);
+            ok = !token.empty() && parse_float(token, values[k]);
+        }
+        if (ok) {
+            block.x[i] = values[0];
+            block.y[i] = values[1];
+            block.z[i] = values[2];
+            block.nx[i] = values[3];
+            block.ny[i] = values[4];
+            block.nz[i] = values[5];
+            block.u[i] = values[6];
+            block.v[i] = values[7];
+            block.flags[i] = 0;
+        } else {
+            block.set_harmless(i);
+            block.flags[i] = flag_of(GeometryIssue::Malformed);
+        }
+        if (s.options.repair_normals) {
+            s.px.push_back(block.x[i]);
+            s.py.push_back(block.y[i]);
+            s.pz.push_back(block.z[i]);
+        }
+        block.lines[i] = line_number;
+        block.texts[i] = line;
+        ++block.count;
+        ++s.vertex;
+        ++s.report.vertices;
+        if (block.count == block_size) {
+            s.check();
+        }
+    }
+
+    bool GeometryScanner::needs_indices() {
+        if (impl_->block.count > 0) {
+            impl_->check();
+        }
+        return !impl_->pending.empty();
+    }
+
+    void GeometryScanner::add_index(long long index) {
+        Impl& s = *impl_;
+        s.triangle[s.corners++] = index;
+        if (s.corners == 3) {
+            s.add_triangle();
+            s.corners = 0;
+        }
+    }
+
+    void GeometryScanner::add_indices(std::string_view idx_line, long long offset) {
+        size_t pos = 0;
+        next_token(idx_line, pos);  // IDX or IDX10
+        for (std::string_view token = next_token(idx_line, pos); !token.empty(); token = next_token(idx_line, pos)) {
+            int index = 0;
+            if (parse_int_prefix(token, index)) {
+                add_index(index + offset);
+            }
+        }
+    }
+
+    size_t scan_vertex_lines(GeometryScanner& scanner, std::string_view data, size_t& pos, uint64_t& line,
+                             size_t max_bytes) {
+        size_t start = pos;
+        while (pos < data.size() && pos - start < max_bytes) {
+            const void* found = std::memchr(data.data() + pos, '\n', data.size() - pos);
+            size_t end = found ? static_cast<const char*>(found) - data.data() : data.size();
+            scanner.add(data.substr(pos, end - pos), line++, data.size() - pos);
+            pos = end + 1;
+        }
+        pos = std::min(pos, data.size());
+        return pos - start;
+    }
+
+    GeometryReport GeometryScanner::finish(std::vector<Repair>* repairs) {
+        Impl& s = *impl_;
+        if (s.block.count > 0) {
+            s.check();
+        }
+        // Vertices no triangle gave a direction point up
+        for (auto& entry : s.pending) {
+            double length = std::sqrt(entry.nx * entry.nx + entry.ny * entry.ny + entry.nz * entry.nz);
+            if (length > 0.0 && std::isfinite(length)) {
+                s.repairs.push_back(Repair{entry.line, with_normal(entry.text, entry.nx / length,
+                                                                   entry.ny / length, entry.nz / length)});
+            } else {
+                s.repairs.push_back(Repair{entry.line, with_normal(entry.text, 0.0, 1.0, 0.0)});
+            }
+        }
+        s.pending.clear();
+        std::sort(s.repairs.begin(), s.repairs.end(),
+                  [](const Repair& a, const Repair& b) { return a.line < b.line; });
+        s.report.repaired_normals = s.repairs.size();
+        if (repairs) {
+            *repairs = std::move(s.repairs);
+        }
+        s.repairs.clear();
+        return s.report;
+    }
+}
+}
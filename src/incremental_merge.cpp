@@ -0,0 +1,85 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <chrono>
+#include <stdexcept>
+
+namespace kitbash {
+    struct IncrementalMerge::Impl {
+        // Small units keep the overshoot past a frame budget to tens of microseconds
+        static constexpr size_t step_chunk_bytes = 64 * 1024;
+
+        Impl(const std::string& base, const std::string& addition, const std::string& output)
+            : job(base, addition, output, step_chunk_bytes) {}
+
+        detail::MergeJob job;
+        bool finished = false;
+        bool failed = false;
+        std::string error;
+        MergeProgress last_progress;
+    };
+
+    IncrementalMerge::IncrementalMerge(const std::string& base, const std::string& addition,
+                                       const std::string& output)
+        : impl_(std::make_unique<Impl>(base, addition, output)) {}
+
+    IncrementalMerge::~IncrementalMerge() = default;
+    IncrementalMerge::IncrementalMerge(IncrementalMerge&& other) noexcept = default;
+    IncrementalMerge& IncrementalMerge::operator=(IncrementalMerge&& other) noexcept = default;
+
+    bool IncrementalMerge::step(int64_t budget_us) {
+        if (impl_->finished) {
+            return true;
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget_us);
+        try {
+            // Always make progress, even with a zero budget
+            do {
+                if (impl_->job.run_chunk()) {
+                    impl_->finished = true;
+                    break;
+                }
+            } while (std::chrono::steady_clock::now() < deadline);
+            impl_->last_progress = impl_->job.progress();
+        } catch (const std::exception& e) {
+            impl_->job.abort();
+            impl_->finished = true;
+            impl_->failed = true;
+            impl_->error = e.what();
+        }
+        return impl_->finished;
+    }
+
+    bool IncrementalMerge::done() const {
+        return impl_->finished;
+    }
+
+    bool IncrementalMerge::failed() const {
+        return impl_->failed;
+    }
+
+    const std::string& IncrementalMerge::error() const {
+        return impl_->error;
+    }
+
+    double IncrementalMerge::percent() const {
+        return impl_->last_progress.percent;
+    }
+
+    MergeProgress IncrementalMerge::progress() const {
+        return impl_->last_progress;
+    }
+
+    const MergeStats& IncrementalMerge::stats() const {
+        return impl_->job.stats();
+    }
+
+    void IncrementalMerge::cancel() {
+        if (!impl_->finished) {
+            impl_->job.abort();
+            impl_->finished = true;
+            impl_->failed = true;
+            impl_->error = "Merge cancelled";
+        }
+    }
+}
@@ -0,0 +1,416 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+// Internal helper functions
+namespace {
+    namespace fs = std::filesystem;
+
+    // <queue>/pending/<id>.job          waiting to be claimed
+    // <queue>/leased/<id>@<owner>.lease  claimed; mtime is the last heartbeat
+    // <queue>/done/<id>.result           outcome and stats
+    // <queue>/done/<id>.commit           an in-place job is replacing its base
+    // Files are written as dot-files and renamed into place, so readers never see
+    // a partial one.
+    constexpr const char* job_extension = ".job";
+    constexpr const char* lease_extension = ".lease";
+    constexpr const char* result_extension = ".result";
+    constexpr const char* commit_extension = ".commit";
+
+    int process_id() {
+#ifdef _WIN32
+        return _getpid();
+#else
+        return static_cast<int>(::getpid());
+#endif
+    }
+
+    std::string host_name() {
+#ifdef _WIN32
+        const char* name = std::getenv("COMPUTERNAME");
+        return name ? name : "localhost";
+#else
+        char name[256] = {};
+        if (::gethostname(name, sizeof(name) - 1) != 0) {
+            return "localhost";
+        }
+        return name;
+#endif
+    }
+
+    // Unique across machines and processes; '@' separates it from the job id
+    std::string owner_name() {
+        std::string owner = host_name() + "-" + std::to_string(process_id());
+        std::replace(owner.begin(), owner.end(), '@', '_');
+        return owner;
+    }
+
+    void write_atomically(const fs::path& path, const std::string& contents) {
+        fs::path temp = path.parent_path() / ("." + path.filename().string() + ".tmp");
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            out << contents;
+            if (!out) {
+                throw std::runtime_error("Cannot write file: " + temp.string());
+            }
+        }
+        fs::rename(temp, path);
+    }
+
+    // Create a file that must not exist yet; throws if it does
+    void create_marker(const fs::path& path, const std::string& contents) {
+        std::FILE* file = std::fopen(path.string().c_str(), "wx");
+        if (!file) {
+            throw std::runtime_error("Job already committed by another worker: " + path.string());
+        }
+        bool written = std::fputs((contents + "\n").c_str(), file) >= 0;
+        if (std::fclose(file) != 0 || !written) {
+            throw std::runtime_error("Cannot write file: " + path.string());
+        }
+    }
+
+    std::string read_text(const fs::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        std::ostringstream contents;
+        contents << in.rdbuf();
+        return contents.str();
+    }
+
+    // One path per line: base, addition, output (may be empty)
+    bool parse_job(const std::string& text, kitbash::BatchJob& job) {
+        std::istringstream in(text);
+        std::getline(in, job.base);
+        std::getline(in, job.addition);
+        std::getline(in, job.output);
+        return !job.base.empty() && !job.addition.empty();
+    }
+
+    std::string format_result(const std::string& owner, const kitbash::BatchResult& result) {
+        const MergeStats& stats = result.stats;
+        std::ostringstream out;
+        out << "status " << (result.success ? "ok" : "failed") << "\n"
+            << "worker " << owner << "\n"
+            << "base " << result.job.base << "\n"
+            << "addition " << result.job.addition << "\n"
+            << "output " << (result.job.output.empty() ? result.job.base : result.job.output) << "\n";
+        if (!result.success) {
+            out << "error " << result.error << "\n";
+            return out.str();
+        }
+        if (!stats.backup_filename.empty()) {
+            out << "backup " << stats.backup_filename << "\n";
+        }
+        out << "original_vt_count " << stats.original_vt_count << "\n"
+            << "original_tris_count " << stats.original_tris_count << "\n"
+            << "original_line_count " << stats.original_line_count << "\n"
+            << "added_vt_count " << stats.added_vt_count << "\n"
+            << "added_tris_count " << stats.added_tris_count << "\n"
+            << "added_line_count " << stats.added_line_count << "\n"
+            << "final_vt_count " << stats.final_vt_count << "\n"
+            << "final_tris_count " << stats.final_tris_count << "\n"
+            << "final_line_count " << stats.final_line_count << "\n"
+            << "processing_time " << stats.processing_time << "\n";
+        return out.str();
+    }
+
+    bool has_extension(const fs::path& path, const char* extension) {
+        std::string name = path.filename().string();
+        return !name.empty() && name[0] != '.' && path.extension() == extension;
+    }
+
+    // Leases held by this process, renewed by one heartbeat thread
+    class Heartbeat {
+    public:
+        explicit Heartbeat(std::chrono::milliseconds interval)
+            : interval_(interval), thread_([this] { run(); }) {
+        }
+
+        ~Heartbeat() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            wake_.notify_all();
+            thread_.join();
+        }
+
+        void hold(const fs::path& lease) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            leases_.insert(lease.string());
+        }
+
+        void release(const fs::path& lease) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            leases_.erase(lease.string());
+        }
+
+    private:
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!wake_.wait_for(lock, interval_, [this] { return stopping_; })) {
+                for (const auto& lease : leases_) {
+                    // Fails once another worker has taken the lease over; the job
+                    // then runs twice and the later result wins. In-place jobs are
+                    // guarded by their commit marker instead (see run_job()).
+                    std::error_code ec;
+                    fs::last_write_time(lease, fs::file_time_type::clock::now(), ec);
+                }
+            }
+        }
+
+        std::chrono::milliseconds interval_;
+        std::set<std::string> leases_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        bool stopping_ = false;
+        std::thread thread_;
+    };
+
+    class QueueWorker {
+    public:
+        QueueWorker(const fs::path& queue, const kitbash::QueueOptions& options)
+            : pending_(queue / "pending"), leased_(queue / "leased"), done_(queue / "done"),
+              owner_(owner_name()),
+              lease_(std::chrono::duration_cast<fs::file_time_type::duration>(
+                  std::chrono::duration<double>(std::max(options.lease_seconds, 0.1)))),
+              poll_(std::chrono::milliseconds(static_cast<long long>(
+                  std::clamp(options.lease_seconds * 250.0, 10.0, 1000.0)))),
+              heartbeat_(poll_) {
+            fs::create_directories(pending_);
+            fs::create_directories(leased_);
+            fs::create_directories(done_);
+        }
+
+        // One claim loop; several run side by side in one process, each under its own name
+        void run(size_t loop) {
+            std::string owner = owner_ + "-" + std::to_string(loop);
+            std::mt19937 random(std::random_device{}());
+            for (;;) {
+                if (claim_and_run(owner, random)) {
+                    continue;
+                }
+                if (reclaim_expired() > 0) {
+                    continue;
+                }
+                if (queue_empty()) {
+                    return;
+                }
+                // Everything left is leased by live workers; a lease may still expire
+                std::this_thread::sleep_for(poll_);
+            }
+        }
+
+        kitbash::QueueRunResult take_result() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return std::move(result_);
+        }
+
+    private:
+        bool claim_and_run(const std::string& owner, std::mt19937& random) {
+            std::vector<fs::path> jobs;
+            std::error_code ec;
+            for (fs::directory_iterator it(pending_, ec), end; !ec && it != end; it.increment(ec)) {
+                if (has_extension(it->path(), job_extension)) {
+                    jobs.push_back(it->path());
+                }
+            }
+            // Oldest first, but start anywhere among the first few so many workers
+            // polling one folder do not all race for the same file
+            std::sort(jobs.begin(), jobs.end());
+            if (jobs.size() > 1) {
+                size_t start = std::uniform_int_distribution<size_t>(0, std::min<size_t>(jobs.size(), 16) - 1)(random);
+                std::rotate(jobs.begin(), jobs.begin() + start, jobs.end());
+            }
+
+            for (const auto& job : jobs) {
+                std::string id = job.stem().string();
+                fs::path lease = leased_ / (id + "@" + owner + lease_extension);
+                // Rename keeps the mtime, so refresh it first or the new lease looks expired
+                fs::last_write_time(job, fs::file_time_type::clock::now(), ec);
+                fs::rename(job, lease, ec);
+                if (ec) {
+                    continue;   // Another worker won this one
+                }
+                heartbeat_.hold(lease);
+                run_job(id, owner, lease);
+                heartbeat_.release(lease);
+                fs::remove(lease, ec);
+                return true;
+            }
+            return false;
+        }
+
+        void run_job(const std::string& id, const std::string& owner, const fs::path& lease) {
+            fs::path result_file = done_ / (id + result_extension);
+            std::error_code ec;
+            if (fs::exists(result_file, ec)) {
+                return;     // Finished by a worker that died before dropping its lease
+            }
+            // An in-place job replaces its own input, so it must not run again once a
+            // worker has started to commit it: that worker creates the marker first,
+            // and only one creation succeeds. The marker stays after the result is
+            // written, so a worker that took over an expired lease can never commit again.
+            fs::path commit_file = done_ / (id + commit_extension);
+            kitbash::QueueJobResult outcome;
+            outcome.id = id;
+            bool guarded = false;
+            bool committing = false;
+            if (!parse_job(read_text(lease), outcome.result.job)) {
+                outcome.result.error = "Invalid job file: " + lease.string();
+            } else if (outcome.result.job.output.empty() && fs::exists(commit_file, ec)) {
+                outcome.result.error = "Interrupted while replacing " + outcome.result.job.base +
+                                       "; not merged again, check it against its backup";
+            } else if (outcome.result.job.output.empty()) {
+                kitbash::detail::run_batch_job(outcome.result.job, outcome.result, [&] {
+                    guarded = true;
+                    if (fs::exists(result_file)) {
+                        throw std::runtime_error("Job already finished by another worker: " + result_file.string());
+                    }
+                    create_marker(commit_file, owner);
+                    committing = true;
+                });
+            } else {
+                kitbash::detail::run_batch_job(outcome.result.job, outcome.result);
+            }
+            try {
+                // A worker refused at the commit leaves the result to the one that committed
+                if (!guarded || committing) {
+                    write_atomically(result_file, format_result(owner, outcome.result));
+                }
+            } catch (const std::exception& e) {
+                if (outcome.result.success) {
+                    outcome.result.success = false;
+                    outcome.result.error = e.what();
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            result_.jobs.push_back(std::move(outcome));
+        }
+
+        // Return leases whose heartbeat stopped to pending; exactly one rename wins
+        size_t reclaim_expired() {
+            size_t reclaimed = 0;
+            auto now = fs::file_time_type::clock::now();
+            std::error_code ec;
+            for (fs::directory_iterator it(leased_, ec), end; !ec && it != end; it.increment(ec)) {
+                const fs::path& lease = it->path();
+                std::error_code stat_error;
+                auto renewed = fs::last_write_time(lease, stat_error);
+                if (!has_extension(lease, lease_extension) || stat_error || now - renewed <= lease_) {
+                    continue;
+                }
+                std::string name = lease.stem().string();
+                fs::path job = pending_ / (name.substr(0, name.find('@')) + job_extension);
+                std::error_code rename_error;
+                fs::rename(lease, job, rename_error);
+                if (!rename_error) {
+                    ++reclaimed;
+                }
+            }
+            if (reclaimed > 0) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                result_.reclaimed += reclaimed;
+            }
+            return reclaimed;
+        }
+
+        // Stray temporary files (e.g. from a crashed submitter) do not count
+        bool queue_empty() const {
+            for (const auto& [folder, extension] : {std::make_pair(pending_, job_extension),
+                                                    std::make_pair(leased_, lease_extension)}) {
+                std::error_code ec;
+                for (fs::directory_iterator it(folder, ec), end; !ec && it != end; it.increment(ec)) {
+                    if (has_extension(it->path(), extension)) {
+                        return false;
+                    }
+                }
+                if (ec) {
+                    return false;   // Unreadable for now (e.g. NFS hiccup): keep waiting
+                }
+            }
+            return true;
+        }
+
+        fs::path pending_;
+        fs::path leased_;
+        fs::path done_;
+        std::string owner_;
+        fs::file_time_type::duration lease_;
+        std::chrono::milliseconds poll_;
+        Heartbeat heartbeat_;
+        std::mutex mutex_;
+        kitbash::QueueRunResult result_;
+    };
+}
+
+namespace kitbash {
+    std::vector<std::string> submit_batch(const std::string& queue_dir, const std::vector<BatchJob>& jobs) {
+        fs::path pending = fs::path(queue_dir) / "pending";
+        fs::create_directories(pending);
+        fs::create_directories(fs::path(queue_dir) / "leased");
+        fs::create_directories(fs::path(queue_dir) / "done");
+
+        // Ids sort in submission order and stay unique across submitters
+        auto stamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        std::ostringstream prefix;
+        prefix << std::hex << stamp << "-" << detail::hash_bytes(owner_name()) % 0x10000 << "-";
+
+        std::vector<std::string> ids;
+        ids.reserve(jobs.size());
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            std::ostringstream id;
+            id << prefix.str();
+            id.width(6);
+            id.fill('0');
+            id << i;
+            const BatchJob& job = jobs[i];
+            std::string contents = fs::absolute(job.base).lexically_normal().string() + "\n" +
+                                   fs::absolute(job.addition).lexically_normal().string() + "\n" +
+                                   (job.output.empty() ? "" : fs::absolute(job.output).lexically_normal().string()) +
+                                   "\n";
+            write_atomically(pending / (id.str() + job_extension), contents);
+            ids.push_back(id.str());
+        }
+        return ids;
+    }
+
+    QueueRunResult run_queue_worker(const std::string& queue_dir, const QueueOptions& options) {
+        try {
+            QueueWorker worker(queue_dir, options);
+            size_t threads = options.workers > 0 ? options.workers
+                                                 : std::max<size_t>(1, std::thread::hardware_concurrency());
+            std::vector<std::thread> loops;
+            for (size_t i = 1; i < threads; ++i) {
+                loops.emplace_back([&worker, i] { worker.run(i); });
+            }
+            worker.run(0);
+            for (auto& loop : loops) {
+                loop.join();
+            }
+            return worker.take_result();
+        } catch (const std::exception& e) {
+            QueueRunResult result;
+            result.error = e.what();
+            return result;
+        }
+    }
+}
@@ -1,4 +1,5 @@
 #include "kitbash.h"
+#include "kitbash_engine.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -254,6 +255,33 @@ namespace {
         }
     }
 
+    // Vertex checks on merged output lines; repaired VT lines are replaced in place
+    kitbash::GeometryReport check_merged_geometry(std::vector<std::string>& lines,
+                                                  const kitbash::GeometryOptions& options) {
+        kitbash::detail::GeometryScanner scanner(options);
+        for (size_t i = 0; i < lines.size(); ++i) {
+            size_t pos = 0;
+            if (kitbash::detail::next_token(lines[i], pos) == "VT") {
+                scanner.add(lines[i], i + 1);
+            }
+        }
+        if (scanner.needs_indices()) {
+            for (const auto& line : lines) {
+                size_t pos = 0;
+                std::string_view type = kitbash::detail::next_token(line, pos);
+                if (type == "IDX" || type == "IDX10") {
+                    scanner.add_indices(line, 0);
+                }
+            }
+        }
+        std::vector<kitbash::detail::GeometryScanner::Repair> repairs;
+        kitbash::GeometryReport report = scanner.finish(&repairs);
+        for (auto& repair : repairs) {
+            lines[repair.line - 1] = std::move(repair.text);
+        }
+        return report;
+    }
+
     // Helper function for adjusting indices (used by merge_objects)
     std::vector<std::string> adjust_indices(const std::vector<std::string>& lines, int vt_offset, int tris_offset) {
         std::vector<std::string> adjusted;
@@ -466,7 +494,8 @@ namespace kitbash {
         return stats;
     }
 
-    bool merge_with_stats(const std::string& base, const std::string& addition, MergeStats* stats) {
+    bool merge_with_stats(const std::string& base, const std::string& addition, MergeStats* stats,
+                          const GeometryOptions& geometry) {
         try {
             auto start_time = std::chrono::high_resolution_clock::now();
             
@@ -504,6 +533,12 @@ namespace kitbash {
             
             // Merge objects
             auto merged_lines = ::merge_objects(base_info, addition_info);
+            if (geometry.check) {
+                GeometryReport report = check_merged_geometry(merged_lines, geometry);
+                if (stats) {
+                    stats->geometry = report;
+                }
+            }
             
             // Write result back to base file
             ::write_file(base, merged_lines);
@@ -526,7 +561,8 @@ namespace kitbash {
     }
 
     bool merge_to_file_with_stats(const std::string& base, const std::string& addition,
-                                  const std::string& output, MergeStats* stats) {
+                                  const std::string& output, MergeStats* stats,
+                                  const GeometryOptions& geometry) {
         try {
             auto start_time = std::chrono::high_resolution_clock::now();
             
@@ -559,6 +595,12 @@ namespace kitbash {
             
             // Merge objects
             auto merged_lines = ::merge_objects(base_info, addition_info);
+            if (geometry.check) {
+                GeometryReport report = check_merged_geometry(merged_lines, geometry);
+                if (stats) {
+                    stats->geometry = report;
+                }
+            }
             
             // Write result to output file
             ::write_file(output, merged_lines);
@@ -604,4 +646,25 @@ namespace kitbash {
     bool validate_obj_format(const std::vector<std::string>& lines) {
         return ::validate_obj_format(lines);
     }
+
+    // Parsing and merging primitives - public wrappers around internal functions
+    std::vector<std::string> tokenize(const std::string& line) {
+        return ::tokenize(line);
+    }
+
+    ObjInfo parse_obj(const std::vector<std::string>& lines) {
+        return ::parse_obj(lines);
+    }
+
+    std::vector<std::string> merge_objects(const ObjInfo& base, const ObjInfo& addition) {
+        return ::merge_objects(base, addition);
+    }
+
+    std::string adjust_indices_line(const std::string& line, int vt_offset) {
+        return ::adjust_indices_line(line, vt_offset);
+    }
+
+    std::string adjust_tris_line(const std::string& line, int tris_offset) {
+        return ::adjust_tris_line(line, tris_offset);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,308 @@
+#ifndef KITBASH_ENGINE_H
+#define KITBASH_ENGINE_H
+
+// Internal chunked merge engine. Works on memory-mapped inputs and produces the
+// same output as merge_objects() without building per-line strings.
+// Not part of the installed SDK header.
+
+#include "kitbash.h"
+#include "kitbash_io.h"
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <string_view>
+
+namespace kitbash {
+namespace detail {
+    // Tokenizer primitives with the same rules as tokenize() and std::stoi
+    std::string_view next_token(std::string_view line, size_t& pos);
+    size_t split_tokens(std::string_view line, std::string_view* tokens, size_t max);
+    bool parse_int_prefix(std::string_view token, int& value);
+    void append_int(std::string& out, long long value);
+
+    // Byte range of one or more consecutive lines, including their newlines
+    struct Span {
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    // Line layout of a mapped OBJ8 file, split into the sections merge_objects() uses
+    struct ObjLayout {
+        std::vector<Span> header;           // Lines before POINT_COUNTS
+        std::string_view point_counts;      // First POINT_COUNTS line (if any)
+        bool has_point_counts = false;
+        int vt_count = 0;                   // From the last POINT_COUNTS line
+        int tris_count = 0;
+        std::vector<Span> vertices;
+        std::vector<Span> indices;
+        std::vector<Span> footer;           // Non-IDX lines after the first IDX line
+        uint64_t header_lines = 0;
+        uint64_t vertex_lines = 0;
+        uint64_t index_lines = 0;
+        uint64_t footer_lines = 0;
+        uint64_t line_count = 0;            // Lines as read_file() counts them
+
+        // Scan state so large files can be classified in several calls
+        size_t scan_pos = 0;
+        bool past_idx = false;
+    };
+
+    // Classify complete lines starting at layout.scan_pos until at least max_bytes
+    // have been consumed. Returns true once the whole buffer has been scanned.
+    bool scan_layout(std::string_view data, ObjLayout& layout, size_t max_bytes);
+
+    // Same checks as validate_obj_format() on the first three lines
+    bool validate_obj_header(std::string_view data);
+
+    // Relocation site in a compiled section: `literal` bytes of text come first,
+    // then a number printed as value + offset when the section is applied
+    struct Relocation {
+        uint32_t literal;
+        int32_t value;
+    };
+
+    struct CompiledSection {
+        std::string_view literals;          // All text between relocation sites
+        const Relocation* relocs = nullptr;
+        size_t reloc_count = 0;
+    };
+
+    // Resumable position while compiling spans or rendering a compiled section
+    struct Cursor {
+        size_t index = 0;                   // Span or relocation index
+        size_t pos = 0;                     // Byte position in the input or literals
+        size_t mark = 0;                    // Literal position of the current relocation
+    };
+
+    // Compiled addition under construction. Owns the bytes that the finished
+    // CompiledAddition::Data views refer to.
+    struct CompiledBuilder {
+        std::string vertices;
+        std::string index_literals;
+        std::vector<Relocation> index_relocs;
+        std::string footer_literals;
+        std::vector<Relocation> footer_relocs;
+
+        // Size for compiling this many IDX and footer bytes. Literals are at most the
+        // input plus a final newline; every index takes at least two input bytes.
+        void reserve(uint64_t index_bytes, uint64_t footer_bytes) {
+            index_literals.reserve(index_bytes + 1);
+            index_relocs.reserve(index_bytes / 2);
+            footer_literals.reserve(footer_bytes + 1);
+        }
+    };
+
+    // Compile IDX lines (footer == false) or footer lines with TRIS offsets
+    // (footer == true), resuming at cursor until about max_bytes of input have been
+    // consumed. Returns the bytes consumed; all spans are compiled once cursor.index
+    // reaches spans.size().
+    size_t compile_spans(std::string_view data, const std::vector<Span>& spans, bool footer,
+                       CompiledBuilder& builder, Cursor& cursor, size_t max_bytes);
+
+    // Freeze a builder into shareable compiled data; vertices are taken from the
+    // builder, so callers that copy VT lines from elsewhere leave them empty
+    std::shared_ptr<const CompiledAddition::Data> finish_compiled(std::shared_ptr<CompiledBuilder> builder,
+                                                                  const ObjLayout& layout,
+                                                                  const std::string& source);
+
+    // .kbo image in memory: parse one (zero-copy; `storage` keeps the bytes alive and
+    // throws on a bad image) or emit one piece by piece, returning its size
+    std::shared_ptr<const CompiledAddition::Data> read_compiled_image(std::string_view image,
+                                                                      std::shared_ptr<const void> storage,
+                                                                      const std::string& name);
+    uint64_t write_compiled_image(const CompiledAddition::Data& data,
+                                  const std::function<void(std::string_view)>& write);
+
+    // Render a compiled section with offset added at every relocation site, resuming
+    // at cursor until about max_bytes have been produced. Returns true when done.
+    bool render_section(std::string& out, const CompiledSection& section, long long offset,
+                        Cursor& cursor, size_t max_bytes);
+
+    // Access to the data behind a CompiledAddition
+    struct CompiledAccess {
+        static const std::shared_ptr<const CompiledAddition::Data>& data(const CompiledAddition& addition) {
+            return addition.data_;
+        }
+        static CompiledAddition wrap(std::shared_ptr<const CompiledAddition::Data> data) {
+            CompiledAddition addition;
+            addition.data_ = std::move(data);
+            return addition;
+        }
+    };
+
+    // Vertex checks over VT lines fed one at a time. Lines are parsed into blocks of
+    // structure-of-arrays floats and checked a block at a time. With repair_normals,
+    // vertices whose normal cannot be normalized wait for their triangles: feed the
+    // output's indices in order with add_indices() while needs_indices().
+    class GeometryScanner {
+    public:
+        explicit GeometryScanner(const GeometryOptions& options);
+        ~GeometryScanner();
+
+        GeometryScanner(const GeometryScanner&) = delete;
+        GeometryScanner& operator=(const GeometryScanner&) = delete;
+
+        void add(std::string_view line, uint64_t line_number);     // One VT line
+        void add(std::string_view line, uint64_t line_number, size_t readable);    // readable bytes at line.data()
+        bool needs_indices();
+        void add_indices(std::string_view idx_line, long long offset);  // IDX or IDX10 line
+        void add_index(long long index);
+
+        // Lines to replace, in line order, without their newlines
+        struct Repair {
+            uint64_t line;
+            std::string text;
+        };
+        GeometryReport finish(std::vector<Repair>* repairs = nullptr);
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl_;
+    };
+
+    // Feed the VT lines of a VT-only byte range (e.g. a vertex span) from pos, numbering
+    // them from line, until about max_bytes have been read. Returns the bytes read.
+    size_t scan_vertex_lines(GeometryScanner& scanner, std::string_view data, size_t& pos, uint64_t& line,
+                             size_t max_bytes);
+
+    // One merge split into bounded units of work. run_chunk() does a single unit
+    // (map, scan, compile, render or write about chunk_bytes) and returns true once
+    // the output has been committed. Output goes to a temporary file that is renamed
+    // on commit. The addition is compiled first, or supplied precompiled.
+    class MergeJob {
+    public:
+        static constexpr size_t default_chunk_bytes = 1 << 20;
+
+        // Empty output merges in place; the base becomes the backup on commit
+        MergeJob(const std::string& base, const std::string& addition, const std::string& output,
+                 size_t chunk_bytes = default_chunk_bytes);
+        MergeJob(const std::string& base, const CompiledAddition& addition, const std::string& output,
+                 size_t chunk_bytes = default_chunk_bytes);
+        ~MergeJob();
+
+        MergeJob(const MergeJob&) = delete;
+        MergeJob& operator=(const MergeJob&) = delete;
+
+        // Write the output to an open descriptor instead, e.g. a memory file; nothing
+        // is renamed on commit. Call before the first run_chunk().
+        void write_to_descriptor(int descriptor) { output_descriptor_ = descriptor; }
+
+        // Vertex checks (on by default) and normal repair. Call before the first run_chunk().
+        void set_geometry_options(const GeometryOptions& options) { geometry_options_ = options; }
+
+        // Called right before an in-place merge replaces the base; throwing stops the
+        // commit and leaves the base untouched
+        void set_commit_guard(std::function<void()> guard) { commit_guard_ = std::move(guard); }
+
+        bool run_chunk();       // Throws std::runtime_error on failure
+        bool done() const { return step_ == Step::Done; }
+        void abort();           // Discard any partial output
+
+        MergeProgress progress() const;
+        const MergeStats& stats() const { return stats_; }
+        uint64_t output_bytes() const { return written_bytes_; }
+
+    private:
+        enum class Step {
+            MapBase, MapAddition, ScanBase, ScanAddition, CompileIndices, CompileFooter,
+            CheckGeometry, PlanHead, RenderIndices, PlanFooter, RenderFooter,
+            Write, Commit, Done
+        };
+
+        // Output piece: bytes plus an optional newline for unterminated last lines
+        struct Segment {
+            const char* data;
+            size_t size;
+            bool newline;
+        };
+
+        void add_spans(const MappedFile& file, const std::vector<Span>& spans);
+        void add_vertices(std::string_view data, bool missing_newline, uint64_t& line, size_t& repair);
+        void start_check();
+        void finish_check();
+        void add_owned(std::string text);
+        bool render(const CompiledSection& section, long long offset);
+        MergePhase phase() const;
+
+        std::string base_name_;
+        std::string addition_name_;
+        std::string output_name_;
+        std::string temp_name_;
+        bool in_place_ = false;
+        int output_descriptor_ = -1;
+        std::function<void()> commit_guard_;
+        size_t chunk_bytes_ = default_chunk_bytes;
+
+        Step step_ = Step::MapBase;
+        MappedFile base_;
+        MappedFile addition_;
+        ObjLayout base_layout_;
+        ObjLayout addition_layout_;
+        std::shared_ptr<CompiledBuilder> builder_;
+        std::shared_ptr<const CompiledAddition::Data> compiled_;
+        bool precompiled_ = false;
+
+        std::vector<Segment> plan_;
+        std::deque<std::string> owned_;     // Rendered text referenced by plan_
+        Cursor cursor_;                     // Compile or render position
+        uint64_t compile_done_ = 0;         // Merge phase progress: input bytes compiled,
+        uint64_t compile_total_ = 0;        // then literal bytes and relocations rendered
+        uint64_t render_done_ = 0;
+        uint64_t render_total_ = 0;
+        uint64_t input_bytes_ = 0;
+        uint64_t output_lines_ = 0;
+
+        std::unique_ptr<FileWriter> writer_;
+        size_t write_segment_ = 0;
+        size_t write_offset_ = 0;
+        uint64_t output_bytes_ = 0;
+        uint64_t written_bytes_ = 0;
+
+        GeometryOptions geometry_options_;
+        std::unique_ptr<GeometryScanner> scanner_;
+        std::vector<std::string_view> check_ranges_;    // Base, then addition vertex bytes
+        size_t check_range_ = 0;
+        size_t check_pos_ = 0;
+        uint64_t check_line_ = 0;                       // Output line of the next vertex
+        uint64_t first_vertex_line_ = 0;
+        uint64_t check_done_ = 0;
+        uint64_t check_total_ = 0;
+        std::vector<GeometryScanner::Repair> repairs_;
+
+        MergeStats stats_;
+        std::chrono::steady_clock::time_point start_time_;
+        bool started_ = false;
+    };
+
+    // Run one batch job to completion in this thread; never throws. commit_guard as
+    // for MergeJob::set_commit_guard().
+    void run_batch_job(const BatchJob& job, BatchResult& result, std::function<void()> commit_guard = {});
+
+    // Read and validate an OBJ8 file into a Document; throws std::runtime_error
+    Document load_document(const std::string& filename);
+
+    // The document a merge result would be after a write and a re-read
+    Document as_reloaded(const Document& doc);
+
+    // Synthetic OBJ8 object for benchmarks and verification: `vertices` VT lines,
+    // one index per vertex, and animated blocks of 64 triangles
+    void write_synthetic_obj(FileWriter& out, uint64_t vertices, uint64_t seed);
+}
+
+// Immutable compiled addition; the views point into `storage`
+struct CompiledAddition::Data {
+    std::string source;                     // Addition filename, for stats
+    int vt_count = 0;
+    int tris_count = 0;
+    uint64_t line_count = 0;
+    uint64_t vertex_lines = 0;
+    uint64_t index_lines = 0;
+    uint64_t footer_lines = 0;
+    std::string_view vertices;              // VT lines, each newline-terminated
+    detail::CompiledSection indices;        // Relocations add the base VT count
+    detail::CompiledSection footer;         // Relocations add the base TRIS count
+    std::shared_ptr<const void> storage;
+};
+}
+
+#endif // KITBASH_ENGINE_H
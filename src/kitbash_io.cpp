@@ -0,0 +1,478 @@
+#include "kitbash_io.h"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#include <process.h>
+#else
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Internal helper functions
+namespace {
+    // Give `to` the permissions and, where allowed, the owner of `from`
+    void copy_metadata(const std::string& from, const std::string& to) {
+        std::error_code ec;
+        std::filesystem::perms mode = std::filesystem::status(from, ec).permissions();
+        if (!ec) {
+            std::filesystem::permissions(to, mode, ec);
+        }
+#ifndef _WIN32
+        struct stat info;
+        if (::stat(from.c_str(), &info) == 0 && ::chown(to.c_str(), info.st_uid, info.st_gid) != 0) {
+            // Only root may give a file away; the mode still matches
+        }
+#endif
+    }
+
+    // Overwrite `target` with the bytes of `source`, keeping its inode
+    void rewrite_in_place(const std::string& source, const std::string& target) {
+        kitbash::detail::FileReader in(source);
+        kitbash::detail::FileWriter out(target);
+        std::vector<char> buffer(1 << 20);
+        while (size_t count = in.read(buffer.data(), buffer.size())) {
+            out.write(std::string_view(buffer.data(), count));
+        }
+        out.close();
+    }
+
+    bool has_other_links(const std::string& path) {
+        std::error_code ec;
+        uintmax_t links = std::filesystem::hard_link_count(path, ec);
+        return !ec && links > 1;
+    }
+}
+
+namespace kitbash {
+namespace detail {
+    MappedFile::MappedFile(const std::string& filename) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Cannot open file: " + filename);
+        }
+        LARGE_INTEGER file_size;
+        if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (view != nullptr) {
+                    file_handle_ = file;
+                    mapping_handle_ = mapping;
+                    data_ = static_cast<const char*>(view);
+                    size_ = static_cast<size_t>(file_size.QuadPart);
+                    mapped_ = true;
+                    return;
+                }
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open file: " + filename);
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* view = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED) {
+                ::close(fd);
+                data_ = static_cast<const char*>(view);
+                size_ = static_cast<size_t>(st.st_size);
+                mapped_ = true;
+                return;
+            }
+        }
+        ::close(fd);
+#endif
+        // Empty files and filesystems without mmap support are read into memory
+        std::ifstream file_stream(filename, std::ios::binary);
+        if (!file_stream.is_open()) {
+            throw std::runtime_error("Cannot open file: " + filename);
+        }
+        // Read in blocks rather than through a stringstream, which would swallow an
+        // allocation failure and leave the contents silently truncated
+        char block[1 << 16];
+        while (file_stream.read(block, sizeof(block)) || file_stream.gcount() > 0) {
+            fallback_.append(block, static_cast<size_t>(file_stream.gcount()));
+        }
+        if (file_stream.bad()) {
+            throw std::runtime_error("Cannot read file: " + filename);
+        }
+        data_ = fallback_.data();
+        size_ = fallback_.size();
+    }
+
+    MappedFile::~MappedFile() {
+        reset();
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            reset();
+            mapped_ = other.mapped_;
+            fallback_ = std::move(other.fallback_);
+            data_ = mapped_ ? other.data_ : fallback_.data();
+            size_ = other.size_;
+#ifdef _WIN32
+            file_handle_ = other.file_handle_;
+            mapping_handle_ = other.mapping_handle_;
+            other.file_handle_ = nullptr;
+            other.mapping_handle_ = nullptr;
+#endif
+            other.data_ = nullptr;
+            other.size_ = 0;
+            other.mapped_ = false;
+        }
+        return *this;
+    }
+
+    void MappedFile::reset() {
+        if (mapped_) {
+#ifdef _WIN32
+            UnmapViewOfFile(data_);
+            CloseHandle(static_cast<HANDLE>(mapping_handle_));
+            CloseHandle(static_cast<HANDLE>(file_handle_));
+            file_handle_ = nullptr;
+            mapping_handle_ = nullptr;
+#else
+            ::munmap(const_cast<char*>(data_), size_);
+#endif
+        }
+        fallback_.clear();
+        data_ = nullptr;
+        size_ = 0;
+        mapped_ = false;
+    }
+
+    static inline uint64_t rotate_left(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    static inline uint64_t load_word(const char* bytes) {
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        return word;
+    }
+
+    uint64_t hash_bytes(std::string_view bytes, uint64_t seed) {
+        const uint64_t k1 = 0x9E3779B97F4A7C15ULL;
+        const uint64_t k2 = 0xC2B2AE3D27D4EB4FULL;
+        const char* p = bytes.data();
+        size_t n = bytes.size();
+
+        // Four independent lanes of 8 bytes keep the multiplier pipelines busy
+        uint64_t lanes[4] = {seed + k1, seed ^ k2, seed - k1, ~seed};
+        while (n >= 32) {
+            for (int i = 0; i < 4; ++i) {
+                lanes[i] = rotate_left(lanes[i] ^ (load_word(p + 8 * i) * k2), 31) * k1;
+            }
+            p += 32;
+            n -= 32;
+        }
+        uint64_t h = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) +
+                     rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+        h += bytes.size();
+        while (n >= 8) {
+            h = rotate_left(h ^ (load_word(p) * k2), 27) * k1;
+            p += 8;
+            n -= 8;
+        }
+        while (n > 0) {
+            h = rotate_left(h ^ (static_cast<unsigned char>(*p) * k1), 11) * k2;
+            ++p;
+            --n;
+        }
+
+        // Final avalanche (MurmurHash3 fmix64)
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    uint64_t hash_file(const std::string& filename) {
+        MappedFile file(filename);
+        return hash_bytes(file.view());
+    }
+
+    FileWriter::FileWriter(const std::string& filename) : filename_(filename) {
+        file_ = std::fopen(filename.c_str(), "wb");
+        if (file_ == nullptr) {
+            throw std::runtime_error("Cannot create file: " + filename);
+        }
+        // All buffering is done here so large spans can skip the copy entirely
+        std::setvbuf(file_, nullptr, _IONBF, 0);
+        buffer_.resize(buffer_size);
+    }
+
+    FileWriter::FileWriter(int descriptor, const std::string& name) : filename_(name) {
+#ifdef _WIN32
+        int copy = ::_dup(descriptor);
+        file_ = copy >= 0 ? ::_fdopen(copy, "wb") : nullptr;
+#else
+        int copy = ::dup(descriptor);
+        file_ = copy >= 0 ? ::fdopen(copy, "wb") : nullptr;
+#endif
+        if (file_ == nullptr) {
+            if (copy >= 0) {
+                close_descriptor(copy);
+            }
+            throw std::runtime_error("Cannot create file: " + name);
+        }
+        std::setvbuf(file_, nullptr, _IONBF, 0);
+        buffer_.resize(buffer_size);
+    }
+
+    FileWriter::~FileWriter() {
+        if (file_ != nullptr) {
+            try {
+                close();
+            } catch (const std::exception&) {
+                // Destructor must not throw; call close() to observe write errors
+            }
+        }
+    }
+
+    void FileWriter::write(std::string_view bytes) {
+        if (bytes.size() >= direct_threshold) {
+            flush();
+            if (std::fwrite(bytes.data(), 1, bytes.size(), file_) != bytes.size()) {
+                throw std::runtime_error("Cannot write file: " + filename_);
+            }
+        } else {
+            if (used_ + bytes.size() > buffer_.size()) {
+                flush();
+            }
+            std::memcpy(buffer_.data() + used_, bytes.data(), bytes.size());
+            used_ += bytes.size();
+        }
+        bytes_written_ += bytes.size();
+    }
+
+    void FileWriter::flush() {
+        if (used_ > 0) {
+            if (std::fwrite(buffer_.data(), 1, used_, file_) != used_) {
+                throw std::runtime_error("Cannot write file: " + filename_);
+            }
+            used_ = 0;
+        }
+    }
+
+    void FileWriter::close() {
+        if (file_ == nullptr) {
+            return;
+        }
+        std::FILE* file = file_;
+        try {
+            flush();
+        } catch (...) {
+            std::fclose(file);
+            file_ = nullptr;
+            throw;
+        }
+        file_ = nullptr;
+        if (std::fclose(file) != 0) {
+            throw std::runtime_error("Cannot write file: " + filename_);
+        }
+    }
+
+    FileReader::FileReader(const std::string& filename) : filename_(filename) {
+        file_ = std::fopen(filename.c_str(), "rb");
+        if (file_ == nullptr) {
+            throw std::runtime_error("Cannot open file: " + filename);
+        }
+        // Callers read in large blocks; a stdio buffer would only add a copy
+        std::setvbuf(file_, nullptr, _IONBF, 0);
+    }
+
+    FileReader::~FileReader() {
+        if (file_ != nullptr) {
+            std::fclose(file_);
+        }
+    }
+
+    size_t FileReader::read(char* out, size_t size) {
+        size_t total = 0;
+        while (total < size) {
+            size_t count = std::fread(out + total, 1, size - total, file_);
+            if (count == 0) {
+                if (std::ferror(file_)) {
+                    throw std::runtime_error("Cannot read file: " + filename_);
+                }
+                break;
+            }
+            total += count;
+        }
+        bytes_read_ += total;
+        return total;
+    }
+
+    std::string temp_prefix_for(const std::string& path, int process) {
+        return path + "." + std::to_string(process) + "-";
+    }
+
+    std::string temp_path_for(const std::string& path) {
+        static std::atomic<uint64_t> next{0};
+#ifdef _WIN32
+        int process = ::_getpid();
+#else
+        int process = static_cast<int>(::getpid());
+#endif
+        return temp_prefix_for(path, process) + std::to_string(next++) + ".tmp";
+    }
+
+    void replace_file(const std::string& temp, const std::string& path) {
+        std::error_code ec;
+        if (has_other_links(path)) {
+            rewrite_in_place(temp, path);
+            std::filesystem::remove(temp, ec);
+            return;
+        }
+        if (std::filesystem::exists(path, ec)) {
+            copy_metadata(path, temp);
+        }
+        std::filesystem::rename(temp, path);
+    }
+
+    void replace_keeping_backup(const std::string& path, const std::string& temp, const std::string& backup) {
+        std::error_code ec;
+        if (has_other_links(path)) {
+            // Links must keep pointing at the merged file: copy the backup, then rewrite
+            std::filesystem::copy_file(path, backup, std::filesystem::copy_options::overwrite_existing, ec);
+            if (ec) {
+                std::filesystem::remove(temp, ec);
+                throw std::runtime_error("Failed to create backup");
+            }
+            try {
+                rewrite_in_place(temp, path);
+            } catch (...) {
+                std::error_code ignored;
+                rewrite_in_place(backup, path);
+                std::filesystem::remove(temp, ignored);
+                throw;
+            }
+            std::filesystem::remove(temp, ec);
+            return;
+        }
+        copy_metadata(path, temp);
+        std::filesystem::rename(path, backup, ec);
+        if (ec) {
+            std::filesystem::remove(temp, ec);
+            throw std::runtime_error("Failed to create backup");
+        }
+        std::filesystem::rename(temp, path, ec);
+        if (ec) {
+            std::error_code ignored;
+            std::filesystem::rename(backup, path, ignored);
+            std::filesystem::remove(temp, ignored);
+            throw std::runtime_error("Cannot replace file: " + path + " (" + ec.message() + ")");
+        }
+    }
+
+    int create_memory_file(const std::string& name) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+        int memfd = ::memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (memfd >= 0) {
+            return memfd;
+        }
+#endif
+#ifdef _WIN32
+        throw std::runtime_error("In-memory files are not supported on this platform: " + name);
+#else
+        // Older kernels and other systems: a temporary file with no name left
+        const char* folder = std::getenv("TMPDIR");
+        std::string path = std::string(folder ? folder : "/tmp") + "/kitbash-XXXXXX";
+        int descriptor = ::mkstemp(&path[0]);
+        if (descriptor < 0) {
+            throw std::runtime_error("Cannot create file: " + name);
+        }
+        ::unlink(path.c_str());
+        ::fcntl(descriptor, F_SETFD, FD_CLOEXEC);
+        return descriptor;
+#endif
+    }
+
+    bool seal_memory_file(int descriptor) {
+#if defined(__linux__) && defined(F_ADD_SEALS)
+        return ::fcntl(descriptor, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == 0;
+#else
+        (void)descriptor;
+        return false;   // Temporary files (and other systems) cannot be sealed
+#endif
+    }
+
+    int reopen_read_only(int descriptor) {
+#ifdef _WIN32
+        (void)descriptor;
+        return -1;
+#else
+        // Holders could otherwise reopen their copy for writing through /proc
+        if (::fchmod(descriptor, S_IRUSR) != 0) {
+            return -1;
+        }
+        for (const char* folder : {"/proc/self/fd/", "/dev/fd/"}) {
+            int reopened = ::open((folder + std::to_string(descriptor)).c_str(), O_RDONLY | O_CLOEXEC);
+            if (reopened < 0) {
+                continue;
+            }
+            int flags = ::fcntl(reopened, F_GETFL);
+            if (flags >= 0 && (flags & O_ACCMODE) == O_RDONLY) {
+                return reopened;
+            }
+            ::close(reopened);  // A duplicate keeping write access (e.g. /dev/fd on macOS)
+        }
+        return -1;
+#endif
+    }
+
+    bool memory_files_shareable() {
+        static const bool shareable = [] {
+            try {
+                int descriptor = create_memory_file("kitbash-probe");
+                bool sealed = seal_memory_file(descriptor);
+                int read_only = sealed ? -1 : reopen_read_only(descriptor);
+                if (read_only >= 0) {
+                    close_descriptor(read_only);
+                }
+                close_descriptor(descriptor);
+                return sealed || read_only >= 0;
+            } catch (const std::exception&) {
+                return false;
+            }
+        }();
+        return shareable;
+    }
+
+    void close_descriptor(int descriptor) {
+#ifdef _WIN32
+        ::_close(descriptor);
+#else
+        ::close(descriptor);
+#endif
+    }
+}
+}
@@ -0,0 +1,135 @@
+#ifndef KITBASH_IO_H
+#define KITBASH_IO_H
+
+// Internal I/O helpers shared by the core library translation units.
+// Not part of the installed SDK header.
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kitbash {
+namespace detail {
+    // Read-only memory mapping of a whole file. Falls back to reading the file into
+    // memory where mapping is unavailable. Throws std::runtime_error like read_file().
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const std::string& filename);
+        ~MappedFile();
+
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* data() const { return data_; }
+        size_t size() const { return size_; }
+        std::string_view view() const { return std::string_view(data_, size_); }
+
+        void reset();   // Unmap and release the file
+
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+        bool mapped_ = false;
+        std::string fallback_;  // Owns the bytes when the file could not be mapped
+#ifdef _WIN32
+        void* file_handle_ = nullptr;
+        void* mapping_handle_ = nullptr;
+#endif
+    };
+
+    // Fast non-cryptographic 64-bit hash for change detection. Not stable across
+    // byte orders; values are only compared on the machine that wrote them.
+    uint64_t hash_bytes(std::string_view bytes, uint64_t seed = 0);
+    uint64_t hash_file(const std::string& filename);   // Throws like read_file()
+
+    // Buffered binary writer. Small writes are gathered in one buffer; large spans
+    // (e.g. slices of a MappedFile) are handed to the OS directly without copying.
+    // Throws std::runtime_error like write_file().
+    class FileWriter {
+    public:
+        explicit FileWriter(const std::string& filename);
+        FileWriter(int descriptor, const std::string& name);   // Writes through a duplicate of it
+        ~FileWriter();
+
+        FileWriter(const FileWriter&) = delete;
+        FileWriter& operator=(const FileWriter&) = delete;
+
+        void write(std::string_view bytes);
+        void write_line(std::string_view line) {
+            write(line);
+            write(std::string_view("\n", 1));
+        }
+        void close();   // Flush and close; throws if the data could not be written
+
+        uint64_t bytes_written() const { return bytes_written_; }
+
+    private:
+        static constexpr size_t buffer_size = 1 << 20;      // 1 MiB gather buffer
+        static constexpr size_t direct_threshold = 1 << 16; // Spans above 64 KiB bypass it
+
+        void flush();
+
+        std::string filename_;
+        std::FILE* file_ = nullptr;
+        std::vector<char> buffer_;
+        size_t used_ = 0;
+        uint64_t bytes_written_ = 0;
+    };
+
+    // Sequential binary reader for files read once front to back, e.g. inputs too
+    // large to map. Reads go straight into the caller's buffer. Throws
+    // std::runtime_error like read_file().
+    class FileReader {
+    public:
+        explicit FileReader(const std::string& filename);
+        ~FileReader();
+
+        FileReader(const FileReader&) = delete;
+        FileReader& operator=(const FileReader&) = delete;
+
+        size_t read(char* out, size_t size);    // Less than size only at end of file
+
+        uint64_t bytes_read() const { return bytes_read_; }
+
+    private:
+        std::string filename_;
+        std::FILE* file_ = nullptr;
+        uint64_t bytes_read_ = 0;
+    };
+
+    // Name for a temporary file next to `path`, "<path>.<pid>-<n>.tmp", that no other
+    // thread or process writing the same path uses
+    std::string temp_path_for(const std::string& path);
+    std::string temp_prefix_for(const std::string& path, int process);     // Up to the "-<n>"
+
+    // Move `temp` to `path`. An existing `path` keeps its mode and owner; one with
+    // other hard links is rewritten in place instead, so every link sees the result.
+    // Throws std::runtime_error.
+    void replace_file(const std::string& temp, const std::string& path);
+
+    // Keep `path` as `backup` and put `temp` in its place, with the same rules for
+    // mode, owner and hard links as replace_file(). If the replacement fails the
+    // original is restored, so `path` is never left missing. Throws std::runtime_error.
+    void replace_keeping_backup(const std::string& path, const std::string& temp, const std::string& backup);
+
+    // Anonymous in-memory file for handing results to other processes: a memfd on
+    // Linux, an unlinked temporary file on other POSIX systems. Throws
+    // std::runtime_error, always on Windows.
+    int create_memory_file(const std::string& name);
+    bool seal_memory_file(int descriptor);     // Read-only from now on, for every holder; false if unsupported
+
+    // Where sealing is unavailable: a read-only descriptor for the same file, whose
+    // mode no longer allows writing. The caller closes the writable one. -1 if the
+    // system cannot reopen descriptors.
+    int reopen_read_only(int descriptor);
+    bool memory_files_shareable();     // Sealing or reopen_read_only() works here; probed once
+    void close_descriptor(int descriptor);
+}
+}
+
+#endif // KITBASH_IO_H
@@ -0,0 +1,84 @@
+#include "kitbash_thread_pool.h"
+#include <algorithm>
+#include <chrono>
+
+// Internal helper functions
+namespace {
+    thread_local const kitbash::detail::ThreadPool* current_pool = nullptr;    // Pool this thread works for
+}
+
+namespace kitbash {
+namespace detail {
+    ThreadPool::ThreadPool(size_t threads) {
+        threads = std::max<size_t>(1, threads);
+        workers_.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] { worker_loop(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        available_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        available_.notify_one();
+    }
+
+    void ThreadPool::wait(std::future<void>& future) {
+        if (current_pool != this) {
+            future.wait();      // Our workers make progress without this thread
+            return;
+        }
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            std::function<void()> task;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!tasks_.empty()) {
+                    task = std::move(tasks_.front());
+                    tasks_.pop_front();
+                }
+            }
+            if (!task) {
+                future.wait();  // Nothing queued: the task is already running elsewhere
+                return;
+            }
+            task();
+        }
+    }
+
+    ThreadPool& ThreadPool::shared() {
+        static ThreadPool pool(std::thread::hardware_concurrency());
+        return pool;
+    }
+
+    void ThreadPool::worker_loop() {
+        current_pool = this;
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                available_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                // Drain queued work before exiting so futures are always satisfied
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+}
+}
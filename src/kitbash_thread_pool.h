@@ -0,0 +1,48 @@
+#ifndef KITBASH_THREAD_POOL_H
+#define KITBASH_THREAD_POOL_H
+
+// Internal fixed-size thread pool shared by the asynchronous SDK entry points.
+// Not part of the installed SDK header.
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kitbash {
+namespace detail {
+    class ThreadPool {
+    public:
+        explicit ThreadPool(size_t threads);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void submit(std::function<void()> task);
+        size_t size() const { return workers_.size(); }
+
+        // Wait for a task submitted to this pool. Called from one of the pool's own
+        // workers (e.g. an async completion callback), it runs queued tasks meanwhile:
+        // a plain wait there deadlocks once every worker waits, at once with one worker.
+        void wait(std::future<void>& future);
+
+        // Process-wide pool with one worker per hardware thread, created on first use
+        static ThreadPool& shared();
+
+    private:
+        void worker_loop();
+
+        std::vector<std::thread> workers_;
+        std::deque<std::function<void()>> tasks_;
+        std::mutex mutex_;
+        std::condition_variable available_;
+        bool stopping_ = false;
+    };
+}
+}
+
+#endif // KITBASH_THREAD_POOL_H
@@ -8,6 +8,8 @@
 #include <cctype>
 #include <filesystem>
 #include <chrono>
+#include <climits>
+#include <csignal>
 
 // CLI function declarations
 void print_usage();
@@ -16,11 +18,46 @@ void print_version();
 void print_error(const std::string& error_type, const std::string& message, const std::string& suggestion = "");
 bool confirm_overwrite(const std::string& filename);
 void print_detailed_summary(const MergeStats& stats);
+void print_cache_summary(const kitbash::MergeCache& cache, bool hit);
+void print_bounded_summary(const kitbash::BoundedMergeResult& result, uint64_t max_memory);
+void print_selection_summary(const kitbash::SelectionStats& selection);
 std::string format_number(int number);  // Add commas for readability (e.g., "1,245")
+std::string format_number(uint64_t number);
 bool validate_arguments(int argc, char* argv[]);
 
 // Helper functions
 bool is_obj_extension(const std::string& filename);
+bool is_kbo_extension(const std::string& filename);
+std::string compiled_filename(const std::string& filename);
+int run_compile(const std::string& addition_file, const std::string& output_file);
+int run_fanout(const std::vector<std::string>& files, const std::string& output_dir, bool wants_summary);
+int run_build(const std::string& manifest_file, bool force);
+int run_batch_file(const std::string& batch_file, const kitbash::BatchOptions& options, bool wants_summary);
+int run_queue(const std::string& queue_dir, const std::string& batch_file, size_t workers, bool wants_summary);
+int run_serve(const std::string& socket_path, size_t workers);
+int run_remote(const std::string& socket_path, const std::string& base_file, const std::string& addition_file,
+               const std::string& output_file, bool interactive, bool fetch, bool wants_summary);
+int run_analyze(const std::string& obj_file, bool json, bool breakdown);
+void print_analysis(const kitbash::ObjAnalysis& report);
+int run_profile(const std::string& base_file, const std::string& addition_file, const std::string& output_file);
+void print_profile(const kitbash::MergeProfile& profile);
+int run_bench(uint64_t max_vertices, size_t max_threads, int runs, bool json);
+void print_bench_row(const kitbash::BenchmarkPoint& point);
+void print_bench_json(const std::vector<kitbash::BenchmarkPoint>& points, int runs);
+int run_verify(const std::string& base_file, const std::string& addition_file);
+int run_verify_corpus(uint64_t max_vertices, size_t max_threads);
+void print_divergence(const kitbash::VerifyResult& result);
+int run_validate(const std::vector<std::string>& files, size_t threads);
+void print_structure_rows(const kitbash::StructureReport& report);
+bool check_structure(const std::string& file, bool strict);
+int run_plan(const std::vector<kitbash::BatchJob>& jobs, const kitbash::BatchOptions& options,
+             const std::string& calibration_file);
+void print_analysis_json(const kitbash::ObjAnalysis& report);
+void print_geometry_rows(const kitbash::GeometryReport& report, bool all);
+void print_geometry_warnings(const kitbash::GeometryReport& report);
+std::string json_string(const std::string& text);
+bool parse_count(const std::string& text, uint64_t& value);
+bool parse_line_range(const std::string& text, std::pair<uint64_t, uint64_t>& range);
 std::string to_lower(const std::string& str);
 
 // Helper function implementations
@@ -30,6 +67,42 @@ bool is_obj_extension(const std::string& filename) {
     return ext == ".obj";
 }
 
+bool is_kbo_extension(const std::string& filename) {
+    if (filename.length() < 4) return false;
+    std::string ext = to_lower(filename.substr(filename.length() - 4));
+    return ext == ".kbo";
+}
+
+std::string compiled_filename(const std::string& filename) {
+    // part.obj -> part.kbo
+    return std::filesystem::path(filename).replace_extension(".kbo").string();
+}
+
+bool parse_count(const std::string& text, uint64_t& value) {
+    if (text.empty() || !std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isdigit(c); })) {
+        return false;
+    }
+    try {
+        value = std::stoull(text);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// "120-340", or "120" for a single line; 1-based and inclusive
+bool parse_line_range(const std::string& text, std::pair<uint64_t, uint64_t>& range) {
+    size_t dash = text.find('-');
+    if (!parse_count(text.substr(0, dash), range.first)) {
+        return false;
+    }
+    range.second = range.first;
+    if (dash != std::string::npos && !parse_count(text.substr(dash + 1), range.second)) {
+        return false;
+    }
+    return range.first > 0 && range.first <= range.second;
+}
+
 std::string to_lower(const std::string& str) {
     std::string result = str;
     std::transform(result.begin(), result.end(), result.begin(),
@@ -47,22 +120,113 @@ void print_help() {
     std::cout << "KITBASH - X-Plane OBJ8 File Merger\n";
     std::cout << "==================================\n\n";
     std::cout << "USAGE:\n";
-    std::cout << "  kitbash base.obj addition.obj [OPTIONS]\n\n";
+    std::cout << "  kitbash base.obj addition.obj [OPTIONS]\n";
+    std::cout << "  kitbash --compile addition.obj [-o addition.kbo]\n";
+    std::cout << "  kitbash --fanout addition.obj base1.obj ... baseN.obj [-o DIR] [-s]\n";
+    std::cout << "  kitbash --manifest kit.manifest [--force]\n";
+    std::cout << "  kitbash --batch jobs.txt [--isolate] [--workers N] [--memory-limit MB] [-s]\n";
+    std::cout << "  kitbash --queue DIR [--batch jobs.txt] [--workers N] [-s]\n";
+    std::cout << "  kitbash --serve SOCKET [--workers N]\n";
+    std::cout << "  kitbash --remote SOCKET base.obj addition.obj [-o FILE] [--interactive] [--fetch] [-s]\n";
+    std::cout << "  kitbash --analyze model.obj [--breakdown] [--json]\n";
+    std::cout << "  kitbash --profile base.obj addition.obj [-o FILE]\n";
+    std::cout << "  kitbash --bench [--max-vertices N] [--workers N] [--runs N] [--json]\n";
+    std::cout << "  kitbash --verify [base.obj addition.obj] [--max-vertices N] [--workers N]\n";
+    std::cout << "  kitbash --validate model.obj ... [--workers N]\n";
+    std::cout << "  kitbash --plan (base.obj addition.obj | --batch jobs.txt | --fanout addition.obj base.obj ...)\n";
+    std::cout << "                 [--calibration bench.json] [--workers N] [--memory-limit MB]\n\n";
     std::cout << "DESCRIPTION:\n";
     std::cout << "  Merges X-Plane OBJ8 files by combining vertices, indices, and animations\n";
     std::cout << "  from the addition file into the base file. Automatically adjusts vertex\n";
     std::cout << "  and triangle indices to maintain proper references.\n\n";
     std::cout << "ARGUMENTS:\n";
     std::cout << "  base.obj      Base OBJ8 file (will be modified unless -o is used)\n";
-    std::cout << "  addition.obj  Addition OBJ8 file to merge into base\n\n";
+    std::cout << "  addition.obj  Addition OBJ8 file to merge into base, or a .kbo file\n";
+    std::cout << "                made with --compile\n\n";
     std::cout << "OPTIONS:\n";
     std::cout << "  -s            Show detailed summary statistics\n";
     std::cout << "  -o FILE       Output to specified file (preserves original base file)\n";
+    std::cout << "  --compile     Precompile an addition into a .kbo file for repeated merges\n";
+    std::cout << "  --fanout      Merge one addition into every listed base concurrently\n";
+    std::cout << "                (-o names an output directory in this mode)\n";
+    std::cout << "  --manifest    Run the merge steps in a manifest, rebuilding only steps\n";
+    std::cout << "                whose inputs changed since the last run\n";
+    std::cout << "  --force       With --manifest: rebuild every step\n";
+    std::cout << "  --batch       Run the merge jobs listed in a file ('base + addition [-> output]')\n";
+    std::cout << "  --isolate     With --batch: run jobs in worker processes so a crash fails\n";
+    std::cout << "                only its own job\n";
+    std::cout << "  --workers N   With --batch: number of concurrent jobs (default: all cores)\n";
+    std::cout << "  --memory-limit MB  With --batch --isolate: cap each worker's memory\n";
+    std::cout << "  --queue DIR   Work through a job queue shared with other kitbash processes\n";
+    std::cout << "                (also on other machines); with --batch, submit the jobs first\n";
+    std::cout << "  --serve SOCKET  Run a merge server on a Unix socket: identical requests in\n";
+    std::cout << "                flight run once, in-place merges into one base are combined\n";
+    std::cout << "                into a single write, interactive requests go first\n";
+    std::cout << "  --remote SOCKET  Send the merge to a server started with --serve\n";
+    std::cout << "  --interactive  With --remote: queue ahead of bulk requests\n";
+    std::cout << "  --fetch       With --remote -o: the server merges into memory and passes\n";
+    std::cout << "                the result over the socket; it is written to FILE here\n";
+    std::cout << "  --analyze     Report the render cost of one file: draw calls, state changes,\n";
+    std::cout << "                animation, manipulators, memory, LODs and unused data\n";
+    std::cout << "  --breakdown   With --analyze: cost of each ANIM block and each dataref,\n";
+    std::cout << "                most expensive first\n";
+    std::cout << "  --json        With --analyze: print the report as JSON\n";
+    std::cout << "  --profile     Time each merge phase and read hardware counters (Linux);\n";
+    std::cout << "                without -o the output is discarded and no file changes\n";
+    std::cout << "  --bench       Benchmark full merges of generated objects from 10,000\n";
+    std::cout << "                vertices up to --max-vertices (default 1,000,000), on 1\n";
+    std::cout << "                to --workers threads; --json prints the results as JSON\n";
+    std::cout << "  --runs N      With --bench: timed runs per point (default 5)\n";
+    std::cout << "  --verify      Check that every merge engine gives the reference output;\n";
+    std::cout << "                without files, over generated objects of 1 vertex up to\n";
+    std::cout << "                --max-vertices (default 100,000) and fan-out on 1 to --workers threads\n";
+    std::cout << "  --validate    Check POINT_COUNTS against the real records, every index against\n";
+    std::cout << "                the vertex count and every TRIS/LINES range against the indices\n";
+    std::cout << "  --strict      Fail a merge whose inputs do not pass those checks, before any\n";
+    std::cout << "                file changes (without it they are printed as warnings)\n";
+    std::cout << "  --plan        Predict output size, counts, peak memory and time of a merge,\n";
+    std::cout << "                batch or fan-out from file sizes and POINT_COUNTS alone\n";
+    std::cout << "  --calibration FILE  With --plan: fit time and memory to a --bench --json result\n";
+    std::cout << "  --max-memory MB  Merge within a fixed memory budget (at least 16), reading\n";
+    std::cout << "                the inputs in blocks and spilling to temporary files next to\n";
+    std::cout << "                the output, for objects larger than RAM\n";
+    std::cout << "  --select-dataref REF  Merge only the addition's TRIS batches inside ANIM\n";
+    std::cout << "                blocks driven by REF ('prefix*' matches a prefix), with their\n";
+    std::cout << "                ANIM blocks and only the vertices and indices they use\n";
+    std::cout << "  --select-manip TYPE  Only batches under that ATTR_manip_ type (or 'none')\n";
+    std::cout << "  --select-lod N      Only batches of the addition's Nth ATTR_LOD (0: before the first)\n";
+    std::cout << "  --select-lines A-B  Only TRIS lines within those addition lines\n";
+    std::cout << "  --repair-normals    Normalize VT normals in the output; zero or NaN normals\n";
+    std::cout << "                take the normal of their triangles\n";
+    std::cout << "  --geometry-check    Check the output vertices (NaN positions, bad normals, UVs)\n";
+    std::cout << "  --cache       Reuse stored results of identical merges (folder from\n";
+    std::cout << "                KITBASH_CACHE_DIR, default ~/.cache/kitbash)\n";
+    std::cout << "  --shared-objects  Share parsed additions with concurrent kitbash processes\n";
+    std::cout << "                through shared memory, so each part is parsed once per machine\n";
     std::cout << "  -h, --help    Show this help message\n";
     std::cout << "  -v, --version Show version information\n\n";
     std::cout << "EXAMPLES:\n";
     std::cout << "  kitbash aircraft.obj landing_gear.obj\n";
-    std::cout << "  kitbash -s -o merged.obj base.obj addon.obj\n\n";
+    std::cout << "  kitbash -s -o merged.obj base.obj addon.obj\n";
+    std::cout << "  kitbash --compile landing_gear.obj\n";
+    std::cout << "  kitbash -o merged.obj aircraft.obj landing_gear.kbo\n";
+    std::cout << "  kitbash --fanout -o retrofit avionics_box.obj c172.obj c182.obj pa28.obj\n";
+    std::cout << "  kitbash --manifest fuselage.manifest\n";
+    std::cout << "  kitbash --cache -s -o merged.obj base.obj addon.obj\n";
+    std::cout << "  kitbash --batch --isolate --memory-limit 4096 overnight.txt\n";
+    std::cout << "  kitbash --queue /mnt/farm/queue --batch overnight.txt\n";
+    std::cout << "  kitbash --serve /tmp/kitbash.sock &\n";
+    std::cout << "  kitbash --remote /tmp/kitbash.sock --interactive -o preview.obj base.obj addon.obj\n";
+    std::cout << "  kitbash --analyze --json aircraft.obj > aircraft_cost.json\n";
+    std::cout << "  kitbash --analyze --breakdown cockpit.obj\n";
+    std::cout << "  kitbash --profile aircraft.obj landing_gear.obj\n";
+    std::cout << "  kitbash --bench --max-vertices 10000000 --json > agent.json\n";
+    std::cout << "  kitbash --verify aircraft.obj landing_gear.obj\n";
+    std::cout << "  kitbash --validate aircraft.obj landing_gear.obj\n";
+    std::cout << "  kitbash --strict -o merged.obj aircraft.obj landing_gear.obj\n";
+    std::cout << "  kitbash --max-memory 512 -o scenery.obj terrain.obj buildings.obj\n";
+    std::cout << "  kitbash --select-manip command -o panel.obj panel.obj switches.obj\n";
+    std::cout << "  kitbash --plan --batch overnight.txt --workers 8 --calibration agent.json\n\n";
     std::cout << "SAFETY:\n";
     std::cout << "  - Automatic backup created when overwriting original files\n";
     std::cout << "  - User confirmation required before any modifications\n";
@@ -89,7 +253,7 @@ void print_error(const std::string& error_type, const std::string& message, cons
     } else if (error_type == "invalid_switch") {
         std::cout << "Command Line:\n";
         std::cout << "  Invalid switch: '" << message << "'\n";
-        std::cout << "    Expected: -s, -o, -h, --help, -v, --version\n\n";
+        std::cout << "    Expected: -s, -o, --compile, --fanout, --manifest, --force, --cache, --batch, --isolate, --workers, --memory-limit, --queue, --serve, --remote, --interactive, --fetch, --analyze, --breakdown, --json, --profile, --bench, --max-vertices, --runs, --verify, --validate, --strict, --plan, --calibration, --max-memory, --select-dataref, --select-manip, --select-lod, --select-lines, --repair-normals, --geometry-check, --shared-objects, -h, --help, -v, --version\n\n";
         std::cout << "Usage:\n";
         std::cout << "  kitbash base.obj addition.obj [-s] [-o output.obj]\n";
     } else if (error_type == "invalid_obj") {
@@ -106,6 +270,22 @@ void print_error(const std::string& error_type, const std::string& message, cons
         std::cout << "Backup Operations:\n";
         std::cout << "  " << message << "\n";
         std::cout << "    Check: Write permissions and disk space\n";
+    } else if (error_type == "invalid_manifest") {
+        std::cout << "Manifest:\n";
+        std::cout << "  " << message << "\n";
+        std::cout << "    Expected: name = base.obj + addition.obj [+ @step ...] [-> output.obj]\n";
+    } else if (error_type == "invalid_batch") {
+        std::cout << "Batch:\n";
+        std::cout << "  " << message << "\n";
+        std::cout << "    Expected: base.obj + addition.obj [-> output.obj]\n";
+    } else if (error_type == "invalid_structure") {
+        std::cout << "Structure:\n";
+        std::cout << "  " << message << "\n";
+        std::cout << "    Check: POINT_COUNTS, IDX and TRIS lines (kitbash --validate lists every problem)\n";
+    } else if (error_type == "invalid_selection") {
+        std::cout << "Selection:\n";
+        std::cout << "  " << message << "\n";
+        std::cout << "    Check: Filters against the addition (kitbash --analyze --breakdown lists its datarefs)\n";
     } else if (error_type == "merge_failed") {
         std::cout << "Processing:\n";
         std::cout << "  " << message << "\n";
@@ -119,6 +299,344 @@ void print_error(const std::string& error_type, const std::string& message, cons
     }
 }
 
+int run_compile(const std::string& addition_file, const std::string& output_file) {
+    if (!is_obj_extension(addition_file)) {
+        print_error("invalid_obj", addition_file, "");
+        return 1;
+    }
+    if (!std::filesystem::exists(addition_file)) {
+        print_error("file_not_found", "Addition file '" + addition_file + "' not found", "Check the file path and try again");
+        return 1;
+    }
+    
+    try {
+        auto compiled = kitbash::CompiledAddition::compile(addition_file);
+        compiled.save(output_file);
+        std::cout << "Compiled " << addition_file << " -> " << output_file << " ("
+                  << format_number(compiled.vt_count()) << " vertices, "
+                  << format_number(static_cast<int>(compiled.relocation_count())) << " relocations)\n";
+        return 0;
+    } catch (const std::exception& e) {
+        print_error("merge_failed", e.what(), "");
+        return 1;
+    }
+}
+
+int run_fanout(const std::vector<std::string>& files, const std::string& output_dir, bool wants_summary) {
+    const std::string& addition_file = files[0];
+    std::vector<std::string> bases(files.begin() + 1, files.end());
+    
+    if (!is_obj_extension(addition_file) && !is_kbo_extension(addition_file)) {
+        print_error("invalid_obj", addition_file, "");
+        return 1;
+    }
+    if (!std::filesystem::exists(addition_file)) {
+        print_error("file_not_found", "Addition file '" + addition_file + "' not found", "Check the file path and try again");
+        return 1;
+    }
+    for (const auto& base : bases) {
+        if (!is_obj_extension(base)) {
+            print_error("invalid_obj", base, "");
+            return 1;
+        }
+        if (!std::filesystem::exists(base)) {
+            print_error("file_not_found", "Base file '" + base + "' not found", "Check the file path and try again");
+            return 1;
+        }
+    }
+    
+    kitbash::FanoutOptions options;
+    options.output_dir = output_dir;
+    if (output_dir.empty()) {
+        // One confirmation covers every base; each keeps its own backup
+        if (!confirm_overwrite(std::to_string(bases.size()) + " base files")) {
+            std::cout << "\nUser Actions:\n";
+            std::cout << "  Operation cancelled by user\n";
+            std::cout << "    Note: No files were modified\n";
+            return 0;
+        }
+    } else {
+        std::error_code ec;
+        std::filesystem::create_directories(output_dir, ec);
+        if (ec) {
+            print_error("exception", "Cannot create output directory '" + output_dir + "'", "Check file permissions");
+            return 1;
+        }
+    }
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    auto results = kitbash::merge_fanout(addition_file, bases, options);
+    auto duration = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time);
+    
+    int failures = 0;
+    for (const auto& result : results) {
+        if (result.success) {
+            std::cout << "  OK    " << result.base << " -> " << result.output << " ("
+                      << format_number(result.stats.final_line_count) << " lines)\n";
+        } else {
+            std::cout << "  FAIL  " << result.base << ": " << result.error << "\n";
+            ++failures;
+        }
+    }
+    if (wants_summary) {
+        for (const auto& result : results) {
+            if (result.success) {
+                MergeStats stats = result.stats;
+                stats.addition_filename = addition_file;
+                print_detailed_summary(stats);
+            }
+        }
+    }
+    std::cout << "\nMerged " << (results.size() - failures) << " of " << results.size()
+              << " bases in " << std::fixed << std::setprecision(3) << duration.count() << " seconds.\n";
+    return failures == 0 ? 0 : 1;
+}
+
+int run_batch_file(const std::string& batch_file, const kitbash::BatchOptions& options, bool wants_summary) {
+    if (!std::filesystem::exists(batch_file)) {
+        print_error("file_not_found", "Batch file '" + batch_file + "' not found", "Check the file path and try again");
+        return 1;
+    }
+    std::vector<kitbash::BatchJob> jobs;
+    try {
+        jobs = kitbash::read_batch_file(batch_file);
+    } catch (const std::exception& e) {
+        print_error("invalid_batch", e.what(), "");
+        return 1;
+    }
+    
+    size_t in_place = std::count_if(jobs.begin(), jobs.end(),
+                                    [](const kitbash::BatchJob& job) { return job.output.empty(); });
+    if (in_place > 0 && !confirm_overwrite(std::to_string(in_place) + " base files")) {
+        std::cout << "\nUser Actions:\n";
+        std::cout << "  Operation cancelled by user\n";
+        std::cout << "    Note: No files were modified\n";
+        return 0;
+    }
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    auto results = kitbash::run_batch(jobs, options);
+    auto duration = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time);
+    
+    int failures = 0;
+    for (const auto& result : results) {
+        if (result.success) {
+            std::cout << "  OK    " << result.job.base << " + " << result.job.addition << " -> "
+                      << result.stats.output_filename << " (" << format_number(result.stats.final_line_count)
+                      << " lines)\n";
+        } else {
+            std::cout << "  FAIL  " << result.job.base << " + " << result.job.addition << ": "
+                      << result.error << "\n";
+            ++failures;
+        }
+    }
+    if (wants_summary) {
+        for (const auto& result : results) {
+            if (result.success) {
+                print_detailed_summary(result.stats);
+            }
+        }
+    }
+    std::cout << "\nCompleted " << (results.size() - failures) << " of " << results.size()
+              << " jobs in " << std::fixed << std::setprecision(3) << duration.count() << " seconds.\n";
+    return failures == 0 ? 0 : 1;
+}
+
+int run_queue(const std::string& queue_dir, const std::string& batch_file, size_t workers, bool wants_summary) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    if (!batch_file.empty()) {
+        if (!std::filesystem::exists(batch_file)) {
+            print_error("file_not_found", "Batch file '" + batch_file + "' not found", "Check the file path and try again");
+            return 1;
+        }
+        try {
+            auto jobs = kitbash::read_batch_file(batch_file);
+            size_t in_place = std::count_if(jobs.begin(), jobs.end(),
+                                            [](const kitbash::BatchJob& job) { return job.output.empty(); });
+            if (in_place > 0 && !confirm_overwrite(std::to_string(in_place) + " base files")) {
+                std::cout << "\nUser Actions:\n";
+                std::cout << "  Operation cancelled by user\n";
+                std::cout << "    Note: No files were modified\n";
+                return 0;
+            }
+            auto ids = kitbash::submit_batch(queue_dir, jobs);
+            std::cout << "Submitted " << ids.size() << " jobs to " << queue_dir << "\n";
+        } catch (const std::exception& e) {
+            print_error("invalid_batch", e.what(), "");
+            return 1;
+        }
+    }
+    
+    kitbash::QueueOptions options;
+    options.workers = workers;
+    auto result = kitbash::run_queue_worker(queue_dir, options);
+    auto duration = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time);
+    if (!result.error.empty()) {
+        print_error("exception", result.error, "Check that the queue folder exists and is writable");
+        return 1;
+    }
+    
+    int failures = 0;
+    for (const auto& job : result.jobs) {
+        const kitbash::BatchResult& outcome = job.result;
+        if (outcome.success) {
+            std::cout << "  OK    " << job.id << "  " << outcome.job.base << " + " << outcome.job.addition
+                      << " -> " << outcome.stats.output_filename << "\n";
+        } else {
+            std::cout << "  FAIL  " << job.id << "  " << outcome.job.base << " + " << outcome.job.addition
+                      << ": " << outcome.error << "\n";
+            ++failures;
+        }
+    }
+    if (wants_summary) {
+        for (const auto& job : result.jobs) {
+            if (job.result.success) {
+                print_detailed_summary(job.result.stats);
+            }
+        }
+    }
+    std::cout << "\nRan " << result.jobs.size() << " jobs here (" << failures << " failed";
+    if (result.reclaimed > 0) {
+        std::cout << ", " << result.reclaimed << " expired leases reclaimed";
+    }
+    std::cout << ") in " << std::fixed << std::setprecision(3) << duration.count() << " seconds; queue drained.\n";
+    return failures == 0 ? 0 : 1;
+}
+
+// Set by SIGINT/SIGTERM while serving
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) {
+    stop_requested = 1;
+}
+
+int run_serve(const std::string& socket_path, size_t workers) {
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+    kitbash::ServiceOptions options;
+    options.workers = workers;
+    std::cout << "Serving merges on " << socket_path << " (Ctrl+C to stop)\n";
+    std::string error;
+    kitbash::ServiceStats stats;
+    if (!kitbash::serve_merge_service(socket_path, options, [] { return stop_requested != 0; }, &error, &stats)) {
+        print_error("exception", error, "The socket folder is writable and no other server uses the path");
+        return 1;
+    }
+    std::cout << "Server stopped after " << stats.requests << " requests: " << stats.executions << " merges run, "
+              << stats.coalesced << " coalesced, " << stats.combined << " combined into another write.\n";
+    return 0;
+}
+
+int run_remote(const std::string& socket_path, const std::string& base_file, const std::string& addition_file,
+               const std::string& output_file, bool interactive, bool fetch, bool wants_summary) {
+    if (output_file.empty() && !confirm_overwrite(base_file)) {
+        std::cout << "\nUser Actions:\n";
+        std::cout << "  Operation cancelled by user\n";
+        std::cout << "    Note: No files were modified\n";
+        return 0;
+    }
+    auto priority = interactive ? kitbash::Priority::Interactive : kitbash::Priority::Bulk;
+    auto result = fetch ? kitbash::fetch_remote(socket_path, base_file, addition_file, output_file,
+                                                kitbash::Transfer::Descriptor, priority)
+                        : kitbash::merge_remote(socket_path, base_file, addition_file, output_file, priority);
+    if (!result.success) {
+        print_error("exception", result.error, "The server is running and both files are valid OBJ8 format");
+        return 1;
+    }
+    if (!result.stats.backup_filename.empty()) {
+        std::cout << "Backup created: " << result.stats.backup_filename << "\n";
+    }
+    std::cout << "Merge completed successfully.\n";
+    if (wants_summary) {
+        print_detailed_summary(result.stats);
+    }
+    return 0;
+}
+
+int run_analyze(const std::string& obj_file, bool json, bool breakdown) {
+    try {
+        kitbash::AnalysisOptions options;
+        options.breakdown = breakdown;
+        kitbash::ObjAnalysis report = kitbash::analyze_obj(obj_file, options);
+        if (json) {
+            print_analysis_json(report);
+        } else {
+            print_analysis(report);
+        }
+    } catch (const std::exception& e) {
+        print_error("exception", e.what(), "The file exists and is valid OBJ8 format");
+        return 1;
+    }
+    return 0;
+}
+
+int run_profile(const std::string& base_file, const std::string& addition_file, const std::string& output_file) {
+    namespace fs = std::filesystem;
+    // Profiling must not touch the inputs: without -o, merge into a scratch file
+    std::string target = output_file;
+    if (target.empty()) {
+        target = (fs::temp_directory_path() / ("kitbash-profile-" + std::to_string(
+            std::chrono::steady_clock::now().time_since_epoch().count()) + ".obj")).string();
+    }
+    int status = 0;
+    try {
+        kitbash::MergeProfile profile = kitbash::profile_merge(base_file, addition_file, target);
+        print_profile(profile);
+        std::cout << "\nOutput: " << (output_file.empty() ? "discarded" : output_file) << " ("
+                  << format_number(profile.stats.final_line_count) << " lines)\n";
+    } catch (const std::exception& e) {
+        print_error("exception", e.what(), "Both files exist and are valid OBJ8 format");
+        status = 1;
+    }
+    if (output_file.empty()) {
+        std::error_code ec;
+        fs::remove(target, ec);
+    }
+    return status;
+}
+
+int run_build(const std::string& manifest_file, bool force) {
+    if (!std::filesystem::exists(manifest_file)) {
+        print_error("file_not_found", "Manifest file '" + manifest_file + "' not found", "Check the file path and try again");
+        return 1;
+    }
+    
+    kitbash::ManifestOptions options;
+    options.force = force;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    auto result = kitbash::run_manifest(manifest_file, options);
+    auto duration = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time);
+    
+    if (!result.error.empty() && result.steps.empty()) {
+        print_error("invalid_manifest", result.error, "");
+        return 1;
+    }
+    for (const auto& step : result.steps) {
+        std::string target = step.output.empty() ? "(in memory)" : step.output;
+        switch (step.status) {
+        case kitbash::StepStatus::Built:
+            std::cout << "  BUILT  " << step.name << " -> " << target << " (" << std::fixed
+                      << std::setprecision(3) << step.processing_time << " s)\n";
+            break;
+        case kitbash::StepStatus::UpToDate:
+            std::cout << "  OK     " << step.name << " -> " << target << " (up to date)\n";
+            break;
+        case kitbash::StepStatus::Failed:
+            std::cout << "  FAIL   " << step.name << ": " << step.error << "\n";
+            break;
+        case kitbash::StepStatus::Unused:
+            std::cout << "  UNUSED " << step.name << " (no output and no dependents)\n";
+            break;
+        }
+    }
+    if (!result.error.empty()) {
+        std::cout << "  " << result.error << "\n";
+    }
+    std::cout << "\nBuilt " << result.built << " steps, " << result.up_to_date << " up to date, in "
+              << std::fixed << std::setprecision(3) << duration.count() << " seconds.\n";
+    return result.success ? 0 : 1;
+}
+
 bool confirm_overwrite(const std::string& filename) {
     std::cout << "Warning: This operation will overwrite " << filename << "\n";
     std::cout << "Please confirm you have a backup before proceeding.\n";
@@ -165,11 +683,602 @@ void print_detailed_summary(const MergeStats& stats) {
     if (!stats.backup_filename.empty()) {
         std::cout << "  Backup:   " << stats.backup_filename << "\n";
     }
+    if (stats.geometry.checked) {
+        std::cout << "  Geometry: " << format_number(stats.geometry.vertices) << " vertices checked"
+                  << (stats.geometry.vectorized ? " (AVX2)" : "")
+                  << (stats.geometry.clean() ? ", no issues" : ", see warnings above") << "\n";
+    }
     std::cout << "\nCompleted successfully in " << std::fixed << std::setprecision(3)
               << stats.processing_time << " seconds.\n";
 }
 
+void print_cache_summary(const kitbash::MergeCache& cache, bool hit) {
+    kitbash::CacheStats cache_stats = cache.stats();
+    std::cout << "\nCache:\n";
+    std::cout << "  " << (hit ? "Hit" : "Miss") << " (" << cache_stats.hits << " hits, "
+              << cache_stats.misses << " misses)\n";
+    if (!hit) {
+        std::cout << "  Stored:   " << cache_stats.entries << " entries, " << std::fixed << std::setprecision(1)
+                  << cache_stats.bytes / (1024.0 * 1024.0) << " MB in " << cache.directory() << "\n";
+    } else {
+        std::cout << "  Folder:   " << cache.directory() << "\n";
+    }
+}
+
+void print_bounded_summary(const kitbash::BoundedMergeResult& result, uint64_t max_memory) {
+    std::cout << "\nMemory budget:\n";
+    std::cout << "  Budget:   " << format_number(max_memory >> 20) << " MB, " << std::fixed << std::setprecision(1)
+              << result.peak_buffered_bytes / (1024.0 * 1024.0) << " MB of sections held at peak\n";
+    if (result.spill_files > 0) {
+        std::cout << "  Spilled:  " << std::fixed << std::setprecision(1) << result.spilled_bytes / (1024.0 * 1024.0)
+                  << " MB to " << result.spill_files << (result.spill_files == 1 ? " file" : " files")
+                  << " (removed)\n";
+    } else {
+        std::cout << "  Spilled:  nothing\n";
+    }
+}
+
+void print_selection_summary(const kitbash::SelectionStats& selection) {
+    std::cout << "\nSelection:\n";
+    std::cout << "  Batches:  " << format_number(selection.kept_batches) << " of " << format_number(selection.batches)
+              << " (" << format_number(selection.kept_anim_blocks) << " of " << format_number(selection.anim_blocks)
+              << " ANIM blocks)\n";
+    std::cout << "  Vertices: " << format_number(selection.kept_vertices) << " of "
+              << format_number(selection.vertices) << "\n";
+    std::cout << "  Indices:  " << format_number(selection.kept_indices) << " of "
+              << format_number(selection.indices) << "\n";
+    if (selection.dropped_draws > 0) {
+        std::cout << "  Dropped:  " << format_number(selection.dropped_draws) << " LINES and LIGHTS draws\n";
+    }
+}
+
+void print_analysis(const kitbash::ObjAnalysis& report) {
+    std::cout << "KITBASH RENDER COST\n";
+    std::cout << "===================\n\n";
+    std::cout << "File: " << report.filename << " (" << format_number(report.file_bytes) << " bytes, "
+              << format_number(report.line_count) << " lines)\n\n";
+    
+    std::cout << "Geometry:\n";
+    std::cout << "  Vertices:     " << format_number(report.vertices) << " ("
+              << format_number(report.vertex_bytes) << " bytes)\n";
+    std::cout << "  Indices:      " << format_number(report.indices) << " ("
+              << format_number(report.index_bytes) << " bytes)\n";
+    std::cout << "  Draw calls:   " << format_number(report.draw_calls) << " ("
+              << format_number(report.triangles) << " triangles)\n\n";
+    
+    std::cout << "State Changes:\n";
+    if (report.state_changes.empty()) {
+        std::cout << "  None\n";
+    }
+    for (const auto& attribute : report.state_changes) {
+        std::cout << "  " << std::left << std::setw(14) << attribute.attribute << std::right
+                  << format_number(attribute.changes);
+        if (attribute.redundant > 0) {
+            std::cout << " (+" << format_number(attribute.redundant) << " redundant)";
+        }
+        std::cout << "\n";
+    }
+    std::cout << "\n";
+    
+    std::cout << "Animation:\n";
+    std::cout << "  ANIM nodes:   " << format_number(report.anim_nodes) << " (max depth "
+              << report.max_anim_depth << ")\n";
+    std::cout << "  Manipulators: " << format_number(report.manipulators) << "\n\n";
+    
+    std::cout << "LODs:\n";
+    if (report.lods.empty()) {
+        std::cout << "  None\n";
+    }
+    for (const auto& lod : report.lods) {
+        if (lod.near_distance == 0.0 && lod.far_distance == 0.0) {
+            std::cout << "  No LOD:       ";
+        } else {
+            std::ostringstream range;
+            range << lod.near_distance << "-" << lod.far_distance << " m:";
+            std::cout << "  " << std::left << std::setw(14) << range.str() << std::right;
+        }
+        std::cout << format_number(lod.triangles) << " triangles in " << format_number(lod.draw_calls)
+                  << " draw calls\n";
+    }
+    std::cout << "\n";
+    
+    std::cout << "Unreferenced Data:\n";
+    std::cout << "  Vertices not used by any index:  " << format_number(report.unreferenced_vertices) << " ("
+              << format_number(report.unreferenced_vertices * kitbash::ObjAnalysis::bytes_per_vertex)
+              << " bytes)\n";
+    std::cout << "  Indices not drawn by any TRIS:   " << format_number(report.undrawn_indices) << " ("
+              << format_number(report.undrawn_indices * kitbash::ObjAnalysis::bytes_per_index) << " bytes)\n";
+    if (report.invalid_references > 0) {
+        std::cout << "  Out-of-range references:         " << format_number(report.invalid_references) << "\n";
+    }
+    if (report.geometry.checked) {
+        std::cout << "\nVertex Geometry" << (report.geometry.vectorized ? " (AVX2)" : "") << ":\n";
+        print_geometry_rows(report.geometry, true);
+    }
+    if (report.anim_nodes == 0 || (report.anim_subtrees.empty() && report.datarefs.empty())) {
+        return;
+    }
+    
+    const size_t shown = 20;
+    std::cout << "\nANIM Blocks (" << format_number(report.anim_subtrees.size()) << ", most triangles first):\n";
+    std::cout << "  Line       Depth   Triangles   Vertices   Draws   Keys   Datarefs\n";
+    for (size_t i = 0; i < report.anim_subtrees.size() && i < shown; ++i) {
+        const auto& node = report.anim_subtrees[i];
+        std::cout << "  " << std::left << std::setw(11) << node.line << std::right << std::setw(5) << node.depth
+                  << std::setw(12) << format_number(node.triangles) << std::setw(11) << format_number(node.vertices)
+                  << std::setw(8) << format_number(node.draw_calls) << std::setw(7) << format_number(node.keyframes)
+                  << "   " << (node.datarefs.empty() ? "-" : node.datarefs) << "\n";
+    }
+    if (report.anim_subtrees.size() > shown) {
+        std::cout << "  ... " << format_number(report.anim_subtrees.size() - shown) << " more (all with --json)\n";
+    }
+    
+    std::cout << "\nDatarefs (" << format_number(report.datarefs.size()) << ", most triangles first):\n";
+    std::cout << "  Blocks   Triangles   Vertices   Draws   Keys   Dataref\n";
+    for (size_t i = 0; i < report.datarefs.size() && i < shown; ++i) {
+        const auto& dataref = report.datarefs[i];
+        std::cout << "  " << std::setw(6) << format_number(dataref.nodes) << std::setw(12)
+                  << format_number(dataref.triangles) << std::setw(11) << format_number(dataref.vertices)
+                  << std::setw(8) << format_number(dataref.draw_calls) << std::setw(7)
+                  << format_number(dataref.keyframes) << "   " << dataref.dataref << "\n";
+    }
+    if (report.datarefs.size() > shown) {
+        std::cout << "  ... " << format_number(report.datarefs.size() - shown) << " more (all with --json)\n";
+    }
+}
+
+void print_profile(const kitbash::MergeProfile& profile) {
+    using kitbash::Counter;
+    static const char* phase_names[] = {"Read", "Parse", "Merge", "Write"};
+    auto available = [&](Counter counter) { return profile.available[static_cast<int>(counter)]; };
+    // Events per megabyte the phase processed, or "-" when unknown
+    auto per_mb = [&](const kitbash::PhaseProfile& phase, Counter counter) {
+        std::ostringstream text;
+        if (!available(counter) || phase.bytes == 0) {
+            text << "-";
+        } else {
+            text << std::fixed << std::setprecision(0) << phase.count(counter) / (phase.bytes / (1024.0 * 1024.0));
+        }
+        return text.str();
+    };
+    
+    std::cout << "KITBASH PROFILE\n";
+    std::cout << "===============\n\n";
+    std::cout << "Phase     Time (ms)        MB        Cycles   IPC   Branch miss/MB   LLC miss/MB   Faults/MB\n";
+    kitbash::PhaseProfile total;
+    for (const auto& phase : profile.phases) {
+        total.seconds += phase.seconds;
+        for (int i = 0; i < kitbash::counter_count; ++i) {
+            total.counters[i] += phase.counters[i];
+        }
+        total.bytes = std::max(total.bytes, phase.bytes);
+    }
+    auto print_row = [&](const char* name, const kitbash::PhaseProfile& phase) {
+        uint64_t cycles = phase.count(Counter::Cycles);
+        std::ostringstream ipc;
+        if (available(Counter::Cycles) && available(Counter::Instructions) && cycles > 0) {
+            ipc << std::fixed << std::setprecision(2)
+                << static_cast<double>(phase.count(Counter::Instructions)) / cycles;
+        } else {
+            ipc << "-";
+        }
+        std::cout << std::left << std::setw(6) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << phase.seconds * 1000.0 << std::setw(10) << phase.bytes / (1024.0 * 1024.0)
+                  << std::setw(14) << (available(Counter::Cycles) ? format_number(cycles) : "-")
+                  << std::setw(6) << ipc.str() << std::setw(17) << per_mb(phase, Counter::BranchMisses)
+                  << std::setw(14) << per_mb(phase, Counter::CacheMisses)
+                  << std::setw(12) << per_mb(phase, Counter::PageFaults) << "\n";
+    };
+    for (size_t i = 0; i < profile.phases.size(); ++i) {
+        print_row(phase_names[static_cast<int>(profile.phases[i].phase)], profile.phases[i]);
+    }
+    print_row("Total", total);
+    
+    std::cout << "\nCounters:\n";
+    for (int i = 0; i < kitbash::counter_count; ++i) {
+        Counter counter = static_cast<Counter>(i);
+        std::cout << "  " << std::left << std::setw(14) << kitbash::counter_name(counter) << std::right
+                  << (available(counter) ? format_number(total.count(counter)) : "unavailable") << "\n";
+    }
+    if (!profile.counter_error.empty()) {
+        std::cout << "    Note: " << profile.counter_error << "; timings are still measured\n";
+    }
+}
+
+int run_bench(uint64_t max_vertices, size_t max_threads, int runs, bool json) {
+    kitbash::BenchmarkOptions options;
+    options.sizes.clear();
+    for (uint64_t vertices = 10000; vertices <= max_vertices; vertices *= 10) {
+        options.sizes.push_back(vertices);
+    }
+    if (options.sizes.empty() || options.sizes.back() != max_vertices) {
+        options.sizes.push_back(max_vertices);
+    }
+    options.thread_counts = kitbash::default_thread_counts(max_threads);
+    options.runs = runs;
+    if (!json) {
+        std::cout << "KITBASH BENCHMARK\n";
+        std::cout << "=================\n\n";
+        std::cout << "Each point runs " << options.thread_counts.back() << " merges (addition 1/"
+                  << options.addition_ratio << " of the base); median of " << runs << " runs\n\n";
+        std::cout << "    Vertices   Threads   Time (ms)      MB/s   Speedup   Efficiency   Peak memory (MB)\n";
+        options.on_point = print_bench_row;
+    }
+    try {
+        std::vector<kitbash::BenchmarkPoint> points = kitbash::run_benchmark(options);
+        if (json) {
+            print_bench_json(points, runs);
+        }
+    } catch (const std::exception& e) {
+        print_error("exception", e.what(), "There is enough memory for the largest size");
+        return 1;
+    }
+    return 0;
+}
+
+void print_bench_row(const kitbash::BenchmarkPoint& point) {
+    std::cout << std::setw(12) << format_number(point.vertices) << std::setw(10) << point.threads << std::fixed
+              << std::setprecision(1) << std::setw(12) << point.seconds * 1000.0 << std::setw(10)
+              << point.mb_per_second << std::setprecision(2) << std::setw(10) << point.speedup << std::setw(13)
+              << point.efficiency << std::setprecision(1) << std::setw(19)
+              << point.peak_memory / (1024.0 * 1024.0) << "\n" << std::flush;
+}
+
+void print_bench_json(const std::vector<kitbash::BenchmarkPoint>& points, int runs) {
+    std::cout << "{\n";
+    std::cout << "  \"tool\": \"kitbash\",\n";
+    std::cout << "  \"runs\": " << runs << ",\n";
+    std::cout << "  \"benchmarks\": [";
+    for (size_t i = 0; i < points.size(); ++i) {
+        const auto& point = points[i];
+        std::cout << (i ? ",\n" : "\n") << "    {\"name\": \"merge/" << point.vertices << "v/" << point.threads
+                  << "t\", \"vertices\": " << point.vertices << ", \"threads\": " << point.threads
+                  << ", \"merges\": " << point.merges << ", \"input_bytes\": " << point.input_bytes
+                  << ", \"output_bytes\": " << point.output_bytes << ",\n     \"samples_seconds\": [";
+        std::cout << std::setprecision(9);
+        for (size_t j = 0; j < point.samples.size(); ++j) {
+            std::cout << (j ? ", " : "") << point.samples[j];
+        }
+        std::cout << "], \"median_seconds\": " << point.seconds << ", \"mb_per_second\": " << point.mb_per_second
+                  << ", \"speedup\": " << point.speedup << ", \"efficiency\": " << point.efficiency
+                  << ", \"peak_memory_bytes\": " << point.peak_memory << "}";
+    }
+    std::cout << (points.empty() ? "]\n" : "\n  ]\n");
+    std::cout << "}\n";
+}
+
+void print_divergence(const kitbash::VerifyResult& result) {
+    if (!result.error.empty()) {
+        std::cout << "  Engine '" << result.engine << "' failed: " << result.error << "\n";
+        return;
+    }
+    std::cout << "  Engine '" << result.engine << "' diverges from the reference in " << result.section << " after "
+              << format_number(result.lines_compared) << " matching lines\n";
+    std::cout << "    Reference line " << (result.expected_line ? format_number(result.expected_line) : "-")
+              << ": " << (result.expected_line ? result.expected : "(end of output)") << "\n";
+    std::cout << "    Engine line    " << (result.actual_line ? format_number(result.actual_line) : "-")
+              << ": " << (result.actual_line ? result.actual : "(end of output)") << "\n";
+}
+
+int run_verify(const std::string& base_file, const std::string& addition_file) {
+    for (const std::string& file : {base_file, addition_file}) {
+        if (!is_obj_extension(file)) {
+            print_error("invalid_obj", file, "");
+            return 1;
+        }
+        if (!std::filesystem::exists(file)) {
+            print_error("file_not_found", "File '" + file + "' not found", "Check the file path and try again");
+            return 1;
+        }
+    }
+    kitbash::VerifyResult result = kitbash::verify_merge(base_file, addition_file);
+    if (result.match) {
+        std::cout << "Verification passed: streaming, compiled, bounded and document engines match the reference ("
+                  << format_number(result.lines_compared) << " lines compared).\n";
+        return 0;
+    }
+    std::cout << "KITBASH VERIFY\n";
+    std::cout << "==============\n\n";
+    print_divergence(result);
+    return 1;
+}
+
+int run_verify_corpus(uint64_t max_vertices, size_t max_threads) {
+    kitbash::VerifyOptions options;
+    options.sizes.erase(std::remove_if(options.sizes.begin(), options.sizes.end(),
+                                       [&](uint64_t size) { return size > max_vertices; }),
+                        options.sizes.end());
+    if (options.sizes.empty() || options.sizes.back() < max_vertices) {
+        options.sizes.push_back(max_vertices);
+    }
+    options.thread_counts = kitbash::default_thread_counts(max_threads);
+    options.on_case = [](const kitbash::VerifyResult& result) {
+        std::cout << "  " << std::left << std::setw(24) << result.case_name << std::right
+                  << (result.match ? "match" : "DIVERGED") << "\n" << std::flush;
+    };
+    std::cout << "KITBASH VERIFY\n";
+    std::cout << "==============\n\n";
+    kitbash::VerifySweepResult sweep;
+    try {
+        sweep = kitbash::verify_corpus(options);
+    } catch (const std::exception& e) {
+        print_error("exception", e.what(), "The temporary folder is writable and has space");
+        return 1;
+    }
+    std::cout << "\n" << sweep.cases - sweep.divergences.size() << " of " << sweep.cases
+              << " cases match the reference.\n";
+    for (const auto& result : sweep.divergences) {
+        std::cout << "\n" << result.case_name << ":\n";
+        print_divergence(result);
+    }
+    return sweep.divergences.empty() ? 0 : 1;
+}
+
+int run_validate(const std::vector<std::string>& files, size_t threads) {
+    std::cout << "KITBASH VALIDATE\n";
+    std::cout << "================\n";
+    kitbash::StructureOptions options;
+    options.threads = threads;
+    bool all_valid = true;
+    for (const std::string& file : files) {
+        std::cout << "\n" << file << ":\n";
+        try {
+            auto start = std::chrono::steady_clock::now();
+            kitbash::StructureReport report = kitbash::validate_structure(file, options);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "  " << format_number(report.line_count) << " lines, " << format_number(report.vertices)
+                      << " VT, " << format_number(report.indices) << " indices, "
+                      << format_number(report.draw_commands) << " draw commands (" << report.chunks
+                      << (report.chunks == 1 ? " chunk, " : " chunks, ") << std::fixed << std::setprecision(3)
+                      << seconds << "s)\n";
+            if (report.valid()) {
+                std::cout << "  Valid\n";
+            } else {
+                print_structure_rows(report);
+                all_valid = false;
+            }
+        } catch (const std::exception& e) {
+            std::cout << "  " << e.what() << "\n";
+            all_valid = false;
+        }
+    }
+    return all_valid ? 0 : 1;
+}
+
+int run_plan(const std::vector<kitbash::BatchJob>& jobs, const kitbash::BatchOptions& options,
+             const std::string& calibration_file) {
+    kitbash::PlanOptions plan_options;
+    plan_options.workers = options.workers;
+    plan_options.memory_limit = options.memory_limit;
+    if (!calibration_file.empty()) {
+        try {
+            plan_options.calibration = kitbash::load_plan_calibration(calibration_file);
+        } catch (const std::exception& e) {
+            print_error("exception", e.what(), "The file is the output of kitbash --bench --json");
+            return 1;
+        }
+    }
+    kitbash::BatchPlan plan = kitbash::plan_merges(jobs, plan_options);
+    const kitbash::PlanCalibration& calibration = plan_options.calibration;
+    auto megabytes = [](uint64_t bytes) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << bytes / (1024.0 * 1024.0);
+        return out.str();
+    };
+
+    std::cout << "KITBASH PLAN\n";
+    std::cout << "============\n\n";
+    if (calibration.source.empty()) {
+        std::cout << "Calibration: built-in figures (run kitbash --bench --json > bench.json and\n";
+        std::cout << "             pass --calibration bench.json for this machine)\n\n";
+    } else {
+        std::cout << "Calibration: " << calibration.source << " (" << calibration.points << " single-thread "
+                  << (calibration.points == 1 ? "point" : "points") << ", " << std::fixed << std::setprecision(0)
+                  << 1.0 / (calibration.seconds_per_byte * 1024.0 * 1024.0) << " MB/s)\n\n";
+    }
+    std::cout << std::left << std::setw(36) << "Merge" << std::right << std::setw(10) << "Input MB" << std::setw(11)
+              << "Output MB" << std::setw(13) << "Vertices" << std::setw(13) << "Indices" << std::setw(11)
+              << "Memory MB" << std::setw(10) << "Seconds" << "\n";
+    for (const auto& merge : plan.merges) {
+        std::string name = std::filesystem::path(merge.job.base).filename().string() + " + " +
+                           std::filesystem::path(merge.job.addition).filename().string();
+        if (name.size() > 34) {
+            name = name.substr(0, 31) + "...";
+        }
+        std::cout << std::left << std::setw(36) << name << std::right;
+        if (!merge.error.empty()) {
+            std::cout << merge.error << "\n";
+            continue;
+        }
+        std::cout << std::setw(10) << megabytes(merge.base_bytes + merge.addition_bytes) << std::setw(11)
+                  << megabytes(merge.output_bytes) << std::setw(13) << format_number(merge.vertices) << std::setw(13)
+                  << format_number(merge.indices) << std::setw(11) << megabytes(merge.peak_memory) << std::setw(10)
+                  << std::fixed << std::setprecision(2) << merge.seconds
+                  << (merge.over_memory_limit ? "  over --memory-limit" : "") << "\n";
+    }
+
+    size_t planned = plan.merges.size() - plan.failed;
+    size_t workers = std::min(plan.workers, std::max<size_t>(1, planned));
+    std::cout << "\nTotal: " << planned << (planned == 1 ? " merge" : " merges") << " on " << workers
+              << (workers == 1 ? " worker" : " workers") << "\n";
+    std::cout << "  Input:        " << megabytes(plan.input_bytes) << " MB\n";
+    std::cout << "  Output:       " << megabytes(plan.output_bytes) << " MB\n";
+    std::cout << "  Peak memory:  " << megabytes(plan.peak_memory) << " MB (largest merges at once)\n";
+    std::cout << "  CPU time:     " << std::fixed << std::setprecision(2) << plan.cpu_seconds << "s\n";
+    std::cout << "  Wall time:    " << plan.wall_seconds << "s (efficiency " << plan.efficiency << ")\n";
+    if (plan.over_memory_limit > 0) {
+        std::cout << "  " << plan.over_memory_limit << (plan.over_memory_limit == 1 ? " merge is" : " merges are")
+                  << " predicted over --memory-limit\n";
+    }
+    if (plan.failed > 0) {
+        std::cout << "  " << plan.failed << (plan.failed == 1 ? " merge" : " merges") << " could not be planned\n";
+    }
+    return plan.failed > 0 ? 1 : 0;
+}
+
+// Issue counts, then the first diagnostics with their line numbers
+void print_structure_rows(const kitbash::StructureReport& report) {
+    static const char* const labels[kitbash::structure_issue_count] = {
+        "Missing POINT_COUNTS:", "Count mismatches:", "Indices out of range:", "Draw ranges out of bounds:",
+        "Records out of order:", "Malformed lines:"};
+    for (int i = 0; i < kitbash::structure_issue_count; ++i) {
+        if (report.counts[i] > 0) {
+            std::cout << "  " << std::left << std::setw(33) << labels[i] << std::right
+                      << format_number(report.counts[i]) << "\n";
+        }
+    }
+    for (const auto& diagnostic : report.diagnostics) {
+        std::cout << "    " << (diagnostic.line > 0 ? "line " + std::to_string(diagnostic.line) + ": " : "")
+                  << diagnostic.message << "\n";
+    }
+    if (report.issue_count() > report.diagnostics.size()) {
+        std::cout << "    ... and " << format_number(report.issue_count() - report.diagnostics.size()) << " more\n";
+    }
+}
+
+// Structural check of one merge input; false if --strict should stop the merge.
+// A file that cannot be read or is not OBJ8 is left to the merge to report.
+bool check_structure(const std::string& file, bool strict) {
+    kitbash::StructureReport report;
+    try {
+        report = kitbash::validate_structure(file);
+    } catch (const std::exception&) {
+        return true;
+    }
+    if (report.valid()) {
+        return true;
+    }
+    std::cout << "\nStructure " << (strict ? "errors" : "warnings") << " in " << file
+              << " (line numbers in this file):\n";
+    print_structure_rows(report);
+    return !strict;
+}
+
+std::string json_string(const std::string& text) {
+    std::ostringstream out;
+    out << '"';
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+void print_analysis_json(const kitbash::ObjAnalysis& report) {
+    std::cout << "{\n";
+    std::cout << "  \"file\": " << json_string(report.filename) << ",\n";
+    std::cout << "  \"file_bytes\": " << report.file_bytes << ",\n";
+    std::cout << "  \"lines\": " << report.line_count << ",\n";
+    std::cout << "  \"vertices\": " << report.vertices << ",\n";
+    std::cout << "  \"vertex_bytes\": " << report.vertex_bytes << ",\n";
+    std::cout << "  \"indices\": " << report.indices << ",\n";
+    std::cout << "  \"index_bytes\": " << report.index_bytes << ",\n";
+    std::cout << "  \"draw_calls\": " << report.draw_calls << ",\n";
+    std::cout << "  \"triangles\": " << report.triangles << ",\n";
+    std::cout << "  \"state_changes\": [";
+    for (size_t i = 0; i < report.state_changes.size(); ++i) {
+        const auto& attribute = report.state_changes[i];
+        std::cout << (i ? ",\n" : "\n") << "    {\"attribute\": " << json_string(attribute.attribute)
+                  << ", \"changes\": " << attribute.changes << ", \"redundant\": " << attribute.redundant << "}";
+    }
+    std::cout << (report.state_changes.empty() ? "],\n" : "\n  ],\n");
+    std::cout << "  \"anim_nodes\": " << report.anim_nodes << ",\n";
+    std::cout << "  \"max_anim_depth\": " << report.max_anim_depth << ",\n";
+    std::cout << "  \"manipulators\": " << report.manipulators << ",\n";
+    std::cout << "  \"lods\": [";
+    for (size_t i = 0; i < report.lods.size(); ++i) {
+        const auto& lod = report.lods[i];
+        std::cout << (i ? ",\n" : "\n") << "    {\"near\": " << lod.near_distance << ", \"far\": "
+                  << lod.far_distance << ", \"draw_calls\": " << lod.draw_calls << ", \"triangles\": "
+                  << lod.triangles << "}";
+    }
+    std::cout << (report.lods.empty() ? "],\n" : "\n  ],\n");
+    std::cout << "  \"unreferenced_vertices\": " << report.unreferenced_vertices << ",\n";
+    std::cout << "  \"undrawn_indices\": " << report.undrawn_indices << ",\n";
+    std::cout << "  \"invalid_references\": " << report.invalid_references;
+    if (report.geometry.checked) {
+        std::cout << ",\n  \"geometry\": {";
+        for (int i = 0; i < kitbash::geometry_issue_count; ++i) {
+            std::cout << (i ? ", " : "") << "\"" << kitbash::geometry_issue_name(static_cast<kitbash::GeometryIssue>(i))
+                      << "\": {\"count\": " << report.geometry.counts[i] << ", \"lines\": [";
+            for (size_t j = 0; j < report.geometry.first_lines[i].size(); ++j) {
+                std::cout << (j ? ", " : "") << report.geometry.first_lines[i][j];
+            }
+            std::cout << "]}";
+        }
+        std::cout << "}";
+    }
+    if (!report.anim_subtrees.empty() || !report.datarefs.empty()) {
+        std::cout << ",\n  \"anim_subtrees\": [";
+        for (size_t i = 0; i < report.anim_subtrees.size(); ++i) {
+            const auto& node = report.anim_subtrees[i];
+            std::cout << (i ? ",\n" : "\n") << "    {\"line\": " << node.line << ", \"depth\": " << node.depth
+                      << ", \"datarefs\": " << json_string(node.datarefs) << ", \"triangles\": " << node.triangles
+                      << ", \"vertices\": " << node.vertices << ", \"draw_calls\": " << node.draw_calls
+                      << ", \"keyframes\": " << node.keyframes << "}";
+        }
+        std::cout << (report.anim_subtrees.empty() ? "],\n" : "\n  ],\n");
+        std::cout << "  \"datarefs\": [";
+        for (size_t i = 0; i < report.datarefs.size(); ++i) {
+            const auto& dataref = report.datarefs[i];
+            std::cout << (i ? ",\n" : "\n") << "    {\"dataref\": " << json_string(dataref.dataref)
+                      << ", \"blocks\": " << dataref.nodes << ", \"triangles\": " << dataref.triangles
+                      << ", \"vertices\": " << dataref.vertices << ", \"draw_calls\": " << dataref.draw_calls
+                      << ", \"keyframes\": " << dataref.keyframes << ", \"own_keyframes\": "
+                      << dataref.own_keyframes << "}";
+        }
+        std::cout << (report.datarefs.empty() ? "]" : "\n  ]");
+    }
+    std::cout << "\n}\n";
+}
+
+// One row per issue: count and first lines; all == false skips issues not found
+void print_geometry_rows(const kitbash::GeometryReport& report, bool all) {
+    static const char* const labels[kitbash::geometry_issue_count] = {
+        "NaN or infinite positions:", "Zero-length or NaN normals:", "Unnormalized normals:",
+        "UVs far outside 0..1:", "Malformed VT lines:"};
+    for (int i = 0; i < kitbash::geometry_issue_count; ++i) {
+        if (!all && report.counts[i] == 0) {
+            continue;
+        }
+        std::cout << "  " << std::left << std::setw(33) << labels[i] << std::right << format_number(report.counts[i]);
+        const auto& lines = report.first_lines[i];
+        for (size_t j = 0; j < lines.size(); ++j) {
+            std::cout << (j ? ", " : (lines.size() > 1 ? " (lines " : " (line ")) << lines[j];
+        }
+        std::cout << (lines.empty() ? "" : report.counts[i] > lines.size() ? ", ...)" : ")") << "\n";
+    }
+}
+
+void print_geometry_warnings(const kitbash::GeometryReport& report) {
+    if (!report.checked || (report.clean() && report.repaired_normals == 0)) {
+        return;
+    }
+    std::cout << "\nGeometry warnings (" << format_number(report.vertices)
+              << " vertices checked, line numbers in the output):\n";
+    print_geometry_rows(report, false);
+    if (report.repaired_normals > 0) {
+        std::cout << "  Repaired " << format_number(report.repaired_normals) << " normals\n";
+    } else if (report.count(kitbash::GeometryIssue::BadNormal) > 0 ||
+               report.count(kitbash::GeometryIssue::UnnormalizedNormal) > 0) {
+        std::cout << "  Run with --repair-normals to fix the normals\n";
+    }
+}
+
 std::string format_number(int number) {
+    if (number < 0) {
+        return "-" + format_number(static_cast<uint64_t>(-static_cast<int64_t>(number)));
+    }
+    return format_number(static_cast<uint64_t>(number));
+}
+
+std::string format_number(uint64_t number) {
     // Add commas for readability (e.g., "1,245")
     std::string num_str = std::to_string(number);
     std::string result;
@@ -226,6 +1335,38 @@ int main(int argc, char* argv[]) {
     
     // Parse command line arguments
     bool wants_summary = false;
+    bool wants_compile = false;
+    bool wants_fanout = false;
+    bool wants_manifest = false;
+    bool wants_force = false;
+    bool wants_cache = false;
+    bool wants_shared_objects = false;
+    bool wants_batch = false;
+    std::string batch_switch;           // First batch-only option seen
+    std::string bench_switch;           // First benchmark-only option seen
+    std::string queue_dir;
+    std::string serve_socket;
+    std::string remote_socket;
+    bool wants_interactive = false;
+    bool wants_fetch = false;
+    bool wants_analyze = false;
+    bool wants_json = false;
+    bool wants_breakdown = false;
+    bool wants_profile = false;
+    bool wants_bench = false;
+    bool wants_verify = false;
+    bool wants_validate = false;
+    bool wants_strict = false;
+    bool wants_plan = false;
+    std::string calibration_file;
+    uint64_t max_memory = 0;                // 0 = no budget (mapped inputs)
+    kitbash::SelectionFilter selection;
+    std::string selection_switch;           // First selection option seen
+    kitbash::GeometryOptions geometry_options;
+    std::string geometry_switch;        // First vertex-check option seen
+    uint64_t bench_max_vertices = 0;         // 0 = the mode's default
+    uint64_t bench_runs = 5;
+    kitbash::BatchOptions batch_options;
     bool has_output_file = false;
     std::string base_file;
     std::string addition_file;
@@ -237,6 +1378,124 @@ int main(int argc, char* argv[]) {
         std::string arg = argv[i];
         if (arg == "-s") {
             wants_summary = true;
+        } else if (arg == "--compile") {
+            wants_compile = true;
+        } else if (arg == "--fanout") {
+            wants_fanout = true;
+        } else if (arg == "--manifest") {
+            wants_manifest = true;
+        } else if (arg == "--force") {
+            wants_force = true;
+        } else if (arg == "--cache") {
+            wants_cache = true;
+        } else if (arg == "--repair-normals") {
+            geometry_options.check = true;
+            geometry_options.repair_normals = true;
+            geometry_switch = arg;
+        } else if (arg == "--geometry-check") {
+            geometry_options.check = true;
+            geometry_switch = arg;
+        } else if (arg == "--shared-objects") {
+            wants_shared_objects = true;
+        } else if (arg == "--batch") {
+            wants_batch = true;
+        } else if (arg == "--queue") {
+            if (i + 1 >= argc) {
+                print_error("invalid_args", "Missing folder after --queue", "");
+                return 1;
+            }
+            queue_dir = argv[++i];
+        } else if (arg == "--serve" || arg == "--remote") {
+            if (i + 1 >= argc) {
+                print_error("invalid_args", "Missing socket path after " + arg, "");
+                return 1;
+            }
+            (arg == "--serve" ? serve_socket : remote_socket) = argv[++i];
+        } else if (arg == "--interactive") {
+            wants_interactive = true;
+        } else if (arg == "--fetch") {
+            wants_fetch = true;
+        } else if (arg == "--analyze") {
+            wants_analyze = true;
+        } else if (arg == "--json") {
+            wants_json = true;
+        } else if (arg == "--breakdown") {
+            wants_breakdown = true;
+        } else if (arg == "--profile") {
+            wants_profile = true;
+        } else if (arg == "--bench") {
+            wants_bench = true;
+        } else if (arg == "--verify") {
+            wants_verify = true;
+        } else if (arg == "--validate") {
+            wants_validate = true;
+        } else if (arg == "--strict") {
+            wants_strict = true;
+        } else if (arg == "--plan") {
+            wants_plan = true;
+        } else if (arg == "--calibration") {
+            if (i + 1 >= argc) {
+                print_error("invalid_args", "Missing benchmark file after --calibration", "");
+                return 1;
+            }
+            calibration_file = argv[++i];
+        } else if (arg == "--max-memory") {
+            if (i + 1 >= argc || !parse_count(argv[i + 1], max_memory) || max_memory == 0) {
+                print_error("invalid_args", "Missing megabytes after --max-memory", "");
+                return 1;
+            }
+            ++i;
+            max_memory <<= 20;  // Megabytes
+        } else if (arg == "--select-dataref" || arg == "--select-manip") {
+            if (i + 1 >= argc) {
+                print_error("invalid_args", "Missing value after " + arg, "");
+                return 1;
+            }
+            (arg == "--select-dataref" ? selection.datarefs : selection.manipulators).push_back(argv[++i]);
+            selection_switch = arg;
+        } else if (arg == "--select-lod") {
+            uint64_t value = 0;
+            if (i + 1 >= argc || !parse_count(argv[i + 1], value) || value > INT_MAX) {
+                print_error("invalid_args", "Missing LOD number after --select-lod", "");
+                return 1;
+            }
+            ++i;
+            selection.lods.push_back(static_cast<int>(value));
+            selection_switch = arg;
+        } else if (arg == "--select-lines") {
+            std::pair<uint64_t, uint64_t> range;
+            if (i + 1 >= argc || !parse_line_range(argv[i + 1], range)) {
+                print_error("invalid_args", "Missing line range after --select-lines", "");
+                return 1;
+            }
+            ++i;
+            selection.lines.push_back(range);
+            selection_switch = arg;
+        } else if (arg == "--max-vertices" || arg == "--runs") {
+            uint64_t value = 0;
+            if (i + 1 >= argc || !parse_count(argv[i + 1], value) || value == 0) {
+                print_error("invalid_args", "Missing count after " + arg, "");
+                return 1;
+            }
+            ++i;
+            (arg == "--runs" ? bench_runs : bench_max_vertices) = value;
+            bench_switch = arg;
+        } else if (arg == "--isolate") {
+            batch_options.isolate = true;
+            batch_switch = arg;
+        } else if (arg == "--workers" || arg == "--memory-limit") {
+            uint64_t value = 0;
+            if (i + 1 >= argc || !parse_count(argv[i + 1], value) || value == 0) {
+                print_error("invalid_args", "Missing count after " + arg, "");
+                return 1;
+            }
+            ++i;
+            if (arg == "--workers") {
+                batch_options.workers = static_cast<size_t>(value);
+            } else {
+                batch_options.memory_limit = value << 20;   // Megabytes
+            }
+            batch_switch = arg;
         } else if (arg == "-o") {
             // Next argument should be output file
             if (i + 1 >= argc) {
@@ -255,6 +1514,243 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    // The cache applies to single merges only
+    if (wants_cache && (wants_compile || wants_fanout || wants_manifest || wants_batch || !queue_dir.empty())) {
+        print_error("invalid_switch", "--cache", "");
+        return 1;
+    }
+    
+    // Shared objects apply to single merges only
+    if (wants_shared_objects && (wants_compile || wants_fanout || wants_manifest || wants_batch ||
+                                 !queue_dir.empty() || wants_cache)) {
+        print_error("invalid_switch", "--shared-objects", "");
+        return 1;
+    }
+    
+    // Vertex-check options apply to single merges only
+    if (!geometry_switch.empty() &&
+        (wants_compile || wants_fanout || wants_manifest || wants_batch || !queue_dir.empty() ||
+         wants_analyze || wants_profile || wants_bench || wants_verify || wants_plan || !serve_socket.empty() ||
+         !remote_socket.empty())) {
+        print_error("invalid_switch", geometry_switch, "");
+        return 1;
+    }
+    
+    // --strict applies to single merges only
+    if (wants_strict && (wants_compile || wants_fanout || wants_manifest || wants_batch || !queue_dir.empty() ||
+                         wants_analyze || wants_profile || wants_bench || wants_verify || wants_plan ||
+                         !serve_socket.empty() || !remote_socket.empty())) {
+        print_error("invalid_switch", "--strict", "");
+        return 1;
+    }
+    
+    // The memory budget applies to single merges of OBJ8 files only
+    if (max_memory > 0 && (wants_compile || wants_fanout || wants_manifest || wants_batch || !queue_dir.empty() ||
+                           wants_analyze || wants_profile || wants_bench || wants_verify || wants_validate ||
+                           wants_plan || !serve_socket.empty() || !remote_socket.empty() || wants_cache ||
+                           wants_shared_objects || geometry_options.repair_normals)) {
+        print_error("invalid_switch", "--max-memory", "");
+        return 1;
+    }
+    
+    // Selection filters apply to single merges of an OBJ8 addition only
+    if (!selection_switch.empty() &&
+        (wants_compile || wants_fanout || wants_manifest || wants_batch || !queue_dir.empty() || wants_analyze ||
+         wants_profile || wants_bench || wants_verify || wants_validate || wants_plan || !serve_socket.empty() ||
+         !remote_socket.empty() || wants_cache || wants_shared_objects || max_memory > 0)) {
+        print_error("invalid_switch", selection_switch, "");
+        return 1;
+    }
+    
+    // Analyze mode reads a single file and changes nothing
+    if (wants_analyze) {
+        if (wants_compile || wants_fanout || wants_manifest || wants_batch || !queue_dir.empty() ||
+            !serve_socket.empty() || !remote_socket.empty() || has_output_file || !batch_switch.empty() ||
+            wants_cache || wants_shared_objects || wants_interactive || wants_fetch || wants_profile ||
+            wants_bench || !bench_switch.empty() || non_flag_args.size() != 1) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        return run_analyze(non_flag_args[0], wants_json, wants_breakdown);
+    }
+    
+    // Validate mode checks the structure of each file given and changes nothing
+    if (wants_validate) {
+        if (wants_compile || wants_fanout || wants_manifest || wants_batch || !queue_dir.empty() ||
+            !serve_socket.empty() || !remote_socket.empty() || has_output_file || batch_options.isolate ||
+            batch_options.memory_limit > 0 || wants_cache || wants_shared_objects || wants_interactive ||
+            wants_fetch || wants_profile || wants_bench || wants_verify || wants_strict || wants_json ||
+            wants_breakdown || !bench_switch.empty() || non_flag_args.empty()) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        return run_validate(non_flag_args, batch_options.workers);
+    }
+    
+    // Plan mode reads file sizes and headers only: a pair, a batch file or a fan-out
+    if (wants_plan) {
+        if (wants_compile || wants_manifest || !queue_dir.empty() || !serve_socket.empty() ||
+            !remote_socket.empty() || batch_options.isolate || wants_cache || wants_shared_objects ||
+            wants_interactive || wants_fetch || wants_profile || wants_bench || wants_verify || wants_json ||
+            wants_breakdown || !bench_switch.empty() || (wants_batch && wants_fanout) ||
+            (has_output_file && (wants_batch || wants_fanout)) ||
+            (wants_batch ? non_flag_args.size() != 1 : wants_fanout ? non_flag_args.size() < 2
+                                                                    : non_flag_args.size() != 2)) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        std::vector<kitbash::BatchJob> jobs;
+        if (wants_batch) {
+            try {
+                jobs = kitbash::read_batch_file(non_flag_args[0]);
+            } catch (const std::exception& e) {
+                print_error("invalid_batch", e.what(), "");
+                return 1;
+            }
+        } else if (wants_fanout) {
+            for (size_t i = 1; i < non_flag_args.size(); ++i) {
+                jobs.push_back(kitbash::BatchJob{non_flag_args[i], non_flag_args[0], ""});
+            }
+        } else {
+            jobs.push_back(kitbash::BatchJob{non_flag_args[0], non_flag_args[1], has_output_file ? output_file : ""});
+        }
+        return run_plan(jobs, batch_options, calibration_file);
+    }
+    if (!calibration_file.empty()) {
+        print_error("invalid_switch", "--calibration", "");
+        return 1;
+    }
+    
+    // Benchmark mode generates its own inputs; --workers is the largest thread count
+    if (wants_bench) {
+        if (wants_compile || wants_fanout || wants_manifest || wants_batch || !queue_dir.empty() ||
+            !serve_socket.empty() || !remote_socket.empty() || has_output_file || batch_options.isolate ||
+            batch_options.memory_limit > 0 || wants_cache || wants_shared_objects || wants_interactive ||
+            wants_fetch || wants_profile || wants_breakdown || !non_flag_args.empty()) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        int runs = static_cast<int>(std::min<uint64_t>(bench_runs, 1000));
+        return run_bench(bench_max_vertices > 0 ? bench_max_vertices : 1000000, batch_options.workers, runs, wants_json);
+    }
+    
+    // Verify mode compares the engines on a pair of files, or on generated objects
+    if (wants_verify) {
+        if (wants_compile || wants_fanout || wants_manifest || wants_batch || !queue_dir.empty() ||
+            !serve_socket.empty() || !remote_socket.empty() || has_output_file || batch_options.isolate ||
+            batch_options.memory_limit > 0 || wants_cache || wants_shared_objects || wants_interactive ||
+            wants_fetch || wants_profile || wants_breakdown || wants_json || bench_switch == "--runs" ||
+            (non_flag_args.size() != 0 && non_flag_args.size() != 2) ||
+            (non_flag_args.size() == 2 && !bench_switch.empty())) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        if (non_flag_args.empty()) {
+            return run_verify_corpus(bench_max_vertices > 0 ? bench_max_vertices : 100000, batch_options.workers);
+        }
+        return run_verify(non_flag_args[0], non_flag_args[1]);
+    }
+    if (!bench_switch.empty()) {
+        print_error("invalid_switch", bench_switch, "");
+        return 1;
+    }
+    if (wants_json || wants_breakdown) {
+        print_error("invalid_switch", wants_json ? "--json" : "--breakdown", "");
+        return 1;
+    }
+    
+    // Profile mode runs one merge with counters around each phase
+    if (wants_profile) {
+        if (wants_compile || wants_fanout || wants_manifest || wants_batch || !queue_dir.empty() ||
+            !serve_socket.empty() || !remote_socket.empty() || !batch_switch.empty() || wants_cache ||
+            wants_shared_objects || wants_interactive || wants_fetch || non_flag_args.size() != 2) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        return run_profile(non_flag_args[0], non_flag_args[1], has_output_file ? output_file : "");
+    }
+    
+    // Server mode takes no files; requests arrive on the socket
+    if (!serve_socket.empty()) {
+        if (wants_compile || wants_fanout || wants_manifest || wants_batch || !queue_dir.empty() ||
+            !remote_socket.empty() || has_output_file || batch_options.isolate || batch_options.memory_limit > 0 ||
+            wants_cache || wants_shared_objects || wants_interactive || wants_fetch || !non_flag_args.empty()) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        return run_serve(serve_socket, batch_options.workers);
+    }
+    
+    // Remote mode sends a single merge to a running server
+    if (!remote_socket.empty()) {
+        if (wants_compile || wants_fanout || wants_manifest || wants_batch || !queue_dir.empty() ||
+            !batch_switch.empty() || wants_cache || wants_shared_objects || non_flag_args.size() != 2 ||
+            (wants_fetch && !has_output_file)) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        return run_remote(remote_socket, non_flag_args[0], non_flag_args[1], has_output_file ? output_file : "",
+                          wants_interactive, wants_fetch, wants_summary);
+    }
+    if (wants_interactive || wants_fetch) {
+        print_error("invalid_switch", wants_interactive ? "--interactive" : "--fetch", "");
+        return 1;
+    }
+    
+    // Queue mode works through a shared folder, optionally submitting a job file first
+    if (!queue_dir.empty()) {
+        if (wants_compile || wants_fanout || wants_manifest || has_output_file || batch_options.isolate ||
+            batch_options.memory_limit > 0 || non_flag_args.size() != (wants_batch ? 1u : 0u)) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        return run_queue(queue_dir, wants_batch ? non_flag_args[0] : "", batch_options.workers, wants_summary);
+    }
+    
+    // Batch mode takes the job file only
+    if (wants_batch) {
+        if (wants_compile || wants_fanout || wants_manifest || has_output_file || non_flag_args.size() != 1) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        return run_batch_file(non_flag_args[0], batch_options, wants_summary);
+    }
+    if (!batch_switch.empty()) {
+        print_error("invalid_switch", batch_switch, "");
+        return 1;
+    }
+    
+    // Compile mode takes a single addition file
+    if (wants_compile) {
+        if (non_flag_args.size() != 1) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        return run_compile(non_flag_args[0], has_output_file ? output_file : compiled_filename(non_flag_args[0]));
+    }
+    
+    // Manifest mode takes the manifest file only
+    if (wants_manifest) {
+        if (wants_compile || wants_fanout || has_output_file || non_flag_args.size() != 1) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        return run_build(non_flag_args[0], wants_force);
+    }
+    if (wants_force) {
+        print_error("invalid_switch", "--force", "");
+        return 1;
+    }
+    
+    // Fan-out mode takes the addition followed by any number of bases
+    if (wants_fanout) {
+        if (wants_compile || non_flag_args.size() < 2) {
+            print_error("invalid_args", "", "");
+            return 1;
+        }
+        return run_fanout(non_flag_args, has_output_file ? output_file : "", wants_summary);
+    }
+    
     // Validate we have exactly 2 input files
     if (non_flag_args.size() != 2) {
         print_error("invalid_args", "", "");
@@ -275,7 +1771,7 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    if (!is_obj_extension(addition_file)) {
+    if (!is_obj_extension(addition_file) && !is_kbo_extension(addition_file)) {
         print_error("invalid_obj", addition_file, "");
         return 1;
     }
@@ -296,6 +1792,45 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    // Structural check of the inputs before anything is written; a compiled
+    // addition is no longer OBJ8 text, so only an .obj addition is checked. A
+    // cache hit parses nothing: the same inputs were checked when it was stored.
+    kitbash::CacheOptions cache_options;
+    cache_options.geometry = geometry_options;
+    bool cached = wants_cache && kitbash::MergeCache(cache_options).contains(base_file, addition_file);
+    bool structure_ok = cached || check_structure(base_file, wants_strict);
+    if (!cached && !kitbash::CompiledAddition::is_compiled_file(addition_file)) {
+        structure_ok = check_structure(addition_file, wants_strict) && structure_ok;
+    }
+    if (!structure_ok) {
+        print_error("invalid_structure", "Inputs failed the structural checks under --strict",
+                    "");
+        std::cout << "    Note: No files were modified\n";
+        return 1;
+    }
+    
+    // A selection compiles the addition down to the matching batches first, so a
+    // filter that matches nothing stops before any file changes
+    kitbash::CompiledAddition selected;
+    kitbash::SelectionStats selection_stats;
+    if (!selection.empty()) {
+        if (kitbash::CompiledAddition::is_compiled_file(addition_file)) {
+            print_error("invalid_selection", "Selection filters need an OBJ8 addition, not a .kbo file", "");
+            return 1;
+        }
+        try {
+            selected = kitbash::CompiledAddition::compile_selected(addition_file, selection, &selection_stats);
+        } catch (const std::exception& e) {
+            print_error("invalid_selection", e.what(), "");
+            return 1;
+        }
+        if (selection_stats.kept_batches == 0) {
+            print_error("invalid_selection", "No TRIS batch of " + addition_file + " matches the selection", "");
+            std::cout << "    Note: No files were modified\n";
+            return 1;
+        }
+    }
+    
     // Create backup if overwriting original file (no -o flag)
     std::string backup_filename;
     if (!has_output_file) {
@@ -333,8 +1868,39 @@ int main(int argc, char* argv[]) {
         // Record start time for benchmarking
         auto start_time = std::chrono::high_resolution_clock::now();
         
-        // Call the kitbash merge function
-        bool success = kitbash::merge_to_file_with_stats(base_file, addition_file, output_file, &stats);
+        // Call the kitbash merge function; compiled additions skip parsing entirely,
+        // cache hits skip merging entirely
+        bool success;
+        bool cache_hit = false;
+        bool shared_hit = false;
+        kitbash::MergeCache cache(cache_options);
+        kitbash::BoundedMergeResult bounded;
+        if (max_memory > 0) {
+            // The backup is already made; write over the base like the other paths
+            kitbash::BoundedMergeOptions bounded_options;
+            bounded_options.max_memory = max_memory;
+            bounded_options.geometry = geometry_options;
+            bounded = kitbash::merge_to_file_bounded(base_file, addition_file,
+                                                     has_output_file ? output_file : base_file,
+                                                     bounded_options, &stats);
+            stats.output_filename = output_file;
+            stats.backup_filename = has_output_file ? "" : backup_filename;
+            success = true;
+        } else if (!selection.empty()) {
+            success = kitbash::merge_compiled_to_file(base_file, selected, output_file, &stats, geometry_options);
+            stats.backup_filename = has_output_file ? "" : backup_filename;
+        } else if (wants_cache) {
+            success = cache.merge_to_file(base_file, addition_file, output_file, &stats, &cache_hit);
+        } else {
+            // The streaming engine that --bench measures and --plan is calibrated on
+            bool is_compiled = kitbash::CompiledAddition::is_compiled_file(addition_file);
+            auto compiled = is_compiled ? kitbash::CompiledAddition::load(addition_file)
+                : wants_shared_objects ? kitbash::CompiledAddition::compile_shared(addition_file, &shared_hit)
+                : kitbash::CompiledAddition::compile(addition_file);
+            success = kitbash::merge_compiled_to_file(base_file, compiled, output_file, &stats, geometry_options);
+            stats.addition_filename = addition_file;
+            stats.backup_filename = has_output_file ? "" : backup_filename;
+        }
         
         // Record end time
         auto end_time = std::chrono::high_resolution_clock::now();
@@ -348,10 +1914,25 @@ int main(int argc, char* argv[]) {
         
         // Print completion message
         std::cout << "Merge completed successfully.\n";
+        print_geometry_warnings(stats.geometry);
         
         // Print summary if requested
         if (wants_summary) {
             print_detailed_summary(stats);
+            if (wants_cache) {
+                print_cache_summary(cache, cache_hit);
+            }
+            if (max_memory > 0) {
+                print_bounded_summary(bounded, max_memory);
+            }
+            if (!selection.empty()) {
+                print_selection_summary(selection_stats);
+            }
+            if (wants_shared_objects) {
+                std::cout << "\nShared objects:\n";
+                std::cout << "  Addition " << (shared_hit ? "mapped from shared memory (not parsed)"
+                                                          : "parsed and published for other processes") << "\n";
+            }
         }
         
         return 0;
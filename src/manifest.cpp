@@ -0,0 +1,442 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include "kitbash_io.h"
+#include "kitbash_thread_pool.h"
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+// Internal helper functions
+namespace {
+    // Bump when the merge rules change so every recorded step is rebuilt
+    constexpr const char* manifest_format = "kitbash-manifest-1";
+
+    struct Operand {
+        bool is_step = false;
+        std::string text;               // As written in the manifest
+        std::string path;               // Resolved file path
+        size_t step = 0;                // Index of the referenced step
+    };
+
+    struct Step {
+        std::string name;
+        std::vector<Operand> operands;  // Base first, then additions in merge order
+        std::string output;             // Resolved path; empty for intermediates
+        int line = 0;
+
+        std::vector<size_t> dependents;
+        uint64_t key = 0;               // Hash of the definition and every input
+        std::string key_error;          // Input that could not be hashed
+        bool runs = false;
+
+        // Execution state, guarded by Executor::mutex
+        size_t waiting = 0;             // Running upstream steps not yet finished
+        size_t consumers = 0;           // Running dependents still to read the result
+        kitbash::Document result;
+        bool failed = false;
+    };
+
+    std::string resolve(const std::filesystem::path& folder, const std::string& path) {
+        std::filesystem::path p(path);
+        return p.is_absolute() ? p.string() : (folder / p).lexically_normal().string();
+    }
+
+    std::string to_hex(uint64_t value) {
+        std::ostringstream out;
+        out << std::hex << value;
+        return out.str();
+    }
+
+    std::vector<Step> parse_manifest(const std::string& filename) {
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open file: " + filename);
+        }
+        std::filesystem::path folder = std::filesystem::path(filename).parent_path();
+
+        std::vector<Step> steps;
+        std::map<std::string, size_t> names;
+        std::string text;
+        int line_number = 0;
+        while (std::getline(file, text)) {
+            ++line_number;
+            auto fail = [&](const std::string& message) {
+                throw std::runtime_error(filename + ":" + std::to_string(line_number) + ": " + message);
+            };
+            auto tokens = kitbash::tokenize(text);
+            if (tokens.empty() || tokens[0][0] == '#') {
+                continue;
+            }
+
+            // name = operand (+ operand)* [-> output]
+            Step step;
+            step.name = tokens[0];
+            step.line = line_number;
+            if (tokens.size() < 3 || tokens[1] != "=") {
+                fail("expected 'name = base.obj + addition.obj'");
+            }
+            size_t i = 2;
+            for (;;) {
+                const std::string& token = tokens[i];
+                if (token == "+" || token == "->") {
+                    fail("missing operand before '" + token + "'");
+                }
+                Operand operand;
+                operand.text = token;
+                operand.is_step = token[0] == '@';
+                if (!operand.is_step) {
+                    operand.path = resolve(folder, token);
+                }
+                step.operands.push_back(operand);
+                ++i;
+                if (i == tokens.size()) {
+                    break;
+                }
+                if (tokens[i] == "->") {
+                    if (i + 2 != tokens.size()) {
+                        fail("expected one output file after '->'");
+                    }
+                    step.output = resolve(folder, tokens[i + 1]);
+                    break;
+                }
+                if (tokens[i] != "+" || ++i == tokens.size()) {
+                    fail("expected '+ operand' or '-> output'");
+                }
+            }
+            if (step.operands.size() < 2) {
+                fail("a step needs a base and at least one addition");
+            }
+            if (!names.emplace(step.name, steps.size()).second) {
+                fail("step '" + step.name + "' is defined twice");
+            }
+            steps.push_back(std::move(step));
+        }
+
+        // Resolve step references now that every name is known (forward references are fine)
+        for (size_t s = 0; s < steps.size(); ++s) {
+            for (auto& operand : steps[s].operands) {
+                if (!operand.is_step) {
+                    continue;
+                }
+                auto found = names.find(operand.text.substr(1));
+                if (found == names.end()) {
+                    throw std::runtime_error(filename + ":" + std::to_string(steps[s].line) +
+                                             ": unknown step '" + operand.text + "'");
+                }
+                operand.step = found->second;
+                auto& dependents = steps[operand.step].dependents;
+                if (dependents.empty() || dependents.back() != s) {
+                    dependents.push_back(s);
+                }
+            }
+        }
+        return steps;
+    }
+
+    // Steps ordered so every step comes after the steps it reads; throws on a cycle
+    std::vector<size_t> topological_order(const std::vector<Step>& steps, const std::string& filename) {
+        enum class Mark { None, Active, Done };
+        std::vector<Mark> marks(steps.size(), Mark::None);
+        std::vector<size_t> order;
+        order.reserve(steps.size());
+
+        // Iterative depth-first search: (step, next operand to visit)
+        for (size_t root = 0; root < steps.size(); ++root) {
+            if (marks[root] != Mark::None) {
+                continue;
+            }
+            std::vector<std::pair<size_t, size_t>> stack = {{root, 0}};
+            marks[root] = Mark::Active;
+            while (!stack.empty()) {
+                auto& top = stack.back();
+                const Step& step = steps[top.first];
+                if (top.second == step.operands.size()) {
+                    marks[top.first] = Mark::Done;
+                    order.push_back(top.first);
+                    stack.pop_back();
+                    continue;
+                }
+                const Operand& operand = step.operands[top.second++];
+                if (!operand.is_step || marks[operand.step] == Mark::Done) {
+                    continue;
+                }
+                if (marks[operand.step] == Mark::Active) {
+                    throw std::runtime_error(filename + ":" + std::to_string(step.line) +
+                                             ": dependency cycle through step '" + steps[operand.step].name + "'");
+                }
+                marks[operand.step] = Mark::Active;
+                stack.push_back({operand.step, 0});
+            }
+        }
+        return order;
+    }
+
+    std::map<std::string, std::string> read_state(const std::string& filename) {
+        std::map<std::string, std::string> state;
+        std::ifstream file(filename);
+        std::string name;
+        std::string key;
+        while (file >> name >> key) {
+            state[name] = key;
+        }
+        return state;
+    }
+
+    // Runs the steps marked `runs` on a thread pool as their inputs become ready
+    class Executor {
+    public:
+        Executor(std::vector<Step>& steps, std::vector<kitbash::ManifestStepResult>& results,
+                 kitbash::detail::ThreadPool& pool)
+            : steps_(steps), results_(results), pool_(pool) {}
+
+        void run() {
+            for (size_t i = 0; i < steps_.size(); ++i) {
+                Step& step = steps_[i];
+                if (!step.runs) {
+                    continue;
+                }
+                ++remaining_;
+                std::set<size_t> upstream;      // A step may be used twice; wait for it once
+                for (const auto& operand : step.operands) {
+                    if (operand.is_step && steps_[operand.step].runs) {
+                        upstream.insert(operand.step);
+                        ++steps_[operand.step].consumers;
+                    }
+                }
+                step.waiting = upstream.size();
+            }
+            // Collect the roots before submitting any: finished steps start their own dependents
+            std::vector<size_t> roots;
+            for (size_t i = 0; i < steps_.size(); ++i) {
+                if (steps_[i].runs && steps_[i].waiting == 0) {
+                    roots.push_back(i);
+                }
+            }
+            for (size_t index : roots) {
+                submit(index);
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            finished_.wait(lock, [this] { return remaining_ == 0; });
+        }
+
+    private:
+        void submit(size_t index) {
+            pool_.submit([this, index] { execute(index); });
+        }
+
+        void execute(size_t index) {
+            Step& step = steps_[index];
+            kitbash::ManifestStepResult& result = results_[index];
+            auto start_time = std::chrono::steady_clock::now();
+            kitbash::Document merged;
+            bool failed = false;
+            try {
+                if (!step.key_error.empty()) {
+                    throw std::runtime_error(step.key_error);
+                }
+                for (size_t i = 0; i < step.operands.size(); ++i) {
+                    kitbash::Document operand = document_for(step.operands[i]);
+                    if (i == 0) {
+                        merged = std::move(operand);
+                    } else {
+                        // Each merge after the first reads the previous result back,
+                        // as `kitbash` would when chained through files
+                        if (i > 1) {
+                            merged = kitbash::detail::as_reloaded(merged);
+                        }
+                        merged.merge(operand);
+                    }
+                }
+                if (!step.output.empty()) {
+                    merged.write(step.output);
+                }
+                if (step.consumers > 0) {
+                    merged = kitbash::detail::as_reloaded(merged);
+                }
+                result.status = kitbash::StepStatus::Built;
+            } catch (const std::exception& e) {
+                result.status = kitbash::StepStatus::Failed;
+                result.error = e.what();
+                failed = true;
+            }
+            result.processing_time = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start_time).count();
+
+            std::vector<size_t> ready;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                step.failed = failed;
+                if (!failed && step.consumers > 0) {
+                    step.result = std::move(merged);    // Handed to dependents in memory
+                }
+                release_inputs(step);
+                for (size_t dependent : step.dependents) {
+                    if (steps_[dependent].runs && --steps_[dependent].waiting == 0) {
+                        ready.push_back(dependent);
+                    }
+                }
+                // Notify under the lock: run() may return and destroy this executor
+                // as soon as it sees remaining_ reach zero
+                --remaining_;
+                finished_.notify_all();
+            }
+            for (size_t dependent : ready) {
+                submit(dependent);
+            }
+        }
+
+        kitbash::Document document_for(const Operand& operand) {
+            if (!operand.is_step) {
+                return kitbash::detail::load_document(operand.path);
+            }
+            const Step& upstream = steps_[operand.step];
+            if (!upstream.runs) {
+                // Up to date: its output file holds exactly the result it would produce
+                return kitbash::detail::load_document(upstream.output);
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (upstream.failed) {
+                throw std::runtime_error("Dependency '" + upstream.name + "' failed");
+            }
+            return upstream.result.snapshot();      // O(1); merging copies only what it touches
+        }
+
+        // Drop in-memory results once their last consumer has read them
+        void release_inputs(const Step& step) {
+            for (const auto& operand : step.operands) {
+                if (!operand.is_step) {
+                    continue;
+                }
+                Step& upstream = steps_[operand.step];
+                if (upstream.runs && upstream.consumers > 0 && --upstream.consumers == 0) {
+                    upstream.result = kitbash::Document();
+                }
+            }
+        }
+
+        std::vector<Step>& steps_;
+        std::vector<kitbash::ManifestStepResult>& results_;
+        kitbash::detail::ThreadPool& pool_;
+        std::mutex mutex_;
+        std::condition_variable finished_;
+        size_t remaining_ = 0;
+    };
+}
+
+namespace kitbash {
+    ManifestResult run_manifest(const std::string& manifest_file, const ManifestOptions& options) {
+        ManifestResult outcome;
+        std::vector<Step> steps;
+        std::vector<size_t> order;
+        try {
+            steps = parse_manifest(manifest_file);
+            order = topological_order(steps, manifest_file);
+        } catch (const std::exception& e) {
+            outcome.error = e.what();
+            return outcome;
+        }
+
+        // Keys in dependency order: definition, file contents and upstream keys
+        std::map<std::string, uint64_t> file_hashes;
+        for (size_t index : order) {
+            Step& step = steps[index];
+            std::string definition = std::string(manifest_format) + "\n" + step.name + "\n" + step.output;
+            uint64_t key = detail::hash_bytes(definition);
+            for (const auto& operand : step.operands) {
+                uint64_t input;
+                if (operand.is_step) {
+                    input = steps[operand.step].key;
+                    if (!steps[operand.step].key_error.empty() && step.key_error.empty()) {
+                        step.key_error = "Dependency '" + steps[operand.step].name + "' failed";
+                    }
+                } else {
+                    auto found = file_hashes.find(operand.path);
+                    if (found == file_hashes.end()) {
+                        try {
+                            found = file_hashes.emplace(operand.path, detail::hash_file(operand.path)).first;
+                        } catch (const std::exception& e) {
+                            if (step.key_error.empty()) {
+                                step.key_error = e.what();
+                            }
+                            continue;
+                        }
+                    }
+                    input = found->second;
+                }
+                key = detail::hash_bytes(operand.text, key ^ input);
+            }
+            step.key = key;
+        }
+
+        // A step with an output runs when the output is stale; running dependents read
+        // it back from disk otherwise. An intermediate runs when a running step needs it.
+        std::string state_file = manifest_file + ".state";
+        auto state = read_state(state_file);
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            Step& step = steps[*it];
+            if (!step.output.empty()) {
+                auto recorded = state.find(step.name);
+                step.runs = options.force || recorded == state.end() || recorded->second != to_hex(step.key) ||
+                            !std::filesystem::exists(step.output);
+            } else {
+                for (size_t dependent : step.dependents) {
+                    step.runs = step.runs || steps[dependent].runs;
+                }
+            }
+        }
+
+        outcome.steps.resize(steps.size());
+        for (size_t i = 0; i < steps.size(); ++i) {
+            outcome.steps[i].name = steps[i].name;
+            outcome.steps[i].output = steps[i].output;
+        }
+
+        std::unique_ptr<detail::ThreadPool> own_pool;
+        if (options.threads > 0) {
+            own_pool = std::make_unique<detail::ThreadPool>(options.threads);
+        }
+        Executor executor(steps, outcome.steps, own_pool ? *own_pool : detail::ThreadPool::shared());
+        executor.run();
+
+        // Record the new state; failed steps are forgotten so they run again next time
+        outcome.success = true;
+        for (size_t i = 0; i < steps.size(); ++i) {
+            ManifestStepResult& result = outcome.steps[i];
+            if (!steps[i].runs) {
+                bool consumed = !steps[i].output.empty() || !steps[i].dependents.empty();
+                result.status = consumed ? StepStatus::UpToDate : StepStatus::Unused;
+            }
+            switch (result.status) {
+            case StepStatus::Built:
+                state[steps[i].name] = to_hex(steps[i].key);
+                ++outcome.built;
+                break;
+            case StepStatus::UpToDate:
+                ++outcome.up_to_date;
+                break;
+            case StepStatus::Failed:
+                state.erase(steps[i].name);
+                outcome.success = false;
+                break;
+            case StepStatus::Unused:
+                break;
+            }
+        }
+
+        std::ofstream out(state_file, std::ios::trunc);
+        for (const auto& entry : state) {
+            out << entry.first << " " << entry.second << "\n";
+        }
+        if (!out) {
+            outcome.success = false;
+            outcome.error = "Cannot write file: " + state_file;
+        }
+        return outcome;
+    }
+}
@@ -0,0 +1,399 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+// Internal helper functions
+namespace {
+    namespace fs = std::filesystem;
+
+    // Part of every key: bump when the merge output or the entry layout changes
+    constexpr const char* cache_version = "kitbash 1.0.0 merge-cache 1";
+
+    // Files left behind by crashed writers are removed once they are this old
+    constexpr auto stale_age = std::chrono::hours(1);
+
+    std::string to_hex(uint64_t value) {
+        std::ostringstream out;
+        out << std::hex;
+        out.width(16);
+        out.fill('0');
+        out << value;
+        return out.str();
+    }
+
+    // 128-bit key from two independently seeded hash chains over every input. Vertex
+    // check settings count only when checking, since they change the stored report.
+    std::string cache_key(const std::string& base, const std::string& addition, const std::string& options,
+                          const kitbash::GeometryOptions& geometry) {
+        kitbash::detail::MappedFile base_file(base);
+        kitbash::detail::MappedFile addition_file(addition);
+        std::string checks;
+        if (geometry.check) {
+            std::ostringstream out;
+            out << "geometry " << geometry.repair_normals << " " << geometry.normal_tolerance << " "
+                << geometry.uv_margin << " " << geometry.max_lines;
+            checks = out.str();
+        }
+        std::string key;
+        for (uint64_t seed : {0x6B697462617368ULL, 0x636163686521ULL}) {
+            uint64_t h = kitbash::detail::hash_bytes(cache_version, seed);
+            h = kitbash::detail::hash_bytes(options, h);
+            h = kitbash::detail::hash_bytes(checks, h);
+            h = kitbash::detail::hash_bytes(base_file.view(), h);
+            h = kitbash::detail::hash_bytes(addition_file.view(), h);
+            key += to_hex(h);
+        }
+        return key;
+    }
+
+    // Unique suffix for temporary files shared between threads and processes
+    std::string unique_suffix() {
+        std::ostringstream out;
+        out << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id()) << "-"
+            << std::chrono::steady_clock::now().time_since_epoch().count() << ".tmp";
+        return out.str();
+    }
+
+    void write_entry_stats(const fs::path& path, const MergeStats& stats, uint64_t output_bytes) {
+        std::string temp = path.string() + "." + unique_suffix();
+        {
+            std::ofstream out(temp, std::ios::trunc);
+            out << "output_bytes " << output_bytes << "\n"
+                << "original_vt_count " << stats.original_vt_count << "\n"
+                << "original_tris_count " << stats.original_tris_count << "\n"
+                << "original_line_count " << stats.original_line_count << "\n"
+                << "added_vt_count " << stats.added_vt_count << "\n"
+                << "added_tris_count " << stats.added_tris_count << "\n"
+                << "added_line_count " << stats.added_line_count << "\n"
+                << "final_vt_count " << stats.final_vt_count << "\n"
+                << "final_tris_count " << stats.final_tris_count << "\n"
+                << "final_line_count " << stats.final_line_count << "\n";
+            const kitbash::GeometryReport& geometry = stats.geometry;
+            if (geometry.checked) {
+                out << "geometry_vertices " << geometry.vertices << "\n"
+                    << "geometry_vectorized " << geometry.vectorized << "\n"
+                    << "geometry_repaired_normals " << geometry.repaired_normals << "\n";
+                // Count, then the first line numbers
+                for (int i = 0; i < kitbash::geometry_issue_count; ++i) {
+                    out << "geometry_" << kitbash::geometry_issue_name(static_cast<kitbash::GeometryIssue>(i)) << " "
+                        << geometry.counts[i];
+                    for (uint64_t line : geometry.first_lines[i]) {
+                        out << " " << line;
+                    }
+                    out << "\n";
+                }
+            }
+            if (!out) {
+                throw std::runtime_error("Cannot write file: " + temp);
+            }
+        }
+        fs::rename(temp, path);     // The stats file appearing is what publishes an entry
+    }
+
+    bool read_entry_stats(const fs::path& path, MergeStats& stats, uint64_t& output_bytes) {
+        std::ifstream in(path);
+        std::map<std::string, std::vector<long long>> values;     // Name, then its numbers
+        std::string text;
+        while (std::getline(in, text)) {
+            std::istringstream fields(text);
+            std::string name;
+            long long value;
+            if (fields >> name) {
+                std::vector<long long>& numbers = values[name];
+                while (fields >> value) {
+                    numbers.push_back(value);
+                }
+            }
+        }
+        static const char* const required[] = {
+            "output_bytes", "original_vt_count", "original_tris_count", "original_line_count", "added_vt_count",
+            "added_tris_count", "added_line_count", "final_vt_count", "final_tris_count", "final_line_count"};
+        for (const char* name : required) {
+            if (values[name].size() != 1) {
+                return false;
+            }
+        }
+        output_bytes = static_cast<uint64_t>(values["output_bytes"][0]);
+        stats.original_vt_count = static_cast<int>(values["original_vt_count"][0]);
+        stats.original_tris_count = static_cast<int>(values["original_tris_count"][0]);
+        stats.original_line_count = static_cast<int>(values["original_line_count"][0]);
+        stats.added_vt_count = static_cast<int>(values["added_vt_count"][0]);
+        stats.added_tris_count = static_cast<int>(values["added_tris_count"][0]);
+        stats.added_line_count = static_cast<int>(values["added_line_count"][0]);
+        stats.final_vt_count = static_cast<int>(values["final_vt_count"][0]);
+        stats.final_tris_count = static_cast<int>(values["final_tris_count"][0]);
+        stats.final_line_count = static_cast<int>(values["final_line_count"][0]);
+
+        // Vertex check report, stored when the merge checked
+        kitbash::GeometryReport& geometry = stats.geometry;
+        geometry = kitbash::GeometryReport();
+        if (values.count("geometry_vertices")) {
+            if (values["geometry_vertices"].size() != 1 || values["geometry_vectorized"].size() != 1 ||
+                values["geometry_repaired_normals"].size() != 1) {
+                return false;
+            }
+            geometry.checked = true;
+            geometry.vertices = static_cast<uint64_t>(values["geometry_vertices"][0]);
+            geometry.vectorized = values["geometry_vectorized"][0] != 0;
+            geometry.repaired_normals = static_cast<uint64_t>(values["geometry_repaired_normals"][0]);
+            for (int i = 0; i < kitbash::geometry_issue_count; ++i) {
+                const std::vector<long long>& numbers =
+                    values[std::string("geometry_") + kitbash::geometry_issue_name(static_cast<kitbash::GeometryIssue>(i))];
+                if (numbers.empty()) {
+                    return false;
+                }
+                geometry.counts[i] = static_cast<uint64_t>(numbers[0]);
+                geometry.first_lines[i].assign(numbers.begin() + 1, numbers.end());
+            }
+        }
+        return true;
+    }
+
+    // Copy-on-write clone where the filesystem supports it (Btrfs, XFS, ...)
+    bool reflink(const fs::path& from, const fs::path& to) {
+#if defined(__linux__) && defined(FICLONE)
+        int source = ::open(from.c_str(), O_RDONLY);
+        if (source < 0) {
+            return false;
+        }
+        int target = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool cloned = target >= 0 && ::ioctl(target, FICLONE, source) == 0;
+        if (target >= 0) {
+            ::close(target);
+        }
+        ::close(source);
+        if (!cloned) {
+            std::error_code ec;
+            fs::remove(to, ec);
+        }
+        return cloned;
+#else
+        (void)from;
+        (void)to;
+        return false;
+#endif
+    }
+
+    // Place a cached output at `to` atomically: reflink, hard link or copy
+    void materialize(const fs::path& from, const std::string& to, bool hard_links) {
+        fs::path temp = to + "." + unique_suffix();
+        std::error_code ec;
+        if (!reflink(from, temp)) {
+            if (!hard_links || (fs::create_hard_link(from, temp, ec), ec)) {
+                fs::copy_file(from, temp, fs::copy_options::overwrite_existing);
+                // Entries are read-only; a private copy should not be
+                fs::permissions(temp, fs::perms::owner_write, fs::perm_options::add);
+            }
+        }
+        fs::rename(temp, to, ec);
+        bool failed = static_cast<bool>(ec);
+        // Renaming onto another link of the same file is a no-op that keeps both names
+        fs::remove(temp, ec);
+        if (failed) {
+            throw std::runtime_error("Cannot create file: " + to);
+        }
+    }
+}
+
+namespace kitbash {
+    MergeCache::MergeCache(const CacheOptions& options) : options_(options) {
+        if (options_.directory.empty()) {
+            options_.directory = default_directory();
+        }
+    }
+
+    std::string MergeCache::default_directory() {
+        if (const char* dir = std::getenv("KITBASH_CACHE_DIR")) {
+            return dir;
+        }
+#ifdef _WIN32
+        if (const char* local = std::getenv("LOCALAPPDATA")) {
+            return (fs::path(local) / "kitbash" / "cache").string();
+        }
+#else
+        if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+            return (fs::path(xdg) / "kitbash").string();
+        }
+        if (const char* home = std::getenv("HOME")) {
+            return (fs::path(home) / ".cache" / "kitbash").string();
+        }
+#endif
+        return (fs::temp_directory_path() / "kitbash-cache").string();
+    }
+
+    bool MergeCache::merge_to_file(const std::string& base, const std::string& addition, const std::string& output,
+                                   MergeStats* stats, bool* hit, const std::string& options) {
+        auto start_time = std::chrono::steady_clock::now();
+        if (hit) {
+            *hit = false;
+        }
+        MergeStats result;
+        if (stats) {
+            result.backup_filename = stats->backup_filename;    // Chosen by the caller
+        }
+
+        try {
+            std::string key = cache_key(base, addition, options, options_.geometry);
+            fs::path folder = fs::path(options_.directory) / key.substr(0, 2);
+            fs::path entry = folder / (key + ".obj");
+            fs::path entry_stats = folder / (key + ".stats");
+
+            // Hit: no parse, just place the stored output
+            uint64_t entry_bytes = 0;
+            std::error_code ec;
+            bool found = read_entry_stats(entry_stats, result, entry_bytes) &&
+                         fs::file_size(entry, ec) == entry_bytes && !ec;
+            if (found) {
+                try {
+                    materialize(entry, output, options_.hard_links);
+                    fs::last_write_time(entry_stats, fs::file_time_type::clock::now(), ec);   // LRU
+                    ++stats_.hits;
+                    if (hit) {
+                        *hit = true;
+                    }
+                } catch (const std::exception&) {
+                    found = false;      // Evicted meanwhile: merge again
+                }
+            }
+
+            if (!found) {
+                ++stats_.misses;
+                fs::create_directories(folder, ec);
+                fs::path temp = entry.string() + "." + unique_suffix();
+                std::string target = ec ? output : temp.string();   // Unwritable cache: plain merge
+                std::unique_ptr<detail::MergeJob> job;
+                if (CompiledAddition::is_compiled_file(addition)) {
+                    job = std::make_unique<detail::MergeJob>(base, CompiledAddition::load(addition), target);
+                } else {
+                    job = std::make_unique<detail::MergeJob>(base, addition, target);
+                }
+                job->set_geometry_options(options_.geometry);
+                while (!job->run_chunk()) {
+                }
+                std::string backup = result.backup_filename;
+                result = job->stats();
+                result.backup_filename = backup;
+                if (!ec) {
+                    // Publish read-only, then place it like a hit
+                    fs::permissions(temp, fs::perms::owner_read | fs::perms::group_read | fs::perms::others_read);
+                    uint64_t bytes = fs::file_size(temp);
+                    fs::rename(temp, entry);
+                    write_entry_stats(entry_stats, result, bytes);
+                    materialize(entry, output, options_.hard_links);
+                    trim();
+                }
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+
+        if (stats) {
+            result.base_filename = base;
+            result.addition_filename = addition;
+            result.output_filename = output;
+            auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start_time);
+            result.processing_time = duration.count() / 1000000.0; // Convert to seconds
+            *stats = result;
+        }
+        return true;
+    }
+
+    bool MergeCache::contains(const std::string& base, const std::string& addition,
+                              const std::string& options) const {
+        try {
+            std::string key = cache_key(base, addition, options, options_.geometry);
+            fs::path folder = fs::path(options_.directory) / key.substr(0, 2);
+            MergeStats stored;
+            uint64_t entry_bytes = 0;
+            std::error_code ec;
+            return read_entry_stats(folder / (key + ".stats"), stored, entry_bytes) &&
+                   fs::file_size(folder / (key + ".obj"), ec) == entry_bytes && !ec;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+
+    void MergeCache::trim() {
+        struct Entry {
+            fs::path stats;
+            fs::path output;
+            uint64_t bytes;
+            fs::file_time_type used;
+        };
+        std::vector<Entry> entries;
+        uint64_t total = 0;
+        auto now = fs::file_time_type::clock::now();
+
+        std::error_code ec;
+        for (fs::recursive_directory_iterator it(options_.directory, ec), end; !ec && it != end; it.increment(ec)) {
+            if (!it->is_regular_file(ec)) {
+                continue;
+            }
+            // Per-file errors must not end the walk, which stops once `ec` is set
+            const fs::path& path = it->path();
+            std::error_code file_error;
+            auto modified = fs::last_write_time(path, file_error);
+            if (path.extension() == ".tmp" || (path.extension() == ".obj" &&
+                                               !fs::exists(fs::path(path).replace_extension(".stats")))) {
+                // Leftovers from interrupted writers; recent ones may still be in use
+                if (!file_error && now - modified > stale_age) {
+                    fs::remove(path, file_error);
+                }
+                continue;
+            }
+            if (path.extension() != ".stats" || file_error) {
+                continue;
+            }
+            Entry entry{path, fs::path(path).replace_extension(".obj"), 0, modified};
+            uint64_t stats_bytes = it->file_size(file_error);
+            uint64_t output_bytes = file_error ? 0 : fs::file_size(entry.output, file_error);
+            if (file_error) {
+                fs::remove(entry.stats, file_error);    // Dangling: its output is gone
+                continue;
+            }
+            entry.bytes = stats_bytes + output_bytes;
+            total += entry.bytes;
+            entries.push_back(entry);
+        }
+
+        // Least recently used first
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry& a, const Entry& b) { return a.used < b.used; });
+        size_t evicted = 0;
+        while (total > options_.max_bytes && evicted < entries.size()) {
+            const Entry& entry = entries[evicted++];
+            fs::remove(entry.stats, ec);    // Unpublish first
+            fs::remove(entry.output, ec);
+            total -= entry.bytes;
+        }
+        stats_.entries = entries.size() - evicted;
+        stats_.bytes = total;
+    }
+
+    void MergeCache::clear() {
+        std::error_code ec;
+        for (fs::directory_iterator it(options_.directory, ec), end; !ec && it != end; it.increment(ec)) {
+            fs::remove_all(it->path(), ec);
+        }
+        stats_.entries = 0;
+        stats_.bytes = 0;
+    }
+}
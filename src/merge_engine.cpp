@@ -0,0 +1,763 @@
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+// Internal helper functions
+namespace {
+    using kitbash::detail::ObjLayout;
+    using kitbash::detail::Span;
+    using kitbash::detail::next_token;
+    using kitbash::detail::split_tokens;
+    using kitbash::detail::parse_int_prefix;
+
+    // Same whitespace set tokenize() splits on
+    inline bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    }
+
+    // extract_point_counts() on a view: (VT, TRIS) or zeros if malformed
+    std::pair<int, int> point_counts_of(std::string_view line) {
+        std::string_view tokens[5];
+        size_t count = split_tokens(line, tokens, 5);
+        int vt = 0;
+        int tris = 0;
+        if (count == 5 && tokens[0] == "POINT_COUNTS" &&
+            parse_int_prefix(tokens[1], vt) && parse_int_prefix(tokens[4], tris)) {
+            return {vt, tris};
+        }
+        return {0, 0};
+    }
+
+    void add_span(std::vector<Span>& spans, size_t begin, size_t end) {
+        // Coalesce lines that follow each other directly in the file
+        if (!spans.empty() && spans.back().end == begin) {
+            spans.back().end = end;
+        } else {
+            spans.push_back(Span{begin, end});
+        }
+    }
+
+    void classify_line(std::string_view line, size_t begin, size_t next, ObjLayout& layout) {
+        size_t pos = 0;
+        std::string_view type = next_token(line, pos);
+        bool is_point_counts = line.find("POINT_COUNTS") != std::string_view::npos;
+        bool is_index = type == "IDX" || type == "IDX10";
+
+        if (!layout.has_point_counts) {
+            if (is_point_counts) {
+                layout.has_point_counts = true;
+                layout.point_counts = line;
+            } else {
+                add_span(layout.header, begin, next);
+                ++layout.header_lines;
+            }
+        }
+        if (is_point_counts) {
+            auto counts = point_counts_of(line);
+            layout.vt_count = counts.first;
+            layout.tris_count = counts.second;
+        }
+
+        if (type == "VT") {
+            add_span(layout.vertices, begin, next);
+            ++layout.vertex_lines;
+        } else if (is_index) {
+            add_span(layout.indices, begin, next);
+            ++layout.index_lines;
+            layout.past_idx = true;
+        }
+
+        if (layout.past_idx && !is_index) {
+            add_span(layout.footer, begin, next);
+            ++layout.footer_lines;
+        }
+    }
+
+    // Render progress unit: literal bytes plus one per relocation
+    uint64_t rendered_size(const kitbash::CompiledAddition::Data& data) {
+        return data.indices.literals.size() + data.indices.reloc_count +
+               data.footer.literals.size() + data.footer.reloc_count;
+    }
+
+    uint64_t span_bytes(const std::vector<Span>& spans) {
+        uint64_t total = 0;
+        for (const auto& span : spans) {
+            total += span.end - span.begin;
+        }
+        return total;
+    }
+}
+
+namespace kitbash {
+namespace detail {
+    // Next whitespace-separated token at or after pos; empty at end of line
+    std::string_view next_token(std::string_view line, size_t& pos) {
+        while (pos < line.size() && is_space(line[pos])) {
+            ++pos;
+        }
+        size_t start = pos;
+        while (pos < line.size() && !is_space(line[pos])) {
+            ++pos;
+        }
+        return line.substr(start, pos - start);
+    }
+
+    // std::stoi semantics: optional sign, at least one digit, trailing junk ignored,
+    // values outside int rejected
+    bool parse_int_prefix(std::string_view token, int& value) {
+        size_t i = 0;
+        bool negative = false;
+        if (i < token.size() && (token[i] == '+' || token[i] == '-')) {
+            negative = token[i] == '-';
+            ++i;
+        }
+        size_t digits_start = i;
+        long long result = 0;
+        while (i < token.size() && token[i] >= '0' && token[i] <= '9') {
+            result = result * 10 + (token[i] - '0');
+            if (result > static_cast<long long>(INT_MAX) + 1) {
+                return false;
+            }
+            ++i;
+        }
+        if (i == digits_start) {
+            return false;
+        }
+        result = negative ? -result : result;
+        if (result > INT_MAX || result < INT_MIN) {
+            return false;
+        }
+        value = static_cast<int>(result);
+        return true;
+    }
+
+    void append_int(std::string& out, long long value) {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, static_cast<size_t>(result.ptr - buffer));
+    }
+
+    // First max tokens of a line; returns how many were found
+    size_t split_tokens(std::string_view line, std::string_view* tokens, size_t max) {
+        size_t pos = 0;
+        size_t count = 0;
+        while (count < max) {
+            std::string_view token = next_token(line, pos);
+            if (token.empty()) {
+                break;
+            }
+            tokens[count++] = token;
+        }
+        return count;
+    }
+
+    bool scan_layout(std::string_view data, ObjLayout& layout, size_t max_bytes) {
+        size_t pos = layout.scan_pos;
+        size_t limit = pos + max_bytes;
+        while (pos < data.size() && pos < limit) {
+            const void* found = std::memchr(data.data() + pos, '\n', data.size() - pos);
+            size_t line_end = found ? static_cast<const char*>(found) - data.data() : data.size();
+            size_t next = found ? line_end + 1 : data.size();
+
+            // Empty lines are counted but skipped, as in parse_obj()
+            ++layout.line_count;
+            if (line_end > pos) {
+                classify_line(data.substr(pos, line_end - pos), pos, next, layout);
+            }
+            pos = next;
+        }
+        layout.scan_pos = pos;
+        return pos >= data.size();
+    }
+
+    bool validate_obj_header(std::string_view data) {
+        std::string_view lines[3];
+        size_t pos = 0;
+        for (size_t i = 0; i < 3; ++i) {
+            if (pos >= data.size()) {
+                return false;   // Need at least 3 lines for basic format
+            }
+            size_t end = data.find('\n', pos);
+            if (end == std::string_view::npos) {
+                end = data.size();
+            }
+            lines[i] = data.substr(pos, end - pos);
+            pos = end + 1;
+        }
+        return lines[1].find("800") != std::string_view::npos &&
+               lines[2].find("OBJ") != std::string_view::npos;
+    }
+
+    size_t compile_spans(std::string_view data, const std::vector<Span>& spans, bool footer,
+                       CompiledBuilder& builder, Cursor& cursor, size_t max_bytes) {
+        std::string& literals = footer ? builder.footer_literals : builder.index_literals;
+        std::vector<Relocation>& relocs = footer ? builder.footer_relocs : builder.index_relocs;
+        size_t consumed = 0;
+
+        // Record a relocation for the literal text added since the previous one
+        auto relocate = [&](int value) {
+            size_t gap = literals.size() - cursor.mark;
+            if (gap > UINT32_MAX) {
+                throw std::runtime_error("Addition too large to compile");
+            }
+            relocs.push_back(Relocation{static_cast<uint32_t>(gap), value});
+            cursor.mark = literals.size();
+        };
+
+        while (cursor.index < spans.size() && consumed < max_bytes) {
+            const Span& span = spans[cursor.index];
+            size_t pos = std::max(cursor.pos, span.begin);
+            const void* found = std::memchr(data.data() + pos, '\n', span.end - pos);
+            size_t line_end = found ? static_cast<const char*>(found) - data.data() : span.end;
+            std::string_view line = data.substr(pos, line_end - pos);
+
+            size_t token_pos = 0;
+            std::string_view token = next_token(line, token_pos);
+            if (!footer) {
+                // [IDX|IDX10]([tab][index + vt_offset])*, keeping tokens that are not numbers
+                literals.append(token.data(), token.size());
+                for (token = next_token(line, token_pos); !token.empty(); token = next_token(line, token_pos)) {
+                    literals.push_back('\t');
+                    int index;
+                    if (parse_int_prefix(token, index)) {
+                        relocate(index);
+                    } else {
+                        literals.append(token.data(), token.size());
+                    }
+                }
+            } else {
+                // [indentation]TRIS[tab][offset + tris_offset][tab][count]; other lines verbatim
+                std::string_view offset = next_token(line, token_pos);
+                std::string_view count = next_token(line, token_pos);
+                int tris_index;
+                if (token == "TRIS" && !count.empty() && parse_int_prefix(offset, tris_index)) {
+                    literals.append(line.data(), line.find("TRIS"));
+                    literals.append("TRIS\t");
+                    relocate(tris_index);
+                    literals.push_back('\t');
+                    literals.append(count.data(), count.size());
+                } else {
+                    literals.append(line.data(), line.size());
+                }
+            }
+            literals.push_back('\n');
+
+            size_t next = found ? line_end + 1 : span.end;
+            consumed += next - pos;
+            cursor.pos = next;
+            if (cursor.pos >= span.end) {
+                ++cursor.index;
+            }
+        }
+        return consumed;
+    }
+
+    std::shared_ptr<const CompiledAddition::Data> finish_compiled(std::shared_ptr<CompiledBuilder> builder,
+                                                                  const ObjLayout& layout,
+                                                                  const std::string& source) {
+        auto data = std::make_shared<CompiledAddition::Data>();
+        data->source = source;
+        data->vt_count = layout.vt_count;
+        data->tris_count = layout.tris_count;
+        data->line_count = layout.line_count;
+        data->vertex_lines = layout.vertex_lines;
+        data->index_lines = layout.index_lines;
+        data->footer_lines = layout.footer_lines;
+        data->vertices = builder->vertices;
+        data->indices = CompiledSection{builder->index_literals, builder->index_relocs.data(),
+                                        builder->index_relocs.size()};
+        data->footer = CompiledSection{builder->footer_literals, builder->footer_relocs.data(),
+                                       builder->footer_relocs.size()};
+        data->storage = std::move(builder);
+        return data;
+    }
+
+    bool render_section(std::string& out, const CompiledSection& section, long long offset,
+                        Cursor& cursor, size_t max_bytes) {
+        const char* literals = section.literals.data();
+        size_t produced = 0;
+        for (;;) {
+            bool relocation = cursor.index < section.reloc_count;
+            size_t literal_end = relocation ? cursor.mark + section.relocs[cursor.index].literal
+                                            : section.literals.size();
+            size_t length = std::min(literal_end - cursor.pos, max_bytes - produced);
+            out.append(literals + cursor.pos, length);
+            cursor.pos += length;
+            produced += length;
+            if (cursor.pos < literal_end) {
+                return false;   // Budget used up inside a literal
+            }
+            if (!relocation) {
+                return true;
+            }
+            append_int(out, static_cast<long long>(section.relocs[cursor.index].value) + offset);
+            ++cursor.index;
+            cursor.mark = cursor.pos;
+            produced += 8;
+            if (produced >= max_bytes) {
+                return cursor.index >= section.reloc_count && cursor.pos >= section.literals.size();
+            }
+        }
+    }
+
+    MergeJob::MergeJob(const std::string& base, const std::string& addition, const std::string& output,
+                       size_t chunk_bytes)
+        : base_name_(base), addition_name_(addition), output_name_(output.empty() ? base : output),
+          chunk_bytes_(chunk_bytes) {
+        in_place_ = output.empty();
+        temp_name_ = temp_path_for(output_name_);
+
+        std::error_code ec;
+        uint64_t base_size = std::filesystem::file_size(base_name_, ec);
+        input_bytes_ += ec ? 0 : base_size;
+        uint64_t addition_size = std::filesystem::file_size(addition_name_, ec);
+        input_bytes_ += ec ? 0 : addition_size;
+    }
+
+    MergeJob::MergeJob(const std::string& base, const CompiledAddition& addition, const std::string& output,
+                       size_t chunk_bytes)
+        : base_name_(base), output_name_(output.empty() ? base : output), chunk_bytes_(chunk_bytes) {
+        in_place_ = output.empty();
+        temp_name_ = temp_path_for(output_name_);
+        compiled_ = CompiledAccess::data(addition);
+        if (!compiled_) {
+            throw std::runtime_error("Compiled addition is empty");
+        }
+        addition_name_ = compiled_->source;
+        precompiled_ = true;
+        render_total_ = rendered_size(*compiled_);
+
+        std::error_code ec;
+        uint64_t base_size = std::filesystem::file_size(base_name_, ec);
+        input_bytes_ += ec ? 0 : base_size;
+    }
+
+    MergeJob::~MergeJob() {
+        if (step_ != Step::Done) {
+            abort();
+        }
+    }
+
+    void MergeJob::abort() {
+        writer_.reset();    // Closes the temporary file without reporting errors
+        if (output_descriptor_ < 0) {
+            std::error_code ec;
+            std::filesystem::remove(temp_name_, ec);
+        }
+    }
+
+    bool MergeJob::run_chunk() {
+        if (!started_) {
+            start_time_ = std::chrono::steady_clock::now();
+            started_ = true;
+        }
+
+        switch (step_) {
+        case Step::MapBase:
+            base_ = MappedFile(base_name_);
+            if (!validate_obj_header(base_.view())) {
+                throw std::runtime_error("Invalid OBJ8 format");
+            }
+            step_ = precompiled_ ? Step::ScanBase : Step::MapAddition;
+            break;
+
+        case Step::MapAddition:
+            addition_ = MappedFile(addition_name_);
+            if (!validate_obj_header(addition_.view())) {
+                throw std::runtime_error("Invalid OBJ8 format");
+            }
+            step_ = Step::ScanBase;
+            break;
+
+        case Step::ScanBase:
+            if (scan_layout(base_.view(), base_layout_, chunk_bytes_)) {
+                if (precompiled_) {
+                    start_check();
+                } else {
+                    step_ = Step::ScanAddition;
+                }
+            }
+            break;
+
+        case Step::ScanAddition:
+            if (scan_layout(addition_.view(), addition_layout_, chunk_bytes_)) {
+                builder_ = std::make_shared<CompiledBuilder>();
+                uint64_t index_bytes = span_bytes(addition_layout_.indices);
+                uint64_t footer_bytes = span_bytes(addition_layout_.footer);
+                builder_->reserve(index_bytes, footer_bytes);
+                compile_total_ = index_bytes + footer_bytes;
+                cursor_ = Cursor();
+                step_ = Step::CompileIndices;
+            }
+            break;
+
+        case Step::CompileIndices:
+            compile_done_ += compile_spans(addition_.view(), addition_layout_.indices, false,
+                                           *builder_, cursor_, chunk_bytes_);
+            if (cursor_.index >= addition_layout_.indices.size()) {
+                cursor_ = Cursor();
+                step_ = Step::CompileFooter;
+            }
+            break;
+
+        case Step::CompileFooter:
+            compile_done_ += compile_spans(addition_.view(), addition_layout_.footer, true,
+                                           *builder_, cursor_, chunk_bytes_);
+            if (cursor_.index >= addition_layout_.footer.size()) {
+                // VT lines are copied straight from the mapping, not from the builder
+                compiled_ = finish_compiled(std::move(builder_), addition_layout_, addition_name_);
+                render_total_ = rendered_size(*compiled_);
+                start_check();
+            }
+            break;
+
+        case Step::CheckGeometry: {
+            size_t budget = chunk_bytes_;
+            while (check_range_ < check_ranges_.size() && budget > 0) {
+                std::string_view range = check_ranges_[check_range_];
+                size_t read = scan_vertex_lines(*scanner_, range, check_pos_, check_line_, budget);
+                check_done_ += read;
+                budget -= std::min(read, budget);
+                if (check_pos_ >= range.size()) {
+                    ++check_range_;
+                    check_pos_ = 0;
+                }
+            }
+            if (check_range_ >= check_ranges_.size()) {
+                finish_check();
+                step_ = Step::PlanHead;
+            }
+            break;
+        }
+
+        case Step::PlanHead:
+            stats_.base_filename = base_name_;
+            stats_.addition_filename = addition_name_;
+            stats_.output_filename = output_name_;
+            stats_.original_vt_count = base_layout_.vt_count;
+            stats_.original_tris_count = base_layout_.tris_count;
+            stats_.original_line_count = static_cast<int>(base_layout_.line_count);
+            stats_.added_vt_count = compiled_->vt_count;
+            stats_.added_tris_count = compiled_->tris_count;
+            stats_.added_line_count = static_cast<int>(compiled_->line_count);
+            stats_.final_vt_count = stats_.original_vt_count + stats_.added_vt_count;
+            stats_.final_tris_count = stats_.original_tris_count + stats_.added_tris_count;
+
+            // 1. Header and POINT_COUNTS with combined totals (dropped if malformed)
+            add_spans(base_, base_layout_.header);
+            output_lines_ += base_layout_.header_lines;
+            if (base_layout_.has_point_counts) {
+                std::string_view tokens[5];
+                if (split_tokens(base_layout_.point_counts, tokens, 5) == 5) {
+                    std::string line = "POINT_COUNTS ";
+                    append_int(line, stats_.final_vt_count);
+                    line.append(" ").append(tokens[2]).append(" ").append(tokens[3]).append(" ");
+                    append_int(line, stats_.final_tris_count);
+                    line.push_back('\n');
+                    add_owned(std::move(line));
+                    ++output_lines_;
+                }
+            }
+            // 2-4. Base vertices, addition vertices, base indices - copied verbatim
+            // apart from VT lines with repaired normals
+            if (repairs_.empty()) {
+                add_spans(base_, base_layout_.vertices);
+                if (precompiled_) {
+                    if (!compiled_->vertices.empty()) {
+                        plan_.push_back(Segment{compiled_->vertices.data(), compiled_->vertices.size(), false});
+                    }
+                } else {
+                    add_spans(addition_, addition_layout_.vertices);
+                }
+            } else {
+                uint64_t line = first_vertex_line_;
+                size_t repair = 0;
+                for (const MappedFile* file : {&base_, &addition_}) {
+                    const ObjLayout& layout = file == &base_ ? base_layout_ : addition_layout_;
+                    if (file == &addition_ && precompiled_) {
+                        add_vertices(compiled_->vertices, false, line, repair);
+                        continue;
+                    }
+                    for (const auto& span : layout.vertices) {
+                        bool missing_newline = span.end == file->size() && file->data()[file->size() - 1] != '\n';
+                        add_vertices(std::string_view(file->data() + span.begin, span.end - span.begin),
+                                     missing_newline, line, repair);
+                    }
+                }
+                repairs_.clear();
+            }
+            add_spans(base_, base_layout_.indices);
+            output_lines_ += base_layout_.vertex_lines + compiled_->vertex_lines + base_layout_.index_lines;
+            cursor_ = Cursor();
+            step_ = Step::RenderIndices;
+            break;
+
+        case Step::RenderIndices:
+            // 5. Addition indices rebased onto the base vertex count
+            if (render(compiled_->indices, base_layout_.vt_count)) {
+                output_lines_ += compiled_->index_lines;
+                step_ = Step::PlanFooter;
+            }
+            break;
+
+        case Step::PlanFooter:
+            // 6-7. Base footer, then attributes for the addition
+            add_spans(base_, base_layout_.footer);
+            output_lines_ += base_layout_.footer_lines;
+            add_owned("\tATTR_draw_enable\n\tATTR_cockpit\n");
+            output_lines_ += 2;
+            cursor_ = Cursor();
+            step_ = Step::RenderFooter;
+            break;
+
+        case Step::RenderFooter:
+            // 7. Addition footer with TRIS offsets rebased
+            if (render(compiled_->footer, base_layout_.tris_count)) {
+                output_lines_ += compiled_->footer_lines;
+                for (const auto& segment : plan_) {
+                    output_bytes_ += segment.size + (segment.newline ? 1 : 0);
+                }
+                writer_ = output_descriptor_ >= 0 ? std::make_unique<FileWriter>(output_descriptor_, output_name_)
+                                                  : std::make_unique<FileWriter>(temp_name_);
+                step_ = Step::Write;
+            }
+            break;
+
+        case Step::Write: {
+            size_t budget = chunk_bytes_;
+            while (write_segment_ < plan_.size() && budget > 0) {
+                const Segment& segment = plan_[write_segment_];
+                size_t length = std::min(segment.size - write_offset_, budget);
+                writer_->write(std::string_view(segment.data + write_offset_, length));
+                write_offset_ += length;
+                written_bytes_ += length;
+                budget -= length;
+                if (write_offset_ == segment.size) {
+                    if (segment.newline) {
+                        writer_->write(std::string_view("\n", 1));
+                        ++written_bytes_;
+                    }
+                    ++write_segment_;
+                    write_offset_ = 0;
+                }
+            }
+            if (write_segment_ == plan_.size()) {
+                writer_->close();
+                writer_.reset();
+                step_ = Step::Commit;
+            }
+            break;
+        }
+
+        case Step::Commit: {
+            // Release the inputs before replacing a file that may be one of them
+            plan_.clear();
+            owned_.clear();
+            base_.reset();
+            addition_.reset();
+            compiled_.reset();
+            // Output written to a caller's descriptor is already in place
+            if (output_descriptor_ < 0) {
+                if (in_place_) {
+                    if (commit_guard_) {
+                        commit_guard_();
+                    }
+                    // The untouched base becomes the backup: a rename instead of a copy
+                    // keeps the commit O(1) for time-sliced callers
+                    stats_.backup_filename = kitbash::generate_backup_filename(base_name_);
+                    replace_keeping_backup(base_name_, temp_name_, stats_.backup_filename);
+                } else {
+                    replace_file(temp_name_, output_name_);
+                }
+            }
+
+            stats_.final_line_count = static_cast<int>(output_lines_);
+            auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start_time_);
+            stats_.processing_time = duration.count() / 1000000.0; // Convert to seconds
+            step_ = Step::Done;
+            break;
+        }
+
+        case Step::Done:
+            break;
+        }
+
+        return step_ == Step::Done;
+    }
+
+    void MergeJob::add_spans(const MappedFile& file, const std::vector<Span>& spans) {
+        const char* data = file.data();
+        size_t size = file.size();
+        for (const auto& span : spans) {
+            // Only the file's last line can lack a newline
+            bool newline = span.end == size && data[size - 1] != '\n';
+            plan_.push_back(Segment{data + span.begin, span.end - span.begin, newline});
+        }
+    }
+
+    // Vertex bytes into the plan, with the lines in repairs_ replaced
+    void MergeJob::add_vertices(std::string_view data, bool missing_newline, uint64_t& line, size_t& repair) {
+        size_t planned = 0;     // Bytes before this are in the plan
+        size_t at = 0;
+        while (at < data.size()) {
+            const void* found = std::memchr(data.data() + at, '\n', data.size() - at);
+            size_t next = found ? static_cast<const char*>(found) - data.data() + 1 : data.size();
+            if (repair < repairs_.size() && repairs_[repair].line == line) {
+                if (at > planned) {
+                    plan_.push_back(Segment{data.data() + planned, at - planned, false});
+                }
+                add_owned(std::move(repairs_[repair].text) + "\n");
+                ++repair;
+                planned = next;
+            }
+            ++line;
+            at = next;
+        }
+        if (data.size() > planned) {
+            plan_.push_back(Segment{data.data() + planned, data.size() - planned, missing_newline});
+        }
+    }
+
+    // Vertex checks run between compiling the addition and planning the output
+    void MergeJob::start_check() {
+        step_ = Step::PlanHead;
+        if (!geometry_options_.check) {
+            return;
+        }
+        scanner_ = std::make_unique<GeometryScanner>(geometry_options_);
+        for (const auto& span : base_layout_.vertices) {
+            check_ranges_.push_back(std::string_view(base_.data() + span.begin, span.end - span.begin));
+        }
+        if (precompiled_) {
+            check_ranges_.push_back(compiled_->vertices);
+        } else {
+            for (const auto& span : addition_layout_.vertices) {
+                check_ranges_.push_back(std::string_view(addition_.data() + span.begin, span.end - span.begin));
+            }
+        }
+        for (const auto& range : check_ranges_) {
+            check_total_ += range.size();
+        }
+        // Output line of the first vertex: the header, then POINT_COUNTS unless it is dropped
+        std::string_view tokens[5];
+        bool point_counts = base_layout_.has_point_counts && split_tokens(base_layout_.point_counts, tokens, 5) == 5;
+        first_vertex_line_ = base_layout_.header_lines + (point_counts ? 1 : 0) + 1;
+        check_line_ = first_vertex_line_;
+        step_ = Step::CheckGeometry;
+    }
+
+    void MergeJob::finish_check() {
+        if (scanner_->needs_indices()) {
+            // Zero or NaN normals take face normals from the output triangles
+            for (const auto& span : base_layout_.indices) {
+                std::string_view data(base_.data() + span.begin, span.end - span.begin);
+                size_t pos = 0;
+                while (pos < data.size()) {
+                    size_t end = data.find('\n', pos);
+                    end = end == std::string_view::npos ? data.size() : end;
+                    scanner_->add_indices(data.substr(pos, end - pos), 0);
+                    pos = end + 1;
+                }
+            }
+            const CompiledSection& indices = compiled_->indices;
+            for (size_t i = 0; i < indices.reloc_count; ++i) {
+                scanner_->add_index(static_cast<long long>(indices.relocs[i].value) + base_layout_.vt_count);
+            }
+        }
+        stats_.geometry = scanner_->finish(geometry_options_.repair_normals ? &repairs_ : nullptr);
+        scanner_.reset();
+        check_ranges_.clear();
+    }
+
+    void MergeJob::add_owned(std::string text) {
+        owned_.push_back(std::move(text));
+        plan_.push_back(Segment{owned_.back().data(), owned_.back().size(), false});
+    }
+
+    bool MergeJob::render(const CompiledSection& section, long long offset) {
+        std::string out;
+        out.reserve(chunk_bytes_ + chunk_bytes_ / 4);
+        uint64_t before = cursor_.pos + cursor_.index;
+        bool finished = render_section(out, section, offset, cursor_, chunk_bytes_);
+        render_done_ += cursor_.pos + cursor_.index - before;
+        if (!out.empty()) {
+            add_owned(std::move(out));
+        }
+        return finished;
+    }
+
+    MergePhase MergeJob::phase() const {
+        switch (step_) {
+        case Step::MapBase:
+        case Step::MapAddition:
+            return MergePhase::Read;
+        case Step::ScanBase:
+        case Step::ScanAddition:
+            return MergePhase::Parse;
+        case Step::CompileIndices:
+        case Step::CompileFooter:
+        case Step::CheckGeometry:
+        case Step::PlanHead:
+        case Step::RenderIndices:
+        case Step::PlanFooter:
+        case Step::RenderFooter:
+            return MergePhase::Merge;
+        case Step::Write:
+        case Step::Commit:
+            return MergePhase::Write;
+        case Step::Done:
+            break;
+        }
+        return MergePhase::Done;
+    }
+
+    MergeProgress MergeJob::progress() const {
+        // Phase weights for the overall percentage: read 5, parse 40, merge 20, write 35
+        MergeProgress progress;
+        progress.phase = phase();
+        double start = 0.0;
+        double weight = 0.0;
+        switch (progress.phase) {
+        case MergePhase::Read:
+            progress.bytes_done = base_.size() + addition_.size();
+            progress.bytes_total = input_bytes_;
+            weight = 5.0;
+            break;
+        case MergePhase::Parse:
+            progress.bytes_done = base_layout_.scan_pos + addition_layout_.scan_pos;
+            progress.bytes_total = base_.size() + addition_.size();
+            start = 5.0;
+            weight = 40.0;
+            break;
+        case MergePhase::Merge:
+            // Compiling the addition, checking vertices, then rendering; the rendered size
+            // is about the compiled input size until the compiled sections exist
+            progress.bytes_done = compile_done_ + check_done_ + render_done_;
+            progress.bytes_total = compile_total_ + check_total_ + (compiled_ ? render_total_ : compile_total_);
+            start = 45.0;
+            weight = 20.0;
+            break;
+        case MergePhase::Write:
+            progress.bytes_done = written_bytes_;
+            progress.bytes_total = output_bytes_;
+            start = 65.0;
+            weight = 35.0;
+            break;
+        case MergePhase::Done:
+            progress.bytes_done = output_bytes_;
+            progress.bytes_total = output_bytes_;
+            start = 100.0;
+            break;
+        }
+        double fraction = progress.bytes_total > 0
+            ? std::min(1.0, static_cast<double>(progress.bytes_done) / progress.bytes_total) : 0.0;
+        progress.percent = start + weight * fraction;
+        return progress;
+    }
+}
+}
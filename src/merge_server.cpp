@@ -0,0 +1,515 @@
+#include "kitbash.h"
+#include "kitbash_io.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+// Internal helper functions
+namespace {
+#ifndef _WIN32
+    // One request per connection, one tab-separated line each way:
+    //     merge <interactive|bulk> <base> <addition> <output> <file|descriptor|stream>
+    //     ok <9 counts> <processing_time> <backup> <size>    or    error <message>
+    // Paths are absolute, resolved by the client. With `descriptor` the reply carries
+    // the result's memory file (SCM_RIGHTS); with `stream`, <size> bytes follow it.
+    constexpr size_t max_line = 64 * 1024;
+    constexpr size_t stream_block = 1 << 20;
+
+    int open_socket() {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0) {
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        return fd;
+    }
+
+    bool send_all(int fd, std::string_view data) {
+        const char* bytes = data.data();
+        size_t size = data.size();
+        while (size > 0) {
+            ssize_t sent = ::send(fd, bytes, size, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                return false;
+            }
+            bytes += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    // Sends a descriptor along with the first byte when one is given
+    bool send_line(int fd, const std::string& line, int descriptor = -1) {
+        if (descriptor < 0) {
+            return send_all(fd, line);
+        }
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        iovec data{const_cast<char*>(line.data()), 1};
+        msghdr message{};
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(header), &descriptor, sizeof(int));
+        ssize_t sent;
+        do {
+            sent = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+        } while (sent < 0 && errno == EINTR);
+        return sent == 1 && send_all(fd, line.substr(1));
+    }
+
+    // Byte by byte so nothing after the newline is consumed; keeps a passed descriptor
+    bool receive_line(int fd, std::string& line, int* descriptor = nullptr) {
+        line.clear();
+        char c;
+        while (line.size() < max_line) {
+            char control[CMSG_SPACE(sizeof(int))] = {};
+            iovec data{&c, 1};
+            msghdr message{};
+            message.msg_iov = &data;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            ssize_t received = ::recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                return false;
+            }
+            for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+                if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+                    int passed;
+                    std::memcpy(&passed, CMSG_DATA(header), sizeof(int));
+                    if (descriptor && *descriptor < 0) {
+                        *descriptor = passed;
+                    } else {
+                        ::close(passed);
+                    }
+                }
+            }
+            if (c == '\n') {
+                return true;
+            }
+            line += c;
+        }
+        return false;
+    }
+
+    // Plain streaming: map the memory file and copy it through the socket
+    bool send_stream(int fd, const kitbash::MemoryOutput& memory) {
+        if (memory.size == 0) {
+            return true;
+        }
+        void* data = ::mmap(nullptr, memory.size, PROT_READ, MAP_SHARED, memory.descriptor, 0);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        bool sent = send_all(fd, std::string_view(static_cast<const char*>(data), memory.size));
+        ::munmap(data, memory.size);
+        return sent;
+    }
+
+    // Copy `size` bytes of a descriptor into a file in the kernel where possible
+    void copy_to_file(int descriptor, uint64_t size, const std::string& output) {
+        std::string temp = kitbash::detail::temp_path_for(output);
+        int target = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (target < 0) {
+            throw std::runtime_error("Cannot create file: " + output);
+        }
+        uint64_t copied = 0;
+        bool failed = false;
+#ifdef __linux__
+        off_t offset = 0;
+        while (copied < size) {
+            ssize_t n = ::sendfile(target, descriptor, &offset, std::min<uint64_t>(size - copied, 1ULL << 30));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;      // Not supported here: finish with read/write
+            }
+            copied += static_cast<uint64_t>(n);
+        }
+#endif
+        std::vector<char> buffer(copied < size ? stream_block : 0);
+        while (copied < size && !failed) {
+            ssize_t n = ::pread(descriptor, buffer.data(), std::min<uint64_t>(size - copied, buffer.size()),
+                                static_cast<off_t>(copied));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            failed = n <= 0 || ::write(target, buffer.data(), static_cast<size_t>(n)) != n;
+            copied += failed ? 0 : static_cast<uint64_t>(n);
+        }
+        failed = ::close(target) != 0 || failed;
+        std::error_code ec;
+        if (failed) {
+            std::filesystem::remove(temp, ec);
+            throw std::runtime_error("Cannot write file: " + output);
+        }
+        kitbash::detail::replace_file(temp, output);
+    }
+
+    std::vector<std::string> split_fields(const std::string& line) {
+        std::vector<std::string> fields;
+        std::string field;
+        std::istringstream in(line);
+        while (std::getline(in, field, '\t')) {
+            fields.push_back(field);
+        }
+        if (!line.empty() && line.back() == '\t') {
+            fields.push_back("");       // Trailing empty output
+        }
+        return fields;
+    }
+
+    std::string encode(const kitbash::MergeResult& result) {
+        if (!result.success) {
+            std::string message = result.error;
+            std::replace(message.begin(), message.end(), '\n', ' ');
+            return "error\t" + message + "\n";
+        }
+        const MergeStats& stats = result.stats;
+        std::ostringstream out;
+        out << "ok";
+        for (int count : {stats.original_vt_count, stats.original_tris_count, stats.original_line_count,
+                          stats.added_vt_count, stats.added_tris_count, stats.added_line_count,
+                          stats.final_vt_count, stats.final_tris_count, stats.final_line_count}) {
+            out << "\t" << count;
+        }
+        out << "\t" << stats.processing_time << "\t" << stats.backup_filename << "\t"
+            << (result.memory ? result.memory->size : 0) << "\n";
+        return out.str();
+    }
+
+    bool decode(const std::string& line, kitbash::MergeResult& result, uint64_t& size) {
+        auto fields = split_fields(line);
+        if (fields.size() == 2 && fields[0] == "error") {
+            result.error = fields[1];
+            return true;
+        }
+        if (fields.size() != 13 || fields[0] != "ok") {
+            return false;
+        }
+        MergeStats& stats = result.stats;
+        int* counts[9] = {
+            &stats.original_vt_count, &stats.original_tris_count, &stats.original_line_count,
+            &stats.added_vt_count, &stats.added_tris_count, &stats.added_line_count,
+            &stats.final_vt_count, &stats.final_tris_count, &stats.final_line_count,
+        };
+        try {
+            for (size_t i = 0; i < 9; ++i) {
+                *counts[i] = std::stoi(fields[i + 1]);
+            }
+            stats.processing_time = std::stod(fields[10]);
+            size = std::stoull(fields[12]);
+        } catch (const std::exception&) {
+            return false;
+        }
+        stats.backup_filename = fields[11];
+        result.success = true;
+        return true;
+    }
+
+    void handle_client(int fd, kitbash::MergeService& service) {
+        std::string line;
+        kitbash::MergeResult result;
+        if (receive_line(fd, line)) {
+            auto fields = split_fields(line);
+            if (fields.size() != 6 || fields[0] != "merge" ||
+                (fields[1] != "interactive" && fields[1] != "bulk") ||
+                (fields[5] != "file" && fields[5] != "descriptor" && fields[5] != "stream")) {
+                result.error = "Malformed request";
+            } else {
+                auto priority = fields[1] == "interactive" ? kitbash::Priority::Interactive
+                                                           : kitbash::Priority::Bulk;
+                try {
+                    result = fields[5] == "file" ? service.submit(fields[2], fields[3], fields[4], priority).get()
+                                                 : service.submit_to_memory(fields[2], fields[3], priority).get();
+                } catch (const std::exception& e) {
+                    result.error = e.what();
+                }
+            }
+            if (result.memory && fields[5] == "descriptor") {
+                // The client gets its own reference to the same sealed file
+                send_line(fd, encode(result), result.memory->descriptor);
+            } else if (send_all(fd, encode(result)) && result.memory) {
+                send_stream(fd, *result.memory);
+            }
+        }
+        ::close(fd);
+    }
+
+    bool make_address(const std::string& socket_path, sockaddr_un& address, std::string* error) {
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            if (error) {
+                *error = "Socket path too long: " + socket_path;
+            }
+            return false;
+        }
+        std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+        return true;
+    }
+
+    // Send one request and collect the reply, receiving the output here for
+    // `descriptor` and `stream` deliveries
+    kitbash::MergeResult exchange(const std::string& socket_path, const std::string& base,
+                                  const std::string& addition, const std::string& output,
+                                  const std::string& delivery, kitbash::Priority priority) {
+        kitbash::MergeResult result;
+        bool server_writes = delivery == "file";
+        std::string fields[3] = {base, addition, server_writes ? output : ""};
+        for (auto& field : fields) {
+            if (!field.empty()) {
+                field = std::filesystem::absolute(field).lexically_normal().string();
+            }
+            if (field.find_first_of("\t\n") != std::string::npos) {
+                result.error = "Unsupported character in path: " + field;
+                return result;
+            }
+        }
+
+        sockaddr_un address;
+        if (!make_address(socket_path, address, &result.error)) {
+            return result;
+        }
+        int fd = open_socket();
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            result.error = "Cannot connect to " + socket_path + ": " + std::strerror(errno);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return result;
+        }
+        std::string request = std::string("merge\t") +
+                              (priority == kitbash::Priority::Interactive ? "interactive" : "bulk") + "\t" +
+                              fields[0] + "\t" + fields[1] + "\t" + fields[2] + "\t" + delivery + "\n";
+        std::string reply;
+        int passed = -1;
+        uint64_t size = 0;
+        bool received = send_all(fd, request) && receive_line(fd, reply, &passed) && decode(reply, result, size);
+
+        auto memory = std::make_shared<kitbash::MemoryOutput>();
+        memory->descriptor = passed;    // Closed with `memory` unless handed out
+        memory->size = size;
+        std::string temp = output.empty() ? std::string() : kitbash::detail::temp_path_for(output);
+        try {
+            if (received && result.success && delivery == "descriptor" && passed < 0) {
+                received = false;
+            } else if (received && result.success && delivery == "stream") {
+                // Receive into our own memory file, or straight into the output
+                std::unique_ptr<kitbash::detail::FileWriter> writer;
+                if (output.empty()) {
+                    memory->descriptor = kitbash::detail::create_memory_file("kitbash-result");
+                    writer = std::make_unique<kitbash::detail::FileWriter>(memory->descriptor, "<memory>");
+                } else {
+                    writer = std::make_unique<kitbash::detail::FileWriter>(temp);
+                }
+                std::vector<char> buffer(stream_block);
+                uint64_t left = size;
+                while (received && left > 0) {
+                    ssize_t n = ::recv(fd, buffer.data(), std::min<uint64_t>(left, buffer.size()), 0);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    received = n > 0;
+                    if (received) {
+                        writer->write(std::string_view(buffer.data(), static_cast<size_t>(n)));
+                        left -= static_cast<uint64_t>(n);
+                    }
+                }
+                writer->close();
+                if (output.empty()) {
+                    kitbash::detail::seal_memory_file(memory->descriptor);
+                } else {
+                    std::error_code ec;
+                    if (received) {
+                        kitbash::detail::replace_file(temp, output);
+                    } else {
+                        std::filesystem::remove(temp, ec);
+                    }
+                }
+            } else if (received && result.success && !output.empty() && !server_writes) {
+                copy_to_file(passed, size, output);
+            }
+        } catch (const std::exception& e) {
+            ::close(fd);
+            if (!output.empty() && !server_writes) {
+                std::error_code ec;
+                std::filesystem::remove(temp, ec);
+            }
+            result = kitbash::MergeResult();
+            result.error = e.what();
+            return result;
+        }
+        ::close(fd);
+        if (!received) {
+            result = kitbash::MergeResult();
+            result.error = "Connection to the merge server was lost";
+            return result;
+        }
+        if (result.success) {
+            result.stats.base_filename = fields[0];
+            result.stats.addition_filename = fields[1];
+            if (server_writes) {
+                result.stats.output_filename = output.empty() ? fields[0] : fields[2];
+            } else if (output.empty()) {
+                result.memory = memory;
+            } else {
+                result.stats.output_filename = output;
+            }
+        }
+        return result;
+    }
+#endif
+}
+
+namespace kitbash {
+#ifndef _WIN32
+    bool serve_merge_service(const std::string& socket_path, const ServiceOptions& options,
+                             const std::function<bool()>& should_stop, std::string* error,
+                             ServiceStats* stats) {
+        sockaddr_un address;
+        if (!make_address(socket_path, address, error)) {
+            return false;
+        }
+        int listener = open_socket();
+        if (listener < 0) {
+            if (error) {
+                *error = std::string("Cannot create socket: ") + std::strerror(errno);
+            }
+            return false;
+        }
+
+        // A socket file nobody answers on is left over from a server that died
+        if (::connect(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+            ::close(listener);
+            if (error) {
+                *error = "A server is already listening on " + socket_path;
+            }
+            return false;
+        }
+        ::close(listener);
+        std::error_code ec;
+        if (std::filesystem::is_socket(socket_path, ec)) {
+            ::unlink(socket_path.c_str());
+        }
+        listener = open_socket();
+        if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listener, SOMAXCONN) != 0) {
+            if (error) {
+                *error = "Cannot listen on " + socket_path + ": " + std::strerror(errno);
+            }
+            if (listener >= 0) {
+                ::close(listener);
+            }
+            return false;
+        }
+
+        {
+            MergeService service(options);
+            struct Client {
+                std::thread thread;
+                std::shared_ptr<std::atomic<bool>> done;
+            };
+            std::list<Client> clients;
+            while (!should_stop || !should_stop()) {
+                pollfd poll_fd{listener, POLLIN, 0};
+                int ready = ::poll(&poll_fd, 1, 200);   // Wake up to check should_stop
+                for (auto it = clients.begin(); it != clients.end();) {
+                    if (*it->done) {
+                        it->thread.join();
+                        it = clients.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                if (ready <= 0) {
+                    continue;
+                }
+                int fd = ::accept(listener, nullptr, nullptr);
+                if (fd < 0) {
+                    continue;
+                }
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+                // Each connection waits on its own result, so slow merges don't hold up others
+                auto done = std::make_shared<std::atomic<bool>>(false);
+                clients.push_back({std::thread([fd, &service, done] {
+                    handle_client(fd, service);
+                    *done = true;
+                }), done});
+            }
+            ::close(listener);
+            ::unlink(socket_path.c_str());
+            for (auto& client : clients) {
+                client.thread.join();
+            }
+            if (stats) {
+                *stats = service.stats();
+            }
+        }
+        return true;
+    }
+
+    MergeResult merge_remote(const std::string& socket_path, const std::string& base, const std::string& addition,
+                             const std::string& output, Priority priority) {
+        return exchange(socket_path, base, addition, output, "file", priority);
+    }
+
+    MergeResult fetch_remote(const std::string& socket_path, const std::string& base, const std::string& addition,
+                             const std::string& output, Transfer transfer, Priority priority) {
+        return exchange(socket_path, base, addition, output,
+                        transfer == Transfer::Descriptor ? "descriptor" : "stream", priority);
+    }
+#else
+    bool serve_merge_service(const std::string&, const ServiceOptions&, const std::function<bool()>&,
+                             std::string* error, ServiceStats*) {
+        if (error) {
+            *error = "Server mode is not supported on this platform";
+        }
+        return false;
+    }
+
+    MergeResult merge_remote(const std::string&, const std::string&, const std::string&, const std::string&,
+                             Priority) {
+        MergeResult result;
+        result.error = "Server mode is not supported on this platform";
+        return result;
+    }
+
+    MergeResult fetch_remote(const std::string&, const std::string&, const std::string&, const std::string&,
+                             Transfer, Priority) {
+        MergeResult result;
+        result.error = "Server mode is not supported on this platform";
+        return result;
+    }
+#endif
+}
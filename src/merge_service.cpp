@@ -0,0 +1,380 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+// Internal helper functions
+namespace {
+    std::string normalize(const std::string& path) {
+        return std::filesystem::absolute(path).lexically_normal().string();
+    }
+
+    // One caller's addition; coalesced callers share it
+    struct Part {
+        std::string addition;
+        std::promise<kitbash::MergeResult> promise;
+        std::shared_future<kitbash::MergeResult> future;
+    };
+
+    // One execution: a single write of `target`
+    struct Entry {
+        std::string base;               // As given, for stats
+        std::string output;             // Empty: in place
+        std::string base_key;           // Normalized paths
+        std::string target_key;
+        std::string addition_key;       // Of the first part
+        kitbash::Priority lane = kitbash::Priority::Bulk;
+        bool combinable = false;        // In place with OBJ8 additions only
+        bool to_memory = false;         // Output goes to a memory file, not `output`
+        bool running = false;
+        uint64_t sequence = 0;          // Order of creation, across both lanes
+        std::vector<std::unique_ptr<Part>> parts;   // Applied in submission order
+    };
+
+    // Apply every part to the base and write the result once
+    void run_combined(Entry& entry, std::vector<kitbash::MergeResult>& results) {
+        auto start_time = std::chrono::steady_clock::now();
+        kitbash::Document doc = kitbash::detail::load_document(entry.base);
+        MergeStats stats;
+        stats.base_filename = entry.base;
+        stats.output_filename = entry.base;
+        stats.original_vt_count = doc.vt_count();
+        stats.original_tris_count = doc.tris_count();
+        stats.original_line_count = static_cast<int>(doc.total_line_count());
+
+        bool applied = false;
+        for (size_t i = 0; i < entry.parts.size(); ++i) {
+            try {
+                kitbash::Document addition = kitbash::detail::load_document(entry.parts[i]->addition);
+                if (applied) {
+                    // As if the previous result had been written and read back
+                    doc = kitbash::detail::as_reloaded(doc);
+                }
+                doc.merge(addition);
+                results[i].success = true;
+                applied = true;
+            } catch (const std::exception& e) {
+                results[i].error = e.what();    // Skipped; the others still go in
+            }
+        }
+        if (!applied) {
+            return;
+        }
+
+        std::string temp = kitbash::detail::temp_path_for(entry.base);
+        try {
+            doc.write(temp);
+        } catch (...) {
+            std::error_code ec;
+            std::filesystem::remove(temp, ec);
+            throw;
+        }
+        stats.backup_filename = kitbash::generate_backup_filename(entry.base);
+        kitbash::detail::replace_keeping_backup(entry.base, temp, stats.backup_filename);
+
+        stats.final_vt_count = doc.vt_count();
+        stats.final_tris_count = doc.tris_count();
+        stats.final_line_count = static_cast<int>(doc.total_line_count());
+        stats.added_vt_count = stats.final_vt_count - stats.original_vt_count;
+        stats.added_tris_count = stats.final_tris_count - stats.original_tris_count;
+        stats.added_line_count = stats.final_line_count - stats.original_line_count;
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_time);
+        stats.processing_time = duration.count() / 1000000.0; // Convert to seconds
+        for (size_t i = 0; i < entry.parts.size(); ++i) {
+            if (results[i].success) {
+                results[i].stats = stats;
+                results[i].stats.addition_filename = entry.parts[i]->addition;
+            }
+        }
+    }
+}
+
+namespace kitbash {
+    MemoryOutput::~MemoryOutput() {
+        if (descriptor >= 0) {
+            detail::close_descriptor(descriptor);
+        }
+    }
+
+    struct MergeService::Impl {
+        std::mutex mutex;
+        std::condition_variable available;
+        std::deque<std::shared_ptr<Entry>> lanes[2];    // Indexed by Priority
+        std::vector<std::shared_ptr<Entry>> running;
+        std::vector<std::thread> workers;
+        size_t bulk_running = 0;
+        size_t bulk_limit = 1;
+        bool stopping = false;
+        uint64_t next_sequence = 0;
+        ServiceStats stats;
+
+        // Another merge is writing a file this one reads or writes, or reading the file it writes
+        bool blocked(const Entry& entry) const {
+            for (const auto& other : running) {
+                if (other->target_key == entry.base_key || other->target_key == entry.target_key ||
+                    other->base_key == entry.target_key) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::shared_ptr<Entry> take(std::deque<std::shared_ptr<Entry>>& lane) {
+            for (auto it = lane.begin(); it != lane.end(); ++it) {
+                if (!blocked(**it)) {
+                    std::shared_ptr<Entry> entry = *it;
+                    lane.erase(it);
+                    return entry;
+                }
+            }
+            return nullptr;
+        }
+
+        // Interactive first; bulk only while a worker stays free for interactive work
+        std::shared_ptr<Entry> next() {
+            std::shared_ptr<Entry> entry = take(lanes[static_cast<int>(Priority::Interactive)]);
+            if (!entry && bulk_running < bulk_limit) {
+                entry = take(lanes[static_cast<int>(Priority::Bulk)]);
+                if (entry) {
+                    ++bulk_running;
+                }
+            }
+            return entry;
+        }
+
+        void worker_loop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                std::shared_ptr<Entry> entry;
+                available.wait(lock, [&] {
+                    entry = next();
+                    return entry || (stopping && lanes[0].empty() && lanes[1].empty());
+                });
+                if (!entry) {
+                    return;
+                }
+                entry->running = true;
+                running.push_back(entry);
+                ++stats.executions;
+                lock.unlock();
+
+                std::vector<MergeResult> results(entry->parts.size());
+                execute(*entry, results);
+
+                lock.lock();
+                running.erase(std::find(running.begin(), running.end(), entry));
+                if (entry->lane == Priority::Bulk) {
+                    --bulk_running;
+                }
+                // Joiners are refused once running, so the parts are final here
+                for (size_t i = 0; i < entry->parts.size(); ++i) {
+                    entry->parts[i]->promise.set_value(results[i]);
+                }
+                available.notify_all();
+            }
+        }
+
+        void execute(Entry& entry, std::vector<MergeResult>& results) {
+            try {
+                if (entry.parts.size() == 1) {
+                    const std::string& addition = entry.parts[0]->addition;
+                    std::string output = entry.to_memory ? "<memory>" : entry.output;
+                    std::unique_ptr<detail::MergeJob> job;
+                    if (CompiledAddition::is_compiled_file(addition)) {
+                        job = std::make_unique<detail::MergeJob>(entry.base, CompiledAddition::load(addition), output);
+                    } else {
+                        job = std::make_unique<detail::MergeJob>(entry.base, addition, output);
+                    }
+                    std::shared_ptr<MemoryOutput> memory;
+                    if (entry.to_memory) {
+                        memory = std::make_shared<MemoryOutput>();
+                        memory->descriptor = detail::create_memory_file("kitbash-result");
+                        job->write_to_descriptor(memory->descriptor);
+                    }
+                    while (!job->run_chunk()) {
+                    }
+                    results[0].stats = job->stats();
+                    results[0].stats.addition_filename = addition;
+                    if (memory) {
+                        // Read-only, so waiters sharing it cannot change each other's result.
+                        // Without either way there is only one waiter (see enqueue()).
+                        if (!detail::seal_memory_file(memory->descriptor)) {
+                            int read_only = detail::reopen_read_only(memory->descriptor);
+                            if (read_only >= 0) {
+                                detail::close_descriptor(memory->descriptor);
+                                memory->descriptor = read_only;
+                            }
+                        }
+                        memory->size = job->output_bytes();
+                        results[0].stats.output_filename.clear();
+                        results[0].memory = memory;
+                    }
+                    results[0].success = true;
+                } else {
+                    run_combined(entry, results);
+                }
+            } catch (const std::bad_alloc&) {
+                for (auto& result : results) {
+                    result = MergeResult();
+                    result.error = "Out of memory";
+                }
+            } catch (const std::exception& e) {
+                for (auto& result : results) {
+                    result = MergeResult();
+                    result.error = e.what();
+                }
+            }
+        }
+
+        std::shared_future<MergeResult> enqueue(const std::string& base, const std::string& addition,
+                                                const std::string& output, Priority priority, bool to_memory) {
+            std::string base_key = normalize(base);
+            // Memory outputs write no file, so they have no target to wait for
+            std::string target_key = to_memory ? "" : output.empty() ? base_key : normalize(output);
+            std::string addition_key = normalize(addition);
+            // Compiled additions cannot be chained in memory, so they always run alone
+            bool combinable = output.empty() && !to_memory && !CompiledAddition::is_compiled_file(addition);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                throw std::runtime_error("Merge service is shutting down");
+            }
+            ++stats.requests;
+
+            std::shared_ptr<Entry> joined;
+            bool combine = false;
+            auto promote = [&](const std::shared_ptr<Entry>& entry) {
+                if (priority == Priority::Interactive && entry->lane == Priority::Bulk && !entry->running) {
+                    auto& bulk = lanes[static_cast<int>(Priority::Bulk)];
+                    bulk.erase(std::find(bulk.begin(), bulk.end(), entry));
+                    entry->lane = Priority::Interactive;
+                    lanes[static_cast<int>(Priority::Interactive)].push_back(entry);
+                }
+            };
+
+            if (!output.empty() || to_memory) {
+                // An identical merge in flight: wait for its result instead of running again.
+                // In-place merges are never coalesced, as each one changes the base, and
+                // memory results only where they can be made read-only for every waiter.
+                bool shareable = !to_memory || detail::memory_files_shareable();
+                auto same = [&](const std::shared_ptr<Entry>& entry) {
+                    return shareable && entry->to_memory == to_memory && entry->target_key == target_key &&
+                           entry->base_key == base_key && entry->addition_key == addition_key;
+                };
+                for (const auto& entry : running) {
+                    if (same(entry)) {
+                        joined = entry;
+                    }
+                }
+                for (auto& lane : lanes) {
+                    for (const auto& entry : lane) {
+                        if (!joined && same(entry)) {
+                            joined = entry;
+                        }
+                    }
+                }
+                if (joined) {
+                    ++stats.coalesced;
+                    promote(joined);
+                    return joined->parts[0]->future;
+                }
+            } else if (combinable) {
+                // A pending in-place merge into the same base takes this addition too, but
+                // only if it is the last merge queued that reads or writes the base; joining
+                // an earlier one would apply this addition before merges submitted ahead of it
+                std::shared_ptr<Entry> latest;
+                auto consider = [&](const std::shared_ptr<Entry>& entry) {
+                    if ((entry->base_key == base_key || entry->target_key == base_key) &&
+                        (!latest || entry->sequence > latest->sequence)) {
+                        latest = entry;
+                    }
+                };
+                for (const auto& entry : running) {
+                    consider(entry);
+                }
+                for (auto& lane : lanes) {
+                    for (const auto& entry : lane) {
+                        consider(entry);
+                    }
+                }
+                if (latest && latest->combinable && !latest->running) {
+                    joined = latest;
+                }
+                combine = static_cast<bool>(joined);
+            }
+
+            auto part = std::make_unique<Part>();
+            part->addition = addition;
+            part->future = part->promise.get_future().share();
+            std::shared_future<MergeResult> future = part->future;
+            if (combine) {
+                ++stats.combined;
+                joined->parts.push_back(std::move(part));
+                promote(joined);
+            } else {
+                auto entry = std::make_shared<Entry>();
+                entry->base = base;
+                entry->output = output;
+                entry->base_key = base_key;
+                entry->target_key = target_key;
+                entry->addition_key = addition_key;
+                entry->combinable = combinable;
+                entry->to_memory = to_memory;
+                entry->lane = priority;
+                entry->sequence = next_sequence++;
+                entry->parts.push_back(std::move(part));
+                lanes[static_cast<int>(priority)].push_back(entry);
+            }
+            available.notify_all();
+            return future;
+        }
+    };
+
+    MergeService::MergeService(const ServiceOptions& options) : impl_(std::make_unique<Impl>()) {
+        size_t workers = options.workers > 0 ? options.workers
+                                             : std::max<size_t>(1, std::thread::hardware_concurrency());
+        // One worker stays free for interactive requests; a single worker gets a
+        // second thread for that, or bulk work could hold the only one
+        impl_->bulk_limit = workers > 1 ? workers - 1 : 1;
+        workers = impl_->bulk_limit + 1;
+        for (size_t i = 0; i < workers; ++i) {
+            impl_->workers.emplace_back([this] { impl_->worker_loop(); });
+        }
+    }
+
+    MergeService::~MergeService() {
+        {
+            std::lock_guard<std::mutex> lock(impl_->mutex);
+            impl_->stopping = true;
+        }
+        impl_->available.notify_all();
+        for (auto& worker : impl_->workers) {
+            worker.join();
+        }
+    }
+
+    std::shared_future<MergeResult> MergeService::submit(const std::string& base, const std::string& addition,
+                                                         const std::string& output, Priority priority) {
+        return impl_->enqueue(base, addition, output, priority, false);
+    }
+
+    std::shared_future<MergeResult> MergeService::submit_to_memory(const std::string& base,
+                                                                   const std::string& addition, Priority priority) {
+        return impl_->enqueue(base, addition, "", priority, true);
+    }
+
+    ServiceStats MergeService::stats() const {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        return impl_->stats;
+    }
+}
@@ -0,0 +1,356 @@
+#include "kitbash.h"
+#include "kitbash_io.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+// Internal helper functions
+namespace {
+    constexpr size_t kIndexBlockSize = 1 << 14;
+
+    // Newline counts of an immutable buffer sampled every 16 KiB. Stays tiny for
+    // gigabyte files; each query scans at most one block.
+    class SparseLineIndex {
+    public:
+        void build(const char* data, size_t size) {
+            data_ = data;
+            size_ = size;
+            prefix_.assign(1, 0);
+            for (size_t start = 0; start < size; start += kIndexBlockSize) {
+                size_t length = std::min(kIndexBlockSize, size - start);
+                prefix_.push_back(prefix_.back() +
+                                  static_cast<size_t>(std::count(data + start, data + start + length, '\n')));
+            }
+        }
+
+        // Newlines in [0, pos)
+        size_t rank(size_t pos) const {
+            size_t block = pos / kIndexBlockSize;
+            const char* start = data_ + block * kIndexBlockSize;
+            return prefix_[block] + static_cast<size_t>(std::count(start, data_ + pos, '\n'));
+        }
+
+        // Position of the newline with 0-based index n (must exist)
+        size_t select(size_t n) const {
+            auto it = std::upper_bound(prefix_.begin(), prefix_.end(), n);
+            size_t block = static_cast<size_t>(it - prefix_.begin()) - 1;
+            return nth_newline(data_ + block * kIndexBlockSize, data_ + size_, n - prefix_[block]) - data_;
+        }
+
+        static const char* nth_newline(const char* p, const char* end, size_t n) {
+            for (;;) {
+                p = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+                if (n == 0) {
+                    return p;
+                }
+                --n;
+                ++p;
+            }
+        }
+
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+        std::vector<size_t> prefix_;
+    };
+
+    // Treap node describing one piece; sums cover the whole subtree
+    struct PieceNode {
+        bool added = false;         // Piece refers to the add buffer, not the original
+        size_t start = 0;
+        size_t length = 0;
+        size_t newlines = 0;
+        uint32_t priority = 0;
+        int left = -1;
+        int right = -1;
+        size_t sum_bytes = 0;
+        size_t sum_newlines = 0;
+    };
+}
+
+namespace kitbash {
+    struct PieceTable::Impl {
+        std::string filename;
+        detail::MappedFile original;
+        SparseLineIndex original_index;
+        std::string added;
+        std::vector<PieceNode> nodes;
+        std::vector<int> free_nodes;
+        int root = -1;
+        std::mt19937 rng{0x6b627074u};
+
+        void open(const std::string& name) {
+            filename = name;
+            original = detail::MappedFile(name);
+            original_index.build(original.data(), original.size());
+            added.clear();
+            nodes.clear();
+            free_nodes.clear();
+            root = original.size() > 0 ? make_node(false, 0, original.size()) : -1;
+        }
+
+        const char* piece_data(const PieceNode& node) const {
+            return (node.added ? added.data() : original.data()) + node.start;
+        }
+
+        size_t count_newlines(bool in_added, size_t start, size_t length) const {
+            if (in_added) {
+                return static_cast<size_t>(std::count(added.data() + start, added.data() + start + length, '\n'));
+            }
+            return original_index.rank(start + length) - original_index.rank(start);
+        }
+
+        // Offset within the piece of its n-th newline (0-based)
+        size_t piece_newline(const PieceNode& node, size_t n) const {
+            if (node.added) {
+                const char* data = piece_data(node);
+                return SparseLineIndex::nth_newline(data, data + node.length, n) - data;
+            }
+            return original_index.select(original_index.rank(node.start) + n) - node.start;
+        }
+
+        size_t bytes(int t) const { return t < 0 ? 0 : nodes[t].sum_bytes; }
+        size_t newlines(int t) const { return t < 0 ? 0 : nodes[t].sum_newlines; }
+
+        void update(int t) {
+            PieceNode& node = nodes[t];
+            node.sum_bytes = node.length + bytes(node.left) + bytes(node.right);
+            node.sum_newlines = node.newlines + newlines(node.left) + newlines(node.right);
+        }
+
+        int make_node(bool in_added, size_t start, size_t length) {
+            PieceNode node;
+            node.added = in_added;
+            node.start = start;
+            node.length = length;
+            node.newlines = count_newlines(in_added, start, length);
+            node.priority = static_cast<uint32_t>(rng());
+            int t;
+            if (!free_nodes.empty()) {
+                t = free_nodes.back();
+                free_nodes.pop_back();
+                nodes[t] = node;
+            } else {
+                t = static_cast<int>(nodes.size());
+                nodes.push_back(node);
+            }
+            update(t);
+            return t;
+        }
+
+        int merge(int a, int b) {
+            if (a < 0) return b;
+            if (b < 0) return a;
+            if (nodes[a].priority > nodes[b].priority) {
+                int right = merge(nodes[a].right, b);
+                nodes[a].right = right;
+                update(a);
+                return a;
+            }
+            int left = merge(a, nodes[b].left);
+            nodes[b].left = left;
+            update(b);
+            return b;
+        }
+
+        // Split into [0, pos) and [pos, end), cutting a piece in two if needed
+        std::pair<int, int> split(int t, size_t pos) {
+            if (t < 0) {
+                return {-1, -1};
+            }
+            size_t left_bytes = bytes(nodes[t].left);
+            size_t length = nodes[t].length;
+            if (pos <= left_bytes) {
+                auto parts = split(nodes[t].left, pos);
+                nodes[t].left = parts.second;
+                update(t);
+                return {parts.first, t};
+            }
+            if (pos >= left_bytes + length) {
+                auto parts = split(nodes[t].right, pos - left_bytes - length);
+                nodes[t].right = parts.first;
+                update(t);
+                return {t, parts.second};
+            }
+
+            size_t keep = pos - left_bytes;
+            int tail = make_node(nodes[t].added, nodes[t].start + keep, length - keep);
+            PieceNode& node = nodes[t];
+            node.length = keep;
+            node.newlines -= nodes[tail].newlines;
+            int right = node.right;
+            node.right = -1;
+            update(t);
+            return {t, merge(tail, right)};
+        }
+
+        void release(int t) {
+            std::vector<int> stack;
+            if (t >= 0) stack.push_back(t);
+            while (!stack.empty()) {
+                int n = stack.back();
+                stack.pop_back();
+                if (nodes[n].left >= 0) stack.push_back(nodes[n].left);
+                if (nodes[n].right >= 0) stack.push_back(nodes[n].right);
+                free_nodes.push_back(n);
+            }
+        }
+
+        // Byte position of the newline with 0-based index n
+        size_t newline_position(size_t n) const {
+            size_t base = 0;
+            int t = root;
+            while (t >= 0) {
+                const PieceNode& node = nodes[t];
+                size_t left_newlines = newlines(node.left);
+                if (n < left_newlines) {
+                    t = node.left;
+                    continue;
+                }
+                n -= left_newlines;
+                base += bytes(node.left);
+                if (n < node.newlines) {
+                    return base + piece_newline(node, n);
+                }
+                n -= node.newlines;
+                base += node.length;
+                t = node.right;
+            }
+            throw std::out_of_range("PieceTable newline index out of range");
+        }
+
+        // In-order visit of the pieces overlapping [offset, offset + length)
+        template <typename Visitor>
+        void visit(int t, size_t offset, size_t length, size_t base, Visitor& visitor) const {
+            if (t < 0 || length == 0) {
+                return;
+            }
+            const PieceNode& node = nodes[t];
+            size_t left_bytes = bytes(node.left);
+            if (offset < base + left_bytes) {
+                visit(node.left, offset, length, base, visitor);
+            }
+            size_t piece_begin = base + left_bytes;
+            size_t piece_end = piece_begin + node.length;
+            size_t begin = std::max(offset, piece_begin);
+            size_t end = std::min(offset + length, piece_end);
+            if (begin < end) {
+                visitor(std::string_view(piece_data(node) + (begin - piece_begin), end - begin));
+            }
+            if (offset + length > piece_end) {
+                visit(node.right, offset, length, piece_end, visitor);
+            }
+        }
+    };
+
+    PieceTable::PieceTable(const std::string& filename) : impl_(std::make_unique<Impl>()) {
+        impl_->open(filename);
+    }
+
+    PieceTable::~PieceTable() = default;
+    PieceTable::PieceTable(PieceTable&& other) noexcept = default;
+    PieceTable& PieceTable::operator=(PieceTable&& other) noexcept = default;
+
+    size_t PieceTable::size() const {
+        return impl_->bytes(impl_->root);
+    }
+
+    size_t PieceTable::line_count() const {
+        size_t count = impl_->newlines(impl_->root);
+        size_t total = size();
+        if (total > 0 && text(total - 1, 1) != "\n") {
+            ++count;    // Last line has no trailing newline
+        }
+        return count;
+    }
+
+    size_t PieceTable::piece_count() const {
+        return impl_->nodes.size() - impl_->free_nodes.size();
+    }
+
+    size_t PieceTable::line_offset(size_t line) const {
+        if (line >= line_count()) {
+            throw std::out_of_range("PieceTable line out of range");
+        }
+        return line == 0 ? 0 : impl_->newline_position(line - 1) + 1;
+    }
+
+    std::string PieceTable::line(size_t line) const {
+        size_t start = line_offset(line);
+        size_t end = line < impl_->newlines(impl_->root) ? impl_->newline_position(line) : size();
+        return text(start, end - start);
+    }
+
+    std::string PieceTable::text(size_t offset, size_t length) const {
+        if (offset > size() || length > size() - offset) {
+            throw std::out_of_range("PieceTable range out of range");
+        }
+        std::string result;
+        result.reserve(length);
+        auto append = [&result](std::string_view piece) { result.append(piece.data(), piece.size()); };
+        impl_->visit(impl_->root, offset, length, 0, append);
+        return result;
+    }
+
+    void PieceTable::insert(size_t offset, const std::string& text) {
+        if (offset > size()) {
+            throw std::out_of_range("PieceTable insert offset out of range");
+        }
+        if (text.empty()) {
+            return;
+        }
+        size_t start = impl_->added.size();
+        impl_->added += text;
+        int node = impl_->make_node(true, start, text.size());
+        auto parts = impl_->split(impl_->root, offset);
+        impl_->root = impl_->merge(impl_->merge(parts.first, node), parts.second);
+    }
+
+    void PieceTable::erase(size_t offset, size_t length) {
+        if (offset > size() || length > size() - offset) {
+            throw std::out_of_range("PieceTable erase range out of range");
+        }
+        if (length == 0) {
+            return;
+        }
+        auto head = impl_->split(impl_->root, offset);
+        auto tail = impl_->split(head.second, length);
+        impl_->release(tail.first);
+        impl_->root = impl_->merge(head.first, tail.second);
+    }
+
+    void PieceTable::replace_line(size_t line, const std::string& content) {
+        size_t start = line_offset(line);
+        size_t end = line < impl_->newlines(impl_->root) ? impl_->newline_position(line) : size();
+        erase(start, end - start);
+        insert(start, content);
+    }
+
+    void PieceTable::write(const std::string& filename) {
+        std::error_code ec;
+        bool same_file = std::filesystem::equivalent(filename, impl_->filename, ec);
+        std::string target = same_file ? detail::temp_path_for(filename) : filename;
+
+        try {
+            detail::FileWriter writer(target);
+            auto stream = [&writer](std::string_view piece) { writer.write(piece); };
+            impl_->visit(impl_->root, 0, size(), 0, stream);
+            writer.close();
+        } catch (...) {
+            if (same_file) {
+                std::filesystem::remove(target, ec);
+            }
+            throw;
+        }
+
+        if (same_file) {
+            // Release the mapping before replacing the file (required on Windows)
+            impl_->original.reset();
+            std::filesystem::rename(target, filename);
+            impl_->open(filename);
+        }
+    }
+}
@@ -0,0 +1,455 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+// Internal helper functions
+namespace {
+    namespace fs = std::filesystem;
+    using kitbash::detail::next_token;
+
+    const uint64_t attribute_bytes = std::strlen("\tATTR_draw_enable\n\tATTR_cockpit\n");  // Before the addition footer
+
+    // What the planner reads of an OBJ8 file: everything up to the first record
+    struct HeaderCounts {
+        uint64_t header_bytes = 0;          // Through the end of the first POINT_COUNTS line
+        uint64_t point_counts_bytes = 0;    // That line and its newline, which the merge replaces
+        bool rewritten = false;             // It has 5 tokens or more, so the merge writes it again
+        uint64_t kept_bytes = 0;            // Its VLINE and VLIGHT tokens, copied as they are
+        uint64_t values[4] = {};            // VT, VLINE, VLIGHT, IDX of the last valid line
+    };
+
+    bool parse_number(std::string_view token, uint64_t& value) {
+        if (token.empty() || token.size() > 18) {
+            return false;
+        }
+        value = 0;
+        for (char c : token) {
+            if (c < '0' || c > '9') {
+                return false;
+            }
+            value = value * 10 + static_cast<uint64_t>(c - '0');
+        }
+        return true;
+    }
+
+    // Lines up to the first VT or IDX record. Like the merge, the first line mentioning
+    // POINT_COUNTS is the one replaced, and the counts come from the last one with at
+    // least 5 tokens (extra tokens, e.g. a comment, are ignored).
+    HeaderCounts read_point_counts(const std::string& filename) {
+        kitbash::detail::MappedFile file(filename);
+        std::string_view data = file.view();
+        if (!kitbash::detail::validate_obj_header(data)) {
+            throw std::runtime_error("Invalid OBJ8 format: " + filename);
+        }
+        HeaderCounts header;
+        bool found_line = false;
+        bool found_counts = false;
+        size_t pos = 0;
+        while (pos < data.size()) {
+            const void* found = std::memchr(data.data() + pos, '\n', data.size() - pos);
+            size_t end = found ? static_cast<const char*>(found) - data.data() : data.size();
+            std::string_view line = data.substr(pos, end - pos);
+            size_t next = std::min(end + 1, data.size());
+            size_t token_pos = 0;
+            std::string_view type = next_token(line, token_pos);
+            if (type == "VT" || type == "IDX" || type == "IDX10") {
+                break;
+            }
+            if (line.find("POINT_COUNTS") != std::string_view::npos) {
+                std::string_view tokens[5];
+                bool complete = kitbash::detail::split_tokens(line, tokens, 5) == 5;
+                if (!found_line) {
+                    found_line = true;
+                    header.header_bytes = next;
+                    header.point_counts_bytes = next - pos;
+                    header.rewritten = complete;
+                    header.kept_bytes = complete ? tokens[2].size() + tokens[3].size() : 0;
+                }
+                uint64_t values[4] = {};
+                bool valid = complete && tokens[0] == "POINT_COUNTS";
+                for (size_t i = 0; valid && i < 4; ++i) {
+                    valid = parse_number(tokens[i + 1], values[i]);
+                }
+                if (valid) {
+                    std::copy(values, values + 4, header.values);
+                    found_counts = true;
+                }
+            }
+            pos = next;
+        }
+        if (!found_line) {
+            throw std::runtime_error("No POINT_COUNTS line before the first record in " + filename);
+        }
+        if (!found_counts) {
+            throw std::runtime_error("Malformed POINT_COUNTS line in " + filename);
+        }
+        return header;
+    }
+
+    // Total decimal digits of every number in [0, n)
+    uint64_t digits_below(uint64_t n) {
+        uint64_t total = 0;
+        uint64_t low = 0;
+        uint64_t high = 10;
+        for (uint64_t digits = 1; low < n; ++digits) {
+            total += (std::min(n, high) - low) * digits;
+            low = high;
+            high = high > UINT64_MAX / 10 ? UINT64_MAX : high * 10;
+        }
+        return total;
+    }
+
+    // Average printed length of the numbers in [first, first + count)
+    double average_digits(uint64_t first, uint64_t count) {
+        if (count == 0) {
+            return 0.0;
+        }
+        return static_cast<double>(digits_below(first + count) - digits_below(first)) / static_cast<double>(count);
+    }
+
+    // The merged POINT_COUNTS line; the base's VLINE and VLIGHT tokens are copied
+    uint64_t point_counts_line_bytes(const HeaderCounts& base, uint64_t vertices, uint64_t indices) {
+        if (!base.rewritten) {
+            return 0;   // Dropped by the merge
+        }
+        return std::strlen("POINT_COUNTS") + 4 + 1 + std::to_string(vertices).size() + base.kept_bytes +
+               std::to_string(indices).size();
+    }
+
+    // One merge: the base is copied apart from its POINT_COUNTS line, the addition
+    // loses its header, and the rebased numbers print longer
+    kitbash::MergePlan plan_merge(const kitbash::BatchJob& job, const kitbash::PlanOptions& options) {
+        kitbash::MergePlan plan;
+        plan.job = job;
+        try {
+            HeaderCounts base = read_point_counts(job.base);
+            plan.base_bytes = fs::file_size(job.base);
+            plan.addition_bytes = fs::file_size(job.addition);
+            plan.base_vertices = base.values[0];
+            plan.base_indices = base.values[3];
+
+            double addition_text = 0.0;
+            if (kitbash::CompiledAddition::is_compiled_file(job.addition)) {
+                // Section sizes from the .kbo header; relocations print their value plus the offset
+                auto data = kitbash::detail::CompiledAccess::data(kitbash::CompiledAddition::load(job.addition));
+                plan.addition_vertices = static_cast<uint64_t>(std::max(0, data->vt_count));
+                plan.addition_indices = static_cast<uint64_t>(std::max(0, data->tris_count));
+                addition_text = static_cast<double>(data->vertices.size() + data->indices.literals.size() +
+                                                    data->footer.literals.size()) +
+                                data->indices.reloc_count * average_digits(plan.base_vertices, plan.addition_vertices) +
+                                data->footer.reloc_count * average_digits(plan.base_indices, plan.addition_indices);
+            } else {
+                HeaderCounts addition = read_point_counts(job.addition);
+                plan.addition_vertices = addition.values[0];
+                plan.addition_indices = addition.values[3];
+                addition_text = static_cast<double>(plan.addition_bytes - addition.header_bytes) +
+                                plan.addition_indices * (average_digits(plan.base_vertices, plan.addition_vertices) -
+                                                         average_digits(0, plan.addition_vertices));
+            }
+
+            plan.vertices = plan.base_vertices + plan.addition_vertices;
+            plan.indices = plan.base_indices + plan.addition_indices;
+            plan.output_bytes = plan.base_bytes - base.point_counts_bytes +
+                                point_counts_line_bytes(base, plan.vertices, plan.indices) +
+                                static_cast<uint64_t>(std::max(0.0, addition_text)) + attribute_bytes;
+
+            const kitbash::PlanCalibration& fit = options.calibration;
+            double input = static_cast<double>(plan.base_bytes + plan.addition_bytes);
+            plan.seconds = fit.seconds_fixed + fit.seconds_per_byte * input;
+            plan.peak_memory = static_cast<uint64_t>(fit.memory_fixed + fit.memory_per_byte * input);
+            plan.over_memory_limit = options.memory_limit > 0 && plan.peak_memory > options.memory_limit;
+        } catch (const std::exception& e) {
+            plan = kitbash::MergePlan();
+            plan.job = job;
+            plan.error = e.what();
+        }
+        return plan;
+    }
+
+    // Least squares line through the points; through the origin when the intercept
+    // would be negative or the points cannot fix a slope
+    void fit_line(const std::vector<double>& x, const std::vector<double>& y, double& fixed, double& slope) {
+        double n = static_cast<double>(x.size());
+        double sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (size_t i = 0; i < x.size(); ++i) {
+            sx += x[i];
+            sy += y[i];
+            sxx += x[i] * x[i];
+            sxy += x[i] * y[i];
+        }
+        double variance = n * sxx - sx * sx;
+        if (x.size() >= 2 && variance > 0.0) {
+            slope = (n * sxy - sx * sy) / variance;
+            fixed = (sy - slope * sx) / n;
+            if (slope > 0.0 && fixed >= 0.0) {
+                return;
+            }
+        }
+        fixed = 0.0;
+        slope = sxx > 0.0 ? sxy / sxx : 0.0;
+    }
+
+    double median(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        size_t mid = values.size() / 2;
+        return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2.0;
+    }
+
+    // Just enough JSON for `kitbash --bench --json`: the numbers of each benchmark
+    class BenchReader {
+    public:
+        explicit BenchReader(const std::string& text) : text_(text) {}
+
+        std::vector<kitbash::BenchmarkPoint> points() {
+            std::vector<kitbash::BenchmarkPoint> result;
+            expect('{');
+            while (!take('}')) {
+                std::string key = string();
+                expect(':');
+                if (key == "benchmarks") {
+                    expect('[');
+                    while (!take(']')) {
+                        result.push_back(point());
+                        take(',');
+                    }
+                } else {
+                    skip();
+                }
+                take(',');
+            }
+            return result;
+        }
+
+    private:
+        kitbash::BenchmarkPoint point() {
+            kitbash::BenchmarkPoint entry;
+            expect('{');
+            while (!take('}')) {
+                std::string key = string();
+                expect(':');
+                if (key == "vertices") {
+                    entry.vertices = static_cast<uint64_t>(number());
+                } else if (key == "threads") {
+                    entry.threads = static_cast<size_t>(number());
+                } else if (key == "merges") {
+                    entry.merges = static_cast<size_t>(number());
+                } else if (key == "input_bytes") {
+                    entry.input_bytes = static_cast<uint64_t>(number());
+                } else if (key == "output_bytes") {
+                    entry.output_bytes = static_cast<uint64_t>(number());
+                } else if (key == "median_seconds") {
+                    entry.seconds = number();
+                } else if (key == "efficiency") {
+                    entry.efficiency = number();
+                } else if (key == "peak_memory_bytes") {
+                    entry.peak_memory = static_cast<uint64_t>(number());
+                } else {
+                    skip();
+                }
+                take(',');
+            }
+            return entry;
+        }
+
+        void space() {
+            while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+                ++pos_;
+            }
+        }
+
+        bool take(char c) {
+            space();
+            if (pos_ < text_.size() && text_[pos_] == c) {
+                ++pos_;
+                return true;
+            }
+            return false;
+        }
+
+        void expect(char c) {
+            if (!take(c)) {
+                throw std::runtime_error(std::string("expected '") + c + "' at offset " + std::to_string(pos_));
+            }
+        }
+
+        std::string string() {
+            expect('"');
+            std::string value;
+            while (pos_ < text_.size() && text_[pos_] != '"') {
+                if (text_[pos_] == '\\' && pos_ + 1 < text_.size()) {
+                    ++pos_;
+                }
+                value += text_[pos_++];
+            }
+            expect('"');
+            return value;
+        }
+
+        double number() {
+            space();
+            const char* start = text_.c_str() + pos_;
+            char* end = nullptr;
+            double value = std::strtod(start, &end);
+            if (end == start) {
+                throw std::runtime_error("expected a number at offset " + std::to_string(pos_));
+            }
+            pos_ += end - start;
+            return value;
+        }
+
+        void skip() {
+            space();
+            if (take('{')) {
+                while (!take('}')) {
+                    string();
+                    expect(':');
+                    skip();
+                    take(',');
+                }
+            } else if (take('[')) {
+                while (!take(']')) {
+                    skip();
+                    take(',');
+                }
+            } else if (pos_ < text_.size() && text_[pos_] == '"') {
+                string();
+            } else {
+                while (pos_ < text_.size() && text_[pos_] != ',' && text_[pos_] != '}' && text_[pos_] != ']') {
+                    ++pos_;
+                }
+            }
+        }
+
+        const std::string& text_;
+        size_t pos_ = 0;
+    };
+}
+
+namespace kitbash {
+    double PlanCalibration::efficiency_at(size_t threads) const {
+        double result = 1.0;
+        for (const auto& entry : efficiency) {
+            if (entry.first <= threads) {
+                result = entry.second;
+            }
+        }
+        return result;
+    }
+
+    PlanCalibration calibrate_plan(const std::vector<BenchmarkPoint>& points) {
+        std::vector<double> bytes;
+        std::vector<double> seconds;
+        std::vector<double> memory;
+        std::vector<std::pair<size_t, std::vector<double>>> efficiencies;
+        for (const auto& point : points) {
+            if (point.threads == 0 || point.merges == 0 || point.input_bytes == 0) {
+                continue;
+            }
+            if (point.threads == 1) {
+                double merges = static_cast<double>(point.merges);     // Run one after another
+                bytes.push_back(static_cast<double>(point.input_bytes) / merges);
+                seconds.push_back(point.seconds / merges);
+                memory.push_back(static_cast<double>(point.peak_memory));
+            }
+            auto group = std::find_if(efficiencies.begin(), efficiencies.end(),
+                                      [&](const auto& entry) { return entry.first == point.threads; });
+            if (group == efficiencies.end()) {
+                efficiencies.emplace_back(point.threads, std::vector<double>());
+                group = std::prev(efficiencies.end());
+            }
+            group->second.push_back(point.efficiency);
+        }
+        if (bytes.empty()) {
+            throw std::runtime_error("No single-thread benchmark points to calibrate from");
+        }
+
+        PlanCalibration calibration;
+        calibration.points = bytes.size();
+        fit_line(bytes, seconds, calibration.seconds_fixed, calibration.seconds_per_byte);
+        fit_line(bytes, memory, calibration.memory_fixed, calibration.memory_per_byte);
+        std::sort(efficiencies.begin(), efficiencies.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+        calibration.efficiency.clear();
+        for (const auto& entry : efficiencies) {
+            calibration.efficiency.emplace_back(entry.first, entry.first == 1 ? 1.0 : median(entry.second));
+        }
+        return calibration;
+    }
+
+    PlanCalibration load_plan_calibration(const std::string& bench_json) {
+        std::ifstream file(bench_json, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Cannot open file: " + bench_json);
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string text = buffer.str();
+        std::vector<BenchmarkPoint> points;
+        try {
+            points = BenchReader(text).points();
+        } catch (const std::exception& e) {
+            throw std::runtime_error(bench_json + ": " + e.what());
+        }
+        PlanCalibration calibration = calibrate_plan(points);
+        calibration.source = bench_json;
+        return calibration;
+    }
+
+    BatchPlan plan_merges(const std::vector<BatchJob>& jobs, const PlanOptions& options) {
+        BatchPlan batch;
+        batch.workers = options.workers > 0 ? options.workers
+                                            : std::max<size_t>(1, std::thread::hardware_concurrency());
+        std::vector<double> times;
+        std::vector<uint64_t> peaks;
+        for (const auto& job : jobs) {
+            MergePlan plan = plan_merge(job, options);
+            if (!plan.error.empty()) {
+                ++batch.failed;
+            } else {
+                batch.input_bytes += plan.base_bytes + plan.addition_bytes;
+                batch.output_bytes += plan.output_bytes;
+                batch.cpu_seconds += plan.seconds;
+                batch.over_memory_limit += plan.over_memory_limit ? 1 : 0;
+                times.push_back(plan.seconds);
+                peaks.push_back(plan.peak_memory);
+            }
+            batch.merges.push_back(std::move(plan));
+        }
+
+        // Longest merge first onto the least loaded worker; running `busy` merges at
+        // once slows each by the measured efficiency at that thread count
+        size_t busy = std::min(batch.workers, times.size());
+        batch.efficiency = options.calibration.efficiency_at(std::max<size_t>(1, busy));
+        std::sort(times.begin(), times.end(), std::greater<double>());
+        std::priority_queue<double, std::vector<double>, std::greater<double>> loads;
+        for (size_t i = 0; i < busy; ++i) {
+            loads.push(0.0);
+        }
+        double makespan = 0.0;
+        for (double time : times) {
+            double load = loads.top() + time;
+            loads.pop();
+            loads.push(load);
+            makespan = std::max(makespan, load);
+        }
+        batch.wall_seconds = batch.efficiency > 0.0 ? makespan / batch.efficiency : makespan;
+
+        // Concurrent merges share one process: its fixed part counts once
+        std::sort(peaks.begin(), peaks.end(), std::greater<uint64_t>());
+        uint64_t fixed = static_cast<uint64_t>(options.calibration.memory_fixed);
+        for (size_t i = 0; i < busy; ++i) {
+            batch.peak_memory += (i == 0 ? peaks[i] : peaks[i] - std::min(peaks[i], fixed));
+        }
+        return batch;
+    }
+}
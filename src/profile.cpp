@@ -0,0 +1,185 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Internal helper functions
+namespace {
+    using kitbash::Counter;
+    using kitbash::counter_count;
+
+    // One perf event per counter, opened separately so a counter the CPU or VM lacks
+    // does not take the others with it. Counts user space of the calling thread.
+    class PerfCounters {
+    public:
+        PerfCounters() {
+            for (int i = 0; i < counter_count; ++i) {
+                descriptors_[i] = -1;
+            }
+#ifdef __linux__
+            static const struct {
+                uint32_t type;
+                uint64_t config;
+            } events[counter_count] = {
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},   // Last-level cache on most CPUs
+                {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+            };
+            for (int i = 0; i < counter_count; ++i) {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = events[i].type;
+                attr.config = events[i].config;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                long fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+                if (fd >= 0) {
+                    descriptors_[i] = static_cast<int>(fd);
+                } else if (error_.empty()) {
+                    error_ = describe(errno);
+                }
+            }
+#else
+            error_ = "Hardware counters need Linux perf events";
+#endif
+        }
+
+        ~PerfCounters() {
+#ifdef __linux__
+            for (int fd : descriptors_) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+#endif
+        }
+
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        bool available(int counter) const { return descriptors_[counter] >= 0; }
+        const std::string& error() const { return error_; }
+
+        // Running totals, scaled up when the kernel multiplexed a counter
+        void read(uint64_t (&values)[counter_count]) const {
+            for (int i = 0; i < counter_count; ++i) {
+                values[i] = 0;
+#ifdef __linux__
+                uint64_t data[3] = {0, 0, 0};  // Value, time enabled, time running
+                if (descriptors_[i] >= 0 && ::read(descriptors_[i], data, sizeof(data)) == sizeof(data)) {
+                    values[i] = data[2] > 0 && data[2] < data[1]
+                                    ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2])
+                                    : data[0];
+                }
+#endif
+            }
+        }
+
+    private:
+#ifdef __linux__
+        static std::string describe(int error) {
+            if (error == EACCES || error == EPERM) {
+                std::string message = "Perf events are not permitted";
+                std::ifstream paranoid("/proc/sys/kernel/perf_event_paranoid");
+                int level = 0;
+                if (paranoid >> level) {
+                    message += " (kernel.perf_event_paranoid = " + std::to_string(level) + ")";
+                }
+                return message;
+            }
+            if (error == ENOSYS) {
+                return "perf_event_open is not available in this kernel";
+            }
+            if (error == ENOENT || error == EOPNOTSUPP || error == EINVAL) {
+                return "Some counters are not supported by this CPU or virtual machine";
+            }
+            return std::strerror(error);
+        }
+#endif
+
+        int descriptors_[counter_count];
+        std::string error_;
+    };
+}
+
+namespace kitbash {
+    const char* counter_name(Counter counter) {
+        switch (counter) {
+        case Counter::Cycles:
+            return "cycles";
+        case Counter::Instructions:
+            return "instructions";
+        case Counter::BranchMisses:
+            return "branch_misses";
+        case Counter::CacheMisses:
+            return "llc_misses";
+        case Counter::PageFaults:
+            return "page_faults";
+        }
+        return "";
+    }
+
+    MergeProfile profile_merge(const std::string& base, const std::string& addition, const std::string& output) {
+        MergeProfile profile;
+        for (MergePhase phase : {MergePhase::Read, MergePhase::Parse, MergePhase::Merge, MergePhase::Write}) {
+            PhaseProfile entry;
+            entry.phase = phase;
+            profile.phases.push_back(entry);
+        }
+
+        std::unique_ptr<detail::MergeJob> job;
+        if (CompiledAddition::is_compiled_file(addition)) {
+            job = std::make_unique<detail::MergeJob>(base, CompiledAddition::load(addition), output);
+        } else {
+            job = std::make_unique<detail::MergeJob>(base, addition, output);
+        }
+
+        PerfCounters counters;
+        for (int i = 0; i < counter_count; ++i) {
+            profile.available[i] = counters.available(i);
+        }
+        profile.counter_error = counters.error();
+
+        // Each chunk is charged to the phase it started in
+        uint64_t before[counter_count];
+        uint64_t after[counter_count];
+        bool finished = false;
+        while (!finished) {
+            MergeProgress progress = job->progress();
+            size_t index = static_cast<size_t>(progress.phase);
+            if (index >= profile.phases.size()) {
+                break;
+            }
+            PhaseProfile& phase = profile.phases[index];
+            counters.read(before);
+            auto start = std::chrono::steady_clock::now();
+            finished = job->run_chunk();
+            phase.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            counters.read(after);
+            for (int i = 0; i < counter_count; ++i) {
+                phase.counters[i] += after[i] - before[i];
+            }
+            phase.bytes = std::max(phase.bytes, progress.bytes_total);
+            MergeProgress now = job->progress();
+            if (now.phase == progress.phase) {
+                phase.bytes = std::max(phase.bytes, now.bytes_total);
+            }
+        }
+        profile.stats = job->stats();
+        return profile;
+    }
+}
@@ -0,0 +1,381 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Internal helper functions
+namespace {
+    using kitbash::detail::next_token;
+    using kitbash::detail::parse_int_prefix;
+
+    bool starts_with(std::string_view text, std::string_view prefix) {
+        return text.size() >= prefix.size() && text.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    // Commands whose last argument is the dataref driving the animation
+    bool names_dataref(std::string_view command) {
+        return command == "ANIM_trans_begin" || command == "ANIM_rotate_begin" || command == "ANIM_trans" ||
+               command == "ANIM_rotate" || command == "ANIM_hide" || command == "ANIM_show";
+    }
+
+    std::string_view last_token(std::string_view text, size_t pos) {
+        std::string_view last;
+        for (std::string_view token = next_token(text, pos); !token.empty(); token = next_token(text, pos)) {
+            last = token;
+        }
+        return last;
+    }
+
+    bool matches_dataref(std::string_view dataref, const std::vector<std::string>& patterns) {
+        for (const auto& pattern : patterns) {
+            if (!pattern.empty() && pattern.back() == '*'
+                    ? starts_with(dataref, std::string_view(pattern).substr(0, pattern.size() - 1))
+                    : dataref == pattern) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string at_line(uint64_t line) {
+        return " at line " + std::to_string(line);
+    }
+
+    // Footer line of the addition and what happens to it
+    struct FooterLine {
+        enum class Kind { Keep, Drop, Anim, Tris };
+
+        std::string_view text;
+        Kind kind = Kind::Keep;
+        size_t block = 0;           // Anim: the ANIM block it belongs to; Keep: innermost block
+        bool in_block = false;      // Keep: inside an ANIM block
+        bool kept = false;          // Tris: passed the filter
+        uint64_t offset = 0;        // Tris: range in the addition's indices
+        uint64_t count = 0;
+    };
+
+    // Selection state while the footer is read in order
+    class Selector {
+    public:
+        Selector(const kitbash::SelectionFilter& filter, kitbash::SelectionStats& stats)
+            : filter_(filter), stats_(stats) {}
+
+        void line(std::string_view text, uint64_t line_number) {
+            size_t pos = 0;
+            std::string_view command = next_token(text, pos);
+            FooterLine entry;
+            entry.text = text;
+            if (command == "VT") {
+                entry.kind = FooterLine::Kind::Drop;    // Vertices are renumbered with the others
+            } else if (command == "ANIM_begin") {
+                entry.kind = FooterLine::Kind::Anim;
+                entry.block = blocks_.size();
+                open_.push_back(blocks_.size());
+                blocks_.push_back(Block());
+                ++stats_.anim_blocks;
+            } else if (starts_with(command, "ANIM_") && !open_.empty()) {
+                entry.kind = FooterLine::Kind::Anim;
+                entry.block = open_.back();
+                if (names_dataref(command) && matches_dataref(last_token(text, pos), filter_.datarefs)) {
+                    blocks_[open_.back()].driven = true;
+                }
+                if (command == "ANIM_end") {
+                    open_.pop_back();
+                }
+            } else if (command == "TRIS") {
+                draw(entry, text, pos, line_number);
+            } else if (command == "LINES" || command == "LIGHTS") {
+                entry.kind = FooterLine::Kind::Drop;    // Their ranges are not compacted
+                ++stats_.dropped_draws;
+            } else if (command == "ATTR_LOD") {
+                ++lod_;
+                manipulator_ = "none";     // Each LOD starts from the default state
+            } else if (command == "ATTR_manip_none") {
+                manipulator_ = "none";
+            } else if (starts_with(command, "ATTR_manip_") && command != "ATTR_manip_wheel") {
+                manipulator_ = command.substr(std::strlen("ATTR_manip_"));
+            }
+            if (entry.kind == FooterLine::Kind::Keep && !open_.empty()) {
+                entry.in_block = true;
+                entry.block = open_.back();
+            }
+            lines_.push_back(entry);
+        }
+
+        std::vector<FooterLine>& lines() { return lines_; }
+        bool block_kept(size_t block) const { return blocks_[block].kept; }
+
+    private:
+        struct Block {
+            bool driven = false;    // Animated by a dataref in the filter
+            bool kept = false;      // Holds a kept batch
+        };
+
+        void draw(FooterLine& entry, std::string_view text, size_t pos, uint64_t line_number) {
+            int offset = 0;
+            int count = 0;
+            if (!parse_int_prefix(next_token(text, pos), offset) || !parse_int_prefix(next_token(text, pos), count) ||
+                offset < 0 || count < 0) {
+                throw std::runtime_error("Malformed TRIS line" + at_line(line_number));
+            }
+            entry.kind = FooterLine::Kind::Tris;
+            entry.offset = static_cast<uint64_t>(offset);
+            entry.count = static_cast<uint64_t>(count);
+            ++stats_.batches;
+            if (!passes(line_number)) {
+                return;
+            }
+            entry.kept = true;
+            ++stats_.kept_batches;
+            for (size_t block : open_) {
+                if (!blocks_[block].kept) {
+                    blocks_[block].kept = true;
+                    ++stats_.kept_anim_blocks;
+                }
+            }
+        }
+
+        bool passes(uint64_t line_number) const {
+            if (!filter_.datarefs.empty() &&
+                std::none_of(open_.begin(), open_.end(), [this](size_t block) { return blocks_[block].driven; })) {
+                return false;
+            }
+            if (!filter_.manipulators.empty() &&
+                std::find(filter_.manipulators.begin(), filter_.manipulators.end(), manipulator_) ==
+                    filter_.manipulators.end()) {
+                return false;
+            }
+            if (!filter_.lods.empty() && std::find(filter_.lods.begin(), filter_.lods.end(), lod_) == filter_.lods.end()) {
+                return false;
+            }
+            if (!filter_.lines.empty() &&
+                std::none_of(filter_.lines.begin(), filter_.lines.end(), [line_number](const auto& range) {
+                    return line_number >= range.first && line_number <= range.second;
+                })) {
+                return false;
+            }
+            return true;
+        }
+
+        const kitbash::SelectionFilter& filter_;
+        kitbash::SelectionStats& stats_;
+        std::vector<FooterLine> lines_;
+        std::vector<Block> blocks_;
+        std::vector<size_t> open_;      // Enclosing blocks, innermost last
+        int lod_ = 0;
+        std::string_view manipulator_ = "none";     // ATTR_manip_ type in effect
+    };
+
+    // Attributes that set the same render state share a key: ATTR_cull and
+    // ATTR_no_cull, and every manipulator type
+    std::string state_key(std::string_view command) {
+        if (starts_with(command, "ATTR_manip_") && command != "ATTR_manip_wheel") {
+            return "ATTR_manip";
+        }
+        if (starts_with(command, "ATTR_no_")) {
+            return "ATTR_" + std::string(command.substr(std::strlen("ATTR_no_")));
+        }
+        return std::string(command);
+    }
+
+    // Set entries before each position, and after the last one; total gets the count
+    std::vector<uint32_t> ranks(const std::vector<bool>& used, uint64_t& total) {
+        std::vector<uint32_t> rank(used.size() + 1);
+        total = 0;
+        for (size_t i = 0; i < used.size(); ++i) {
+            rank[i] = static_cast<uint32_t>(total);
+            total += used[i] ? 1 : 0;
+        }
+        rank[used.size()] = static_cast<uint32_t>(total);
+        return rank;
+    }
+}
+
+namespace kitbash {
+    CompiledAddition CompiledAddition::compile_selected(const std::string& addition_file, const SelectionFilter& filter,
+                                                        SelectionStats* stats) {
+        detail::MappedFile file(addition_file);
+        std::string_view data = file.view();
+        if (!detail::validate_obj_header(data)) {
+            throw std::runtime_error("Invalid OBJ8 format");
+        }
+
+        // Sections as merge_objects() sees them: VT lines anywhere, IDX lines anywhere,
+        // and every other line after the first IDX line as footer
+        SelectionStats selection;
+        Selector selector(filter, selection);
+        std::vector<std::string_view> vertices;
+        std::vector<int> indices;
+        std::vector<uint64_t> index_lines;      // Line of each index, for errors
+        bool past_idx = false;
+        uint64_t line_number = 0;
+        size_t pos = 0;
+        while (pos < data.size()) {
+            const void* found = std::memchr(data.data() + pos, '\n', data.size() - pos);
+            size_t line_end = found ? static_cast<const char*>(found) - data.data() : data.size();
+            std::string_view line = data.substr(pos, line_end - pos);
+            pos = line_end + 1;
+            ++line_number;
+            if (line.empty()) {
+                continue;
+            }
+            size_t token_pos = 0;
+            std::string_view type = next_token(line, token_pos);
+            if (type == "VT") {
+                vertices.push_back(line);
+            } else if (type == "IDX" || type == "IDX10") {
+                for (std::string_view token = next_token(line, token_pos); !token.empty();
+                     token = next_token(line, token_pos)) {
+                    int index = 0;
+                    if (!parse_int_prefix(token, index)) {
+                        throw std::runtime_error("Malformed index" + at_line(line_number));
+                    }
+                    indices.push_back(index);
+                    index_lines.push_back(line_number);
+                }
+                past_idx = true;
+                continue;
+            }
+            if (past_idx) {
+                selector.line(line, line_number);
+            }
+        }
+        selection.vertices = vertices.size();
+        selection.indices = indices.size();
+
+        // Indices inside kept batches, then the vertices they use
+        std::vector<bool> used_indices(indices.size(), false);
+        for (const auto& entry : selector.lines()) {
+            if (entry.kind != FooterLine::Kind::Tris || !entry.kept) {
+                continue;
+            }
+            if (entry.offset + entry.count > indices.size()) {
+                throw std::runtime_error("TRIS range past the indices in " + addition_file);
+            }
+            std::fill(used_indices.begin() + entry.offset, used_indices.begin() + entry.offset + entry.count, true);
+        }
+        std::vector<bool> used_vertices(vertices.size(), false);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            if (!used_indices[i]) {
+                continue;
+            }
+            if (indices[i] < 0 || static_cast<size_t>(indices[i]) >= vertices.size()) {
+                throw std::runtime_error("Index past the vertices" + at_line(index_lines[i]));
+            }
+            used_vertices[indices[i]] = true;
+        }
+        std::vector<uint32_t> index_rank = ranks(used_indices, selection.kept_indices);
+        std::vector<uint32_t> vertex_rank = ranks(used_vertices, selection.kept_vertices);
+
+        // The compacted addition as OBJ8 text, compiled like any other addition
+        auto builder = std::make_shared<detail::CompiledBuilder>();
+        detail::ObjLayout layout;
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            if (used_vertices[i]) {
+                builder->vertices.append(vertices[i].data(), vertices[i].size()).push_back('\n');
+                ++layout.vertex_lines;
+            }
+        }
+
+        // Whole groups of ten as IDX10 lines, the rest one per IDX line
+        std::string text;
+        uint64_t grouped = selection.kept_indices / 10 * 10;
+        uint64_t written = 0;
+        for (size_t i = 0; i < indices.size(); ++i) {
+            if (!used_indices[i]) {
+                continue;
+            }
+            bool group = written < grouped;
+            if (!group || written % 10 == 0) {
+                text += group ? "IDX10" : "IDX";
+                ++layout.index_lines;
+            }
+            text.push_back('\t');
+            detail::append_int(text, vertex_rank[indices[i]]);
+            ++written;
+            if (!group || written % 10 == 0) {
+                text.push_back('\n');
+            }
+        }
+        detail::Span index_span{0, text.size()};
+        detail::Cursor cursor;
+        detail::compile_spans(text, {index_span}, false, *builder, cursor, text.size());
+
+        // Attributes are held until the next kept line that is not an attribute, a
+        // comment or blank, and then the latest of each state is written. One set in
+        // front of a dropped batch, or inside a dropped block, still holds for the
+        // batches after it.
+        std::vector<std::pair<std::string, std::string_view>> pending;
+        auto forget = [&pending](const std::string& key) {
+            pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                         [&key](const auto& attribute) { return attribute.first == key; }),
+                          pending.end());
+        };
+        text.clear();
+        std::string line;
+        for (const auto& entry : selector.lines()) {
+            bool flush = true;      // Write the held attributes first
+            switch (entry.kind) {
+            case FooterLine::Kind::Drop:
+                continue;
+            case FooterLine::Kind::Anim:
+                if (!selector.block_kept(entry.block)) {
+                    continue;
+                }
+                line.assign(entry.text);
+                break;
+            case FooterLine::Kind::Tris:
+                if (!entry.kept) {
+                    continue;
+                }
+                line.assign(entry.text.data(), entry.text.find("TRIS"));
+                line += "TRIS\t";
+                detail::append_int(line, index_rank[entry.offset]);
+                line.push_back('\t');
+                detail::append_int(line, static_cast<long long>(entry.count));
+                break;
+            case FooterLine::Kind::Keep: {
+                size_t token_pos = 0;
+                std::string_view command = next_token(entry.text, token_pos);
+                bool attribute = starts_with(command, "ATTR_");
+                flush = !attribute && !command.empty() && !starts_with(command, "#");
+                bool kept = !entry.in_block || selector.block_kept(entry.block);
+                if (kept && command == "ATTR_LOD") {
+                    pending.clear();    // Each LOD starts from the default state
+                } else if (attribute) {
+                    std::string key = state_key(command);
+                    forget(key);
+                    pending.emplace_back(std::move(key), entry.text);
+                    continue;
+                }
+                if (!kept) {
+                    continue;
+                }
+                line.assign(entry.text);
+                break;
+            }
+            }
+            if (flush) {
+                for (const auto& state : pending) {
+                    text.append(state.second.data(), state.second.size()).push_back('\n');
+                    ++layout.footer_lines;
+                }
+                pending.clear();
+            }
+            text.append(line).push_back('\n');
+            ++layout.footer_lines;
+        }
+        detail::Span footer_span{0, text.size()};
+        cursor = detail::Cursor();
+        detail::compile_spans(text, {footer_span}, true, *builder, cursor, text.size());
+
+        layout.vt_count = static_cast<int>(selection.kept_vertices);
+        layout.tris_count = static_cast<int>(selection.kept_indices);
+        layout.line_count = layout.vertex_lines + layout.index_lines + layout.footer_lines;
+        if (stats) {
+            *stats = selection;
+        }
+        return detail::CompiledAccess::wrap(detail::finish_compiled(std::move(builder), layout, addition_file));
+    }
+}
@@ -0,0 +1,434 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#endif
+
+// Internal helper functions
+namespace {
+#ifndef _WIN32
+    // The index is a fixed open-addressing table in one shared-memory object per
+    // user, zero-filled (all slots empty) when first created. Each slot is guarded
+    // by a seqlock: a writer takes it by moving `version` from even to odd with a
+    // CAS and publishes by making it even again; readers copy the fields and retry
+    // if the version moved. A writer that loses the CAS looks again, so no process
+    // ever waits on another's lock, and one that dies mid-update only loses its slot.
+    // Ready slots record the image size and when it was last mapped, so publishing
+    // can evict the least recently used images to stay under the byte cap.
+    constexpr size_t slot_count = 1024;
+    constexpr size_t probe_limit = 8;
+    constexpr int64_t build_timeout_ns = 30LL * 1000 * 1000 * 1000;
+    constexpr uint64_t max_default_limit = 1ULL << 30;
+
+    std::atomic<uint64_t> shared_limit{0};     // 0: default_limit()
+
+    enum SlotState : uint64_t { Empty = 0, Building = 1, Ready = 2 };
+
+    struct FileKey {
+        uint64_t device = 0;
+        uint64_t inode = 0;
+        uint64_t size = 0;
+        int64_t mtime_ns = 0;
+
+        bool same_file(const FileKey& other) const { return device == other.device && inode == other.inode; }
+        bool operator==(const FileKey& other) const {
+            return same_file(other) && size == other.size && mtime_ns == other.mtime_ns;
+        }
+    };
+
+    // Two cache lines; every field read by other processes is atomic so concurrent
+    // copies are well defined
+    struct Slot {
+        std::atomic<uint64_t> version;
+        std::atomic<uint64_t> state;
+        std::atomic<int64_t> owner;         // Builder's pid; names the segment
+        std::atomic<int64_t> started_ns;    // Building: when it started
+        std::atomic<uint64_t> device;
+        std::atomic<uint64_t> inode;
+        std::atomic<uint64_t> size;
+        std::atomic<int64_t> mtime_ns;
+        std::atomic<uint64_t> bytes;        // Ready: size of the published image
+        std::atomic<int64_t> used_ns;       // Ready: last published or mapped
+        uint64_t reserved[6];
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "The index needs address-free atomics");
+    static_assert(sizeof(Slot) == 128, "Slots are two cache lines");
+
+    struct SlotCopy {
+        uint64_t version = 0;
+        uint64_t state = Empty;
+        int64_t owner = 0;
+        int64_t started_ns = 0;
+        FileKey key;
+        uint64_t bytes = 0;
+        int64_t used_ns = 0;
+    };
+
+    int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    bool file_key(const std::string& filename, FileKey& key) {
+        struct stat st;
+        if (::stat(filename.c_str(), &st) != 0) {
+            return false;
+        }
+        key.device = static_cast<uint64_t>(st.st_dev);
+        key.inode = static_cast<uint64_t>(st.st_ino);
+        key.size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+        key.mtime_ns = st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+        key.mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+        return true;
+    }
+
+    // Short enough for macOS, which limits shared-memory names to 31 characters
+    std::string segment_name(const FileKey& key, int64_t owner) {
+        uint64_t hash = kitbash::detail::hash_bytes(std::string_view(reinterpret_cast<const char*>(&key),
+                                                                     sizeof(key)));
+        char name[32];
+        std::snprintf(name, sizeof(name), "/kb%016llx-%lld", static_cast<unsigned long long>(hash),
+                      static_cast<long long>(owner % 10000000));
+        return name;
+    }
+
+    Slot* open_index() {
+        static Slot* const table = [] () -> Slot* {
+            std::string name = "/kitbash-" + std::to_string(::getuid()) + "-2";    // Layout version
+            int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+            if (fd < 0) {
+                return nullptr;
+            }
+            size_t bytes = slot_count * sizeof(Slot);
+            struct stat st;
+            // Growing from zero is idempotent, so racing creators are harmless
+            if (::fstat(fd, &st) != 0 || (static_cast<size_t>(st.st_size) < bytes &&
+                                          ::ftruncate(fd, static_cast<off_t>(bytes)) != 0)) {
+                ::close(fd);
+                return nullptr;
+            }
+            void* view = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            return view == MAP_FAILED ? nullptr : static_cast<Slot*>(view);
+        }();
+        return table;
+    }
+
+    bool read_slot(const Slot& slot, SlotCopy& copy) {
+        for (int attempt = 0; attempt < 1000; ++attempt) {
+            copy.version = slot.version.load(std::memory_order_acquire);
+            if (copy.version % 2 == 0) {
+                copy.state = slot.state.load(std::memory_order_relaxed);
+                copy.owner = slot.owner.load(std::memory_order_relaxed);
+                copy.started_ns = slot.started_ns.load(std::memory_order_relaxed);
+                copy.key.device = slot.device.load(std::memory_order_relaxed);
+                copy.key.inode = slot.inode.load(std::memory_order_relaxed);
+                copy.key.size = slot.size.load(std::memory_order_relaxed);
+                copy.key.mtime_ns = slot.mtime_ns.load(std::memory_order_relaxed);
+                copy.bytes = slot.bytes.load(std::memory_order_relaxed);
+                copy.used_ns = slot.used_ns.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.version.load(std::memory_order_relaxed) == copy.version) {
+                    return true;
+                }
+            }
+            std::this_thread::yield();
+        }
+        return false;   // A writer died mid-update; the slot is treated as taken
+    }
+
+    bool lock_slot(Slot& slot, uint64_t version) {
+        return slot.version.compare_exchange_strong(version, version + 1, std::memory_order_acquire);
+    }
+
+    void write_slot(Slot& slot, uint64_t version, uint64_t state, int64_t owner, const FileKey& key,
+                    uint64_t bytes = 0) {
+        int64_t now = now_ns();
+        slot.state.store(state, std::memory_order_relaxed);
+        slot.owner.store(owner, std::memory_order_relaxed);
+        slot.started_ns.store(now, std::memory_order_relaxed);
+        slot.bytes.store(bytes, std::memory_order_relaxed);
+        slot.used_ns.store(now, std::memory_order_relaxed);
+        slot.device.store(key.device, std::memory_order_relaxed);
+        slot.inode.store(key.inode, std::memory_order_relaxed);
+        slot.size.store(key.size, std::memory_order_relaxed);
+        slot.mtime_ns.store(key.mtime_ns, std::memory_order_relaxed);
+        slot.version.store(version + 2, std::memory_order_release);
+    }
+
+    // Mark a Ready slot as just used; skipped if another process is changing it
+    void touch_slot(Slot& slot, const SlotCopy& copy) {
+        if (lock_slot(slot, copy.version)) {
+            slot.used_ns.store(now_ns(), std::memory_order_relaxed);
+            slot.version.store(copy.version + 2, std::memory_order_release);
+        }
+    }
+
+    uint64_t default_limit() {
+        struct statvfs fs;
+        if (::statvfs("/dev/shm", &fs) != 0) {
+            return max_default_limit;
+        }
+        return std::min<uint64_t>(max_default_limit, static_cast<uint64_t>(fs.f_blocks) * fs.f_frsize / 4);
+    }
+
+    // Evict least recently used images until `bytes` more fit under the cap. Other
+    // processes publish concurrently, so the cap holds to within their images.
+    bool make_room(Slot* table, const Slot* keep, uint64_t bytes) {
+        uint64_t limit = shared_limit.load();
+        if (limit == 0) {
+            limit = default_limit();
+        }
+        if (bytes > limit) {
+            return false;
+        }
+        for (;;) {
+            uint64_t total = 0;
+            Slot* oldest = nullptr;
+            SlotCopy oldest_copy;
+            for (size_t i = 0; i < slot_count; ++i) {
+                SlotCopy copy;
+                if (!read_slot(table[i], copy) || copy.state != Ready) {
+                    continue;
+                }
+                total += copy.bytes;
+                if (&table[i] != keep && (!oldest || copy.used_ns < oldest_copy.used_ns)) {
+                    oldest = &table[i];
+                    oldest_copy = copy;
+                }
+            }
+            if (total + bytes <= limit) {
+                return true;
+            }
+            if (!oldest) {
+                return false;
+            }
+            // Mappings of the evicted image stay valid in processes that hold them
+            if (lock_slot(*oldest, oldest_copy.version)) {
+                write_slot(*oldest, oldest_copy.version, Empty, 0, FileKey());
+                ::shm_unlink(segment_name(oldest_copy.key, oldest_copy.owner).c_str());
+            }
+        }
+    }
+
+    bool process_alive(int64_t pid) {
+        return ::kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+    }
+
+    // Map a published image read-only; empty if it is gone or damaged
+    kitbash::CompiledAddition map_segment(const std::string& name, const std::string& addition_file) {
+        int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return kitbash::CompiledAddition();
+        }
+        struct stat st;
+        void* view = MAP_FAILED;
+        size_t bytes = 0;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            bytes = static_cast<size_t>(st.st_size);
+            view = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (view == MAP_FAILED) {
+            return kitbash::CompiledAddition();
+        }
+        std::shared_ptr<const void> storage(view, [bytes](const void* p) { ::munmap(const_cast<void*>(p), bytes); });
+        try {
+            std::string_view image(static_cast<const char*>(view), bytes);
+            return kitbash::detail::CompiledAccess::wrap(
+                kitbash::detail::read_compiled_image(image, std::move(storage), addition_file));
+        } catch (const std::exception&) {
+            return kitbash::CompiledAddition();
+        }
+    }
+
+    size_t image_bytes(const kitbash::CompiledAddition& compiled) {
+        const auto& data = *kitbash::detail::CompiledAccess::data(compiled);
+        return static_cast<size_t>(kitbash::detail::write_compiled_image(data, [](std::string_view) {}));
+    }
+
+    // Serialize into a new shared-memory object; false if shared memory is unavailable
+    bool write_segment(const std::string& name, const kitbash::CompiledAddition& compiled, size_t bytes) {
+        const auto& data = *kitbash::detail::CompiledAccess::data(compiled);
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) {
+            return false;
+        }
+        void* view = MAP_FAILED;
+        if (::ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+            view = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (view == MAP_FAILED) {
+            ::shm_unlink(name.c_str());
+            return false;
+        }
+        char* out = static_cast<char*>(view);
+        kitbash::detail::write_compiled_image(data, [&out](std::string_view piece) {
+            std::memcpy(out, piece.data(), piece.size());
+            out += piece.size();
+        });
+        ::munmap(view, bytes);
+        return true;
+    }
+
+    // Hand a claimed slot back (to Ready or Empty); false if another process took it over
+    bool finish_slot(Slot& slot, const FileKey& key, int64_t owner, uint64_t state, uint64_t bytes = 0) {
+        for (;;) {
+            SlotCopy copy;
+            if (!read_slot(slot, copy) || copy.state != Building || copy.owner != owner || !(copy.key == key)) {
+                return false;
+            }
+            if (lock_slot(slot, copy.version)) {
+                write_slot(slot, copy.version, state, owner, key, bytes);
+                return true;
+            }
+        }
+    }
+#endif
+}
+
+namespace kitbash {
+    CompiledAddition CompiledAddition::compile_shared(const std::string& addition_file, bool* shared) {
+        if (shared) {
+            *shared = false;
+        }
+#ifdef _WIN32
+        return compile(addition_file);
+#else
+        Slot* table = open_index();
+        FileKey key;
+        if (!table || !file_key(addition_file, key)) {
+            return compile(addition_file);
+        }
+        int64_t self = static_cast<int64_t>(::getpid());
+        size_t home = static_cast<size_t>(detail::hash_bytes(std::string_view(
+            reinterpret_cast<const char*>(&key), 2 * sizeof(uint64_t))) % slot_count);
+
+        for (;;) {
+            // Find this file's slot, else a free one, else the oldest in the probe window
+            Slot* target = nullptr;
+            SlotCopy target_copy;
+            Slot* fallback = nullptr;
+            SlotCopy fallback_copy;
+            for (size_t i = 0; i < probe_limit; ++i) {
+                Slot& slot = table[(home + i) % slot_count];
+                SlotCopy copy;
+                if (!read_slot(slot, copy)) {
+                    continue;
+                }
+                if (copy.state != Empty && copy.key.same_file(key)) {
+                    target = &slot;
+                    target_copy = copy;
+                    break;
+                }
+                bool better = !fallback || (copy.state == Empty && fallback_copy.state != Empty) ||
+                              (copy.state != Empty && fallback_copy.state != Empty &&
+                               copy.started_ns < fallback_copy.started_ns);
+                if (better) {
+                    fallback = &slot;
+                    fallback_copy = copy;
+                }
+            }
+
+            if (target && target_copy.key == key) {
+                if (target_copy.state == Ready) {
+                    CompiledAddition mapped = map_segment(segment_name(key, target_copy.owner), addition_file);
+                    if (!mapped.empty()) {
+                        touch_slot(*target, target_copy);
+                        if (shared) {
+                            *shared = true;
+                        }
+                        return mapped;
+                    }
+                    // Segment vanished (e.g. /dev/shm was cleared): rebuild below
+                } else if (process_alive(target_copy.owner) &&
+                           now_ns() - target_copy.started_ns < build_timeout_ns) {
+                    // Another process is compiling this file right now; its result is coming
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                    continue;
+                }
+            }
+            if (!target) {
+                target = fallback;
+                target_copy = fallback_copy;
+            }
+            if (!target) {
+                return compile(addition_file);  // Probe window unreadable
+            }
+
+            // Claim it; a lost race means someone else changed the slot, so look again
+            if (!lock_slot(*target, target_copy.version)) {
+                continue;
+            }
+            write_slot(*target, target_copy.version, Building, self, key);
+            if (target_copy.state == Ready) {
+                // Mappings of the replaced image stay valid in processes that hold them
+                ::shm_unlink(segment_name(target_copy.key, target_copy.owner).c_str());
+            }
+
+            CompiledAddition compiled;
+            try {
+                compiled = compile(addition_file);
+            } catch (...) {
+                finish_slot(*target, key, self, Empty);
+                throw;
+            }
+            std::string name = segment_name(key, self);
+            size_t bytes = image_bytes(compiled);
+            bool published = make_room(table, target, bytes) && write_segment(name, compiled, bytes);
+            if (!finish_slot(*target, key, self, published ? Ready : Empty, bytes) && published) {
+                ::shm_unlink(name.c_str());     // Took too long and was replaced
+            }
+            return compiled;
+        }
+#endif
+    }
+
+    void CompiledAddition::set_shared_limit(uint64_t bytes) {
+#ifndef _WIN32
+        shared_limit.store(bytes);
+#else
+        (void)bytes;
+#endif
+    }
+
+    void CompiledAddition::clear_shared() {
+#ifndef _WIN32
+        Slot* table = open_index();
+        if (!table) {
+            return;
+        }
+        for (size_t i = 0; i < slot_count; ++i) {
+            SlotCopy copy;
+            while (read_slot(table[i], copy) && copy.state != Empty) {
+                if (lock_slot(table[i], copy.version)) {
+                    write_slot(table[i], copy.version, Empty, 0, FileKey());
+                    if (copy.state == Ready) {
+                        ::shm_unlink(segment_name(copy.key, copy.owner).c_str());
+                    }
+                    break;
+                }
+            }
+        }
+#endif
+    }
+}
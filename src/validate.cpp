@@ -0,0 +1,539 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include "kitbash_thread_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+
+// Internal helper functions
+namespace {
+    using kitbash::StructureDiagnostic;
+    using kitbash::StructureIssue;
+    using kitbash::detail::next_token;
+
+    constexpr size_t index_block = 256;             // Indices summarized together
+    constexpr size_t min_chunk_bytes = 1 << 20;     // Smaller chunks are not worth a task
+
+    enum class Draw { Tris, Lines, Lights };
+
+    const char* draw_name(Draw kind) {
+        return kind == Draw::Tris ? "TRIS" : kind == Draw::Lines ? "LINES" : "LIGHTS";
+    }
+
+    // Line numbers in a chunk summary are local to the chunk (1-based, 0 for none)
+    // until resolve() adds the chunk's first line
+    struct DrawRange {
+        Draw kind;
+        uint64_t line;
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    struct DeclaredCounts {
+        uint64_t line;
+        bool valid;
+        uint64_t values[4];         // VT, VLINE, VLIGHT, IDX
+    };
+
+    // 256 consecutive indices of a chunk: the largest value, and where the first one
+    // is (the line at `offset`, after `skip` entries) so the block can be read again
+    struct IndexBlock {
+        uint64_t max;
+        size_t offset;
+        uint64_t line;
+        uint32_t skip;
+    };
+
+    struct ChunkSummary {
+        size_t begin = 0;
+        size_t end = 0;
+        uint64_t lines = 0;
+        uint64_t first_line = 0;            // Global number of the line before the chunk
+        uint64_t first_index = 0;           // Global ordinal of the chunk's first index
+        uint64_t vertices = 0;
+        uint64_t line_vertices = 0;
+        uint64_t lights = 0;
+        uint64_t indices = 0;
+        uint64_t last_vertex_line = 0;      // Any VT, VLINE or VLIGHT record
+        uint64_t first_index_line = 0;
+        uint64_t last_index_line = 0;
+        uint64_t first_draw_line = 0;
+        std::vector<DeclaredCounts> point_counts;
+        std::vector<DrawRange> draws;
+        std::vector<IndexBlock> blocks;
+        std::vector<StructureDiagnostic> diagnostics;
+        uint64_t counts[kitbash::structure_issue_count] = {};
+    };
+
+    // Collects diagnostics, keeping the `limit` with the lowest line numbers. Counts
+    // cover every diagnostic added.
+    struct Sink {
+        std::vector<StructureDiagnostic>& diagnostics;
+        uint64_t* counts;
+        size_t limit;
+        uint64_t cutoff = UINT64_MAX;       // Once full, later lines cannot be kept
+
+        void add(StructureIssue issue, uint64_t line, std::string message) {
+            ++counts[static_cast<int>(issue)];
+            if (limit == 0 || (diagnostics.size() >= limit && line >= cutoff)) {
+                return;
+            }
+            diagnostics.push_back(StructureDiagnostic{issue, line, std::move(message)});
+            if (diagnostics.size() >= limit * 2) {
+                trim();
+            }
+        }
+
+        // Counts a diagnostic that would not be kept, so the caller need not build its
+        // message; false when it should be added
+        bool skip(StructureIssue issue, uint64_t line) {
+            if (limit > 0 && (diagnostics.size() < limit || line < cutoff)) {
+                return false;
+            }
+            ++counts[static_cast<int>(issue)];
+            return true;
+        }
+
+        void trim() {
+            std::stable_sort(diagnostics.begin(), diagnostics.end(),
+                             [](const StructureDiagnostic& a, const StructureDiagnostic& b) { return a.line < b.line; });
+            if (diagnostics.size() >= limit) {
+                diagnostics.resize(limit);
+                cutoff = limit > 0 ? diagnostics.back().line : 0;
+            }
+        }
+    };
+
+    // Whole non-negative number, no sign or trailing text
+    bool parse_number(std::string_view token, uint64_t& value) {
+        if (token.empty() || token.size() > 18) {
+            return false;
+        }
+        value = 0;
+        for (char c : token) {
+            if (c < '0' || c > '9') {
+                return false;
+            }
+            value = value * 10 + static_cast<uint64_t>(c - '0');
+        }
+        return true;
+    }
+
+    std::string quoted(std::string_view token) {
+        return "'" + std::string(token.substr(0, 32)) + (token.size() > 32 ? "...'" : "'");
+    }
+
+    size_t line_end(std::string_view data, size_t pos, size_t limit) {
+        const void* found = std::memchr(data.data() + pos, '\n', limit - pos);
+        return found ? static_cast<const char*>(found) - data.data() : limit;
+    }
+
+    bool is_vertex_record(std::string_view command) {
+        return command == "VT" || command == "VLINE" || command == "VLIGHT";
+    }
+
+    bool is_index_record(std::string_view command) {
+        return command == "IDX" || command == "IDX10";
+    }
+
+    void scan_point_counts(std::string_view text, uint64_t line, ChunkSummary& chunk, Sink& sink) {
+        std::string_view tokens[6];
+        size_t count = kitbash::detail::split_tokens(text, tokens, 6);
+        DeclaredCounts declared{line, count == 5 && tokens[0] == "POINT_COUNTS", {0, 0, 0, 0}};
+        for (size_t i = 1; declared.valid && i < 5; ++i) {
+            declared.valid = parse_number(tokens[i], declared.values[i - 1]) && declared.values[i - 1] <= INT32_MAX;
+        }
+        if (!declared.valid) {
+            declared = DeclaredCounts{line, false, {0, 0, 0, 0}};
+            sink.add(StructureIssue::Malformed, line,
+                     tokens[0] == "POINT_COUNTS" ? "POINT_COUNTS needs four whole numbers; the merge reads it as 0 0 0 0"
+                                                 : "Line mentions POINT_COUNTS, so the merge reads it as the counts line");
+        }
+        chunk.point_counts.push_back(declared);
+    }
+
+    void scan_indices(std::string_view text, std::string_view command, size_t pos, size_t offset, uint64_t line,
+                      ChunkSummary& chunk, Sink& sink) {
+        if (chunk.first_index_line == 0) {
+            chunk.first_index_line = line;
+        }
+        chunk.last_index_line = line;
+        uint32_t entries = 0;
+        for (std::string_view token = next_token(text, pos); !token.empty(); token = next_token(text, pos)) {
+            if (chunk.indices % index_block == 0) {
+                chunk.blocks.push_back(IndexBlock{0, offset, line, entries});
+            }
+            ++chunk.indices;
+            ++entries;
+            uint64_t value = 0;
+            if (!parse_number(token, value)) {
+                sink.add(StructureIssue::Malformed, line, std::string(command) + " entry " + quoted(token) +
+                                                          " is not a vertex number");
+                continue;
+            }
+            chunk.blocks.back().max = std::max(chunk.blocks.back().max, value);
+        }
+        uint32_t expected = command == "IDX" ? 1 : 10;
+        if (entries != expected) {
+            sink.add(StructureIssue::Malformed, line, std::string(command) + " has " + std::to_string(entries) +
+                                                      (entries == 1 ? " entry" : " entries") + ", not " +
+                                                      std::to_string(expected));
+        }
+    }
+
+    void scan_draw(std::string_view text, Draw kind, size_t pos, uint64_t line, ChunkSummary& chunk, Sink& sink) {
+        if (chunk.first_draw_line == 0) {
+            chunk.first_draw_line = line;
+        }
+        std::string_view offset_token = next_token(text, pos);
+        std::string_view count_token = next_token(text, pos);
+        DrawRange range{kind, line, 0, 0};
+        if (!parse_number(offset_token, range.offset) || !parse_number(count_token, range.count)) {
+            sink.add(StructureIssue::Malformed, line, std::string(draw_name(kind)) + " needs an offset and a count");
+            return;
+        }
+        uint64_t group = kind == Draw::Tris ? 3 : kind == Draw::Lines ? 2 : 1;
+        if (range.count % group != 0) {
+            sink.add(StructureIssue::Malformed, line, std::string(draw_name(kind)) + " count " +
+                                                      std::to_string(range.count) + " is not a multiple of " +
+                                                      std::to_string(group));
+        }
+        chunk.draws.push_back(range);
+    }
+
+    // Pass over one chunk: counts, declared counts, draw ranges, index block maxima
+    // and everything that can be judged from a single line
+    void scan_chunk(std::string_view data, ChunkSummary& chunk, size_t limit) {
+        Sink sink{chunk.diagnostics, chunk.counts, limit};
+        size_t pos = chunk.begin;
+        while (pos < chunk.end) {
+            size_t end = line_end(data, pos, chunk.end);
+            uint64_t line = ++chunk.lines;
+            std::string_view text = data.substr(pos, end - pos);
+            size_t offset = pos;
+            pos = end + 1;
+
+            // The merge takes any line mentioning POINT_COUNTS as the counts line
+            if (text.find("POINT_COUNTS") != std::string_view::npos) {
+                scan_point_counts(text, line, chunk, sink);
+                continue;
+            }
+            size_t token_pos = 0;
+            std::string_view command = next_token(text, token_pos);
+            if (command.empty() || command[0] == '#') {
+                continue;
+            }
+            if (is_vertex_record(command)) {
+                ++(command == "VT" ? chunk.vertices : command == "VLINE" ? chunk.line_vertices : chunk.lights);
+                chunk.last_vertex_line = line;
+            } else if (is_index_record(command)) {
+                scan_indices(text, command, token_pos, offset, line, chunk, sink);
+            } else if (command == "TRIS") {
+                scan_draw(text, Draw::Tris, token_pos, line, chunk, sink);
+            } else if (command == "LINES") {
+                scan_draw(text, Draw::Lines, token_pos, line, chunk, sink);
+            } else if (command == "LIGHTS") {
+                scan_draw(text, Draw::Lights, token_pos, line, chunk, sink);
+            }
+        }
+    }
+
+    // Chunks of at least min_chunk_bytes, a few per thread, split after a newline
+    std::vector<ChunkSummary> plan_chunks(std::string_view data, size_t threads) {
+        size_t count = std::max<size_t>(1, std::min(data.size() / min_chunk_bytes, threads * 4));
+        std::vector<ChunkSummary> chunks;
+        size_t begin = 0;
+        for (size_t i = 1; i <= count && begin < data.size(); ++i) {
+            size_t end = data.size();
+            if (i < count) {
+                size_t target = std::max(begin, data.size() / count * i);
+                end = line_end(data, target, data.size());
+                end = end < data.size() ? end + 1 : end;
+            }
+            if (end > begin) {
+                chunks.emplace_back();
+                chunks.back().begin = begin;
+                chunks.back().end = end;
+            }
+            begin = end;
+        }
+        return chunks;
+    }
+
+    // Sorted, merged index ranges drawn by LINES; everything else must point at VT
+    class LineRanges {
+    public:
+        void add(uint64_t begin, uint64_t end) {
+            if (end > begin) {
+                ranges_.emplace_back(begin, end);
+            }
+        }
+
+        void finish() {
+            std::sort(ranges_.begin(), ranges_.end());
+            std::vector<std::pair<uint64_t, uint64_t>> merged;
+            for (const auto& range : ranges_) {
+                if (!merged.empty() && range.first <= merged.back().second) {
+                    merged.back().second = std::max(merged.back().second, range.second);
+                } else {
+                    merged.push_back(range);
+                }
+            }
+            ranges_ = std::move(merged);
+        }
+
+        bool contains(uint64_t index) const {
+            auto found = std::upper_bound(ranges_.begin(), ranges_.end(), std::make_pair(index, UINT64_MAX));
+            return found != ranges_.begin() && index < std::prev(found)->second;
+        }
+
+        bool overlaps(uint64_t begin, uint64_t end) const {
+            auto found = std::lower_bound(ranges_.begin(), ranges_.end(), std::make_pair(begin, uint64_t(0)));
+            if (found != ranges_.end() && found->first < end) {
+                return true;
+            }
+            return found != ranges_.begin() && std::prev(found)->second > begin;
+        }
+
+        bool empty() const { return ranges_.empty(); }
+
+    private:
+        std::vector<std::pair<uint64_t, uint64_t>> ranges_;
+    };
+
+    // Read one block of indices again and report each entry past its table
+    void check_block(std::string_view data, const ChunkSummary& chunk, const IndexBlock& block, uint64_t first,
+                     const LineRanges& lines, const kitbash::StructureReport& report, Sink& sink) {
+        uint64_t ordinal = first;
+        uint64_t last = std::min(first + index_block, chunk.first_index + chunk.indices);
+        uint64_t line = chunk.first_line + block.line;
+        uint32_t skip = block.skip;
+        for (size_t pos = block.offset; pos < chunk.end && ordinal < last; ++line) {
+            size_t end = line_end(data, pos, chunk.end);
+            std::string_view text = data.substr(pos, end - pos);
+            pos = end + 1;
+            size_t token_pos = 0;
+            if (!is_index_record(next_token(text, token_pos))) {
+                continue;
+            }
+            for (std::string_view token = next_token(text, token_pos); !token.empty() && ordinal < last;
+                 token = next_token(text, token_pos)) {
+                if (skip > 0) {
+                    --skip;
+                    continue;
+                }
+                uint64_t value = 0;
+                bool line_table = lines.contains(ordinal++);
+                uint64_t bound = line_table ? report.line_vertices : report.vertices;
+                if (parse_number(token, value) && value >= bound && !sink.skip(StructureIssue::IndexOutOfRange, line)) {
+                    sink.add(StructureIssue::IndexOutOfRange, line,
+                             "Index " + std::to_string(value) + " is past the " + std::to_string(bound) +
+                             (line_table ? " VLINE records" : " VT records"));
+                }
+            }
+        }
+    }
+
+    // Read a chunk again for records that come after the section that should end them
+    void check_order(std::string_view data, const ChunkSummary& chunk, uint64_t after, bool vertex_records,
+                     Sink& sink) {
+        uint64_t line = chunk.first_line;
+        for (size_t pos = chunk.begin; pos < chunk.end;) {
+            size_t end = line_end(data, pos, chunk.end);
+            std::string_view text = data.substr(pos, end - pos);
+            pos = end + 1;
+            if (++line <= after) {
+                continue;
+            }
+            size_t token_pos = 0;
+            std::string_view command = next_token(text, token_pos);
+            if ((vertex_records ? is_vertex_record(command) : is_index_record(command)) &&
+                !sink.skip(StructureIssue::Misplaced, line)) {
+                sink.add(StructureIssue::Misplaced, line,
+                         std::string(command) + (vertex_records ? " record after the first index (line "
+                                                                : " record after the first draw command (line ") +
+                         std::to_string(after) + "); the merge moves it out of place");
+            }
+        }
+    }
+
+    // Whole-file checks from the chunk summaries, reading again only where needed
+    void resolve(std::string_view data, std::vector<ChunkSummary>& chunks, kitbash::StructureReport& report,
+                 size_t limit) {
+        uint64_t line = 0;
+        uint64_t index = 0;
+        uint64_t first_index_line = 0;
+        uint64_t first_draw_line = 0;
+        for (auto& chunk : chunks) {
+            chunk.first_line = line;
+            chunk.first_index = index;
+            line += chunk.lines;
+            index += chunk.indices;
+            report.vertices += chunk.vertices;
+            report.line_vertices += chunk.line_vertices;
+            report.lights += chunk.lights;
+            report.indices += chunk.indices;
+            report.draw_commands += chunk.draws.size();
+            if (first_index_line == 0 && chunk.first_index_line > 0) {
+                first_index_line = chunk.first_line + chunk.first_index_line;
+            }
+            if (first_draw_line == 0 && chunk.first_draw_line > 0) {
+                first_draw_line = chunk.first_line + chunk.first_draw_line;
+            }
+            for (auto& diagnostic : chunk.diagnostics) {
+                diagnostic.line += chunk.first_line;
+                report.diagnostics.push_back(std::move(diagnostic));
+            }
+            for (int i = 0; i < kitbash::structure_issue_count; ++i) {
+                report.counts[i] += chunk.counts[i];
+            }
+        }
+        report.line_count = line;
+        Sink sink{report.diagnostics, report.counts, limit};
+        sink.trim();
+
+        // Declared counts: the merge uses the last POINT_COUNTS line
+        const DeclaredCounts* declared = nullptr;
+        for (const auto& chunk : chunks) {
+            for (const auto& entry : chunk.point_counts) {
+                uint64_t at = chunk.first_line + entry.line;
+                if (declared) {
+                    sink.add(StructureIssue::Misplaced, at, "Another POINT_COUNTS line; the merge uses the last one");
+                }
+                declared = &entry;
+                line = at;
+            }
+        }
+        if (!declared) {
+            sink.add(StructureIssue::MissingPointCounts, 0, "No POINT_COUNTS line; the merge cannot rebase indices");
+        } else {
+            report.has_point_counts = true;
+            report.declared_vertices = declared->values[0];
+            report.declared_line_vertices = declared->values[1];
+            report.declared_lights = declared->values[2];
+            report.declared_indices = declared->values[3];
+            const char* names[4] = {"VT", "VLINE", "VLIGHT", "index"};
+            uint64_t actual[4] = {report.vertices, report.line_vertices, report.lights, report.indices};
+            for (int i = 0; i < 4; ++i) {
+                if (declared->valid && declared->values[i] != actual[i]) {
+                    sink.add(StructureIssue::CountMismatch, line,
+                             "POINT_COUNTS declares " + std::to_string(declared->values[i]) + " " + names[i] +
+                             " records; the file has " + std::to_string(actual[i]));
+                }
+            }
+        }
+
+        // Draw ranges against their tables
+        LineRanges lines;
+        for (const auto& chunk : chunks) {
+            for (const auto& range : chunk.draws) {
+                uint64_t table = range.kind == Draw::Lights ? report.lights : report.indices;
+                if (range.offset + range.count > table) {
+                    sink.add(StructureIssue::RangeOutOfBounds, chunk.first_line + range.line,
+                             std::string(draw_name(range.kind)) + " " + std::to_string(range.offset) + " " +
+                             std::to_string(range.count) + " ends at " + std::to_string(range.offset + range.count) +
+                             ", past the " + std::to_string(table) +
+                             (range.kind == Draw::Lights ? " VLIGHT records" : " indices"));
+                }
+                if (range.kind == Draw::Lines) {
+                    lines.add(range.offset, range.offset + range.count);
+                }
+            }
+        }
+        lines.finish();
+
+        // Index blocks whose largest entry could be past its table
+        uint64_t lowest = lines.empty() ? report.vertices : std::min(report.vertices, report.line_vertices);
+        for (const auto& chunk : chunks) {
+            for (size_t b = 0; b < chunk.blocks.size(); ++b) {
+                const IndexBlock& block = chunk.blocks[b];
+                uint64_t first = chunk.first_index + b * index_block;
+                uint64_t last = std::min(first + index_block, chunk.first_index + chunk.indices);
+                uint64_t bound = lines.overlaps(first, last) ? lowest : report.vertices;
+                if (block.max >= bound) {
+                    check_block(data, chunk, block, first, lines, report, sink);
+                }
+            }
+        }
+
+        // Record order the merge relies on
+        for (const auto& chunk : chunks) {
+            if (first_index_line > 0 && chunk.last_vertex_line > 0 &&
+                chunk.first_line + chunk.last_vertex_line > first_index_line) {
+                check_order(data, chunk, first_index_line, true, sink);
+            }
+            if (first_draw_line > 0 && chunk.last_index_line > 0 &&
+                chunk.first_line + chunk.last_index_line > first_draw_line) {
+                check_order(data, chunk, first_draw_line, false, sink);
+            }
+        }
+
+        sink.trim();
+    }
+}
+
+namespace kitbash {
+    const char* structure_issue_name(StructureIssue issue) {
+        switch (issue) {
+        case StructureIssue::MissingPointCounts:
+            return "missing_point_counts";
+        case StructureIssue::CountMismatch:
+            return "count_mismatch";
+        case StructureIssue::IndexOutOfRange:
+            return "index_out_of_range";
+        case StructureIssue::RangeOutOfBounds:
+            return "range_out_of_bounds";
+        case StructureIssue::Misplaced:
+            return "misplaced";
+        case StructureIssue::Malformed:
+            return "malformed";
+        }
+        return "";
+    }
+
+    StructureReport validate_structure(const std::string& filename, const StructureOptions& options) {
+        detail::MappedFile file(filename);
+        std::string_view data = file.view();
+        if (!detail::validate_obj_header(data)) {
+            throw std::runtime_error("Invalid OBJ8 format: " + filename);
+        }
+
+        std::unique_ptr<detail::ThreadPool> own_pool;
+        if (options.threads > 0) {
+            own_pool = std::make_unique<detail::ThreadPool>(options.threads);
+        }
+        detail::ThreadPool& pool = own_pool ? *own_pool : detail::ThreadPool::shared();
+
+        std::vector<ChunkSummary> chunks = plan_chunks(data, pool.size());
+        std::vector<std::future<void>> done;
+        done.reserve(chunks.size());
+        for (size_t i = 1; i < chunks.size(); ++i) {
+            auto promise = std::make_shared<std::promise<void>>();
+            done.push_back(promise->get_future());
+            ChunkSummary* chunk = &chunks[i];
+            size_t limit = options.max_diagnostics;
+            pool.submit([promise, chunk, data, limit] {
+                try {
+                    scan_chunk(data, *chunk, limit);
+                    promise->set_value();
+                } catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+        }
+        if (!chunks.empty()) {
+            scan_chunk(data, chunks[0], options.max_diagnostics);    // This thread takes the first
+        }
+        for (auto& future : done) {
+            pool.wait(future);
+            future.get();
+        }
+
+        StructureReport report;
+        report.filename = filename;
+        report.chunks = chunks.size();
+        resolve(data, chunks, report, options.max_diagnostics);
+        return report;
+    }
+}
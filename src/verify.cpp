@@ -0,0 +1,317 @@
+#include "kitbash.h"
+#include "kitbash_engine.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+// Internal helper functions
+namespace {
+    namespace fs = std::filesystem;
+    using kitbash::detail::next_token;
+
+    // Lines of a merge output, without their terminators
+    std::vector<std::string_view> split_lines(std::string_view data) {
+        std::vector<std::string_view> lines;
+        size_t pos = 0;
+        while (pos < data.size()) {
+            const void* found = std::memchr(data.data() + pos, '\n', data.size() - pos);
+            size_t end = found ? static_cast<const char*>(found) - data.data() : data.size();
+            std::string_view line = data.substr(pos, end - pos);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            lines.push_back(line);
+            pos = end + 1;
+        }
+        return lines;
+    }
+
+    std::vector<std::string_view> views_of(const std::vector<std::string>& lines) {
+        return std::vector<std::string_view>(lines.begin(), lines.end());
+    }
+
+    bool blank(std::string_view line) {
+        size_t pos = 0;
+        return next_token(line, pos).empty();
+    }
+
+    // Same tokens in the same order; spacing and tabs do not matter
+    bool same_tokens(std::string_view a, std::string_view b) {
+        size_t pos_a = 0;
+        size_t pos_b = 0;
+        while (true) {
+            std::string_view token_a = next_token(a, pos_a);
+            std::string_view token_b = next_token(b, pos_b);
+            if (token_a != token_b) {
+                return false;
+            }
+            if (token_a.empty()) {
+                return true;
+            }
+        }
+    }
+
+    // Compare two outputs line by line, skipping blank lines on both sides, and
+    // record the first divergence
+    void compare(const std::vector<std::string_view>& expected, const std::vector<std::string_view>& actual,
+                 kitbash::VerifyResult& result) {
+        const char* section = "Header";
+        bool seen_indices = false;
+        size_t i = 0;
+        size_t j = 0;
+        uint64_t compared = 0;
+        while (true) {
+            while (i < expected.size() && blank(expected[i])) {
+                ++i;
+            }
+            while (j < actual.size() && blank(actual[j])) {
+                ++j;
+            }
+            if (i < expected.size()) {
+                size_t pos = 0;
+                std::string_view command = next_token(expected[i], pos);
+                if (command == "VT" && !seen_indices) {
+                    section = "Vertices";
+                } else if (command == "IDX" || command == "IDX10") {
+                    section = "Indices";
+                    seen_indices = true;
+                } else if (seen_indices) {
+                    section = "Footer";
+                }
+            }
+            bool expected_done = i >= expected.size();
+            bool actual_done = j >= actual.size();
+            if (expected_done && actual_done) {
+                result.match = true;
+                result.lines_compared = compared;
+                return;
+            }
+            if (expected_done || actual_done || !same_tokens(expected[i], actual[j])) {
+                result.match = false;
+                result.lines_compared = compared;
+                result.section = expected_done ? "End of output" : section;
+                result.expected_line = expected_done ? 0 : i + 1;
+                result.actual_line = actual_done ? 0 : j + 1;
+                result.expected = expected_done ? "" : std::string(expected[i]);
+                result.actual = actual_done ? "" : std::string(actual[j]);
+                return;
+            }
+            ++compared;
+            ++i;
+            ++j;
+        }
+    }
+
+    std::string scratch_name(const fs::path& folder, const std::string& label) {
+        return (folder / (label + ".obj")).string();
+    }
+
+    fs::path make_scratch_folder(const std::string& prefix) {
+        fs::path folder = fs::temp_directory_path() / (prefix + std::to_string(
+            std::chrono::steady_clock::now().time_since_epoch().count()));
+        fs::create_directories(folder);
+        return folder;
+    }
+
+    // Reference output: the original line-vector path, read_file + parse_obj + merge_objects
+    std::vector<std::string> reference_merge(const std::string& base, const std::string& addition) {
+        std::vector<std::string> base_lines = kitbash::read_file(base);
+        std::vector<std::string> addition_lines = kitbash::read_file(addition);
+        if (!kitbash::validate_obj_format(base_lines) || !kitbash::validate_obj_format(addition_lines)) {
+            throw std::runtime_error("Invalid OBJ8 format");
+        }
+        return kitbash::merge_objects(kitbash::parse_obj(base_lines), kitbash::parse_obj(addition_lines));
+    }
+
+    void run_job(kitbash::detail::MergeJob& job) {
+        while (!job.run_chunk()) {
+        }
+    }
+
+    // Compare one engine's output file against the reference, keeping the first divergence
+    bool check_file(const std::string& engine, const std::string& output,
+                    const std::vector<std::string_view>& expected, kitbash::VerifyResult& result) {
+        kitbash::detail::MappedFile file(output);
+        kitbash::VerifyResult attempt;
+        compare(expected, split_lines(file.view()), attempt);
+        if (!attempt.match) {
+            attempt.engine = engine;
+            result = attempt;
+            return false;
+        }
+        result.lines_compared = attempt.lines_compared;
+        return true;
+    }
+
+    // Every single-merge engine against the reference
+    kitbash::VerifyResult verify_pair(const std::string& base, const std::string& addition, const fs::path& folder) {
+        kitbash::VerifyResult result;
+        std::string engine = "reference";
+        try {
+            std::vector<std::string> reference = reference_merge(base, addition);
+            std::vector<std::string_view> expected = views_of(reference);
+
+            engine = "streaming";
+            std::string output = scratch_name(folder, "streaming");
+            {
+                kitbash::detail::MergeJob job(base, addition, output);
+                run_job(job);
+            }
+            if (!check_file(engine, output, expected, result)) {
+                return result;
+            }
+
+            engine = "compiled";
+            output = scratch_name(folder, "compiled");
+            {
+                kitbash::detail::MergeJob job(base, kitbash::CompiledAddition::compile(addition), output);
+                run_job(job);
+            }
+            if (!check_file(engine, output, expected, result)) {
+                return result;
+            }
+
+            // At the smallest budget, so larger inputs exercise the spill files
+            engine = "bounded";
+            output = scratch_name(folder, "bounded");
+            kitbash::BoundedMergeOptions bounded;
+            bounded.max_memory = 16ull << 20;
+            bounded.temp_dir = folder.string();
+            kitbash::merge_to_file_bounded(base, addition, output, bounded);
+            if (!check_file(engine, output, expected, result)) {
+                return result;
+            }
+
+            engine = "document";
+            kitbash::Document doc = kitbash::detail::load_document(base);
+            doc.merge(kitbash::detail::load_document(addition));
+            std::vector<std::string> lines = doc.to_lines();
+            kitbash::VerifyResult attempt;
+            compare(expected, views_of(lines), attempt);
+            if (!attempt.match) {
+                attempt.engine = engine;
+                return attempt;
+            }
+            result.match = true;
+        } catch (const std::exception& e) {
+            result = kitbash::VerifyResult();
+            result.engine = engine;
+            result.error = e.what();
+        }
+        return result;
+    }
+}
+
+namespace kitbash {
+    VerifyResult verify_merge(const std::string& base, const std::string& addition) {
+        fs::path folder;
+        try {
+            folder = make_scratch_folder("kitbash-verify-");
+        } catch (const std::exception& e) {
+            VerifyResult result;
+            result.error = e.what();
+            return result;
+        }
+        VerifyResult result = verify_pair(base, addition, folder);
+        std::error_code ec;
+        fs::remove_all(folder, ec);
+        return result;
+    }
+
+    VerifySweepResult verify_corpus(const VerifyOptions& options) {
+        std::vector<size_t> thread_counts = options.thread_counts.empty() ? default_thread_counts(0)
+                                                                          : options.thread_counts;
+        VerifySweepResult sweep;
+        fs::path folder = make_scratch_folder("kitbash-verify-corpus-");
+        auto record = [&](const std::string& name, VerifyResult result) {
+            ++sweep.cases;
+            result.case_name = name;
+            if (!result.match) {
+                sweep.divergences.push_back(result);
+            }
+            if (options.on_case) {
+                options.on_case(result);
+            }
+        };
+
+        for (uint64_t vertices : options.sizes) {
+            std::string prefix = std::to_string(vertices) + "v";
+            std::string base = scratch_name(folder, prefix + "-base");
+            std::string addition = scratch_name(folder, prefix + "-addition");
+            uint64_t addition_vertices = std::max<uint64_t>(1, vertices / 4 + vertices % 7);   // Odd ratios too
+            {
+                detail::FileWriter out(base);
+                detail::write_synthetic_obj(out, vertices, vertices * 2 + 1);
+                out.close();
+            }
+            {
+                detail::FileWriter out(addition);
+                detail::write_synthetic_obj(out, addition_vertices, vertices * 2 + 2);
+                out.close();
+            }
+            record(prefix, verify_pair(base, addition, folder));
+
+            // Fan-out on each thread count: one base per thread, merged concurrently
+            std::vector<std::string> expected_lines;
+            try {
+                expected_lines = reference_merge(base, addition);
+            } catch (const std::exception& e) {
+                VerifyResult failed;
+                failed.engine = "reference";
+                failed.error = e.what();
+                record(prefix + " fanout", failed);
+                continue;
+            }
+            std::vector<std::string_view> expected = views_of(expected_lines);
+            for (size_t threads : thread_counts) {
+                std::string name = prefix + " fanout " + std::to_string(threads) + "t";
+                fs::path bases_dir = folder / ("bases-" + std::to_string(threads));
+                fs::path outputs_dir = folder / ("outputs-" + std::to_string(threads));
+                fs::create_directories(bases_dir);
+                fs::create_directories(outputs_dir);
+                std::vector<std::string> bases;
+                for (size_t i = 0; i < std::max<size_t>(2, threads); ++i) {
+                    fs::path copy = bases_dir / ("base" + std::to_string(i) + ".obj");
+                    fs::copy_file(base, copy, fs::copy_options::overwrite_existing);
+                    bases.push_back(copy.string());
+                }
+                FanoutOptions fanout;
+                fanout.output_dir = outputs_dir.string();
+                fanout.threads = threads;
+                VerifyResult result;
+                result.match = true;
+                for (const FanoutResult& merged : merge_fanout(addition, bases, fanout)) {
+                    if (!merged.success) {
+                        result = VerifyResult();
+                        result.engine = "fanout";
+                        result.error = merged.error;
+                        break;
+                    }
+                    try {
+                        if (!check_file("fanout", merged.output, expected, result)) {
+                            break;
+                        }
+                    } catch (const std::exception& e) {
+                        result = VerifyResult();
+                        result.engine = "fanout";
+                        result.error = e.what();
+                        break;
+                    }
+                }
+                record(name, result);
+                std::error_code ec;
+                fs::remove_all(bases_dir, ec);
+                fs::remove_all(outputs_dir, ec);
+            }
+            std::error_code ec;
+            fs::remove(base, ec);
+            fs::remove(addition, ec);
+        }
+
+        std::error_code ec;
+        fs::remove_all(folder, ec);
+        return sweep;
+    }
+}